@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ShaderCompiler.h"
+
+/*! App Settings struct
+	Holds the run options for the app, parsed from the command line
+*/
+struct AppSettings {
+	/*! Number of forced swap chain recreations to time after start up (0 disables the resize storm) */
+	unsigned int resizeStormCount = 0;
+
+	/*! Render offscreen without a window, surface or swap chain (e.g. on CI nodes with software Vulkan) */
+	bool headless = false;
+	/*! Window size, or the offscreen image size when headless */
+	uint32_t width = 512;
+	uint32_t height = 512;
+	/*! Number of frames to render before closing (0 runs until the window is closed, headless defaults to 100) */
+	unsigned int frameCount = 0;
+	/*! Headless only, write rendered frames to <readbackPath>_<frame>.ppm (empty disables readback) */
+	std::string readbackPath;
+	/*! Read back every Nth frame, 0 only reads back the last frame */
+	unsigned int readbackInterval = 0;
+	/*! Compare the last read back frame against this .ppm from an earlier run and fail if it differs (empty disables the check) */
+	std::string readbackReference;
+	/*! Fraction of the reference's drawn pixels that may differ before the comparison fails */
+	float readbackTolerance = 0.05f;
+
+	/*! Print the average GPU frame and phase times every N frames (0 disables the log) */
+	unsigned int gpuLogInterval = 0;
+	/*! Count shader invocations and primitives per phase with pipeline statistics queries, added to the GPU log */
+	bool pipelineStatistics = false;
+	/*! Record CPU profiling zones and write them out as a Chrome trace when the app closes (empty disables profiling) */
+	std::string cpuTracePath;
+	/*! Redraw the scene into a fragment count target and print the overdraw every N frames (0 disables it) */
+	unsigned int overdrawInterval = 0;
+
+	/*! Fractions of a heap's budget that raise a memory warning */
+	std::vector<double> memoryThresholds = { 0.8, 0.95 };
+	/*! Print the memory report every N frames (0 only prints it when the app closes) */
+	unsigned int memoryLogInterval = 0;
+
+	/*! Frames of render stats kept, written to statsOutput when the app closes or F2 is pressed */
+	unsigned int statsHistory = 600;
+	/*! .csv for a spreadsheet, anything else for a text table (empty only writes on F2, to render_stats.csv) */
+	std::string statsOutput;
+
+	/*! Number of fur objects in the scene, laid out on a grid */
+	unsigned int objectCount = 1;
+	/*! Passes drawn per object, the base mesh plus the shells above it */
+	unsigned int shellCount = 6;
+	/*! Fraction of the objects that spin, the rest stand still and their transforms are never recomputed or uploaded */
+	float spinningFraction = 1.0f;
+	/*! Skip the uniform updates and draws of objects outside the camera frustum */
+	bool frustumCulling = true;
+	/*! Build the fins in a geometry shader for every triangle, instead of a compute pass that only adds them on the silhouette.
+		Needs the geometryShader device feature */
+	bool geometryFins = false;
+	/*! Blend the shells with weighted blended order independent transparency, into accumulation and revealage targets that are
+		composited over the frame at the end, instead of alpha blending them in the order they are drawn */
+	bool orderIndependentShells = false;
+	/*! Cull with the scene BVH rather than testing every object's bounds */
+	bool sceneBvh = false;
+	/*! Cull in a compute pass that writes indirect draws, instead of culling and updating uniforms per object on the CPU */
+	bool gpuCulling = false;
+	/*! Also skip objects hidden behind the base meshes, tested against a depth pyramid in the culling pass. Turns on gpuCulling */
+	bool occlusionCulling = false;
+
+	/*! Benchmark run, animates on a fixed timestep and writes the frame timings out as JSON */
+	bool benchmark = false;
+	/*! Frames rendered before measuring starts, the measured frames are set with frameCount */
+	unsigned int warmupFrames = 0;
+	std::string benchmarkOutput = "benchmark.json";
+
+	/*! Run against the mock Vulkan backend, which counts calls and does no work. Always headless */
+	bool mockVulkan = false;
+
+	/*! Time the CPU hot paths (model loading, uniform updates, descriptor writes...) this many times each instead of rendering,
+		against the mock backend so no GPU is needed (0 disables it) */
+	unsigned int microbenchRepetitions = 0;
+	/*! Only run the microbenchmark cases with this in their name (empty runs them all) */
+	std::string microbenchFilter;
+	/*! Write the microbenchmark results out as JSON (empty only prints them) */
+	std::string microbenchOutput;
+
+	/*! Compile the GLSL sources at load time, otherwise load the pre-built SPIR-V */
+	bool compileShaders = true;
+	/*! Compile every shader into its pre-built SPIR-V and stamp it with the source hash, then exit without rendering */
+	bool buildShaders = false;
+	/*! spirv-opt level used before compiled shaders are cached */
+	ShaderOptimisation shaderOptimisation = ShaderOptimisation::Performance;
+
+	/*! Parse the command line arguments into a settings struct, throws on unknown arguments */
+	static AppSettings fromCommandLine(int argc, char** argv);
+
+	/*! Read settings from a config file of key = value lines, # starts a comment */
+	void loadConfig(const std::string& filename);
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "AppSettings.h"
+#include "GpuProfiler.h"
+
+/*! Benchmark
+	Collects the timings of each measured frame and writes a summary out as JSON.
+	Frames are numbered from the start of the run, the warmup frames are ignored
+*/
+class Benchmark
+{
+private:
+	/*! Frame Sample struct
+		Timings and work for a single measured frame
+	*/
+	struct FrameSample {
+		double cpuMs = 0.0;
+		double gpuMs = -1.0; //Negative until the GPU time has been read back (or if timestamps aren't supported)
+		std::vector<GpuZoneTime> zones; //GPU time of each phase
+		bool hasStatistics = false; //True if the zones hold pipeline statistics
+		uint32_t draws = 0;
+		uint64_t triangles = 0;
+		bool recorded = false; //False if the run ended before this frame
+	};
+
+	/*! Stats struct
+		Summary of one timing across all the measured frames
+	*/
+	struct Stats {
+		size_t count = 0;
+		double mean = 0.0;
+		double p50 = 0.0;
+		double p95 = 0.0;
+		double p99 = 0.0;
+		double max = 0.0;
+	};
+
+	AppSettings m_Settings;
+	std::vector<FrameSample> m_Samples;
+
+	/*! Returns the sample for a frame, or null for warmup frames and frames past the end */
+	FrameSample* sample(size_t frame);
+
+	static Stats summarise(std::vector<double> values);
+	static void writeStats(std::ostream& out, const char* name, const Stats& stats);
+
+public:
+	Benchmark(const AppSettings& settings);
+
+	/*! Fixed time step the scene is animated with, so every run renders the same frames */
+	static constexpr double TIME_STEP = 1.0 / 60.0;
+
+	void addFrame(size_t frame, double cpuMs, uint32_t draws, uint64_t triangles);
+	void setGpuTime(size_t frame, const GpuFrameTimes& times);
+
+	/*! Write the settings, per frame stats and percentiles to the output file */
+	void writeJson(const std::string& deviceName);
+};
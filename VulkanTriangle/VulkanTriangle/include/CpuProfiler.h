@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*! CPU Profile Event struct
+	One finished zone, times are nanoseconds since the profiler started
+*/
+struct CpuProfileEvent {
+	const char* name; //Must be a string literal (or otherwise live for the whole run)
+	uint64_t startNs;
+	uint64_t endNs;
+};
+
+/*! CPU Profiler
+	Scoped CPU zones written into a ring buffer per thread, so recording never takes a lock.
+	The buffers are written out as Chrome trace event JSON, which opens in chrome://tracing or ui.perfetto.dev.
+	Recording is off until setEnabled is called, a disabled zone costs one relaxed atomic load.
+	Define DISABLE_CPU_PROFILER to compile the PROFILE_ macros out entirely
+*/
+class CpuProfiler
+{
+public:
+	/*! Events kept per thread, older events are overwritten once a thread has recorded more than this */
+	static const size_t EVENTS_PER_THREAD = 16384;
+
+	/*! Scope class
+		Records the time between its construction and destruction as a zone
+	*/
+	class Scope {
+	private:
+		const char* m_Name;
+		uint64_t m_Start = 0;
+	public:
+		Scope(const char* name) : m_Name(Enabled() ? name : nullptr) {
+			if (m_Name) m_Start = now();
+		}
+		~Scope() {
+			if (m_Name) record(m_Name, m_Start, now());
+		}
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	};
+
+	static void setEnabled(bool enabled) { s_Enabled.store(enabled, std::memory_order_relaxed); }
+	static bool Enabled() { return s_Enabled.load(std::memory_order_relaxed); }
+
+	/*! Name the calling thread in the trace */
+	static void setThreadName(const char* name);
+
+	static uint64_t now();
+	/*! Add a finished zone to the calling thread's buffer */
+	static void record(const char* name, uint64_t startNs, uint64_t endNs);
+
+	/*! Write every thread's events out as Chrome trace JSON. Threads still recording may overwrite their oldest events
+		while this runs, so call it once they are idle (e.g. after the pipeline workers are joined) */
+	static void writeChromeTrace(const std::string& filename);
+
+private:
+	/*! Thread Buffer struct
+		Only the owning thread writes events, the write count is published so the exporter knows which events are finished
+	*/
+	struct ThreadBuffer {
+		uint32_t id;
+		std::string name;
+		std::array<CpuProfileEvent, EVENTS_PER_THREAD> events;
+		std::atomic<uint64_t> written{ 0 };
+	};
+
+	static ThreadBuffer& threadBuffer();
+
+	/*! The calling thread's buffer (null until it records something) and the name to give it */
+	static thread_local ThreadBuffer* t_Buffer;
+	static thread_local const char* t_ThreadName;
+
+	static std::atomic<bool> s_Enabled;
+
+	/*! Every thread's buffer, only locked when a thread records its first event and when exporting.
+		Buffers are never freed so events from finished threads can still be written out */
+	static std::mutex s_Mutex;
+	static std::vector<std::unique_ptr<ThreadBuffer>> s_Buffers;
+};
+
+#ifndef DISABLE_CPU_PROFILER
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+/*! Time the rest of the enclosing block as a zone */
+#define PROFILE_SCOPE(name) CpuProfiler::Scope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_THREAD_NAME(name) CpuProfiler::setThreadName(name)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_THREAD_NAME(name)
+#endif
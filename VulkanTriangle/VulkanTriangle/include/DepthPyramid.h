@@ -0,0 +1,71 @@
+#pragma once
+
+#include "VulkanLoader.h"
+
+#include <GLM/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+class VulkanEngine;
+
+/*! Depth Pyramid
+	Hierarchical depth for occlusion culling. A compute pass reduces the depth buffer into a single channel float mip chain,
+	each texel holding the farthest depth under it, so an object can be tested against the depth in front of it with four reads
+*/
+class DepthPyramid
+{
+private:
+	VulkanEngine* m_Engine;
+	VkDevice& m_Device;
+
+	VkDescriptorSetLayout m_DescriptorSetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout m_PipelineLayout = VK_NULL_HANDLE;
+	VkPipeline m_Pipeline = VK_NULL_HANDLE;
+	VkSampler m_Sampler = VK_NULL_HANDLE;
+
+	//Pyramid, the first level is the depth buffer's size rounded down to a power of two. Kept in the general layout for reading and writing
+	VkImage m_Image = VK_NULL_HANDLE;
+	VkDeviceMemory m_ImageMemory = VK_NULL_HANDLE;
+	VkImageView m_ImageView = VK_NULL_HANDLE; //Every level, for the culling pass
+	std::vector<VkImageView> m_LevelViews;
+	VkExtent2D m_Extent = {};
+	uint32_t m_Levels = 0;
+
+	/*! One set per level, reading the level below it (the depth buffer for the first) and writing the level */
+	VkDescriptorPool m_DescriptorPool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> m_DescriptorSets;
+
+	bool m_HasDepth = false; //Set once a pass has been recorded into the current pyramid
+	glm::mat4 m_ViewProj = glm::mat4(1.0f);
+
+public:
+	/*! Format of the pyramid, storage image support for it is required */
+	static const VkFormat FORMAT = VK_FORMAT_R32_SFLOAT;
+	/*! Threads per workgroup in each direction, matches the local size in depth_reduce.comp */
+	static const uint32_t WORKGROUP_SIZE = 8;
+
+	DepthPyramid(VulkanEngine* engine, VkDevice& device);
+
+	/*! The pipeline only depends on the shader, so it lives for the whole app */
+	void createPipeline(VkShaderModule reduceShader);
+	void destroyPipeline();
+
+	/*! Create the pyramid for a depth buffer, the depth image needs to have been created with sampling allowed */
+	void createTarget(VkExtent2D extent, VkImageView depthImageView);
+	void destroyTarget();
+
+	/*! Record the reduction, the depth buffer must be in the depth read only layout. viewProj is what the depth was drawn with.
+		The pyramid is ready for compute shader reads afterwards */
+	void record(VkCommandBuffer commandBuffer, const glm::mat4& viewProj);
+
+	/*! False if the pyramid was recreated (e.g. on resize) since the last pass, it holds no depth to test against */
+	bool HasDepth() const { return m_HasDepth; }
+	/*! View projection of the depth in the pyramid */
+	const glm::mat4& ViewProj() const { return m_ViewProj; }
+
+	VkImageView ImageView() const { return m_ImageView; }
+	VkSampler Sampler() const { return m_Sampler; }
+	VkExtent2D Extent() const { return m_Extent; }
+	uint32_t Levels() const { return m_Levels; }
+};
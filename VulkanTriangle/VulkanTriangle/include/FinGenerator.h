@@ -0,0 +1,121 @@
+#pragma once
+
+#include "VulkanLoader.h"
+
+#include "InstanceBuffers.h"
+#include "GpuCuller.h"
+#include "VulkanObject.h"
+
+#include <cstdint>
+#include <vector>
+
+class VulkanEngine;
+
+/*! Fin Mesh struct
+	An object's edges and where its vertices start in the geometry arena
+*/
+struct FinMesh {
+	std::vector<MeshEdge> edges;
+	int32_t vertexOffset = 0;
+	uint32_t instanceCount = 0; //Instances of the object, the most that can be visible
+};
+
+/*! Fin Generator
+	Builds the fins in a compute pass instead of a geometry shader. Every edge of every visible instance is tested against the camera,
+	and only the silhouette edges, where one triangle faces the camera and the other faces away, append a fin quad. The quads are then
+	drawn with one indirect draw, fin.vert expands each into two triangles.
+	Each object's dispatch has a thread per edge and instance, edges along X and instances along Y. It is sized for all of the
+	object's instances, as only the GPU knows how many are visible, and the threads past the visible count return straight away.
+	Each frame in flight has its own quads and draw, with a section of each per cull pass. The visible instances come from the culling
+	pass's base mesh draws, or without it from draws the CPU writes with ObjectDraws
+*/
+class FinGenerator
+{
+private:
+	/*! Draw and count for a pass, matches FinDraw in fins.glsl. Starts with a VkDrawIndirectCommand so it can be drawn from directly */
+	struct FinDraw {
+		uint32_t vertexCount;
+		uint32_t instanceCount;
+		uint32_t firstVertex;
+		uint32_t firstInstance;
+		uint32_t finCount; //Fins asked for, can go past the capacity but only those that fit are drawn
+		uint32_t padding[3];
+	};
+
+	/*! Which object a dispatch is for, matches the push constants in fins.comp */
+	struct FinObject {
+		uint32_t firstEdge;
+		uint32_t edgeCount;
+		int32_t vertexOffset;
+		uint32_t draw; //Index of the object's base mesh draw in the draw buffer
+		uint32_t pass;
+		uint32_t capacity;
+		uint32_t firstInstance; //First visible instance of the dispatch
+	};
+
+	/*! Buffers for one frame in flight */
+	struct FrameBuffers {
+		VkBuffer quads = VK_NULL_HANDLE;
+		VkDeviceMemory quadsMemory = VK_NULL_HANDLE;
+
+		VkBuffer draws = VK_NULL_HANDLE;
+		VkDeviceMemory drawsMemory = VK_NULL_HANDLE;
+
+		//Each object's visible instances as a base mesh draw, only when the CPU culls
+		VkBuffer objectDraws = VK_NULL_HANDLE;
+		VkDeviceMemory objectDrawsMemory = VK_NULL_HANDLE;
+		VkDrawIndexedIndirectCommand* mappedObjectDraws = nullptr;
+
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+	};
+
+	VulkanEngine* m_Engine;
+	VkDevice& m_Device;
+
+	VkDescriptorSetLayout m_DescriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool m_DescriptorPool = VK_NULL_HANDLE;
+	VkPipelineLayout m_PipelineLayout = VK_NULL_HANDLE;
+	VkPipeline m_Pipeline = VK_NULL_HANDLE;
+
+	/*! Every object's edges one after the other, the same for every frame */
+	VkBuffer m_Edges = VK_NULL_HANDLE;
+	VkDeviceMemory m_EdgesMemory = VK_NULL_HANDLE;
+	std::vector<FinObject> m_Objects;
+	std::vector<uint32_t> m_InstanceCounts;
+
+	std::vector<FrameBuffers> m_Frames;
+	const GpuCuller* m_Culler = nullptr;
+	uint32_t m_Passes = 1;
+
+public:
+	/*! Threads per workgroup, matches local_size_x in fins.comp */
+	static const uint32_t WORKGROUP_SIZE = 64;
+	/*! Workgroups a dispatch can have along Y, the smallest maxComputeWorkGroupCount allows. Objects with more instances take more dispatches */
+	static constexpr uint32_t MAX_INSTANCE_GROUPS = 65535;
+	/*! Fins each pass can draw, 64 bytes each. Fins past it are dropped */
+	static const uint32_t CAPACITY = 1 << 17;
+	/*! Binding of the quads in the sets fin.vert draws with, and of the pass's own buffers (see fins.glsl) */
+	static const uint32_t QUAD_BINDING = 10;
+	static const uint32_t VERTEX_BINDING = 11;
+	static const uint32_t EDGE_BINDING = 12;
+	static const uint32_t OBJECT_DRAW_BINDING = 13;
+	static const uint32_t FIN_DRAW_BINDING = 14;
+
+	FinGenerator(VulkanEngine* engine, VkDevice& device);
+
+	/*! Create the buffers for the instance buffers' frames, and the compute pipeline from fins.comp. The vertices are the geometry
+		arena's, which must allow storage buffer use and not grow afterwards. With a culler its draws say which instances are visible
+		and there is a section per cull pass, otherwise the draws written to ObjectDraws do */
+	void create(VkShaderModule finShader, InstanceBuffers& instances, VkBuffer vertexBuffer, const std::vector<FinMesh>& meshes, const GpuCuller* culler = nullptr);
+	void destroy();
+
+	/*! Record the fins for a pass, outside a render pass and after the culling pass. They are ready to draw afterwards */
+	void record(VkCommandBuffer commandBuffer, uint32_t frame, CullPass pass = CullPass::Early);
+	/*! Draw a pass's fins with a pipeline that reads the quads, inside the render pass */
+	void draw(VkCommandBuffer commandBuffer, uint32_t frame, CullPass pass = CullPass::Early) const;
+
+	/*! Each object's visible instances for the frame slot when the CPU culls, firstInstance and instanceCount are the range in the visible list */
+	VkDrawIndexedIndirectCommand* ObjectDraws(uint32_t frame) { return m_Frames[frame].mappedObjectDraws; }
+	VkBuffer QuadBuffer(uint32_t frame) const { return m_Frames[frame].quads; }
+	uint32_t EdgeCount() const;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*! Frame Difference struct
+	How far a read back frame is from a reference, over the pixels the reference drew to
+*/
+struct FrameDifference {
+	uint32_t pixels = 0;
+	uint32_t coveredPixels = 0; //Reference pixels that aren't the clear colour
+	uint32_t differingPixels = 0; //Covered pixels with a channel further off than FrameComparison::CHANNEL_THRESHOLD
+	double meanDifference = 0.0; //Mean channel difference over the covered pixels, out of 255
+	uint32_t maxDifference = 0;
+
+	/*! Fraction of the covered pixels that differ, 0 when nothing was drawn */
+	double differingFraction() const { return coveredPixels > 0 ? static_cast<double>(differingPixels) / coveredPixels : 0.0; }
+};
+
+/*! Frame Comparison
+	Checks a read back frame against a reference .ppm written by an earlier headless run, so one rendering path can be checked
+	against another (e.g. --oit against the in order shells). The paths don't have to match exactly, only a large fraction of
+	pixels being far off counts as a failure
+*/
+class FrameComparison
+{
+public:
+	/*! Channel difference out of 255 a pixel has to exceed to count as differing, so small blending differences don't */
+	static const uint32_t CHANNEL_THRESHOLD = 48;
+
+	/*! Load a binary 8 bit .ppm, the format readbackImage writes */
+	static std::vector<unsigned char> loadPpm(const std::string& filename, uint32_t& width, uint32_t& height);
+
+	/*! Compare tightly packed RGB pixels against the reference file. The clear colour is taken from the reference's top left pixel */
+	static FrameDifference compare(const std::vector<unsigned char>& rgb, uint32_t width, uint32_t height, const std::string& referenceFile);
+
+	static void print(const FrameDifference& difference, const std::string& referenceFile);
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <GLM/glm.hpp>
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*! Bounds struct
+	Bounding box and sphere around the same centre. The sphere is the cheaper test, the box is tighter for long thin meshes
+*/
+struct Bounds {
+	glm::vec3 centre = glm::vec3(0.0f);
+	glm::vec3 extents = glm::vec3(0.0f); //Half the size of the box on each axis
+	float radius = 0.0f;
+
+	/*! Grown on every side, e.g. by the fur extrusion */
+	Bounds expanded(float distance) const;
+	/*! Bounds of the transformed volume, the box stays axis aligned so grows under rotation */
+	Bounds transformed(const glm::mat4& transform) const;
+};
+
+/*! Frustum struct
+	Six planes with the normals (xyz) pointing inwards, w is the distance so a point is inside when dot(normal, p) + w >= 0
+*/
+struct Frustum {
+	std::array<glm::vec4, 6> planes;
+
+	/*! Extract the planes from a projection * view matrix */
+	static Frustum fromMatrix(const glm::mat4& viewProjection);
+};
+
+/*! Which implementation cull uses, Auto picks SIMD and goes parallel above PARALLEL_THRESHOLD objects */
+enum class CullPath {
+	Auto,
+	Scalar,
+	Simd,
+	Parallel
+};
+
+/*! Frustum Culler
+	World space bounds of every object kept as structure of arrays, so the planes can be tested against
+	8 (AVX) or 4 (SSE) objects at a time. An object is visible when both its sphere and box are inside or touching every plane
+*/
+class FrustumCuller
+{
+private:
+	/*! Bounds split per component, padded to a multiple of SIMD_WIDTH so the SIMD loop has no remainder */
+	std::vector<float> m_CentreX, m_CentreY, m_CentreZ;
+	std::vector<float> m_ExtentX, m_ExtentY, m_ExtentZ;
+	std::vector<float> m_Radius;
+	size_t m_Count = 0;
+
+	/*! Visible objects of each chunk when culling in parallel, joined in order afterwards */
+	std::vector<std::vector<uint32_t>> m_ChunkVisible;
+
+	/*! Workers for the parallel path, started the first time it is used and kept so a frame only has to wake them.
+		Each takes the chunk after its index, the calling thread takes the first */
+	std::vector<std::thread> m_Workers;
+	std::mutex m_Mutex;
+	std::condition_variable m_JobReady;
+	std::condition_variable m_JobDone;
+	const Frustum* m_JobFrustum = nullptr;
+	size_t m_JobChunkSize = 0;
+	uint64_t m_JobGeneration = 0; //Bumped for every parallel cull, so a worker knows there is a new one
+	size_t m_JobsRemaining = 0;
+	bool m_Stopping = false;
+
+	void cullRange(const Frustum& frustum, size_t begin, size_t end, bool simd, std::vector<uint32_t>& visible) const;
+	void cullChunk(size_t chunk);
+	void workerLoop(size_t chunk);
+
+public:
+	/*! Objects per SIMD test, ranges are always split on a multiple of this */
+	static constexpr size_t SIMD_WIDTH = 8;
+	/*! Object count the Auto path starts splitting the work over threads at. This is a guess, the crossover hasn't been
+		timed on a multi-core machine. Compare the "cull 100k" --microbench cases there to tune it */
+	static constexpr size_t PARALLEL_THRESHOLD = 4096;
+
+	FrustumCuller() = default;
+	FrustumCuller(const FrustumCuller&) = delete;
+	FrustumCuller& operator=(const FrustumCuller&) = delete;
+	~FrustumCuller();
+
+	/*! Name of the SIMD instructions compiled in, "scalar" if there are none */
+	static const char* SimdName();
+
+	/*! Set the number of objects, new objects have empty bounds at the origin until set */
+	void resize(size_t count);
+	size_t Size() const { return m_Count; }
+
+	void setBounds(size_t index, const Bounds& bounds);
+
+	/*! Fill visible with the indices of the objects inside the frustum, in ascending order */
+	void cull(const Frustum& frustum, std::vector<uint32_t>& visible, CullPath path = CullPath::Auto);
+};
@@ -1,7 +1,6 @@
 #pragma once
 
-#define GLFW_INCLUDE_VULKAN
-#include <glfw3.h>
+#include "VulkanLoader.h"
 
 #include <iostream>
 #include <GLM\vec2.hpp>
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "VulkanLoader.h"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+class VulkanEngine;
+struct Vertex;
+
+/*! Mesh Range struct
+	Where a mesh lives in the geometry arena, passed straight to vkCmdDrawIndexed or an indirect draw
+*/
+struct MeshRange {
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+	int32_t vertexOffset = 0;
+	uint32_t vertexCount = 0;
+};
+
+/*! Free List
+	First fit allocator over a range of elements, freed blocks merge with their neighbours
+*/
+class FreeList
+{
+private:
+	std::map<uint32_t, uint32_t> m_Free; //Offset to size, sorted so neighbours can be found
+	uint32_t m_Capacity = 0;
+	uint32_t m_Used = 0;
+
+public:
+	/*! Returned when no free block is big enough */
+	static const uint32_t INVALID = UINT32_MAX;
+
+	/*! Offset of a block of count elements, or INVALID */
+	uint32_t allocate(uint32_t count);
+	void free(uint32_t offset, uint32_t count);
+	/*! Extend the range, the new elements are free */
+	void grow(uint32_t capacity);
+
+	uint32_t Capacity() const { return m_Capacity; }
+	uint32_t Used() const { return m_Used; }
+	/*! Number of free blocks, more than one means the range is fragmented */
+	size_t Blocks() const { return m_Free.size(); }
+};
+
+/*! Geometry Arena
+	Every mesh's vertices and indices sub-allocated from one vertex buffer and one index buffer, so they are bound once
+	per frame and any mesh can be drawn by its range. The buffers double when a mesh doesn't fit
+*/
+class GeometryArena
+{
+private:
+	VulkanEngine* m_Engine;
+	VkDevice& m_Device;
+
+	VkBuffer m_VertexBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory m_VertexMemory = VK_NULL_HANDLE;
+	VkBuffer m_IndexBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory m_IndexMemory = VK_NULL_HANDLE;
+
+	FreeList m_Vertices;
+	FreeList m_Indices;
+
+	/*! Replace a buffer with a bigger one holding the same contents */
+	void growBuffer(VkQueue& graphicsQueue, VkCommandPool& comPool, VkBuffer& buffer, VkDeviceMemory& memory, VkDeviceSize oldSize, VkDeviceSize newSize, VkBufferUsageFlags usage, const std::string& owner);
+	/*! Copy data into a buffer through a staging buffer */
+	void upload(VkQueue& graphicsQueue, VkCommandPool& comPool, VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size, const std::string& owner);
+
+public:
+	GeometryArena(VulkanEngine* engine, VkDevice& device);
+
+	/*! Create the buffers, capacities are in vertices and indices */
+	void create(uint32_t vertexCapacity, uint32_t indexCapacity);
+	void destroy();
+
+	/*! Copy a mesh into the arena and return where it went. Growing waits for the queue to go idle, so it is for load time */
+	MeshRange add(VkQueue& graphicsQueue, VkCommandPool& comPool, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const std::string& owner);
+	/*! Free a mesh's range, it must not be drawn by a frame still in flight */
+	void remove(const MeshRange& mesh);
+
+	/*! Bind the vertex and index buffers, every draw after reads its mesh from them by range */
+	void bind(VkCommandBuffer commandBuffer);
+
+	VkBuffer VertexBuffer() const { return m_VertexBuffer; }
+	VkBuffer IndexBuffer() const { return m_IndexBuffer; }
+	const FreeList& Vertices() const { return m_Vertices; }
+	const FreeList& Indices() const { return m_Indices; }
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "VulkanLoader.h"
+
+#include "InstanceBuffers.h"
+
+#include <cstdint>
+#include <vector>
+
+class VulkanEngine;
+
+/*! Gpu Mesh struct
+	An object's mesh in the geometry arena and where its instances go in each visible list, matches MeshData in cull.comp (std430)
+*/
+struct GpuMesh {
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t firstVisible;
+};
+
+/*! Culling passes, with occlusion culling the frame is drawn in two.
+	Early draws what the last frame's depth pyramid doesn't hide, Late re-tests the rest against the pyramid of what Early drew
+	and draws the ones that have come into view. Without occlusion culling there is only the early pass
+*/
+enum class CullPass : uint32_t {
+	Early,
+	Late,
+	Count
+};
+
+/*! Gpu Culler
+	Culls the instances in a compute pass, filling the visible lists and writing an indirect draw per object for every phase,
+	so the CPU neither culls nor builds the lists. Each frame in flight has its own draw and count buffers, and reads and writes
+	that frame's instance buffers. The draws are cleared each frame and every visible instance adds itself to its object's.
+	With occlusion on, instances are also tested against a depth pyramid in two passes, see CullPass
+*/
+class GpuCuller
+{
+private:
+	/*! Buffers for one frame in flight */
+	struct FrameBuffers {
+		VkBuffer draws = VK_NULL_HANDLE;
+		VkDeviceMemory drawsMemory = VK_NULL_HANDLE;
+
+		//Visible and occluded instance counts, host visible so they can be read once the frame's fence has signalled
+		VkBuffer counts = VK_NULL_HANDLE;
+		VkDeviceMemory countsMemory = VK_NULL_HANDLE;
+		const uint32_t* mappedCounts = nullptr;
+
+		//A flag per instance the early pass drew, for the late pass. Only with occlusion culling
+		VkBuffer drawnEarly = VK_NULL_HANDLE;
+		VkDeviceMemory drawnEarlyMemory = VK_NULL_HANDLE;
+
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+	};
+
+	VulkanEngine* m_Engine;
+	VkDevice& m_Device;
+
+	VkDescriptorSetLayout m_DescriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool m_DescriptorPool = VK_NULL_HANDLE;
+	VkPipelineLayout m_PipelineLayout = VK_NULL_HANDLE;
+	VkPipeline m_Pipeline = VK_NULL_HANDLE;
+
+	/*! Every object's mesh, only read by the culling pass and the same for every frame */
+	VkBuffer m_Meshes = VK_NULL_HANDLE;
+	VkDeviceMemory m_MeshesMemory = VK_NULL_HANDLE;
+
+	std::vector<FrameBuffers> m_Frames;
+	uint32_t m_InstanceCount = 0;
+	uint32_t m_ObjectCount = 0;
+	bool m_Occlusion = false;
+
+public:
+	/*! Threads per workgroup, matches local_size_x in cull.comp */
+	static const uint32_t WORKGROUP_SIZE = 64;
+	/*! Bindings of the culling pass's own buffers, the instance buffers keep theirs (see gpu_scene.glsl) */
+	static const uint32_t DRAW_BINDING = 4;
+	static const uint32_t COUNT_BINDING = 5;
+	static const uint32_t PYRAMID_BINDING = 6;
+	static const uint32_t MESH_BINDING = 8;
+	static const uint32_t DRAWN_EARLY_BINDING = 9;
+
+	GpuCuller(VulkanEngine* engine, VkDevice& device);
+
+	/*! Create the buffers for the instance buffers' frames, and the compute pipeline from cull.comp. Each object's instances are
+		listed from its mesh's firstVisible, so the meshes need room for all of them in object order.
+		With occlusion the shader must be the OCCLUSION variant, the instance buffers need a list per pass, and setDepthPyramid
+		must be called before recording */
+	void create(VkShaderModule cullShader, InstanceBuffers& instances, const std::vector<GpuMesh>& meshes, bool occlusion = false);
+	void destroy();
+
+	/*! Point every frame's culling pass at the depth pyramid, again whenever it is recreated */
+	void setDepthPyramid(VkImageView pyramidView, VkSampler sampler);
+
+	/*! Record a culling pass, outside a render pass. The draws and lists are ready for the draw indirect and vertex stages afterwards.
+		The late pass goes after the early pass's draws and the pyramid built from them */
+	void record(VkCommandBuffer commandBuffer, uint32_t frame, CullPass pass = CullPass::Early);
+
+	/*! Instances drawn, and instances in the frustum but hidden, the last time this slot was drawn. Only valid once its fence has signalled */
+	uint32_t VisibleCount(uint32_t frame) const { return m_Frames[frame].mappedCounts[0]; }
+	uint32_t OccludedCount(uint32_t frame) const { return m_Frames[frame].mappedCounts[1]; }
+
+	VkBuffer DrawBuffer(uint32_t frame) const { return m_Frames[frame].draws; }
+	/*! Offset of an object's draw for a pass and phase in the draw buffer, a phase's draws are consecutive */
+	VkDeviceSize DrawOffset(CullPass pass, DrawPhase phase, uint32_t object) const {
+		VkDeviceSize draw = (static_cast<VkDeviceSize>(pass) * static_cast<uint32_t>(DrawPhase::Count) + static_cast<uint32_t>(phase)) * m_ObjectCount + object;
+		return draw * sizeof(VkDrawIndexedIndirectCommand);
+	}
+
+	uint32_t ObjectCount() const { return m_ObjectCount; }
+	bool Occlusion() const { return m_Occlusion; }
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "VulkanLoader.h"
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+/*! Pipeline Stats struct
+	Pipeline statistics query results for a zone, in the order the query writes them
+*/
+struct PipelineStats {
+	uint64_t vertexInvocations = 0;
+	uint64_t geometryInvocations = 0;
+	uint64_t clippingInvocations = 0; //Primitives that reached the clipping stage
+	uint64_t clippingPrimitives = 0; //Primitives that came out of clipping
+	uint64_t fragmentInvocations = 0;
+
+	PipelineStats& operator+=(const PipelineStats& other);
+};
+
+/*! GPU Zone Time struct
+	Time spent in one named phase of a frame, zones with the same name in a frame are added together
+*/
+struct GpuZoneTime {
+	std::string name;
+	double ms = 0.0;
+	PipelineStats stats; //Only filled in if pipeline statistics are enabled
+};
+
+/*! GPU Frame Times struct
+	The GPU time of a whole frame and each zone in it
+*/
+struct GpuFrameTimes {
+	size_t frame = 0;
+	double gpuMs = 0.0;
+	std::vector<GpuZoneTime> zones;
+	bool hasStatistics = false;
+
+	/*! Time of a zone, 0 if it wasn't drawn this frame */
+	double zone(const std::string& name) const;
+};
+
+/*! GPU Profiler
+	Times each frame on the GPU with timestamp queries, one block of queries per frame in flight.
+	Scoped zones can be written around the phases of a frame (inside or outside a render pass),
+	optionally with a pipeline statistics query over each zone.
+	Results are read back once the frame's fence has signalled, so they arrive a frame or two late and never stall
+*/
+class GpuProfiler
+{
+private:
+	VkDevice& m_Device;
+	VkQueryPool m_QueryPool = VK_NULL_HANDLE;
+	VkQueryPool m_StatsPool = VK_NULL_HANDLE; //One pipeline statistics query per zone, null if disabled
+
+	uint32_t m_Slots; //One per frame in flight
+	uint32_t m_MaxZones; //Zones per frame, each uses two queries
+	double m_TimestampPeriod = 0.0; //Nanoseconds per tick
+	uint64_t m_TimestampMask = 0; //Valid bits in a timestamp
+
+	/*! Frame number written into each slot, the zones recorded in it, and if it is waiting to be read back */
+	std::vector<size_t> m_SlotFrame;
+	std::vector<std::vector<std::string>> m_SlotZones;
+	std::vector<bool> m_SlotPending;
+
+	/*! Rolling history of the frames read back, oldest first */
+	std::deque<GpuFrameTimes> m_History;
+	size_t m_HistorySize;
+
+	uint32_t QueriesPerSlot() const { return 2 + m_MaxZones * 2; }
+	double toMs(uint64_t start, uint64_t end) const;
+
+public:
+	/*! Pipeline statistics need the pipelineStatisticsQuery device feature enabled */
+	GpuProfiler(VkPhysicalDevice& phyDevice, VkDevice& device, uint32_t queueFamily, uint32_t slots, bool pipelineStatistics = false, uint32_t maxZones = 8, size_t historySize = 240);
+	~GpuProfiler();
+
+	/*! Scope struct
+		Times the commands recorded while it is alive as a named zone
+	*/
+	class Scope {
+	private:
+		GpuProfiler& m_Profiler;
+		VkCommandBuffer m_CommandBuffer;
+		uint32_t m_Slot;
+		uint32_t m_Zone;
+	public:
+		Scope(GpuProfiler& profiler, VkCommandBuffer commandBuffer, uint32_t slot, const char* name);
+		~Scope();
+	};
+
+	/*! False if the queue can't write timestamps, all the calls below do nothing */
+	bool Supported() const { return m_QueryPool != VK_NULL_HANDLE; }
+	bool StatisticsEnabled() const { return m_StatsPool != VK_NULL_HANDLE; }
+
+	/*! Start timing a frame, must be recorded outside a render pass */
+	void beginFrame(VkCommandBuffer commandBuffer, uint32_t slot, size_t frame);
+	/*! Stop timing the frame */
+	void endFrame(VkCommandBuffer commandBuffer, uint32_t slot);
+
+	/*! Start a zone, returns the zone to end or UINT32_MAX if the slot has run out of zones.
+		With statistics on, zones can't overlap and have to start and end in the same subpass */
+	uint32_t beginZone(VkCommandBuffer commandBuffer, uint32_t slot, const char* name);
+	void endZone(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t zone);
+
+	/*! Read back the slot's last frame into the history, call after its fence has been waited on. Returns false if there was nothing ready */
+	bool collect(uint32_t slot);
+
+	/*! Most recent frame read back, null if there hasn't been one yet */
+	const GpuFrameTimes* Latest() const { return m_History.empty() ? nullptr : &m_History.back(); }
+	const std::deque<GpuFrameTimes>& History() const { return m_History; }
+
+	/*! Average of the last count frames in the history */
+	GpuFrameTimes average(size_t count) const;
+	/*! Print the average frame and zone times of the last count frames */
+	void printAverage(size_t count) const;
+
+	/*! Destroy the query pool, must be called before the device is destroyed */
+	void destroy();
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "VulkanLoader.h"
+
+#include <GLM/glm.hpp>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+class VulkanEngine;
+
+/*! Gpu Instance struct
+	Per instance data the culling pass and the shaders read, laid out to match InstanceData in gpu_scene.glsl (std430)
+*/
+struct GpuInstance {
+	glm::mat4 model;
+	std::array<glm::vec4, 3> normalMatrix; //Columns of the model's inverse transpose, std430 pads each mat3 column to a vec4
+	glm::vec4 sphere; //Local bounds centre (xyz) and radius (w), grown by the fur
+	glm::vec4 extents; //Local bounds half size (xyz)
+	uint32_t object; //Object whose mesh and texture it draws
+	uint32_t passes; //Base mesh plus shells
+	float extrusion; //Distance the shells and fins reach out from the surface
+	uint32_t padding;
+};
+
+/*! Gpu Frame struct
+	Camera and counts for a frame, matches FrameUniforms in gpu_scene.glsl (std140)
+*/
+struct GpuFrame {
+	glm::mat4 view;
+	glm::mat4 proj;
+	std::array<glm::vec4, 6> frustum; //Planes as in Frustum, normals pointing in
+	glm::vec2 viewportDim;
+	uint32_t instanceCount;
+	uint32_t passStride; //Most passes an instance can have, the shell draws have passStride - 1 instances per visible instance
+
+	//Occlusion culling only
+	glm::mat4 occlusionViewProj; //View projection the depth pyramid was drawn with, for the early pass
+	glm::vec2 pyramidDim; //Size of the pyramid's first level
+	uint32_t pyramidLevels;
+	uint32_t occlusionTest; //0 until the pyramid holds a frame's depth, the early pass then draws everything in the frustum
+
+	glm::vec3 cameraPosition; //World space, for the fins' silhouette test (std140 puts it on a vec4 boundary, which it already is)
+	uint32_t objectCount; //Objects with a draw per phase
+};
+
+/*! Draw phases, each has an instanced draw per object */
+enum class DrawPhase : uint32_t {
+	Fins,
+	Base,
+	Shells,
+	Count
+};
+
+/*! Instance Buffers
+	What every draw reads, for each frame in flight: the camera, every instance's transform and fur settings, and the visible list.
+	An object is drawn with one instanced draw per phase, each instance of the draw picks its instance from the list, so the cost
+	doesn't grow with the number of instances. The CPU writes the lists when it culls, otherwise the culling pass does.
+	Each slot keeps the instances it has stale, so only what changed since the slot was last drawn is written
+*/
+class InstanceBuffers
+{
+private:
+	/*! Buffers for one frame in flight, written through persistent mappings */
+	struct FrameBuffers {
+		VkBuffer frame = VK_NULL_HANDLE;
+		VkDeviceMemory frameMemory = VK_NULL_HANDLE;
+		GpuFrame* mappedFrame = nullptr;
+
+		VkBuffer instances = VK_NULL_HANDLE;
+		VkDeviceMemory instancesMemory = VK_NULL_HANDLE;
+		GpuInstance* mappedInstances = nullptr;
+
+		VkBuffer visible = VK_NULL_HANDLE;
+		VkDeviceMemory visibleMemory = VK_NULL_HANDLE;
+		uint32_t* mappedVisible = nullptr;
+
+		//Instances changed since this slot was last written, each listed once
+		std::vector<uint32_t> changed;
+		std::vector<uint8_t> changedFlags;
+	};
+
+	VulkanEngine* m_Engine;
+	VkDevice& m_Device;
+
+	std::vector<FrameBuffers> m_Frames;
+	uint32_t m_InstanceCount = 0;
+	uint32_t m_Lists = 0;
+
+public:
+	/*! Bindings in every set that draws instances, see gpu_scene.glsl */
+	static const uint32_t FRAME_BINDING = 0;
+	static const uint32_t INSTANCE_BINDING = 3;
+	static const uint32_t VISIBLE_BINDING = 7;
+
+	InstanceBuffers(VulkanEngine* engine, VkDevice& device);
+
+	/*! Create the buffers for a number of frames in flight and instances. Each list can hold every instance,
+		occlusion culling draws from two (see CullPass) */
+	void create(uint32_t frames, uint32_t instanceCount, uint32_t lists = 1);
+	void destroy();
+
+	/*! Have every frame slot rewrite an instance the next time it is written. All of them are pending after create */
+	void markChanged(uint32_t instance);
+	/*! Instances a slot has to rewrite, clear them once written */
+	const std::vector<uint32_t>& Changed(uint32_t frame) const { return m_Frames[frame].changed; }
+	void clearChanged(uint32_t frame);
+
+	/*! Data for a frame slot, only write it once that slot's fence has signalled */
+	GpuFrame& Frame(uint32_t frame) { return *m_Frames[frame].mappedFrame; }
+	GpuInstance* Instances(uint32_t frame) { return m_Frames[frame].mappedInstances; }
+	uint32_t* Visible(uint32_t frame) { return m_Frames[frame].mappedVisible; }
+
+	VkBuffer FrameBuffer(uint32_t frame) const { return m_Frames[frame].frame; }
+	VkBuffer InstanceBuffer(uint32_t frame) const { return m_Frames[frame].instances; }
+	VkBuffer VisibleBuffer(uint32_t frame) const { return m_Frames[frame].visible; }
+	uint32_t Frames() const { return static_cast<uint32_t>(m_Frames.size()); }
+	uint32_t InstanceCount() const { return m_InstanceCount; }
+	uint32_t Lists() const { return m_Lists; }
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/*! Mapped File
+	Read only memory mapping of a file, the mapping is released when the object is destroyed
+*/
+class MappedFile
+{
+private:
+	const void* m_Data = nullptr;
+	size_t m_Size = 0;
+
+#ifdef _WIN32
+	void* m_File = nullptr;
+	void* m_Mapping = nullptr;
+#else
+	int m_File = -1;
+#endif
+
+	void close();
+
+public:
+	MappedFile(const std::string& filename);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const void* Data() const { return m_Data; }
+	size_t Size() const { return m_Size; }
+};
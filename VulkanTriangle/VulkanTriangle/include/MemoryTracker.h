@@ -0,0 +1,104 @@
+#pragma once
+
+#include "VulkanLoader.h"
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*! What an allocation is used for */
+enum class MemoryCategory {
+	Uniform,
+	Mesh,
+	Texture,
+	Depth,
+	RenderTarget,
+	Staging,
+	Other,
+	Count
+};
+
+const char* toString(MemoryCategory category);
+
+/*! Memory Heap Usage struct
+	Usage of one memory heap. Budget and usage come from VK_EXT_memory_budget and cover the whole process,
+	without the extension the budget is the heap size and usage is what we have tracked
+*/
+struct MemoryHeapUsage {
+	VkDeviceSize size = 0;
+	VkDeviceSize tracked = 0; //Live bytes allocated through the tracker
+	VkDeviceSize budget = 0;
+	VkDeviceSize usage = 0;
+	bool deviceLocal = false;
+};
+
+/*! Memory Threshold Event struct
+	Passed to the threshold callback when a heap's usage goes over one of the thresholds
+*/
+struct MemoryThresholdEvent {
+	uint32_t heap = 0;
+	double threshold = 0.0; //Highest threshold crossed, as a fraction of the budget
+	double fraction = 0.0; //Usage as a fraction of the budget
+	MemoryHeapUsage usage;
+};
+
+/*! Memory Tracker
+	Accounts for every device memory allocation made through the engine, tagged with a category and the owner it belongs to.
+	Keeps live bytes per heap and per category, and raises a callback when a heap's usage crosses a threshold of its budget
+*/
+class MemoryTracker
+{
+private:
+	/*! Allocation struct
+		Size and tags of one live allocation
+	*/
+	struct Allocation {
+		VkDeviceSize size;
+		uint32_t heap;
+		MemoryCategory category;
+		std::string owner;
+	};
+
+	VkPhysicalDevice& m_PhyDevice;
+	VkPhysicalDeviceMemoryProperties m_MemoryProperties;
+	PFN_vkGetPhysicalDeviceMemoryProperties2KHR m_GetMemoryProperties2 = nullptr; //Null unless the budget extension is enabled
+
+	std::unordered_map<VkDeviceMemory, Allocation> m_Allocations;
+	std::vector<VkDeviceSize> m_HeapBytes;
+	std::array<VkDeviceSize, static_cast<size_t>(MemoryCategory::Count)> m_CategoryBytes = {};
+	VkDeviceSize m_PeakBytes = 0;
+
+	/*! Thresholds in ascending order, and how many of them each heap is currently over */
+	std::vector<double> m_Thresholds = { 0.8, 0.95 };
+	std::vector<size_t> m_HeapLevel;
+	std::function<void(const MemoryThresholdEvent&)> m_Callback;
+
+public:
+	/*! budgetExtension should only be true if VK_EXT_memory_budget and VK_KHR_get_physical_device_properties2 are enabled */
+	MemoryTracker(VkPhysicalDevice& phyDevice, bool budgetExtension);
+
+	/*! Record a new allocation */
+	void track(VkDeviceMemory memory, VkDeviceSize size, uint32_t memoryTypeIndex, MemoryCategory category, const std::string& owner);
+	/*! Forget an allocation that is about to be freed */
+	void release(VkDeviceMemory memory);
+
+	/*! Fractions of the budget to raise the callback at, the callback is raised again once usage drops back below and crosses it again */
+	void setThresholds(std::vector<double> thresholds);
+	void setCallback(std::function<void(const MemoryThresholdEvent&)> callback) { m_Callback = callback; }
+
+	bool BudgetSupported() const { return m_GetMemoryProperties2 != nullptr; }
+	/*! Current usage of each heap, queries the driver if the budget extension is enabled */
+	std::vector<MemoryHeapUsage> heapUsage() const;
+	/*! Compare each heap against the thresholds and raise the callback for any newly crossed. Called after every allocation,
+		call it every so often too as the budget and other processes' usage change without us allocating */
+	void checkThresholds();
+
+	VkDeviceSize CategoryBytes(MemoryCategory category) const { return m_CategoryBytes[static_cast<size_t>(category)]; }
+	VkDeviceSize TotalBytes() const;
+
+	/*! Print live bytes per category, per heap and the largest owners */
+	void printReport() const;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*! Microbench Result struct
+	Timings of one case over all its repetitions
+*/
+struct MicrobenchResult {
+	std::string name;
+	size_t repetitions = 0;
+	double minMs = 0.0;
+	double medianMs = 0.0;
+	double meanMs = 0.0;
+	double maxMs = 0.0;
+	uint64_t bytes = 0; //Processed by one repetition, 0 if a throughput doesn't make sense for the case
+};
+
+/*! Microbench
+	Times small pieces of engine code on their own. Each case is run a few times to warm the caches,
+	then timed for every repetition. The minimum and median are the stable numbers to compare before and after a change,
+	the mean and max show how noisy the run was
+*/
+class Microbench
+{
+private:
+	size_t m_Repetitions;
+	std::string m_Filter;
+	std::vector<MicrobenchResult> m_Results;
+
+	/*! Written by keep so the compiler can't throw away work whose result isn't used */
+	static volatile uint64_t s_Sink;
+
+public:
+	/*! Untimed runs before the repetitions */
+	static const size_t WARMUP_RUNS = 2;
+
+	/*! Only cases with the filter in their name are run, an empty filter runs everything */
+	Microbench(size_t repetitions, const std::string& filter = "");
+
+	/*! Time body, bytes is the data one run of it processes */
+	void run(const std::string& name, uint64_t bytes, const std::function<void()>& body);
+
+	static void keep(uint64_t value) { s_Sink = s_Sink + value; }
+
+	const std::vector<MicrobenchResult>& Results() const { return m_Results; }
+
+	/*! Print a table of the results */
+	void print() const;
+	/*! Write the results out as JSON */
+	void writeJson(const std::string& filename) const;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "VulkanLoader.h"
+
+#include <cstdint>
+#include <vector>
+
+class VulkanEngine;
+
+/*! Order Independent Transparency Compositor
+	Weighted blended order independent transparency for the shells. The first subpass draws them into an accumulation target,
+	summing each fragment's colour and alpha scaled by a weight that favours the more opaque ones and those nearer the camera
+	in view space (see shader.frag), and a revealage target, multiplied by one minus each alpha to leave how much of the
+	background still shows through. Both blends are commutative, so the shells can go in any order and every object's can be
+	drawn together without sorting.
+	The second subpass reads both targets back as input attachments and blends their weighted average over the frame.
+	The shells test against the base meshes' depth without writing it, the depth has to be stored by the pass before
+*/
+class OitCompositor
+{
+private:
+	VulkanEngine* m_Engine;
+	VkDevice& m_Device;
+
+	VkRenderPass m_RenderPass = VK_NULL_HANDLE;
+
+	/*! The composite reads the two targets as input attachments */
+	VkDescriptorSetLayout m_DescriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool m_DescriptorPool = VK_NULL_HANDLE;
+	VkDescriptorSet m_DescriptorSet = VK_NULL_HANDLE;
+	VkPipelineLayout m_PipelineLayout = VK_NULL_HANDLE;
+
+	//Accumulation and revealage targets, sized to match the swap chain. They only live for the pass so are never stored
+	VkImage m_AccumImage = VK_NULL_HANDLE;
+	VkDeviceMemory m_AccumImageMemory = VK_NULL_HANDLE;
+	VkImageView m_AccumImageView = VK_NULL_HANDLE;
+	VkImage m_RevealImage = VK_NULL_HANDLE;
+	VkDeviceMemory m_RevealImageMemory = VK_NULL_HANDLE;
+	VkImageView m_RevealImageView = VK_NULL_HANDLE;
+
+	/*! One per swap chain image, the targets and depth are shared */
+	std::vector<VkFramebuffer> m_Framebuffers;
+	VkExtent2D m_Extent = {};
+
+public:
+	/*! Accumulated colour needs the range of half floats, revealage only goes down from one so eight bits will do */
+	static const VkFormat ACCUM_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+	static const VkFormat REVEAL_FORMAT = VK_FORMAT_R8_UNORM;
+	/*! Subpasses of the render pass, the shells are drawn in the first */
+	static const uint32_t SHELL_SUBPASS = 0;
+	static const uint32_t COMPOSITE_SUBPASS = 1;
+
+	OitCompositor(VulkanEngine* engine, VkDevice& device);
+
+	/*! The composite's descriptor set and pipeline layouts, they don't depend on the targets so live for the whole app */
+	void createLayout();
+	void destroyLayout();
+	VkPipelineLayout PipelineLayout() const { return m_PipelineLayout; }
+
+	/*! The render pass carries on from the frame's last pass, so the colour must be in the colour attachment layout and the
+		depth in the depth attachment layout. finalLayout is what the colour is left in for presenting or copying out */
+	void createRenderPass(VkFormat colorFormat, VkFormat depthFormat, VkImageLayout finalLayout);
+	void destroyRenderPass();
+	VkRenderPass RenderPass() const { return m_RenderPass; }
+
+	/*! Create the targets and a framebuffer for each swap chain image, sharing the depth buffer with the main pass */
+	void createTargets(VkExtent2D extent, VkImageView depthImageView, const std::vector<VkImageView>& colorImageViews);
+	void destroyTargets();
+
+	/*! Begin the render pass in the shell subpass, draw the shells in between with the weighted blend pipelines */
+	void begin(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	/*! Move on to the composite subpass, then composite with a pipeline built for it and end the pass */
+	void beginComposite(VkCommandBuffer commandBuffer);
+	void composite(VkCommandBuffer commandBuffer, VkPipeline compositePipeline);
+	void end(VkCommandBuffer commandBuffer);
+};
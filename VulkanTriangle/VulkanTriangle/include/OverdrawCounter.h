@@ -0,0 +1,74 @@
+#pragma once
+
+#include "VulkanLoader.h"
+
+#include <array>
+#include <cstdint>
+
+class VulkanEngine;
+
+/*! Overdraw Stats struct
+	Fragments shaded per pixel over a frame, only counting pixels that were drawn to
+*/
+struct OverdrawStats {
+	uint32_t pixels = 0;
+	uint32_t coveredPixels = 0;
+	uint64_t fragments = 0;
+	double mean = 0.0; //Fragments per covered pixel
+	uint32_t p50 = 0;
+	uint32_t p95 = 0;
+	uint32_t max = 0;
+
+	/*! Covered pixels in each bucket, see HISTOGRAM_BUCKETS */
+	std::array<uint32_t, 8> histogram = {};
+
+	/*! Lowest fragment count of each histogram bucket */
+	static constexpr std::array<uint32_t, 8> HISTOGRAM_BUCKETS = { 1, 2, 3, 4, 5, 9, 17, 33 };
+};
+
+/*! Overdraw Counter
+	Debug view that redraws the scene into a single channel float target with additive blending,
+	every fragment adds one so each pixel ends up holding how many times it was shaded
+*/
+class OverdrawCounter
+{
+private:
+	VulkanEngine* m_Engine;
+	VkDevice& m_Device;
+
+	VkRenderPass m_RenderPass = VK_NULL_HANDLE;
+
+	//Count target, sized to match the swap chain
+	VkImage m_Image = VK_NULL_HANDLE;
+	VkDeviceMemory m_ImageMemory = VK_NULL_HANDLE;
+	VkImageView m_ImageView = VK_NULL_HANDLE;
+	VkFramebuffer m_Framebuffer = VK_NULL_HANDLE;
+	VkExtent2D m_Extent = {};
+	bool m_HasCounts = false; //Set once a pass has been recorded into the current target
+
+public:
+	/*! Format of the count target, half floats count exactly up to 2048 and can always be blended */
+	static const VkFormat FORMAT = VK_FORMAT_R16_SFLOAT;
+
+	OverdrawCounter(VulkanEngine* engine, VkDevice& device);
+
+	/*! The render pass depends on the depth format, the pipelines are built against it */
+	void createRenderPass(VkFormat depthFormat);
+	void destroyRenderPass();
+	VkRenderPass RenderPass() const { return m_RenderPass; }
+
+	/*! Create the count target, it shares the depth buffer with the main pass */
+	void createTarget(VkExtent2D extent, VkImageView depthImageView);
+	void destroyTarget();
+
+	/*! Begin and end the overdraw render pass, draw the scene in between with the overdraw pipelines */
+	void begin(VkCommandBuffer commandBuffer);
+	void end(VkCommandBuffer commandBuffer);
+	/*! False if the target was recreated (e.g. on resize) since the last pass */
+	bool HasCounts() const { return m_HasCounts; }
+
+	/*! Copy the counts back and build the stats, waits for the copy so only call it once the frame has finished */
+	OverdrawStats readback(VkQueue& graphicsQueue, VkCommandPool& commandPool);
+
+	static void print(const OverdrawStats& stats);
+};
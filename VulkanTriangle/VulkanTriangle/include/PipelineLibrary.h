@@ -0,0 +1,134 @@
+#pragma once
+
+#include "VulkanLoader.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "ShaderLibrary.h"
+
+/*! Fur Constants struct
+	Specialisation constants for the fur shaders, the constant ids match the constant_id layouts in the GLSL
+*/
+struct FurConstants {
+	int32_t shellCount = 6; //constant_id 0, number of shells the extrusion is split over. The extrusion itself is per instance
+	VkBool32 lighting = VK_TRUE; //constant_id 2, diffuse lighting on or off
+	float furColour[3] = { 0.278f, 0.1607f, 0.0549f }; //constant_id 3-5, colour of the shells above the base mesh
+
+	bool operator==(const FurConstants& other) const;
+};
+
+/*! Pipeline Description struct
+	All the state that differs between our pipelines, used as the key when caching them
+*/
+struct PipelineDesc {
+	std::string vertShader;
+	std::string geomShader; //Leave empty for no geometry stage
+	std::string fragShader;
+	bool vertexInput = true; //False for vertex shaders that read their vertices from storage buffers
+
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	uint32_t subpass = 0;
+
+	VkBool32 depthTest = VK_TRUE;
+	VkBool32 depthWrite = VK_TRUE;
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	VkBool32 blend = VK_TRUE;
+	VkBool32 additive = VK_FALSE; //Blend by adding the colour on top instead of alpha blending
+	VkBool32 weightedBlend = VK_FALSE; //Write two targets for order independent transparency, the first added to and the second multiplied down
+
+	FurConstants constants;
+
+	bool operator==(const PipelineDesc& other) const;
+};
+
+/*! Hash for the pipeline description so it can be used as an unordered map key */
+struct PipelineDescHash {
+	size_t operator()(const PipelineDesc& desc) const;
+};
+
+/*! Pipeline Entry struct
+	A pipeline that is either ready or still being compiled, the worker swaps the handle in atomically when it finishes
+*/
+struct PipelineEntry {
+	std::atomic<VkPipeline> pipeline{ VK_NULL_HANDLE };
+	std::atomic<bool> failed{ false };
+	std::string name; //Name used in the telemetry
+	std::string error; //Set if the build failed
+	double compileMs = 0.0; //Time spent in vkCreateGraphicsPipelines
+	double waitMs = 0.0; //Time from the request until the build started
+	bool async = false; //Built on a worker thread
+
+	bool ready() const { return pipeline.load(std::memory_order_acquire) != VK_NULL_HANDLE; }
+	VkPipeline get() const { return pipeline.load(std::memory_order_acquire); }
+};
+
+/*! Pipeline Library
+	Builds each unique pipeline description once and hands out the cached pipeline after that,
+	pipelines can be built straight away or queued for the worker threads
+*/
+class PipelineLibrary
+{
+private:
+	struct Job {
+		PipelineDesc desc;
+		PipelineEntry* entry;
+		std::chrono::high_resolution_clock::time_point queued;
+	};
+
+	VkDevice& m_Device;
+	ShaderLibrary& m_Shaders;
+
+	/*! Driver side cache, lets the driver skip work shared between our variants (internally synchronised, so the workers share it) */
+	VkPipelineCache m_PipelineCache = VK_NULL_HANDLE;
+
+	std::unordered_map<PipelineDesc, std::unique_ptr<PipelineEntry>, PipelineDescHash> m_Pipelines;
+
+	//Worker threads and their job queue, the mutex guards the map, the queue and the pending count
+	std::vector<std::thread> m_Workers;
+	std::deque<Job> m_Jobs;
+	std::mutex m_Mutex;
+	std::condition_variable m_JobAdded;
+	std::condition_variable m_JobDone;
+	unsigned int m_Pending = 0;
+	bool m_Stopping = false;
+
+	VkPipeline build(const PipelineDesc& desc);
+	void buildEntry(const PipelineDesc& desc, PipelineEntry* entry);
+	void workerLoop();
+
+public:
+	PipelineLibrary(VkDevice& device, ShaderLibrary& shaders, unsigned int workerCount = 2);
+	~PipelineLibrary();
+
+	/*! Get the pipeline for a description, building it now if this is the first time it has been asked for (waits if it is queued) */
+	VkPipeline get(const PipelineDesc& desc, const std::string& name = "");
+
+	/*! Get the entry for a description, queuing it on the worker threads if this is the first time it has been asked for.
+		The entry stays valid until the library is cleared, check ready() each frame and draw a fallback until then */
+	const PipelineEntry* getAsync(const PipelineDesc& desc, const std::string& name = "");
+
+	/*! Block until all queued pipelines have been built */
+	void waitIdle();
+
+	/*! Print the compile time of every pipeline */
+	void printTelemetry();
+
+	/*! Destroy all pipelines (e.g. when the render pass is recreated), the driver cache is kept */
+	void clear();
+
+	/*! Destroy all pipelines and the driver cache, must be called before the device is destroyed */
+	void destroy();
+
+	size_t Size() { std::lock_guard<std::mutex> lock(m_Mutex); return m_Pipelines.size(); }
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*! Frame Stats struct
+	Work recorded for a single frame
+*/
+struct FrameStats {
+	size_t frame = 0;
+	uint32_t drawCalls = 0;
+	uint32_t instances = 0;
+	uint64_t triangles = 0; //Indices / 3 for every draw, so each shell pass counts again
+	uint32_t pipelineBinds = 0;
+	uint32_t descriptorSetBinds = 0;
+	uint32_t vertexBufferBinds = 0;
+	uint32_t indexBufferBinds = 0;
+	uint64_t bytesUploaded = 0; //Host writes into GPU visible memory (uniforms, staging)
+	uint32_t commandBuffers = 0; //Command buffers recorded
+	uint32_t objectsCulled = 0; //Objects outside the frustum, not updated or drawn
+	uint32_t objectsOccluded = 0; //Objects in the frustum but hidden behind others, not drawn
+};
+
+/*! Render Stats
+	Counts the work the renderer records each frame and keeps a rolling history of finished frames.
+	Counting is just adding to the current frame, so it is always on
+*/
+class RenderStats
+{
+private:
+	FrameStats m_Current;
+
+	/*! Ring buffer of finished frames, m_Next is the slot the next frame goes into */
+	std::vector<FrameStats> m_History;
+	size_t m_Next = 0;
+	size_t m_Count = 0;
+
+public:
+	RenderStats(size_t historySize = 600);
+
+	/*! Start counting a new frame, the counts of the last one are kept until endFrame */
+	void beginFrame(size_t frame);
+	/*! Add the current frame to the history */
+	void endFrame();
+
+	void draw(uint32_t indexCount, uint32_t instanceCount = 1) { m_Current.drawCalls++; m_Current.instances += instanceCount; m_Current.triangles += static_cast<uint64_t>(indexCount / 3) * instanceCount; }
+	/*! Draws written by the GPU, only the GPU knows their instances and indices */
+	void indirectDraw(uint32_t drawCount = 1) { m_Current.drawCalls += drawCount; }
+	void pipelineBind() { m_Current.pipelineBinds++; }
+	void descriptorSetBind(uint32_t count = 1) { m_Current.descriptorSetBinds += count; }
+	void vertexBufferBind(uint32_t count = 1) { m_Current.vertexBufferBinds += count; }
+	void indexBufferBind() { m_Current.indexBufferBinds++; }
+	void upload(uint64_t bytes) { m_Current.bytesUploaded += bytes; }
+	void commandBufferRecorded() { m_Current.commandBuffers++; }
+	void culled(uint32_t count) { m_Current.objectsCulled += count; }
+	void occluded(uint32_t count) { m_Current.objectsOccluded += count; }
+
+	/*! Counts so far for the frame being recorded */
+	FrameStats& Current() { return m_Current; }
+	/*! Most recent finished frame, null if there hasn't been one yet */
+	const FrameStats* Latest() const;
+	/*! Finished frames oldest first, at most the history size */
+	std::vector<FrameStats> History() const;
+
+	/*! Write the history out, as CSV if the filename ends in .csv and as a text table with averages otherwise */
+	void dump(const std::string& filename) const;
+};
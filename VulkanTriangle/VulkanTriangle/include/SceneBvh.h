@@ -0,0 +1,93 @@
+#pragma once
+
+#include "FrustumCuller.h"
+
+#include <GLM/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+/*! Scene BVH
+	Dynamic bounding volume hierarchy over object boxes, for queries that would otherwise walk every object.
+	Leaves hold a box grown by a margin, so an object moving a little stays inside its leaf and nothing changes.
+	When it does leave, the leaf is taken out and put back where it adds the least surface area, and the tree is
+	rebalanced on the way up with rotations.
+	The nodes are kept in one array: the box and children that traversal reads are 32 bytes, two to a cache line,
+	with the parent and height that only edits need in a separate array
+*/
+class SceneBvh
+{
+public:
+	static const int32_t NULL_NODE = -1;
+
+	/*! Ray Hit struct
+		Closest object box a ray hits
+	*/
+	struct RayHit {
+		uint32_t object = 0;
+		float distance = 0.0f;
+	};
+
+	/*! Margin as a fraction of a box's size, added on every side of the leaves */
+	SceneBvh(float margin = 0.1f);
+
+	/*! Add an object, returns the proxy used to move or remove it */
+	int32_t insert(const Bounds& bounds, uint32_t object);
+	/*! Update a moved object's box, returns true if it had left its leaf and was reinserted */
+	bool move(int32_t proxy, const Bounds& bounds);
+	void remove(int32_t proxy);
+	void clear();
+
+	/*! Add the objects whose leaf boxes are inside or touching the frustum. Subtrees entirely inside are added without testing their leaves */
+	void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& objects) const;
+	/*! Closest leaf box along the ray within maxDistance, direction doesn't need to be normalised (distance is in its units) */
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const;
+
+	/*! Number of objects in the tree */
+	size_t Size() const { return m_LeafCount; }
+	int32_t Height() const;
+	/*! Sum of the node surface areas over the root's, lower is a better tree */
+	float AreaRatio() const;
+
+private:
+	/*! Node struct
+		Child1 is NULL_NODE for leaves, which keep the object in child2
+	*/
+	struct Node {
+		glm::vec3 min;
+		int32_t child1;
+		glm::vec3 max;
+		int32_t child2;
+
+		bool IsLeaf() const { return child1 == NULL_NODE; }
+	};
+
+	/*! Node Link struct
+		Parent (or the next free node) and height (-1 when free), only used when the tree changes
+	*/
+	struct NodeLink {
+		int32_t parent;
+		int32_t height;
+	};
+
+	std::vector<Node> m_Nodes;
+	std::vector<NodeLink> m_Links;
+	int32_t m_Root = NULL_NODE;
+	int32_t m_FreeList = NULL_NODE;
+	size_t m_LeafCount = 0;
+	float m_Margin;
+
+	int32_t allocateNode();
+	void freeNode(int32_t node);
+
+	void insertLeaf(int32_t leaf);
+	void removeLeaf(int32_t leaf);
+	/*! Rotate the grandchildren up if one side of the node is more than one taller, returns the node now in its place */
+	int32_t balance(int32_t node);
+	/*! Refit the boxes and heights from a node up to the root, balancing as it goes */
+	void refitUp(int32_t node);
+
+	void setChildren(int32_t node, int32_t child1, int32_t child2);
+	/*! Box around both children */
+	void fit(int32_t node);
+};
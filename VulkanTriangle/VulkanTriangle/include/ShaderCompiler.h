@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*! Shader optimisation levels, run through spirv-opt before the SPIR-V is cached */
+enum class ShaderOptimisation {
+	None,
+	Size, //spirv-opt -Os
+	Performance //spirv-opt -O
+};
+
+/*! Shader Source struct
+	A GLSL file to compile, with the pre-built SPIR-V to fall back to when no compiler is installed.
+	The pre-built file has a .hash stamp next to it with the SourceHash it was built from
+*/
+struct ShaderSource {
+	std::string path;
+	std::string fallbackSpv;
+	std::vector<std::string> defines; //NAME or NAME=VALUE, passed to the compiler as -D
+};
+
+/*! Shader Compiler
+	Compiles GLSL to SPIR-V at load time using the glslangValidator (and spirv-opt) from the Vulkan SDK.
+	The output is cached on disk, keyed by a hash of the source, its includes, the defines and the options,
+	so a cache hit skips the compiler entirely. Returns paths so the shader library can map the result
+*/
+class ShaderCompiler
+{
+private:
+	std::string m_CacheDir;
+	ShaderOptimisation m_Optimisation;
+
+	//Tools found on start up, empty if not installed
+	std::string m_Validator;
+	std::string m_Optimiser;
+
+	/*! SPIR-V path for each source and define set already resolved this run */
+	std::unordered_map<std::string, std::string> m_Resolved;
+	std::mutex m_Mutex;
+
+	unsigned int m_CacheHits = 0;
+	unsigned int m_Compiled = 0;
+	unsigned int m_Fallbacks = 0;
+
+	std::string findTool(const std::string& name);
+	uint64_t hashSource(const ShaderSource& source);
+	static void hashFile(const std::string& path, uint64_t& hash, std::vector<std::string>& visited);
+	void compile(const ShaderSource& source, const std::string& output);
+	int run(const std::string& command);
+
+public:
+	ShaderCompiler(const std::string& cacheDir = "shaders/cache", ShaderOptimisation optimisation = ShaderOptimisation::Performance);
+
+	/*! Get the SPIR-V path for a GLSL source, compiling it if the cache doesn't have this exact source, define and option set */
+	std::string get(const ShaderSource& source);
+
+	/*! True if glslangValidator was found, otherwise the pre-built SPIR-V is used */
+	bool Available() const { return !m_Validator.empty(); }
+
+	/*! Compile a source into its pre-built SPIR-V and write the stamp, throws if glslangValidator wasn't found */
+	void build(const ShaderSource& source);
+
+	/*! Hash of the source, its includes and defines, but not the tools or options, what a pre-built file's stamp holds */
+	static uint64_t SourceHash(const ShaderSource& source);
+	/*! The pre-built SPIR-V for a source. Throws if the stamp is missing or doesn't match the source, unless there is no source to check */
+	static std::string Prebuilt(const ShaderSource& source);
+
+	/*! Print the cache hit, compile and fallback counts */
+	void printStats();
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "VulkanLoader.h"
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/*! Shader Library
+	Loads SPIR-V files by memory mapping them and creates each shader module once,
+	modules are shared between every pipeline that uses them until the library is cleared
+*/
+class ShaderLibrary
+{
+private:
+	VkDevice& m_Device;
+
+	/*! Shader modules keyed by the file they were loaded from */
+	std::unordered_map<std::string, VkShaderModule> m_Modules;
+	/*! Guards the modules, pipelines can be built on worker threads */
+	std::mutex m_Mutex;
+
+	VkShaderModule createShaderModule(const void* code, size_t size, const std::string& filename);
+
+public:
+	ShaderLibrary(VkDevice& device);
+	~ShaderLibrary();
+
+	/*! Get the shader module for a SPIR-V file, loading and creating it on first use */
+	VkShaderModule get(const std::string& filename);
+
+	/*! Destroy all the shader modules, must be called before the device is destroyed */
+	void clear();
+
+	size_t Size() { std::lock_guard<std::mutex> lock(m_Mutex); return m_Modules.size(); }
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <GLM/glm.hpp>
+#include <GLM/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <vector>
+
+/*! Transform Store
+	Position, rotation and scale of every transform kept as structure of arrays, with a parent for each so transforms can
+	be nested. Setting a part marks the transform dirty, update then rebuilds only the dirty local matrices, 8 (AVX) or
+	4 (SSE) at a time, and the world matrices of them and everything under them. The rest are left alone, so the cost
+	follows what moved rather than the size of the scene.
+	Transforms are only ever added after their parent, so walking them in index order always reaches a parent first
+*/
+class TransformStore
+{
+private:
+	/*! Local parts split per component */
+	std::vector<float> m_PositionX, m_PositionY, m_PositionZ;
+	std::vector<float> m_RotationX, m_RotationY, m_RotationZ, m_RotationW;
+	std::vector<float> m_ScaleX, m_ScaleY, m_ScaleZ;
+
+	/*! Hierarchy, children are kept as a linked list through their first child and next sibling */
+	std::vector<uint32_t> m_Parent;
+	std::vector<uint32_t> m_FirstChild;
+	std::vector<uint32_t> m_NextSibling;
+
+	std::vector<glm::mat4> m_Local;
+	std::vector<glm::mat4> m_World;
+
+	/*! Transforms set since the last update, and the flags that keep each in the list once */
+	std::vector<uint32_t> m_Dirty;
+	std::vector<uint8_t> m_DirtyFlags;
+	/*! Transforms whose world matrix the last update changed, in index order */
+	std::vector<uint32_t> m_Changed;
+	std::vector<uint8_t> m_ChangedFlags;
+
+	void markDirty(uint32_t index);
+	/*! Rebuild the local matrices of a list of transforms from their parts */
+	void composeLocals(const uint32_t* indices, size_t count, bool simd);
+
+public:
+	/*! No parent, or the end of a list of children */
+	static constexpr uint32_t INVALID = UINT32_MAX;
+
+	/*! Name of the SIMD instructions compiled in, "scalar" if there are none */
+	static const char* SimdName();
+	/*! Matrix that takes normals into world space. Without scaling, or scaled the same on every axis, it is the rotation scaled
+		down and the inverse is skipped. A scale of zero has no inverse, it gives the cofactors instead so the normals stay finite */
+	static glm::mat3 NormalMatrix(const glm::mat4& world);
+
+	/*! Add an identity transform under a parent that already exists, returns its index */
+	uint32_t create(uint32_t parent = INVALID);
+	void clear();
+	size_t Size() const { return m_Parent.size(); }
+
+	void setPosition(uint32_t index, const glm::vec3& position);
+	void setRotation(uint32_t index, const glm::quat& rotation);
+	void setScale(uint32_t index, const glm::vec3& scale);
+
+	glm::vec3 Position(uint32_t index) const { return glm::vec3(m_PositionX[index], m_PositionY[index], m_PositionZ[index]); }
+	uint32_t Parent(uint32_t index) const { return m_Parent[index]; }
+
+	/*! Bring the world matrices of everything set since the last update, and everything under it, up to date.
+		simd false composes one at a time, for comparison */
+	void update(bool simd = true);
+
+	/*! World matrix as of the last update */
+	const glm::mat4& World(uint32_t index) const { return m_World[index]; }
+	/*! Transforms whose world matrix changed in the last update, in index order */
+	const std::vector<uint32_t>& Changed() const { return m_Changed; }
+};
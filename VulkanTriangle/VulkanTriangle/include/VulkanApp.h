@@ -1,8 +1,7 @@
 #pragma once
 
 
-#define GLFW_INCLUDE_VULKAN
-#include <glfw3.h>
+#include "VulkanLoader.h"
 
 #include <GLM/glm.hpp>
 #include <GLM/gtc/matrix_transform.hpp>
@@ -15,35 +14,37 @@
 #include <vector>
 #include <cstring>
 #include <cstdlib>
+#include <cmath>
 #include <array>
 #include <optional>
 #include <set>
 
+#include "AppSettings.h"
+#include "CpuProfiler.h"
 #include "GLFW_Window.h"
 #include "VulkanObject.h"
 #include "VulkanEngine.h"
+#include "ShaderLibrary.h"
+#include "ShaderCompiler.h"
+#include "PipelineLibrary.h"
+#include "RenderStats.h"
+#include "GpuProfiler.h"
+#include "MemoryTracker.h"
+#include "Benchmark.h"
+#include "Microbench.h"
+#include "FrustumCuller.h"
+#include "SceneBvh.h"
+#include "TransformStore.h"
+#include "InstanceBuffers.h"
+#include "GpuCuller.h"
+#include "FinGenerator.h"
+#include "DepthPyramid.h"
+#include "OverdrawCounter.h"
+#include "OitCompositor.h"
+#include "FrameComparison.h"
 
 
 
-/*! Uniform Buffer Object struct
-	Holds the model, view and projection matrix
-*/
-struct UniformBufferObject {
-	glm::mat4 model;
-	glm::mat4 view;
-	glm::mat4 proj;
-	int layer;
-};
-/*! Uniform Buffer Object for the Geometry stage struct
-	Holds the model, view and projection matrix
-*/
-struct GeomUniformBufferObject {
-	glm::mat4 model;
-	glm::mat4 proj;
-	glm::mat4 view;
-	glm::vec2 viewportDim;
-};
-
 /*! Vulkan App
 	Handling all vulkan code for displaying a simple pyrimid 
 */
@@ -73,35 +74,41 @@ private:
 	};
 
 	/*! The GLFW Window used for drawing and call backs*/
-	GLFW_Window *window;
+	GLFW_Window *window = nullptr;
 	/*! Vulkan instance for accessing the vulkan api with the correct settings */
 	VkInstance instance;
 	/*! Vulkan Debug Messenger for printing out errors from he validation layers */
 	VkDebugUtilsMessengerEXT debugMessenger;
 	/*! The physical device (gpu) used for rendering */
-	VkPhysicalDevice physicalDevice;
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
 	/*! The logical device for interfacing with the physical hardware */
 	VkDevice device;
 	/*! The graphics queue used for rending a single object with the provided vertex and fragment shaders */
 	VkQueue graphicsQueue;
 
 	/*! The vulkan surface we can render too */
-	VkSurfaceKHR surface;
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
 	/*! Handle for accessing the presentation queue */
 	VkQueue presentQueue;
 
 	/*! The swap chain that stores the framebuffers we will render too */
-	VkSwapchainKHR swapChain;
+	VkSwapchainKHR swapChain = VK_NULL_HANDLE;
 	std::vector<VkImage> swapChainImages; //Vector of each image we will render
 	VkFormat swapChainImageFormat; //Image formatting
 	VkExtent2D swapChainExtent; //Resolution
 	std::vector<VkImageView> swapChainImageViews; //Descriptors as to how to view the images in the swap chain
 	std::vector<VkFramebuffer> swapChainFramebuffers; //The frame buffer objects for displaying the images
+	std::vector<VkDeviceMemory> m_OffscreenMemory; //Memory for the images when headless (there is no swap chain to own them)
 
 	
-	/*! Shader modules for the Vertex and Fragment stages */
-	VkShaderModule vertShaderModule;
-	VkShaderModule fragShaderModule;
+	/*! Shader modules, loaded once and shared between all the pipelines */
+	ShaderLibrary* m_Shaders;
+	/*! GLSL to SPIR-V compiler with an on disk cache, null when using the pre-built SPIR-V */
+	ShaderCompiler* m_Compiler = nullptr;
+	/*! Pipeline variants, each unique description is built once */
+	PipelineLibrary* m_Pipelines;
+	/*! Fur settings baked into the pipelines as specialisation constants */
+	FurConstants m_FurConstants;
 
 
 	/*! The standard validation layer */
@@ -114,32 +121,96 @@ private:
 	};
 
 	/*! The render pass contain the information about the frame buffer attachments we use while rendering*/
-	VkRenderPass renderPass;
-	VkPipelineLayout pipelineLayout; //The pipeline layout
-	VkPipelineLayout pipelineLayoutGeom;
-
-	/*! Graphics pipeline that contains the sequence of opertations used to render vertex information to the screen */
-	VkPipeline graphicsPipeline; 
-	VkPipeline graphicsPipelineNoDepth;
-	VkPipeline graphicsPipelineGeom;
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	/*! Carries on drawing into the same targets after the depth pyramid is built, only with occlusion culling */
+	VkRenderPass m_LateRenderPass = VK_NULL_HANDLE;
+	VkPipelineLayout pipelineLayout; //The pipeline layout, shared by every graphics pipeline
+
+	/*! Graphics pipelines that contain the sequence of opertations used to render vertex information to the screen (owned by the pipeline library) */
+	VkPipeline graphicsPipeline; //Base mesh, depth writes on
+	const PipelineEntry* m_ShellPipeline; //Shells, depth writes off, or into the transparency targets with OIT (compiled in the background)
+	const PipelineEntry* m_FinPipeline; //Fins from the geometry shader (compiled in the background)
+	const PipelineEntry* m_LateFinPipeline = nullptr; //Depth tested fins for the late pass, so they stay behind what was drawn early
+	bool m_FullPipelinesReady = false;
+
+	/*! Counts fragments per pixel by redrawing the scene with additive pipelines, null unless overdraw is being measured */
+	OverdrawCounter* m_Overdraw = nullptr;
+	VkPipeline m_OverdrawFinPipeline = VK_NULL_HANDLE;
+	VkPipeline m_OverdrawBasePipeline = VK_NULL_HANDLE;
+	VkPipeline m_OverdrawShellPipeline = VK_NULL_HANDLE;
+
+	/*! Blends the shells order independently and composites them after the rest of the frame, null unless OIT is on */
+	OitCompositor* m_Oit = nullptr;
+	VkPipeline m_OitCompositePipeline = VK_NULL_HANDLE;
+
+	/*! Camera, instances and visible lists every draw reads, for each frame in flight */
+	InstanceBuffers* m_InstanceBuffers = nullptr;
+	/*! Culls in a compute pass and writes the visible lists and indirect draws, null unless GPU culling is on */
+	GpuCuller* m_GpuCuller = nullptr;
+	/*! Draws one vkCmdDrawIndexedIndirect can issue, 1 without the multiDrawIndirect feature */
+	uint32_t m_MaxDrawIndirectCount = 1;
+	/*! Farthest depth pyramid of the early pass, null unless occlusion culling is on */
+	DepthPyramid* m_DepthPyramid = nullptr;
+	/*! Adds fins on the silhouette edges in a compute pass, null when the geometry shader builds them */
+	FinGenerator* m_FinGenerator = nullptr;
 
 	/*! The command pool that holds all the command buffers we will use for each frame */
 	VkCommandPool commandPool;
-	std::vector<VkCommandBuffer> commandBuffers; //List of the command buffers, each containing the infomation of the commands to be carried out each frame (e.g. drawing, memory transfer etc)
+	std::vector<VkCommandBuffer> commandBuffers; //List of the command buffers (one per frame in flight), each containing the infomation of the commands to be carried out each frame (e.g. drawing, memory transfer etc)
 	std::vector<VkFence> inFlightFences; //Fences used to halt the command buffers from executing until the previos frame has completed
+	std::vector<VkFence> imagesInFlight; //The fence of the frame currently using each swap chain image
 	std::vector<VkSemaphore> imageAvailableSemaphores; //List of semaphores to signel if an image is available to render too (GPU Syncing)
 	std::vector<VkSemaphore> renderFinishedSemaphores; //List of semaphores to signel when the image is finished and can be presented (GPU Syncing)
 
 	//Number of frames we can have being held at one time
 	const int MAX_FRAMES_IN_FLIGHT = 2;
 	size_t currentFrame = 0;
+	size_t m_FrameCount = 0;
+	double m_SceneTime = 0.0; //Seconds of animation for the frame being drawn
+	float m_CameraDistance = 0.2f;
+
+	/*! World bounds of every instance, tested against the camera each frame */
+	FrustumCuller m_Culler;
+	/*! Instances that passed culling this frame, only these are written to the instance buffers and drawn */
+	std::vector<uint32_t> m_VisibleInstances;
+	/*! Tree over the instances' bounds, culled against instead of m_Culler with --bvh. Updated when an instance moves */
+	SceneBvh m_SceneIndex;
+	std::vector<int32_t> m_InstanceProxies;
+
+	/*! Every instance's transform, under a root for the whole scene */
+	TransformStore m_Transforms;
+	uint32_t m_SceneRoot = 0;
+	/*! Instance each transform places, or TransformStore::INVALID for those that only group others */
+	std::vector<uint32_t> m_TransformInstances;
+	/*! Transforms turned each frame, the rest are only set when placed */
+	std::vector<uint32_t> m_SpinningTransforms;
+	/*! Instances whose world matrix changed this frame */
+	std::vector<uint32_t> m_MovedInstances;
+
+	/*! Each object's visible instances in this frame's visible list, when the CPU culls */
+	struct ObjectDraw {
+		uint32_t firstVisible = 0;
+		uint32_t count = 0;
+	};
+	std::vector<ObjectDraw> m_ObjectDraws;
+
+	/*! Device memory accounting, every allocation made through m_Engine is tracked */
+	MemoryTracker* m_Memory = nullptr;
+	bool m_HasProperties2 = false; //VK_KHR_get_physical_device_properties2 enabled on the instance
+	bool m_HasMemoryBudget = false; //VK_EXT_memory_budget enabled on the device
+
+	/*! Per frame GPU timings */
+	GpuProfiler* m_GpuProfiler;
+	/*! Collects the frame timings during a benchmark run, null otherwise */
+	Benchmark* m_Benchmark = nullptr;
+	std::chrono::high_resolution_clock::time_point m_StartTime = std::chrono::high_resolution_clock::now();
 
 	
-	//Disable validation layers in release mode
+	//Disable validation layers in release mode (and with the mock backend, which has no layers)
 	#ifdef NDEBUG
-		const bool enableValidationLayers = false;
+		bool enableValidationLayers = false;
 	#else
-		const bool enableValidationLayers = true;
+		bool enableValidationLayers = true;
 	#endif
 
 	//Custom Stuff
@@ -147,26 +218,81 @@ private:
 		VulkanEngine* m_Engine;
 
 
+	/*! Run options passed in from the command line */
+	AppSettings m_Settings;
+
+	/*! Draws, binds and uploads counted each frame, with a rolling history */
+	RenderStats m_RenderStats;
+
+	/*! Time taken by each swap chain recreation in milliseconds, used to track resize hitches */
+	std::vector<double> m_RecreateTimes;
+
 public:
-	VulkanApp() {};
+	VulkanApp(const AppSettings& settings) : m_Settings(settings), m_RenderStats(settings.statsHistory) {};
 	void run() {
-		initWindow();
+		//Building the pre-built shaders needs no window or device
+		if (m_Settings.buildShaders) {
+			buildShaders();
+			return;
+		}
+
+		CpuProfiler::setEnabled(!m_Settings.cpuTracePath.empty());
+		PROFILE_THREAD_NAME("main");
+
+		if (!m_Settings.headless) {
+			initWindow();
+		}
 		initVulkan();
-		mainLoop();
+		//Only count the calls made while rendering
+		if (VulkanLoader::Mocked()) {
+			VulkanLoader::resetMockStats();
+		}
+		if (m_Settings.microbenchRepetitions > 0) {
+			microbenchLoop();
+		}
+		else if (m_Settings.benchmark) {
+			benchmarkLoop();
+		}
+		else if (m_Settings.headless) {
+			headlessLoop();
+		}
+		else {
+			if (m_Settings.resizeStormCount > 0) {
+				runResizeStorm(m_Settings.resizeStormCount);
+			}
+			mainLoop();
+		}
+		if (VulkanLoader::Mocked() && m_FrameCount > 0) {
+			VulkanLoader::printMockStats(m_FrameCount, m_Instances.size());
+		}
 		cleanup();
+
+		if (!m_Settings.statsOutput.empty()) {
+			m_RenderStats.dump(m_Settings.statsOutput);
+		}
+		//Written after cleanup so the pipeline workers have finished
+		if (CpuProfiler::Enabled()) {
+			CpuProfiler::writeChromeTrace(m_Settings.cpuTracePath);
+		}
 	}
 
 	bool framebufferResized = false;
+	bool statsDumpRequested = false;
 
 private:
 	const void initWindow();	
 	const void initVulkan();
 	const void mainLoop();
+	void headlessLoop();
+	void benchmarkLoop();
+	void microbenchLoop();
+	void buildShaders();
 	const void cleanup();
 
 	const void createInstance();
 	bool checkValidationLayerSupport();
 	std::vector<const char*> getRequiredExtensions();
+	std::vector<const char*> getRequiredDeviceExtensions();
 	static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
 		VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
 		VkDebugUtilsMessageTypeFlagsEXT messageType,
@@ -191,17 +317,24 @@ private:
 	void createSurface();
 
 	bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+	bool instanceExtensionSupported(const char* name);
+	bool deviceExtensionSupported(VkPhysicalDevice device, const char* name);
 
 	SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 	VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
 	VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR> availablePresentModes);
 	VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
 	void createSwapChain();
+	void createOffscreenImages();
 
 	void createImageViews();
 
-	void createGraphicsPipeline(VkBool32 depthOn);
-	VkShaderModule createShaderModule(const std::vector<char>& code);
+	void createPipelineLayouts();
+	void createGraphicsPipelines();
+	PipelineDesc shellPipelineDesc(VkBool32 depthWrite);
+	PipelineDesc oitShellPipelineDesc();
+	PipelineDesc finPipelineDesc(VkBool32 depthTest);
+	std::string shaderPath(const ShaderSource& source);
 
 	void createRenderPass();
 
@@ -209,33 +342,55 @@ private:
 
 	void createCommandPool();
 	void createCommandBuffers();
+	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	void drawScene(VkCommandBuffer commandBuffer, VkPipeline finPipeline, VkPipeline basePipeline, VkPipeline shellPipeline, bool profilePhases, CullPass pass);
+	/*! Draw every object's shells for a pass in one bind, on their own inside the transparency pass or as the last phase of drawScene */
+	void drawShells(VkCommandBuffer commandBuffer, VkPipeline shellPipeline, bool profilePhases, CullPass pass);
+	/*! Draw a phase for a run of objects, each object's visible instances in one instanced draw (or from the draws a culling pass wrote) */
+	void drawInstances(VkCommandBuffer commandBuffer, DrawPhase phase, CullPass pass, uint32_t firstObject, uint32_t objectCount);
+	/*! Instances each shell draw has per visible instance, one for each pass past the base mesh */
+	uint32_t shellsPerInstance() const;
+	bool overdrawFrame() const;
 
 	void drawFrame();
+	void drawFrameHeadless();
+	void endFrame();
+	void updateSceneTime();
+	/*! Animate the spinning instances and bring the world matrices up to date, then pass the instances that moved on to the culling and the instance buffers */
+	void updateTransforms();
+	void cullObjects();
+	/*! Write the camera and the instances that changed since the slot was last drawn, and the visible lists when the CPU culls */
+	void updateInstances(uint32_t slot);
+	void collectGpuTime(uint32_t slot);
+	/*! Copy the image out to a .ppm, returns its pixels as tightly packed RGB */
+	std::vector<unsigned char> readbackImage(VkImage image, const std::string& filename);
 
 	void createSyncObjects();
 
 	void recreateSwapChain();
 	void cleanupSwapChain();
+	void cleanupPipelines();
+
+	void runResizeStorm(unsigned int count);
+	void printRecreateTimes();
 
 	
 
-	//Uniform layouts
+	//Uniform layout
 	VkDescriptorSetLayout descriptorSetLayout;
-	VkDescriptorSetLayout descriptorSetLayoutGeom;
 	void createDescriptorSetLayout();
 
-	std::vector<VkBuffer> uniformBuffers;
-	std::vector<VkDeviceMemory> uniformBuffersMemory;
+	/*! World matrix as of the last transform update */
+	glm::mat4 modelMatrix(unsigned int instanceIndex) const;
+	/*! World bounds that hold for any rotation about the instance's origin, so spinning doesn't change the tree */
+	Bounds sceneBounds(unsigned int instanceIndex) const;
+	glm::mat4 viewMatrix() const;
+	glm::mat4 projectionMatrix() const;
 
-	std::vector<VkBuffer> geomUniformBuffers;
-	std::vector<VkDeviceMemory> geomUniformBuffersMemory;
-
-	void createUniformBuffers();
-	void updateUniformBuffer(uint32_t currentImage, unsigned int objectIndex, unsigned int pass);
-
-	VkDescriptorPool descriptorPool;
+	/*! Sets for each frame in flight, one for the fins, one for the shells and one per object for the base meshes. Only the texture differs */
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
 	std::vector<VkDescriptorSet> descriptorSets;
-	std::vector<VkDescriptorSet> descriptorSetsGeom;
+	size_t descriptorSetIndex(uint32_t frame, DrawPhase phase, uint32_t object) const;
 
 	void createDescriptorPool();
 	void createDescriptorSets();
@@ -251,7 +406,17 @@ private:
 
 	//Custom
 
+	/*! Loaded meshes and textures, each is drawn once per phase for all of its instances */
 	std::vector<VulkanObject*> m_Objects;
+	/*! Where the objects are placed and their fur */
+	std::vector<FurInstance> m_Instances;
+	/*! Index of the object with the model and texture, loading it the first time */
+	uint32_t loadObject(const char* modelPath, const char* texturePath);
+	/*! Every object's mesh lives in its vertex and index buffers, bound once per frame */
+	GeometryArena* m_Geometry = nullptr;
+	//Starting size of the arena, in vertices and indices. A few bunnies' worth, it doubles from there
+	const uint32_t GEOMETRY_VERTEX_CAPACITY = 1 << 16;
+	const uint32_t GEOMETRY_INDEX_CAPACITY = 1 << 18;
 
 	//Textures
 	VkImage furTextureImage;
@@ -264,7 +429,5 @@ private:
 	VkImageView finTextureImageView;
 	VkSampler finTextureSampler;
 
-	VkViewport viewport;
-
 
 };
\ No newline at end of file
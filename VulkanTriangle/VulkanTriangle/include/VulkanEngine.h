@@ -1,7 +1,6 @@
 #pragma once
 
-#define GLFW_INCLUDE_VULKAN
-#include <glfw3.h>
+#include "VulkanLoader.h"
 
 #include <cstdlib>
 #include <stdexcept>
@@ -11,6 +10,7 @@
 #include <GLM/glm.hpp>
 #include <GLM/gtc/matrix_transform.hpp>
 #include "VulkanObject.h"
+#include "MemoryTracker.h"
 #include <random>
 
 class VulkanEngine
@@ -19,19 +19,21 @@ class VulkanEngine
 private:
 	VkPhysicalDevice& m_PhyDevice;
 	VkDevice& m_Device;
+	MemoryTracker* m_Memory = nullptr; //Accounts for every allocation made below, null until the device is created
 public: 
 	VulkanEngine(VkPhysicalDevice& phyDevice, VkDevice& device);
+	void setMemoryTracker(MemoryTracker* tracker) { m_Memory = tracker; }
 	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+	/*! Allocate device memory tagged with what it is for and who owns it, free it with freeMemory */
+	void allocateMemory(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, VkDeviceMemory& memory, MemoryCategory category, const std::string& owner);
+	void freeMemory(VkDeviceMemory memory);
 	VkCommandBuffer beginSingleTimeCommands(VkCommandPool& comPool);
 	void endSingleTimeCommands(VkQueue& graphicsQueue, VkCommandPool& comPool, VkCommandBuffer commandBuffer);
-	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory, MemoryCategory category, const std::string& owner);
 	void copyBuffer(VkQueue& graphicsQueue, VkCommandPool& comPool, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
 
-	void createVertexBuffer(VkQueue& graphicsQueue, VkCommandPool& comPool, VulkanObject* object);
-	void createIndexBuffer(VkQueue& graphicsQueue, VkCommandPool& comPool, VulkanObject* object);
-
 	//Textures
-	void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
+	void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory, MemoryCategory category, const std::string& owner);
 	void createTextureImage(VkQueue& graphicsQueue, VkCommandPool& comPool, VkImage& textureImage, VkDeviceMemory& textureImageMemory, const char* texturePath);
 	void createNoiseTextureImage(VkQueue& graphicsQueue, VkCommandPool& comPool, VkImage& textureImage, VkDeviceMemory& textureImageMemory, float distribution);
 	void transitionImageLayout(VkQueue& graphicsQueue, VkCommandPool& comPool, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
@@ -0,0 +1,167 @@
+#pragma once
+
+//Vulkan functions are pointers loaded at run time (see VulkanLoader), so the prototypes from the headers are not used
+#ifndef VK_NO_PROTOTYPES
+#define VK_NO_PROTOTYPES
+#endif
+#define GLFW_INCLUDE_VULKAN
+#include <glfw3.h>
+
+#include <cstdint>
+
+/*! Function lists
+	Every Vulkan function the app calls, X is applied to each name. A function that is missing from these won't compile.
+	Global functions are loaded with a null instance and instance functions once the instance has been created.
+	Device functions are loaded from the device with vkGetDeviceProcAddr, so calls go straight to the driver
+	instead of through the loader's trampolines. Extension functions are null when their extension isn't enabled
+*/
+#define VULKAN_GLOBAL_FUNCTIONS(X) \
+	X(vkCreateInstance) \
+	X(vkEnumerateInstanceExtensionProperties) \
+	X(vkEnumerateInstanceLayerProperties)
+
+#define VULKAN_INSTANCE_FUNCTIONS(X) \
+	X(vkDestroyInstance) \
+	X(vkEnumeratePhysicalDevices) \
+	X(vkEnumerateDeviceExtensionProperties) \
+	X(vkGetPhysicalDeviceFeatures) \
+	X(vkGetPhysicalDeviceFormatProperties) \
+	X(vkGetPhysicalDeviceMemoryProperties) \
+	X(vkGetPhysicalDeviceProperties) \
+	X(vkGetPhysicalDeviceQueueFamilyProperties) \
+	X(vkGetPhysicalDeviceSurfaceCapabilitiesKHR) \
+	X(vkGetPhysicalDeviceSurfaceFormatsKHR) \
+	X(vkGetPhysicalDeviceSurfacePresentModesKHR) \
+	X(vkGetPhysicalDeviceSurfaceSupportKHR) \
+	X(vkDestroySurfaceKHR) \
+	X(vkCreateDevice) \
+	X(vkGetDeviceProcAddr)
+
+#define VULKAN_INSTANCE_EXTENSION_FUNCTIONS(X) \
+	X(vkCreateDebugUtilsMessengerEXT) \
+	X(vkDestroyDebugUtilsMessengerEXT) \
+	X(vkGetPhysicalDeviceMemoryProperties2KHR)
+
+#define VULKAN_DEVICE_FUNCTIONS(X) \
+	X(vkDestroyDevice) \
+	X(vkDeviceWaitIdle) \
+	X(vkGetDeviceQueue) \
+	X(vkQueueSubmit) \
+	X(vkQueueWaitIdle) \
+	X(vkAllocateMemory) \
+	X(vkFreeMemory) \
+	X(vkMapMemory) \
+	X(vkUnmapMemory) \
+	X(vkBindBufferMemory) \
+	X(vkBindImageMemory) \
+	X(vkGetBufferMemoryRequirements) \
+	X(vkGetImageMemoryRequirements) \
+	X(vkCreateBuffer) \
+	X(vkDestroyBuffer) \
+	X(vkCreateImage) \
+	X(vkDestroyImage) \
+	X(vkCreateImageView) \
+	X(vkDestroyImageView) \
+	X(vkCreateSampler) \
+	X(vkDestroySampler) \
+	X(vkCreateFence) \
+	X(vkDestroyFence) \
+	X(vkResetFences) \
+	X(vkWaitForFences) \
+	X(vkCreateSemaphore) \
+	X(vkDestroySemaphore) \
+	X(vkCreateQueryPool) \
+	X(vkDestroyQueryPool) \
+	X(vkGetQueryPoolResults) \
+	X(vkCreateRenderPass) \
+	X(vkDestroyRenderPass) \
+	X(vkCreateFramebuffer) \
+	X(vkDestroyFramebuffer) \
+	X(vkCreateShaderModule) \
+	X(vkDestroyShaderModule) \
+	X(vkCreatePipelineCache) \
+	X(vkDestroyPipelineCache) \
+	X(vkCreatePipelineLayout) \
+	X(vkDestroyPipelineLayout) \
+	X(vkCreateGraphicsPipelines) \
+	X(vkCreateComputePipelines) \
+	X(vkDestroyPipeline) \
+	X(vkCreateDescriptorSetLayout) \
+	X(vkDestroyDescriptorSetLayout) \
+	X(vkCreateDescriptorPool) \
+	X(vkDestroyDescriptorPool) \
+	X(vkAllocateDescriptorSets) \
+	X(vkUpdateDescriptorSets) \
+	X(vkCreateCommandPool) \
+	X(vkDestroyCommandPool) \
+	X(vkAllocateCommandBuffers) \
+	X(vkFreeCommandBuffers) \
+	X(vkBeginCommandBuffer) \
+	X(vkEndCommandBuffer) \
+	X(vkCmdBeginRenderPass) \
+	X(vkCmdNextSubpass) \
+	X(vkCmdEndRenderPass) \
+	X(vkCmdBindPipeline) \
+	X(vkCmdBindDescriptorSets) \
+	X(vkCmdBindVertexBuffers) \
+	X(vkCmdBindIndexBuffer) \
+	X(vkCmdDraw) \
+	X(vkCmdDrawIndexed) \
+	X(vkCmdDrawIndexedIndirect) \
+	X(vkCmdDrawIndirect) \
+	X(vkCmdDispatch) \
+	X(vkCmdPushConstants) \
+	X(vkCmdSetViewport) \
+	X(vkCmdSetScissor) \
+	X(vkCmdSetLineWidth) \
+	X(vkCmdPipelineBarrier) \
+	X(vkCmdCopyBuffer) \
+	X(vkCmdFillBuffer) \
+	X(vkCmdUpdateBuffer) \
+	X(vkCmdCopyBufferToImage) \
+	X(vkCmdCopyImageToBuffer) \
+	X(vkCmdResetQueryPool) \
+	X(vkCmdBeginQuery) \
+	X(vkCmdEndQuery) \
+	X(vkCmdWriteTimestamp) \
+	X(vkCreateSwapchainKHR) \
+	X(vkDestroySwapchainKHR) \
+	X(vkGetSwapchainImagesKHR) \
+	X(vkAcquireNextImageKHR) \
+	X(vkQueuePresentKHR)
+
+#define VULKAN_DECLARE_FUNCTION(name) extern PFN_##name name;
+extern PFN_vkGetInstanceProcAddr vkGetInstanceProcAddr;
+VULKAN_GLOBAL_FUNCTIONS(VULKAN_DECLARE_FUNCTION)
+VULKAN_INSTANCE_FUNCTIONS(VULKAN_DECLARE_FUNCTION)
+VULKAN_INSTANCE_EXTENSION_FUNCTIONS(VULKAN_DECLARE_FUNCTION)
+VULKAN_DEVICE_FUNCTIONS(VULKAN_DECLARE_FUNCTION)
+
+/*! Vulkan Loader
+	Fills in the function pointers above, either from the system Vulkan loader or from a mock backend.
+	The mock does no work, it hands out fake handles, host memory for mapping and just enough device properties
+	for the app to start, and counts every call with the bytes of arguments passed. With a headless run that
+	leaves the CPU cost of the engine itself (recording, descriptor writes, uniform updates) on any machine
+*/
+class VulkanLoader
+{
+public:
+	/*! Open the Vulkan library and load the global functions, throws if there is no Vulkan library */
+	static void loadLibrary();
+	/*! Load the instance functions, once the instance has been created. Does nothing when mocked */
+	static void loadInstance(VkInstance instance);
+	/*! Load the device functions for the one device the app uses, once it has been created. Does nothing when mocked */
+	static void loadDevice(VkDevice device);
+	/*! Point every function at the mock backend */
+	static void loadMock();
+	/*! Close the library, after the instance has been destroyed */
+	static void unload();
+
+	static bool Mocked();
+
+	/*! Mock only, zero the call counts (e.g. once start up is done so only frames are counted) */
+	static void resetMockStats();
+	/*! Mock only, print the calls made to each function per frame and per object. frames and objects are used as
+		divisors so a run's totals can be compared between scene sizes */
+	static void printMockStats(size_t frames, size_t objects);
+};
@@ -3,8 +3,9 @@
 
 
 
-#define GLFW_INCLUDE_VULKAN
-#include <glfw3.h>
+#include "VulkanLoader.h"
+#include "FrustumCuller.h"
+#include "GeometryArena.h"
 
 #include <GLM/glm.hpp>
 #include <GLM/gtc/matrix_transform.hpp>
@@ -12,6 +13,7 @@
 #include <glm/gtx/hash.hpp>
 
 #include <array>
+#include <string>
 #include <vector>
 
 
@@ -74,13 +76,39 @@ namespace std {
 	};
 }
 
+/*! Mesh Edge struct
+	An edge and the vertex opposite it in each of the two triangles that share it, so both face normals can be worked out.
+	Indices are into the object's vertices, in the winding of the first triangle. Matches MeshEdge in fins.comp (std430)
+*/
+struct MeshEdge {
+	uint32_t v0;
+	uint32_t v1;
+	uint32_t opposite0;
+	uint32_t opposite1; //NO_NEIGHBOUR on the open edge of a mesh
+
+	static constexpr uint32_t NO_NEIGHBOUR = UINT32_MAX;
+};
+
+/*! Fur Instance struct
+	A placement of a loaded object, every instance of an object shares its mesh and texture and is drawn in the same instanced draws
+*/
+struct FurInstance {
+	uint32_t object = 0; //Index of the object in the app's objects
+	uint32_t transform = 0; //Index of its transform in the app's transform store
+	bool spinning = true; //Turned about Y each frame, otherwise it stays where it was placed
+	unsigned int passes = 6; //Base mesh plus shells
+	float extrusion = 0.009f; //Distance the shells and fins extrude from the surface
+};
+
 class VulkanObject
 {
 private:
 
-	glm::vec3 m_Position = glm::vec3(0, 0, 0);
+	std::string m_Name; //Model path, used to tag the object's memory
+	std::string m_TexturePath;
 
 	VulkanEngine* m_Engine;
+	GeometryArena* m_Geometry;
 	VkPhysicalDevice& m_PhyDevice;
 	VkDevice& m_Device;
 	VkQueue m_GraphicsPipline;
@@ -108,38 +136,39 @@ private:
 		2, 0, 1, 0, 2, 3, 2, 1, 4, 0, 3, 4, 3, 2, 4, 1, 0, 4
 	};*/
 
-	//Vertex Buffers
-	VkBuffer m_VertexBuffer;
-	VkDeviceMemory m_VertexBufferMemory;
-	VkBuffer m_IndexBuffer;
-	VkDeviceMemory m_IndexBufferMemory;
+	//Where the mesh was copied to in the geometry arena
+	MeshRange m_Mesh;
 
-	unsigned int m_Passes = 6;
+	/*! Bounds of the loaded mesh in model space */
+	Bounds m_Bounds;
+	/*! Every edge once, with the triangles either side */
+	std::vector<MeshEdge> m_Edges;
 
 public:
 
-	VulkanObject(VulkanEngine* engine, VkPhysicalDevice& phyDevice, VkDevice& device, VkQueue graphicsQueue, VkCommandPool commandPool, const char* modelPath, const char* texturePath);
+	VulkanObject(VulkanEngine* engine, GeometryArena* geometry, VkPhysicalDevice& phyDevice, VkDevice& device, VkQueue graphicsQueue, VkCommandPool commandPool, const char* modelPath, const char* texturePath);
 	~VulkanObject();
 
 	
 
-	VkBuffer& GetVertexBuffer() { return m_VertexBuffer; }
-	VkBuffer& GetIndexBuffer() { return m_IndexBuffer; }
+	const std::string& Name() const { return m_Name; }
+	const std::string& TexturePath() const { return m_TexturePath; }
+
 	const std::vector<uint32_t>& GetIndices() { return indices; }
 	const std::vector<Vertex>& GetVertices() { return vertices; }
-	VkDeviceMemory& GetVertexMemory() { return m_VertexBufferMemory; }
-	VkDeviceMemory& GetIndexMemory() { return m_IndexBufferMemory; }
-
-	const void SetPos(glm::vec3 pos) { m_Position = pos; }
-	const glm::vec3 GetPos() const { return m_Position; }
+	/*! The mesh's range in the geometry arena, draws use it with the arena's buffers bound */
+	const MeshRange& GetMesh() const { return m_Mesh; }
 
 	VkImage& GetTextureImage() { return textureImage; }
 	void SetTextureImageView(VkImageView view) { textureImageView = view; }
 	VkImageView& GetTextureImageView() { return textureImageView; }
 	VkSampler& GetTextureSampler() { return textureSampler; }
 
+	/*! Load the mesh and compute its bounds and edges */
 	void loadModel(const char* path);
 
-	unsigned int Passes() const { return m_Passes; };
+	/*! Model space bounds of the mesh, an instance's fur reaches out past it by its extrusion */
+	Bounds GetBounds() const { return m_Bounds; }
+	const std::vector<MeshEdge>& GetEdges() const { return m_Edges; }
 
 };
\ No newline at end of file
@@ -1,12 +1,13 @@
 
 #include <VulkanApp.h>
 #include <iostream>
-int main() {
+int main(int argc, char** argv) {
 	//Create app
-	VulkanApp* app = new VulkanApp();
+	VulkanApp* app = nullptr;
 
 	//Try to run the app or exit with an error
 	try {
+		app = new VulkanApp(AppSettings::fromCommandLine(argc, argv));
 		app->run();
 	}
 	catch (const std::exception& e) {
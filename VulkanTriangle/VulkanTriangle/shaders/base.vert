@@ -1,11 +1,8 @@
 #version 450
 
-layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
-    mat4 view;
-    mat4 proj;
-	int layer;
-} ubo;
+//Instances come from the storage buffers, the draw's instance picks the visible instance
+#extension GL_GOOGLE_include_directive : require
+#include "gpu_scene.glsl"
 
 layout (location = 0) in vec3 inPos;
 layout (location = 1) in vec3 inNormal;
@@ -17,9 +14,15 @@ layout (location = 3) out vec4 pos;
 
 void main()
 {
+	InstanceData instance = instances[visible[gl_InstanceIndex]];
+	mat4 modelView = frame.view * instance.model;
+	mat4 proj = frame.proj;
+
 	vec3 newPos = inPos;// + (normalize(inNormal)*0.);
-	gl_Position = ubo.proj * (ubo.view * ubo.model)*vec4(newPos + inNormal * 0.00, 1.0);
-	spos = ubo.proj * (ubo.view * ubo.model)*vec4(newPos + inNormal * 0.00, 1.0); //Calculate the surface position
-	pos = ubo.proj * (ubo.view * ubo.model)*vec4(newPos + inNormal * 0.009, 1.0); //Calculate extruded position
-	outNormal = inNormal;
+	gl_Position = proj * modelView*vec4(newPos + inNormal * 0.00, 1.0);
+	spos = proj * modelView*vec4(newPos + inNormal * 0.00, 1.0); //Calculate the surface position
+	//Instances with only the base mesh have no fur, their fins collapse onto the surface and draw nothing
+	float extrusion = instance.passes > 1 ? instance.extrusion : 0.0;
+	pos = proj * modelView*vec4(newPos + inNormal * extrusion, 1.0); //Calculate extruded position
+	outNormal = instance.normalMatrix * inNormal;
 }
\ No newline at end of file
@@ -0,0 +1,21 @@
+#version 450
+
+//Fins are pulled from the quads the compute pass built, there is no vertex input
+#extension GL_GOOGLE_include_directive : require
+#include "fins.glsl"
+
+layout (location = 0) out vec3 outColor;
+layout (location = 1) out vec2 outTexCoords;
+
+//Two triangles per fin, in the order the geometry shader used to emit them
+const uint CORNERS[6] = uint[](0, 1, 2, 2, 3, 0);
+const vec2 TEX_COORDS[4] = vec2[](vec2(0, 0), vec2(0, 1), vec2(1, 1), vec2(1, 0));
+
+void main()
+{
+	uint vertex = uint(gl_VertexIndex);
+	uint corner = CORNERS[vertex % 6];
+	gl_Position = quads[vertex / 6].corners[corner];
+	outColor = vec3(0.0, 0.0, 0.0);
+	outTexCoords = TEX_COORDS[corner];
+}
@@ -0,0 +1,15 @@
+//Fin quads built by fins.comp and drawn by fin.vert. Matches the bindings in FinGenerator
+
+//Corners of a fin, the edge's two vertices on the surface and pushed out along their normals, in clip space
+struct FinQuad {
+	vec4 corners[4]; //Surface 0, extruded 0, extruded 1, surface 1
+};
+
+//A section per cull pass, each pass's draw starts at its own. Read only for fin.vert, see gpu_scene.glsl
+#ifdef WRITE_QUADS
+layout(std430, binding = 10) buffer FinQuads {
+#else
+layout(std430, binding = 10) readonly buffer FinQuads {
+#endif
+	FinQuad quads[];
+};
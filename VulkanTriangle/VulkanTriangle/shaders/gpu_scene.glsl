@@ -0,0 +1,45 @@
+//Scene data for instanced drawing, shared by cull.comp and the vertex shaders.
+//Matches GpuFrame and GpuInstance in InstanceBuffers.h, and the bindings in InstanceBuffers and GpuCuller
+
+layout(binding = 0) uniform FrameUniforms {
+	mat4 view;
+	mat4 proj;
+	vec4 frustum[6]; //Normals pointing in, a point is inside when dot(xyz, p) + w >= 0
+	vec2 viewportDim;
+	uint instanceCount;
+	uint passStride; //Most passes an instance can have, the shell draws have passStride - 1 instances per visible instance
+
+	//Occlusion culling only
+	mat4 occlusionViewProj; //View projection the depth pyramid was drawn with, for the early pass
+	vec2 pyramidDim;
+	uint pyramidLevels;
+	uint occlusionTest; //0 until the pyramid holds a frame's depth
+
+	vec3 cameraPosition; //World space, for the fins' silhouette test
+	uint objectCount;
+} frame;
+
+struct InstanceData {
+	mat4 model;
+	mat3 normalMatrix; //Inverse transpose of the model, worked out on the CPU when the instance changes
+	vec4 sphere; //Local bounds centre and radius, grown by the fur
+	vec4 extents; //Local bounds half size
+	uint object;
+	uint passes; //Base mesh plus shells
+	float extrusion;
+	uint padding;
+};
+
+layout(std430, binding = 3) readonly buffer Instances {
+	InstanceData instances[];
+};
+
+//Visible instances grouped by object, a draw's instances index into it from its first instance.
+//Only cull.comp writes it, the vertex shaders can't write buffers unless vertexPipelineStoresAndAtomics is enabled
+#ifdef WRITE_VISIBLE
+layout(std430, binding = 7) buffer VisibleInstances {
+#else
+layout(std430, binding = 7) readonly buffer VisibleInstances {
+#endif
+	uint visible[];
+};
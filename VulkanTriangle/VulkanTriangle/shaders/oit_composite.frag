@@ -0,0 +1,20 @@
+#version 450
+
+//Weighted blended transparency composite, blends the weighted average of the shells over the frame by how much they cover it
+layout(input_attachment_index = 0, binding = 0) uniform subpassInput accumulation;
+layout(input_attachment_index = 1, binding = 1) uniform subpassInput revealage;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+	//Fully revealed means no shell was drawn here, leave the frame alone
+	float reveal = subpassLoad(revealage).r;
+	if (reveal >= 1.0)
+	{
+		discard;
+	}
+
+	vec4 accum = subpassLoad(accumulation);
+	vec3 average = accum.rgb / max(accum.a, 1e-5);
+	outColor = vec4(average, 1.0 - reveal);
+}
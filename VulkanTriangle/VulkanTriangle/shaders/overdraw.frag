@@ -0,0 +1,9 @@
+#version 450
+
+//Overdraw counting, every fragment adds one to the count target with additive blending.
+//Nothing is discarded so the count includes fragments the normal shaders would throw away
+layout(location = 0) out vec4 outCount;
+
+void main() {
+	outCount = vec4(1.0);
+}
@@ -1,6 +1,6 @@
-C:/VulkanSDK/1.1.97.0/Bin32/glslangValidator.exe -V shader.vert
-C:/VulkanSDK/1.1.97.0/Bin32/glslangValidator.exe -V shader.frag
-C:/VulkanSDK/1.1.97.0/Bin32/glslangValidator.exe -V base.vert
-C:/VulkanSDK/1.1.97.0/Bin32/glslangValidator.exe -V base.frag
-C:/VulkanSDK/1.1.97.0/Bin32/glslangValidator.exe -V shader.geom
+REM Pre-builds the fallback SPIR-V with the app, which stamps each file with a hash of its source so a stale one is never loaded
+REM The app compiles the GLSL itself when the Vulkan SDK is installed, set APP to the built VulkanTriangle.exe if it isn't the x64 Release one
+if not defined APP set APP="%~dp0..\..\x64\Release\VulkanTriangle.exe"
+cd /d "%~dp0.."
+%APP% --build-shaders
 pause
\ No newline at end of file
@@ -7,7 +7,20 @@ layout(location = 3) flat in int fragLayer;
 
 layout(binding = 1) uniform sampler2D texSampler;
 
+//Specialisation constants, set by the pipeline library
+layout(constant_id = 2) const bool LIGHTING = true;
+layout(constant_id = 3) const float FUR_R = 0.278;
+layout(constant_id = 4) const float FUR_G = 0.1607;
+layout(constant_id = 5) const float FUR_B = 0.0549;
+
+#ifdef OIT
+//Weighted blended order independent transparency, see OitCompositor. Accumulation is added to and revealage multiplied down
+layout(location = 0) out vec4 outAccum;
+layout(location = 1) out float outReveal;
+layout(location = 4) in float viewDepth; //Distance in front of the camera
+#else
 layout(location = 0) out vec4 outColor;
+#endif
 
 
 vec3 ambLight = vec3(0.35, 0.35, 0.35);
@@ -16,9 +29,14 @@ vec3 lightColour = vec3(1, 1, 1);
 
 void main() {
 	
-	vec3 norm = normalize(fragNormal);
-	float diff =  max(dot(norm, lightDir), 0.0);
-	vec3 diffuse = lightColour * diff;
+	vec3 light = vec3(1.0);
+	if(LIGHTING)
+	{
+		vec3 norm = normalize(fragNormal);
+		float diff =  max(dot(norm, lightDir), 0.0);
+		vec3 diffuse = lightColour * diff;
+		light = ambLight + diffuse;
+	}
 	vec4 col = texture(texSampler, fragTexCoord);
 	float alpha = 1.0/fragLayer;
 	if(col.r+col.g+col.b < 0.5)
@@ -26,10 +44,22 @@ void main() {
 		discard;
 	}
 	
+	vec4 colour;
 	if(fragLayer > 1)
-		outColor = vec4((ambLight+ diffuse)*vec3(0.278,0.1607,0.0549), alpha); //Used a fixed surface colour
+		colour = vec4(light*vec3(FUR_R, FUR_G, FUR_B), alpha); //Use the fur colour above the surface
 	else
-		outColor = vec4((ambLight+ diffuse)*col.xyz, alpha);
+		colour = vec4(light*col.xyz, alpha);
+
+#ifdef OIT
+	//More opaque fragments, and those nearer in view space, weigh more so the front shells dominate the average. McGuire and
+	//Bavoil's view depth weight, with its distances scaled down ten times for a scene that sits 0.1 to about 2 from the camera.
+	//The window depth can't be used, with the near plane at 0.01 it is close to 1 everywhere
+	float weight = colour.a * clamp(10.0 / (1e-5 + pow(viewDepth / 0.5, 2.0) + pow(viewDepth / 20.0, 6.0)), 1e-2, 3e3);
+	outAccum = vec4(colour.rgb * colour.a, colour.a) * weight;
+	outReveal = colour.a;
+#else
+	outColor = colour;
+#endif
 	
 	
 
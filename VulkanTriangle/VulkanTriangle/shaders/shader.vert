@@ -1,12 +1,18 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
-    mat4 view;
-    mat4 proj;
-	int layer;
-} ubo;
+//Instances come from the storage buffers, the draw's instance picks the visible instance and its pass
+#extension GL_GOOGLE_include_directive : require
+#include "gpu_scene.glsl"
+
+//Draws of the base mesh have one pass per instance, shell draws have the rest
+layout(push_constant) uniform Layers {
+	uint layersPerInstance;
+	uint firstLayer;
+} layers;
+
+//Specialisation constants, set by the pipeline library
+layout(constant_id = 0) const int SHELL_COUNT = 6;
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
@@ -16,17 +22,33 @@ layout(location = 2) in vec2 inTexCoord;
 layout(location = 0) out vec3 fragNormal;
 layout(location = 1) out vec2 fragTexCoord;
 layout(location = 3) out int fragLayer;
+layout(location = 4) out float viewDepth; //Distance in front of the camera, weighs the shells under OIT
 
 vec3 lDir = vec3(0, -1, -1);
 layout(location = 2) out vec3 lightDir;
 
 void main() {
 
-	lightDir = mat3(ubo.view)*normalize(-lDir);
-	fragNormal = mat3(transpose(inverse(ubo.model))) * inNormal;
-	fragLayer = ubo.layer;
-	vec3 newPos = inPosition + (normalize(inNormal)*ubo.layer*0.0015);//inPosition * (1+ubo.layer*0.15);// + (normalize(fragNormal) * (ubo.layer*0.1));
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(newPos, 1.0);
+	InstanceData instance = instances[visible[uint(gl_InstanceIndex) / layers.layersPerInstance]];
+	uint pass = uint(gl_InstanceIndex) % layers.layersPerInstance + layers.firstLayer;
+	mat4 model = instance.model;
+	mat4 view = frame.view;
+	mat4 proj = frame.proj;
+	int layer = int(pass) + 1;
+
+	//Shells past this instance's own count, put the vertex outside the clip volume so nothing is drawn
+	if (pass >= instance.passes) {
+		gl_Position = vec4(0.0, 0.0, -2.0, 1.0);
+		return;
+	}
+
+	lightDir = mat3(view)*normalize(-lDir);
+	fragNormal = instance.normalMatrix * inNormal;
+	fragLayer = layer;
+	vec3 newPos = inPosition + (normalize(inNormal)*layer*(instance.extrusion/SHELL_COUNT));//inPosition * (1+ubo.layer*0.15);// + (normalize(fragNormal) * (ubo.layer*0.1));
+	vec4 viewPosition = view * model * vec4(newPos, 1.0);
+	viewDepth = -viewPosition.z;
+    gl_Position = proj * viewPosition;
 	
 	fragTexCoord = inTexCoord;
 }
\ No newline at end of file
@@ -0,0 +1,216 @@
+#include "AppSettings.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+//Parse WIDTHxHEIGHT
+static void parseResolution(const std::string& resolution, uint32_t& width, uint32_t& height)
+{
+	size_t split = resolution.find('x');
+	if (split == std::string::npos) {
+		throw std::runtime_error("resolution must be WIDTHxHEIGHT: " + resolution);
+	}
+	width = static_cast<uint32_t>(std::stoul(resolution.substr(0, split)));
+	height = static_cast<uint32_t>(std::stoul(resolution.substr(split + 1)));
+	if (width == 0 || height == 0) {
+		throw std::runtime_error("resolution must be greater than zero: " + resolution);
+	}
+}
+
+static std::string trim(const std::string& text)
+{
+	size_t start = text.find_first_not_of(" \t\r");
+	if (start == std::string::npos) return "";
+	size_t end = text.find_last_not_of(" \t\r");
+	return text.substr(start, end - start + 1);
+}
+
+AppSettings AppSettings::fromCommandLine(int argc, char** argv)
+{
+	AppSettings settings;
+
+	//Go through each argument, options that take a value read the next argument
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+
+		if (arg == "--resize-storm" && i + 1 < argc) {
+			settings.resizeStormCount = static_cast<unsigned int>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--headless") {
+			settings.headless = true;
+		}
+		else if (arg == "--resolution" && i + 1 < argc) {
+			parseResolution(argv[++i], settings.width, settings.height);
+		}
+		else if (arg == "--benchmark" && i + 1 < argc) {
+			//Options after the config file override it
+			settings.benchmark = true;
+			settings.loadConfig(argv[++i]);
+		}
+		else if (arg == "--benchmark-out" && i + 1 < argc) {
+			settings.benchmarkOutput = argv[++i];
+		}
+		else if (arg == "--frames" && i + 1 < argc) {
+			settings.frameCount = static_cast<unsigned int>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--readback" && i + 1 < argc) {
+			settings.readbackPath = argv[++i];
+		}
+		else if (arg == "--readback-every" && i + 1 < argc) {
+			settings.readbackInterval = static_cast<unsigned int>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--readback-compare" && i + 1 < argc) {
+			settings.readbackReference = argv[++i];
+		}
+		else if (arg == "--readback-tolerance" && i + 1 < argc) {
+			settings.readbackTolerance = std::stof(argv[++i]);
+		}
+		else if (arg == "--gpu-log" && i + 1 < argc) {
+			settings.gpuLogInterval = static_cast<unsigned int>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--cpu-trace" && i + 1 < argc) {
+			settings.cpuTracePath = argv[++i];
+		}
+		else if (arg == "--stats-out" && i + 1 < argc) {
+			settings.statsOutput = argv[++i];
+		}
+		else if (arg == "--stats-history" && i + 1 < argc) {
+			settings.statsHistory = static_cast<unsigned int>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--memory-thresholds" && i + 1 < argc) {
+			settings.memoryThresholds.clear();
+			std::stringstream list(argv[++i]);
+			std::string value;
+			while (std::getline(list, value, ',')) {
+				settings.memoryThresholds.push_back(std::stod(value));
+			}
+		}
+		else if (arg == "--memory-log" && i + 1 < argc) {
+			settings.memoryLogInterval = static_cast<unsigned int>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--pipeline-stats") {
+			settings.pipelineStatistics = true;
+		}
+		else if (arg == "--overdraw" && i + 1 < argc) {
+			settings.overdrawInterval = static_cast<unsigned int>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--mock-vulkan") {
+			settings.mockVulkan = true;
+			settings.headless = true;
+		}
+		else if (arg == "--microbench" && i + 1 < argc) {
+			settings.microbenchRepetitions = static_cast<unsigned int>(std::stoul(argv[++i]));
+			settings.mockVulkan = true;
+			settings.headless = true;
+		}
+		else if (arg == "--microbench-filter" && i + 1 < argc) {
+			settings.microbenchFilter = argv[++i];
+		}
+		else if (arg == "--microbench-out" && i + 1 < argc) {
+			settings.microbenchOutput = argv[++i];
+		}
+		else if (arg == "--spinning" && i + 1 < argc) {
+			settings.spinningFraction = std::stof(argv[++i]);
+		}
+		else if (arg == "--geometry-fins") {
+			settings.geometryFins = true;
+		}
+		else if (arg == "--oit") {
+			settings.orderIndependentShells = true;
+		}
+		else if (arg == "--no-cull") {
+			settings.frustumCulling = false;
+		}
+		else if (arg == "--bvh") {
+			settings.sceneBvh = true;
+		}
+		else if (arg == "--gpu-cull") {
+			settings.gpuCulling = true;
+		}
+		else if (arg == "--occlusion") {
+			settings.occlusionCulling = true;
+		}
+		else if (arg == "--prebuilt-shaders") {
+			settings.compileShaders = false;
+		}
+		else if (arg == "--build-shaders") {
+			settings.buildShaders = true;
+		}
+		else if (arg == "--shader-opt" && i + 1 < argc) {
+			std::string level = argv[++i];
+			if (level == "none") settings.shaderOptimisation = ShaderOptimisation::None;
+			else if (level == "size") settings.shaderOptimisation = ShaderOptimisation::Size;
+			else if (level == "perf") settings.shaderOptimisation = ShaderOptimisation::Performance;
+			else throw std::runtime_error("unknown shader optimisation level: " + level);
+		}
+		else {
+			throw std::runtime_error("unknown command line argument: " + arg);
+		}
+	}
+
+	//Headless and benchmark runs have no window to close, so they need a frame count
+	if ((settings.headless || settings.benchmark) && settings.frameCount == 0) {
+		settings.frameCount = settings.benchmark ? 300 : 100;
+	}
+	//Occlusion is tested in the GPU culling pass
+	if (settings.occlusionCulling) {
+		settings.gpuCulling = true;
+	}
+	//Statistics are only printed with the GPU log
+	if (settings.pipelineStatistics && settings.gpuLogInterval == 0) {
+		settings.gpuLogInterval = 120;
+	}
+	if (!settings.readbackPath.empty() && !settings.headless) {
+		throw std::runtime_error("--readback is only supported with --headless");
+	}
+	if (!settings.readbackReference.empty() && settings.readbackPath.empty()) {
+		throw std::runtime_error("--readback-compare needs --readback");
+	}
+
+	return settings;
+}
+
+void AppSettings::loadConfig(const std::string& filename)
+{
+	std::ifstream file(filename);
+	if (!file.is_open()) {
+		throw std::runtime_error("failed to open config file: " + filename);
+	}
+
+	std::string line;
+	while (std::getline(file, line)) {
+		//Strip comments and skip blank lines
+		line = trim(line.substr(0, line.find('#')));
+		if (line.empty()) continue;
+
+		size_t split = line.find('=');
+		if (split == std::string::npos) {
+			throw std::runtime_error("expected key = value in " + filename + ": " + line);
+		}
+		std::string key = trim(line.substr(0, split));
+		std::string value = trim(line.substr(split + 1));
+
+		if (key == "objects") objectCount = static_cast<unsigned int>(std::stoul(value));
+		else if (key == "shells") shellCount = static_cast<unsigned int>(std::stoul(value));
+		else if (key == "spinning") spinningFraction = std::stof(value);
+		else if (key == "resolution") parseResolution(value, width, height);
+		else if (key == "warmup") warmupFrames = static_cast<unsigned int>(std::stoul(value));
+		else if (key == "frames") frameCount = static_cast<unsigned int>(std::stoul(value));
+		else if (key == "cull") frustumCulling = (value == "1" || value == "true");
+		else if (key == "geometry_fins") geometryFins = (value == "1" || value == "true");
+		else if (key == "oit") orderIndependentShells = (value == "1" || value == "true");
+		else if (key == "bvh") sceneBvh = (value == "1" || value == "true");
+		else if (key == "gpu_cull") gpuCulling = (value == "1" || value == "true");
+		else if (key == "occlusion") occlusionCulling = (value == "1" || value == "true");
+		else if (key == "headless") headless = (value == "1" || value == "true");
+		else if (key == "output") benchmarkOutput = value;
+		else if (key == "readback") readbackPath = value;
+		else if (key == "readback_compare") readbackReference = value;
+		else throw std::runtime_error("unknown key in " + filename + ": " + key);
+	}
+
+	if (objectCount == 0 || shellCount == 0) {
+		throw std::runtime_error("objects and shells must be greater than zero: " + filename);
+	}
+}
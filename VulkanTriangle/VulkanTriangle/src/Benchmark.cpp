@@ -0,0 +1,159 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+Benchmark::Benchmark(const AppSettings& settings) : m_Settings(settings)
+{
+	m_Samples.resize(settings.frameCount);
+}
+
+Benchmark::FrameSample* Benchmark::sample(size_t frame)
+{
+	if (frame < m_Settings.warmupFrames) return nullptr;
+	frame -= m_Settings.warmupFrames;
+	if (frame >= m_Samples.size()) return nullptr;
+	return &m_Samples[frame];
+}
+
+void Benchmark::addFrame(size_t frame, double cpuMs, uint32_t draws, uint64_t triangles)
+{
+	FrameSample* frameSample = sample(frame);
+	if (!frameSample) return;
+
+	frameSample->cpuMs = cpuMs;
+	frameSample->draws = draws;
+	frameSample->triangles = triangles;
+	frameSample->recorded = true;
+}
+
+void Benchmark::setGpuTime(size_t frame, const GpuFrameTimes& times)
+{
+	FrameSample* frameSample = sample(frame);
+	if (!frameSample) return;
+
+	frameSample->gpuMs = times.gpuMs;
+	frameSample->zones = times.zones;
+	frameSample->hasStatistics = times.hasStatistics;
+}
+
+Benchmark::Stats Benchmark::summarise(std::vector<double> values)
+{
+	Stats stats;
+	if (values.empty()) return stats;
+
+	std::sort(values.begin(), values.end());
+
+	//Nearest rank percentiles
+	auto percentile = [&values](double p) {
+		size_t rank = static_cast<size_t>(std::ceil(p * values.size()));
+		return values[std::min(values.size(), std::max<size_t>(rank, 1)) - 1];
+	};
+
+	double total = 0.0;
+	for (double value : values) {
+		total += value;
+	}
+
+	stats.count = values.size();
+	stats.mean = total / values.size();
+	stats.p50 = percentile(0.50);
+	stats.p95 = percentile(0.95);
+	stats.p99 = percentile(0.99);
+	stats.max = values.back();
+	return stats;
+}
+
+void Benchmark::writeStats(std::ostream& out, const char* name, const Stats& stats)
+{
+	out << "\t\t\"" << name << "\": { \"samples\": " << stats.count << ", \"mean\": " << stats.mean << ", \"p50\": " << stats.p50
+		<< ", \"p95\": " << stats.p95 << ", \"p99\": " << stats.p99 << ", \"max\": " << stats.max << " }";
+}
+
+void Benchmark::writeJson(const std::string& deviceName)
+{
+	std::vector<double> cpuTimes, gpuTimes, draws, triangles;
+	std::vector<std::string> zoneNames;
+	std::vector<std::vector<double>> zoneTimes;
+	std::vector<PipelineStats> zoneStats; //Totals over the frames with statistics, per phase
+	std::vector<size_t> zoneStatsCount;
+	for (auto& frameSample : m_Samples) {
+		if (!frameSample.recorded) continue;
+		cpuTimes.push_back(frameSample.cpuMs);
+		if (frameSample.gpuMs >= 0.0) gpuTimes.push_back(frameSample.gpuMs);
+
+		//Gather each phase's times under its name
+		for (auto& zone : frameSample.zones) {
+			size_t i = std::find(zoneNames.begin(), zoneNames.end(), zone.name) - zoneNames.begin();
+			if (i == zoneNames.size()) {
+				zoneNames.push_back(zone.name);
+				zoneTimes.emplace_back();
+				zoneStats.emplace_back();
+				zoneStatsCount.push_back(0);
+			}
+			zoneTimes[i].push_back(zone.ms);
+			if (frameSample.hasStatistics) {
+				zoneStats[i] += zone.stats;
+				zoneStatsCount[i]++;
+			}
+		}
+
+		draws.push_back(frameSample.draws);
+		triangles.push_back(static_cast<double>(frameSample.triangles));
+	}
+
+	Stats cpu = summarise(cpuTimes);
+	Stats gpu = summarise(gpuTimes);
+
+	std::ofstream out(m_Settings.benchmarkOutput);
+	if (!out.is_open()) {
+		throw std::runtime_error("failed to open benchmark output: " + m_Settings.benchmarkOutput);
+	}
+
+	out << "{\n";
+	out << "\t\"device\": \"" << deviceName << "\",\n";
+	out << "\t\"config\": { \"objects\": " << m_Settings.objectCount << ", \"shells\": " << m_Settings.shellCount
+		<< ", \"width\": " << m_Settings.width << ", \"height\": " << m_Settings.height << ", \"headless\": " << (m_Settings.headless ? "true" : "false")
+		<< ", \"warmup\": " << m_Settings.warmupFrames << ", \"frames\": " << m_Settings.frameCount << ", \"timeStep\": " << TIME_STEP << " },\n";
+	out << "\t\"frameMs\": {\n";
+	writeStats(out, "cpu", cpu);
+	out << ",\n";
+	writeStats(out, "gpu", gpu);
+	out << "\n\t},\n";
+	out << "\t\"gpuPhaseMs\": {\n";
+	for (size_t i = 0; i < zoneNames.size(); i++) {
+		writeStats(out, zoneNames[i].c_str(), summarise(zoneTimes[i]));
+		out << (i + 1 < zoneNames.size() ? ",\n" : "\n");
+	}
+	out << "\t},\n";
+
+	//Mean invocation counts of each phase, only if the run had pipeline statistics
+	bool hasStatistics = std::any_of(zoneStatsCount.begin(), zoneStatsCount.end(), [](size_t count) { return count > 0; });
+	if (hasStatistics) {
+		out << "\t\"pipelineStats\": {\n";
+		for (size_t i = 0; i < zoneNames.size(); i++) {
+			double count = static_cast<double>(std::max<size_t>(zoneStatsCount[i], 1));
+			const PipelineStats& stats = zoneStats[i];
+			out << "\t\t\"" << zoneNames[i] << "\": { \"vertexInvocations\": " << stats.vertexInvocations / count
+				<< ", \"geometryInvocations\": " << stats.geometryInvocations / count
+				<< ", \"clippingInvocations\": " << stats.clippingInvocations / count
+				<< ", \"clippingPrimitives\": " << stats.clippingPrimitives / count
+				<< ", \"fragmentInvocations\": " << stats.fragmentInvocations / count << " }";
+			out << (i + 1 < zoneNames.size() ? ",\n" : "\n");
+		}
+		out << "\t},\n";
+	}
+
+	out << "\t\"perFrame\": {\n";
+	writeStats(out, "draws", summarise(draws));
+	out << ",\n";
+	writeStats(out, "triangles", summarise(triangles));
+	out << "\n\t}\n";
+	out << "}\n";
+
+	std::cout << "benchmark: cpu p50 " << cpu.p50 << "ms p99 " << cpu.p99 << "ms, gpu p50 " << gpu.p50 << "ms p99 " << gpu.p99
+		<< "ms, written to " << m_Settings.benchmarkOutput << std::endl;
+}
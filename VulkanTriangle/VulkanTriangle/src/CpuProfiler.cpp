@@ -0,0 +1,94 @@
+#include "CpuProfiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+std::atomic<bool> CpuProfiler::s_Enabled{ false };
+std::mutex CpuProfiler::s_Mutex;
+std::vector<std::unique_ptr<CpuProfiler::ThreadBuffer>> CpuProfiler::s_Buffers;
+thread_local CpuProfiler::ThreadBuffer* CpuProfiler::t_Buffer = nullptr;
+thread_local const char* CpuProfiler::t_ThreadName = nullptr;
+
+uint64_t CpuProfiler::now()
+{
+	//Times are relative to the first call so they fit comfortably in a trace
+	static const auto start = std::chrono::steady_clock::now();
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+void CpuProfiler::setThreadName(const char* name)
+{
+	//Buffers are only made for threads that record something, so just remember the name until then
+	t_ThreadName = name;
+	if (t_Buffer) {
+		std::lock_guard<std::mutex> lock(s_Mutex);
+		t_Buffer->name = name;
+	}
+}
+
+CpuProfiler::ThreadBuffer& CpuProfiler::threadBuffer()
+{
+	if (!t_Buffer) {
+		std::lock_guard<std::mutex> lock(s_Mutex);
+		s_Buffers.push_back(std::make_unique<ThreadBuffer>());
+		t_Buffer = s_Buffers.back().get();
+		t_Buffer->id = static_cast<uint32_t>(s_Buffers.size());
+		t_Buffer->name = t_ThreadName ? t_ThreadName : "thread " + std::to_string(t_Buffer->id);
+	}
+	return *t_Buffer;
+}
+
+void CpuProfiler::record(const char* name, uint64_t startNs, uint64_t endNs)
+{
+	ThreadBuffer& buffer = threadBuffer();
+
+	//Only this thread writes, publish the new count after the event so the exporter never sees a half written one
+	uint64_t written = buffer.written.load(std::memory_order_relaxed);
+	buffer.events[written % EVENTS_PER_THREAD] = { name, startNs, endNs };
+	buffer.written.store(written + 1, std::memory_order_release);
+}
+
+void CpuProfiler::writeChromeTrace(const std::string& filename)
+{
+	std::ofstream out(filename);
+	if (!out.is_open()) {
+		throw std::runtime_error("failed to open cpu trace output: " + filename);
+	}
+
+	std::lock_guard<std::mutex> lock(s_Mutex);
+
+	//Complete events ("X") with times in microseconds, plus a metadata event naming each thread
+	out << std::fixed << std::setprecision(3);
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	size_t eventCount = 0;
+	size_t droppedCount = 0;
+	for (auto& buffer : s_Buffers) {
+		out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id
+			<< ",\"args\":{\"name\":\"" << buffer->name << "\"}}";
+		first = false;
+
+		//Only the last EVENTS_PER_THREAD events are still in the ring
+		uint64_t written = buffer->written.load(std::memory_order_acquire);
+		uint64_t begin = written > EVENTS_PER_THREAD ? written - EVENTS_PER_THREAD : 0;
+		droppedCount += static_cast<size_t>(begin);
+
+		for (uint64_t i = begin; i < written; i++) {
+			const CpuProfileEvent& event = buffer->events[i % EVENTS_PER_THREAD];
+			out << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id
+				<< ",\"ts\":" << event.startNs / 1000.0 << ",\"dur\":" << (event.endNs - event.startNs) / 1000.0 << "}";
+			eventCount++;
+		}
+	}
+	out << "\n]}\n";
+
+	std::cout << "cpu trace: " << eventCount << " events from " << s_Buffers.size() << " threads written to " << filename;
+	if (droppedCount > 0) {
+		std::cout << " (" << droppedCount << " older events overwritten)";
+	}
+	std::cout << std::endl;
+}
@@ -0,0 +1,247 @@
+#include "DepthPyramid.h"
+
+#include "VulkanEngine.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+//Largest power of two that is not bigger than the value, so every level halves exactly
+static uint32_t previousPow2(uint32_t value)
+{
+	uint32_t result = 1;
+	while (result * 2 <= value) result *= 2;
+	return result;
+}
+
+DepthPyramid::DepthPyramid(VulkanEngine* engine, VkDevice& device) : m_Engine(engine), m_Device(device) {}
+
+void DepthPyramid::createPipeline(VkShaderModule reduceShader)
+{
+	//Level below in, level out
+	std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+	bindings[0].binding = 0;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[1].binding = 1;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	for (VkDescriptorSetLayoutBinding& binding : bindings) {
+		binding.descriptorCount = 1;
+		binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+	if (vkCreateDescriptorSetLayout(m_Device, &layoutInfo, nullptr, &m_DescriptorSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create depth pyramid descriptor set layout!");
+	}
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &m_DescriptorSetLayout;
+	if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, nullptr, &m_PipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create depth pyramid pipeline layout!");
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = reduceShader;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = m_PipelineLayout;
+	if (vkCreateComputePipelines(m_Device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_Pipeline) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create depth pyramid pipeline!");
+	}
+
+	//Every read is a texelFetch, the sampler is only there because the descriptors need one
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+	if (vkCreateSampler(m_Device, &samplerInfo, nullptr, &m_Sampler) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create depth pyramid sampler!");
+	}
+}
+
+void DepthPyramid::destroyPipeline()
+{
+	vkDestroySampler(m_Device, m_Sampler, nullptr);
+	vkDestroyPipeline(m_Device, m_Pipeline, nullptr);
+	vkDestroyPipelineLayout(m_Device, m_PipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(m_Device, m_DescriptorSetLayout, nullptr);
+	m_Sampler = VK_NULL_HANDLE;
+	m_Pipeline = VK_NULL_HANDLE;
+	m_PipelineLayout = VK_NULL_HANDLE;
+	m_DescriptorSetLayout = VK_NULL_HANDLE;
+}
+
+void DepthPyramid::createTarget(VkExtent2D extent, VkImageView depthImageView)
+{
+	m_Extent = { previousPow2(extent.width), previousPow2(extent.height) };
+	m_Levels = 1;
+	while ((std::max(m_Extent.width, m_Extent.height) >> m_Levels) > 0) m_Levels++;
+	m_HasDepth = false;
+
+	VkImageCreateInfo imageInfo = {};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.extent = { m_Extent.width, m_Extent.height, 1 };
+	imageInfo.mipLevels = m_Levels;
+	imageInfo.arrayLayers = 1;
+	imageInfo.format = FORMAT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	if (vkCreateImage(m_Device, &imageInfo, nullptr, &m_Image) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create depth pyramid image!");
+	}
+
+	VkMemoryRequirements memRequirements;
+	vkGetImageMemoryRequirements(m_Device, m_Image, &memRequirements);
+	m_Engine->allocateMemory(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_ImageMemory, MemoryCategory::RenderTarget, "depth pyramid");
+	vkBindImageMemory(m_Device, m_Image, m_ImageMemory, 0);
+
+	//A view of the whole chain for the culling pass, and one per level for the reduction to write
+	VkImageViewCreateInfo viewInfo = {};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = m_Image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = FORMAT;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.levelCount = m_Levels;
+	viewInfo.subresourceRange.layerCount = 1;
+	if (vkCreateImageView(m_Device, &viewInfo, nullptr, &m_ImageView) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create depth pyramid image view!");
+	}
+
+	m_LevelViews.resize(m_Levels);
+	for (uint32_t level = 0; level < m_Levels; level++) {
+		viewInfo.subresourceRange.baseMipLevel = level;
+		viewInfo.subresourceRange.levelCount = 1;
+		if (vkCreateImageView(m_Device, &viewInfo, nullptr, &m_LevelViews[level]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create depth pyramid level view!");
+		}
+	}
+
+	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount = m_Levels;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[1].descriptorCount = m_Levels;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = m_Levels;
+	if (vkCreateDescriptorPool(m_Device, &poolInfo, nullptr, &m_DescriptorPool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create depth pyramid descriptor pool!");
+	}
+
+	std::vector<VkDescriptorSetLayout> layouts(m_Levels, m_DescriptorSetLayout);
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_DescriptorPool;
+	allocInfo.descriptorSetCount = m_Levels;
+	allocInfo.pSetLayouts = layouts.data();
+
+	m_DescriptorSets.resize(m_Levels);
+	if (vkAllocateDescriptorSets(m_Device, &allocInfo, m_DescriptorSets.data()) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate depth pyramid descriptor sets!");
+	}
+
+	for (uint32_t level = 0; level < m_Levels; level++) {
+		VkDescriptorImageInfo sourceInfo = {};
+		sourceInfo.sampler = m_Sampler;
+		sourceInfo.imageView = level == 0 ? depthImageView : m_LevelViews[level - 1];
+		sourceInfo.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+		VkDescriptorImageInfo targetInfo = {};
+		targetInfo.imageView = m_LevelViews[level];
+		targetInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		std::array<VkWriteDescriptorSet, 2> writes = {};
+		writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[0].dstSet = m_DescriptorSets[level];
+		writes[0].dstBinding = 0;
+		writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writes[0].descriptorCount = 1;
+		writes[0].pImageInfo = &sourceInfo;
+
+		writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[1].dstSet = m_DescriptorSets[level];
+		writes[1].dstBinding = 1;
+		writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writes[1].descriptorCount = 1;
+		writes[1].pImageInfo = &targetInfo;
+
+		vkUpdateDescriptorSets(m_Device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+}
+
+void DepthPyramid::destroyTarget()
+{
+	//Destroying the pool frees the sets
+	vkDestroyDescriptorPool(m_Device, m_DescriptorPool, nullptr);
+	for (VkImageView view : m_LevelViews) {
+		vkDestroyImageView(m_Device, view, nullptr);
+	}
+	vkDestroyImageView(m_Device, m_ImageView, nullptr);
+	vkDestroyImage(m_Device, m_Image, nullptr);
+	m_Engine->freeMemory(m_ImageMemory);
+	m_DescriptorPool = VK_NULL_HANDLE;
+	m_DescriptorSets.clear();
+	m_LevelViews.clear();
+	m_ImageView = VK_NULL_HANDLE;
+	m_Image = VK_NULL_HANDLE;
+	m_ImageMemory = VK_NULL_HANDLE;
+}
+
+void DepthPyramid::record(VkCommandBuffer commandBuffer, const glm::mat4& viewProj)
+{
+	//Wait for the culling passes still reading the old pyramid, the first pass into a new pyramid moves it into the general layout
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.oldLayout = m_HasDepth ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = m_Image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.levelCount = m_Levels;
+	barrier.subresourceRange.layerCount = 1;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_Pipeline);
+
+	//Each level reads the one below, so they are reduced in order with a barrier between them
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.subresourceRange.levelCount = 1;
+	for (uint32_t level = 0; level < m_Levels; level++) {
+		uint32_t width = std::max(m_Extent.width >> level, 1u);
+		uint32_t height = std::max(m_Extent.height >> level, 1u);
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_PipelineLayout, 0, 1, &m_DescriptorSets[level], 0, nullptr);
+		vkCmdDispatch(commandBuffer, (width + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, (height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1);
+
+		barrier.subresourceRange.baseMipLevel = level;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	m_HasDepth = true;
+	m_ViewProj = viewProj;
+}
@@ -0,0 +1,264 @@
+#include "FinGenerator.h"
+
+#include "VulkanEngine.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+FinGenerator::FinGenerator(VulkanEngine* engine, VkDevice& device) : m_Engine(engine), m_Device(device) {}
+
+void FinGenerator::create(VkShaderModule finShader, InstanceBuffers& instances, VkBuffer vertexBuffer, const std::vector<FinMesh>& meshes, const GpuCuller* culler)
+{
+	m_Culler = culler;
+	m_Passes = culler && culler->Occlusion() ? static_cast<uint32_t>(CullPass::Count) : 1;
+
+	//Frame uniforms, instances and lists, the arena's vertices, the edges and the object draws in, quads and fin draws out
+	std::array<VkDescriptorSetLayoutBinding, 8> bindings = {};
+	bindings[0].binding = InstanceBuffers::FRAME_BINDING;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	bindings[1].binding = InstanceBuffers::INSTANCE_BINDING;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[2].binding = InstanceBuffers::VISIBLE_BINDING;
+	bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[3].binding = VERTEX_BINDING;
+	bindings[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[4].binding = EDGE_BINDING;
+	bindings[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[5].binding = OBJECT_DRAW_BINDING;
+	bindings[5].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[6].binding = QUAD_BINDING;
+	bindings[6].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[7].binding = FIN_DRAW_BINDING;
+	bindings[7].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	for (VkDescriptorSetLayoutBinding& binding : bindings) {
+		binding.descriptorCount = 1;
+		binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+	if (vkCreateDescriptorSetLayout(m_Device, &layoutInfo, nullptr, &m_DescriptorSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create fin descriptor set layout!");
+	}
+
+	//The object being tested is pushed as constants, with the dispatches for its instances
+	VkPushConstantRange pushConstant = {};
+	pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstant.size = sizeof(FinObject);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &m_DescriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
+	if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, nullptr, &m_PipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create fin pipeline layout!");
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = finShader;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = m_PipelineLayout;
+	if (vkCreateComputePipelines(m_Device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_Pipeline) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create fin pipeline!");
+	}
+
+	uint32_t frames = instances.Frames();
+	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSizes[0].descriptorCount = frames;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[1].descriptorCount = frames * static_cast<uint32_t>(bindings.size() - 1);
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = frames;
+	if (vkCreateDescriptorPool(m_Device, &poolInfo, nullptr, &m_DescriptorPool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create fin descriptor pool!");
+	}
+
+	//Lay the edges out one object after the other. The culler's draws for an object's base mesh say which of its instances are visible
+	std::vector<MeshEdge> edges;
+	m_Objects.resize(meshes.size());
+	m_InstanceCounts.resize(meshes.size());
+	for (size_t i = 0; i < meshes.size(); i++) {
+		FinObject& object = m_Objects[i];
+		object.firstEdge = static_cast<uint32_t>(edges.size());
+		object.edgeCount = static_cast<uint32_t>(meshes[i].edges.size());
+		object.vertexOffset = meshes[i].vertexOffset;
+		object.draw = static_cast<uint32_t>(i);
+		object.capacity = CAPACITY;
+		object.firstInstance = 0;
+		m_InstanceCounts[i] = meshes[i].instanceCount;
+		edges.insert(edges.end(), meshes[i].edges.begin(), meshes[i].edges.end());
+	}
+
+	//Every buffer needs at least one element, even with no edges
+	const VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	VkDeviceSize edgesSize = sizeof(MeshEdge) * std::max(edges.size(), static_cast<size_t>(1));
+	VkDeviceSize quadsSize = sizeof(glm::vec4) * 4 * CAPACITY * m_Passes;
+	VkDeviceSize drawsSize = sizeof(FinDraw) * m_Passes;
+	VkDeviceSize objectDrawsSize = sizeof(VkDrawIndexedIndirectCommand) * std::max(meshes.size(), static_cast<size_t>(1));
+
+	//The edges don't change, write them once
+	m_Engine->createBuffer(edgesSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible, m_Edges, m_EdgesMemory, MemoryCategory::Mesh, "fin edges");
+	void* edgeData;
+	vkMapMemory(m_Device, m_EdgesMemory, 0, edgesSize, 0, &edgeData);
+	memcpy(edgeData, edges.data(), sizeof(MeshEdge) * edges.size());
+	vkUnmapMemory(m_Device, m_EdgesMemory);
+
+	m_Frames.resize(frames);
+	for (uint32_t f = 0; f < frames; f++) {
+		FrameBuffers& frame = m_Frames[f];
+		m_Engine->createBuffer(quadsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.quads, frame.quadsMemory, MemoryCategory::Other, "fin quads");
+		m_Engine->createBuffer(drawsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.draws, frame.drawsMemory, MemoryCategory::Other, "fin draws");
+
+		//Kept mapped for the whole run, the slot's fence is what stops the CPU writing while the GPU reads
+		VkBuffer objectDraws = culler ? culler->DrawBuffer(f) : VK_NULL_HANDLE;
+		if (!culler) {
+			m_Engine->createBuffer(objectDrawsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible, frame.objectDraws, frame.objectDrawsMemory, MemoryCategory::Other, "fin object draws");
+			void* data;
+			vkMapMemory(m_Device, frame.objectDrawsMemory, 0, objectDrawsSize, 0, &data);
+			frame.mappedObjectDraws = static_cast<VkDrawIndexedIndirectCommand*>(data);
+			memset(data, 0, objectDrawsSize);
+			objectDraws = frame.objectDraws;
+		}
+
+		VkDescriptorSetAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = m_DescriptorPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &m_DescriptorSetLayout;
+		if (vkAllocateDescriptorSets(m_Device, &allocInfo, &frame.descriptorSet) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate fin descriptor set!");
+		}
+
+		//In binding order
+		std::array<VkDescriptorBufferInfo, 8> bufferInfos = {};
+		bufferInfos[0] = { instances.FrameBuffer(f), 0, sizeof(GpuFrame) };
+		bufferInfos[1] = { instances.InstanceBuffer(f), 0, VK_WHOLE_SIZE };
+		bufferInfos[2] = { instances.VisibleBuffer(f), 0, VK_WHOLE_SIZE };
+		bufferInfos[3] = { vertexBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[4] = { m_Edges, 0, edgesSize };
+		bufferInfos[5] = { objectDraws, 0, VK_WHOLE_SIZE };
+		bufferInfos[6] = { frame.quads, 0, quadsSize };
+		bufferInfos[7] = { frame.draws, 0, drawsSize };
+
+		std::array<VkWriteDescriptorSet, 8> writes = {};
+		for (size_t i = 0; i < writes.size(); i++) {
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = frame.descriptorSet;
+			writes[i].dstBinding = bindings[i].binding;
+			writes[i].descriptorType = bindings[i].descriptorType;
+			writes[i].descriptorCount = 1;
+			writes[i].pBufferInfo = &bufferInfos[i];
+		}
+		vkUpdateDescriptorSets(m_Device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+}
+
+void FinGenerator::destroy()
+{
+	for (FrameBuffers& frame : m_Frames) {
+		vkDestroyBuffer(m_Device, frame.quads, nullptr);
+		m_Engine->freeMemory(frame.quadsMemory);
+		vkDestroyBuffer(m_Device, frame.draws, nullptr);
+		m_Engine->freeMemory(frame.drawsMemory);
+		if (frame.objectDraws != VK_NULL_HANDLE) {
+			vkDestroyBuffer(m_Device, frame.objectDraws, nullptr);
+			m_Engine->freeMemory(frame.objectDrawsMemory);
+		}
+	}
+	m_Frames.clear();
+	m_Objects.clear();
+	m_InstanceCounts.clear();
+	vkDestroyBuffer(m_Device, m_Edges, nullptr);
+	m_Engine->freeMemory(m_EdgesMemory);
+	m_Edges = VK_NULL_HANDLE;
+
+	//Destroying the pool frees the sets
+	vkDestroyDescriptorPool(m_Device, m_DescriptorPool, nullptr);
+	vkDestroyPipeline(m_Device, m_Pipeline, nullptr);
+	vkDestroyPipelineLayout(m_Device, m_PipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(m_Device, m_DescriptorSetLayout, nullptr);
+	m_DescriptorPool = VK_NULL_HANDLE;
+	m_Pipeline = VK_NULL_HANDLE;
+	m_PipelineLayout = VK_NULL_HANDLE;
+	m_DescriptorSetLayout = VK_NULL_HANDLE;
+}
+
+void FinGenerator::record(VkCommandBuffer commandBuffer, uint32_t frame, CullPass pass)
+{
+	const FrameBuffers& buffers = m_Frames[frame];
+
+	//Empty draws for every pass, each drawing from its own section of the quads (6 vertices a fin)
+	if (pass == CullPass::Early) {
+		std::vector<FinDraw> draws(m_Passes);
+		for (uint32_t p = 0; p < m_Passes; p++) {
+			draws[p] = {};
+			draws[p].instanceCount = 1;
+			draws[p].firstVertex = p * CAPACITY * 6;
+		}
+		vkCmdUpdateBuffer(commandBuffer, buffers.draws, 0, sizeof(FinDraw) * draws.size(), draws.data());
+	}
+
+	//Wait for the cleared draws, the culling pass's lists and draws, and the last use of the quads before writing them again
+	VkMemoryBarrier readyBarrier = {};
+	readyBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	readyBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	readyBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &readyBarrier, 0, nullptr, 0, nullptr);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_Pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_PipelineLayout, 0, 1, &buffers.descriptorSet, 0, nullptr);
+	for (uint32_t i = 0; i < m_Objects.size(); i++) {
+		if (m_Objects[i].edgeCount == 0 || m_InstanceCounts[i] == 0) continue;
+
+		FinObject object = m_Objects[i];
+		object.pass = static_cast<uint32_t>(pass);
+		if (m_Culler) {
+			object.draw = static_cast<uint32_t>(m_Culler->DrawOffset(pass, DrawPhase::Base, i) / sizeof(VkDrawIndexedIndirectCommand));
+		}
+
+		//A thread per edge and instance, in as many dispatches as the instances need
+		uint32_t edgeGroups = (object.edgeCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
+		for (uint32_t first = 0; first < m_InstanceCounts[i]; first += MAX_INSTANCE_GROUPS) {
+			object.firstInstance = first;
+			vkCmdPushConstants(commandBuffer, m_PipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(FinObject), &object);
+			vkCmdDispatch(commandBuffer, edgeGroups, std::min(m_InstanceCounts[i] - first, MAX_INSTANCE_GROUPS), 1);
+		}
+	}
+
+	//The draw is read as an indirect command and the quads by fin.vert
+	VkMemoryBarrier drawBarrier = {};
+	drawBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	drawBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	drawBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+		0, 1, &drawBarrier, 0, nullptr, 0, nullptr);
+}
+
+void FinGenerator::draw(VkCommandBuffer commandBuffer, uint32_t frame, CullPass pass) const
+{
+	vkCmdDrawIndirect(commandBuffer, m_Frames[frame].draws, sizeof(FinDraw) * static_cast<uint32_t>(pass), 1, sizeof(FinDraw));
+}
+
+uint32_t FinGenerator::EdgeCount() const
+{
+	uint32_t count = 0;
+	for (const FinObject& object : m_Objects) {
+		count += object.edgeCount;
+	}
+	return count;
+}
@@ -0,0 +1,74 @@
+#include "FrameComparison.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+std::vector<unsigned char> FrameComparison::loadPpm(const std::string& filename, uint32_t& width, uint32_t& height)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		throw std::runtime_error("failed to open reference frame: " + filename);
+	}
+
+	std::string magic;
+	uint32_t maxValue = 0;
+	file >> magic >> width >> height >> maxValue;
+	if (!file || magic != "P6" || maxValue != 255) {
+		throw std::runtime_error("failed to read reference frame, expected an 8 bit binary ppm: " + filename);
+	}
+	file.get(); //The single whitespace before the pixels
+
+	std::vector<unsigned char> rgb(static_cast<size_t>(width) * height * 3);
+	file.read(reinterpret_cast<char*>(rgb.data()), rgb.size());
+	if (file.gcount() != static_cast<std::streamsize>(rgb.size())) {
+		throw std::runtime_error("failed to read reference frame, file is truncated: " + filename);
+	}
+	return rgb;
+}
+
+FrameDifference FrameComparison::compare(const std::vector<unsigned char>& rgb, uint32_t width, uint32_t height, const std::string& referenceFile)
+{
+	uint32_t referenceWidth, referenceHeight;
+	std::vector<unsigned char> reference = loadPpm(referenceFile, referenceWidth, referenceHeight);
+	if (referenceWidth != width || referenceHeight != height) {
+		throw std::runtime_error("failed to compare frames, " + referenceFile + " is " + std::to_string(referenceWidth) + "x" +
+			std::to_string(referenceHeight) + " but the frame is " + std::to_string(width) + "x" + std::to_string(height) + "!");
+	}
+
+	FrameDifference difference;
+	difference.pixels = width * height;
+
+	//Pixels the reference left at the clear colour aren't counted, so the result doesn't depend on how much of the screen is drawn
+	const unsigned char* clear = reference.data();
+	uint64_t total = 0;
+	for (size_t i = 0; i < rgb.size(); i += 3) {
+		if (reference[i] == clear[0] && reference[i + 1] == clear[1] && reference[i + 2] == clear[2]) {
+			continue;
+		}
+		difference.coveredPixels++;
+
+		uint32_t pixelMax = 0;
+		for (size_t c = 0; c < 3; c++) {
+			uint32_t channel = static_cast<uint32_t>(std::abs(static_cast<int>(rgb[i + c]) - static_cast<int>(reference[i + c])));
+			total += channel;
+			pixelMax = std::max(pixelMax, channel);
+		}
+		difference.maxDifference = std::max(difference.maxDifference, pixelMax);
+		if (pixelMax > CHANNEL_THRESHOLD) {
+			difference.differingPixels++;
+		}
+	}
+	if (difference.coveredPixels > 0) {
+		difference.meanDifference = static_cast<double>(total) / (difference.coveredPixels * 3.0);
+	}
+	return difference;
+}
+
+void FrameComparison::print(const FrameDifference& difference, const std::string& referenceFile)
+{
+	std::cout << "compared with " << referenceFile << ": " << difference.differingPixels << "/" << difference.coveredPixels << " covered pixels differ ("
+		<< difference.differingFraction() * 100.0 << "%), mean difference " << difference.meanDifference << " max " << difference.maxDifference << std::endl;
+}
@@ -0,0 +1,273 @@
+#include "FrustumCuller.h"
+
+#include "CpuProfiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+//Widest SIMD the compiler is allowed to use, MSVC only defines __AVX__ with /arch:AVX but always has SSE2 on x64
+#if defined(__AVX__)
+#define CULL_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CULL_SSE
+#include <emmintrin.h>
+#endif
+
+Bounds Bounds::expanded(float distance) const
+{
+	Bounds bounds = *this;
+	bounds.extents += glm::vec3(distance);
+	bounds.radius += distance;
+	return bounds;
+}
+
+Bounds Bounds::transformed(const glm::mat4& transform) const
+{
+	Bounds bounds;
+	bounds.centre = glm::vec3(transform * glm::vec4(centre, 1.0f));
+
+	//Each world axis extent is the sum of the local extents projected onto it
+	glm::mat3 rotationScale(transform);
+	for (int axis = 0; axis < 3; axis++) {
+		bounds.extents[axis] = std::abs(rotationScale[0][axis]) * extents.x + std::abs(rotationScale[1][axis]) * extents.y + std::abs(rotationScale[2][axis]) * extents.z;
+	}
+
+	//The sphere grows by the largest scale
+	float scale = std::max(glm::length(rotationScale[0]), std::max(glm::length(rotationScale[1]), glm::length(rotationScale[2])));
+	bounds.radius = radius * scale;
+	return bounds;
+}
+
+Frustum Frustum::fromMatrix(const glm::mat4& viewProjection)
+{
+	//Gribb/Hartmann, each plane is the last row plus or minus one of the others (glm is column major, so m[column][row])
+	auto row = [&viewProjection](int i) { return glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]); };
+
+	Frustum frustum;
+	frustum.planes[0] = row(3) + row(0); //Left
+	frustum.planes[1] = row(3) - row(0); //Right
+	frustum.planes[2] = row(3) + row(1); //Bottom (top with a flipped Y)
+	frustum.planes[3] = row(3) - row(1); //Top
+	frustum.planes[4] = row(3) + row(2); //Near
+	frustum.planes[5] = row(3) - row(2); //Far
+
+	//Normalise so the distances are in world units and can be compared with the radii
+	for (glm::vec4& plane : frustum.planes) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+	return frustum;
+}
+
+const char* FrustumCuller::SimdName()
+{
+#if defined(CULL_AVX)
+	return "AVX";
+#elif defined(CULL_SSE)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+void FrustumCuller::resize(size_t count)
+{
+	m_Count = count;
+	size_t padded = (count + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+	for (std::vector<float>* component : { &m_CentreX, &m_CentreY, &m_CentreZ, &m_ExtentX, &m_ExtentY, &m_ExtentZ, &m_Radius }) {
+		component->resize(padded, 0.0f);
+	}
+}
+
+void FrustumCuller::setBounds(size_t index, const Bounds& bounds)
+{
+	m_CentreX[index] = bounds.centre.x;
+	m_CentreY[index] = bounds.centre.y;
+	m_CentreZ[index] = bounds.centre.z;
+	m_ExtentX[index] = bounds.extents.x;
+	m_ExtentY[index] = bounds.extents.y;
+	m_ExtentZ[index] = bounds.extents.z;
+	m_Radius[index] = bounds.radius;
+}
+
+void FrustumCuller::cullRange(const Frustum& frustum, size_t begin, size_t end, bool simd, std::vector<uint32_t>& visible) const
+{
+	size_t i = begin;
+
+#if defined(CULL_AVX)
+	if (simd) {
+		//Broadcast each plane, and the absolute normals for the box test, once for the whole range
+		__m256 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+		for (int p = 0; p < 6; p++) {
+			const glm::vec4& plane = frustum.planes[p];
+			planeX[p] = _mm256_set1_ps(plane.x);
+			planeY[p] = _mm256_set1_ps(plane.y);
+			planeZ[p] = _mm256_set1_ps(plane.z);
+			planeW[p] = _mm256_set1_ps(plane.w);
+			absX[p] = _mm256_set1_ps(std::abs(plane.x));
+			absY[p] = _mm256_set1_ps(std::abs(plane.y));
+			absZ[p] = _mm256_set1_ps(std::abs(plane.z));
+		}
+		const __m256 zero = _mm256_setzero_ps();
+
+		for (; i + 8 <= end; i += 8) {
+			__m256 x = _mm256_loadu_ps(&m_CentreX[i]);
+			__m256 y = _mm256_loadu_ps(&m_CentreY[i]);
+			__m256 z = _mm256_loadu_ps(&m_CentreZ[i]);
+			__m256 ex = _mm256_loadu_ps(&m_ExtentX[i]);
+			__m256 ey = _mm256_loadu_ps(&m_ExtentY[i]);
+			__m256 ez = _mm256_loadu_ps(&m_ExtentZ[i]);
+			__m256 negRadius = _mm256_sub_ps(zero, _mm256_loadu_ps(&m_Radius[i]));
+
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (int p = 0; p < 6; p++) {
+				__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y)), _mm256_add_ps(_mm256_mul_ps(planeZ[p], z), planeW[p]));
+				__m256 reach = _mm256_add_ps(_mm256_mul_ps(absX[p], ex), _mm256_add_ps(_mm256_mul_ps(absY[p], ey), _mm256_mul_ps(absZ[p], ez)));
+				__m256 sphere = _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ);
+				__m256 box = _mm256_cmp_ps(_mm256_add_ps(distance, reach), zero, _CMP_GE_OQ);
+				inside = _mm256_and_ps(inside, _mm256_and_ps(sphere, box));
+			}
+
+			int mask = _mm256_movemask_ps(inside);
+			for (int bit = 0; mask != 0; bit++, mask >>= 1) {
+				if ((mask & 1) && i + bit < m_Count) visible.push_back(static_cast<uint32_t>(i + bit));
+			}
+		}
+	}
+#elif defined(CULL_SSE)
+	if (simd) {
+		__m128 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+		for (int p = 0; p < 6; p++) {
+			const glm::vec4& plane = frustum.planes[p];
+			planeX[p] = _mm_set1_ps(plane.x);
+			planeY[p] = _mm_set1_ps(plane.y);
+			planeZ[p] = _mm_set1_ps(plane.z);
+			planeW[p] = _mm_set1_ps(plane.w);
+			absX[p] = _mm_set1_ps(std::abs(plane.x));
+			absY[p] = _mm_set1_ps(std::abs(plane.y));
+			absZ[p] = _mm_set1_ps(std::abs(plane.z));
+		}
+		const __m128 zero = _mm_setzero_ps();
+
+		for (; i + 4 <= end; i += 4) {
+			__m128 x = _mm_loadu_ps(&m_CentreX[i]);
+			__m128 y = _mm_loadu_ps(&m_CentreY[i]);
+			__m128 z = _mm_loadu_ps(&m_CentreZ[i]);
+			__m128 ex = _mm_loadu_ps(&m_ExtentX[i]);
+			__m128 ey = _mm_loadu_ps(&m_ExtentY[i]);
+			__m128 ez = _mm_loadu_ps(&m_ExtentZ[i]);
+			__m128 negRadius = _mm_sub_ps(zero, _mm_loadu_ps(&m_Radius[i]));
+
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int p = 0; p < 6; p++) {
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)), _mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+				__m128 reach = _mm_add_ps(_mm_mul_ps(absX[p], ex), _mm_add_ps(_mm_mul_ps(absY[p], ey), _mm_mul_ps(absZ[p], ez)));
+				__m128 sphere = _mm_cmpge_ps(distance, negRadius);
+				__m128 box = _mm_cmpge_ps(_mm_add_ps(distance, reach), zero);
+				inside = _mm_and_ps(inside, _mm_and_ps(sphere, box));
+			}
+
+			int mask = _mm_movemask_ps(inside);
+			for (int bit = 0; mask != 0; bit++, mask >>= 1) {
+				if ((mask & 1) && i + bit < m_Count) visible.push_back(static_cast<uint32_t>(i + bit));
+			}
+		}
+	}
+#endif
+
+	//Scalar path, and the fallback without SIMD
+	for (; i < end && i < m_Count; i++) {
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; p++) {
+			const glm::vec4& plane = frustum.planes[p];
+			float distance = plane.x * m_CentreX[i] + plane.y * m_CentreY[i] + plane.z * m_CentreZ[i] + plane.w;
+			float reach = std::abs(plane.x) * m_ExtentX[i] + std::abs(plane.y) * m_ExtentY[i] + std::abs(plane.z) * m_ExtentZ[i];
+			inside = distance >= -m_Radius[i] && distance + reach >= 0.0f;
+		}
+		if (inside) visible.push_back(static_cast<uint32_t>(i));
+	}
+}
+
+FrustumCuller::~FrustumCuller()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stopping = true;
+	}
+	m_JobReady.notify_all();
+	for (std::thread& worker : m_Workers) {
+		worker.join();
+	}
+}
+
+void FrustumCuller::cullChunk(size_t chunk)
+{
+	size_t padded = m_CentreX.size();
+	size_t begin = std::min(padded, chunk * m_JobChunkSize);
+	m_ChunkVisible[chunk].clear();
+	cullRange(*m_JobFrustum, begin, std::min(padded, begin + m_JobChunkSize), true, m_ChunkVisible[chunk]);
+}
+
+void FrustumCuller::workerLoop(size_t chunk)
+{
+	PROFILE_THREAD_NAME("cull worker");
+	uint64_t generation = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_JobReady.wait(lock, [this, generation] { return m_Stopping || m_JobGeneration != generation; });
+			if (m_Stopping) return;
+			generation = m_JobGeneration;
+		}
+
+		cullChunk(chunk);
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (--m_JobsRemaining == 0) m_JobDone.notify_one();
+	}
+}
+
+void FrustumCuller::cull(const Frustum& frustum, std::vector<uint32_t>& visible, CullPath path)
+{
+	visible.clear();
+	size_t padded = m_CentreX.size();
+
+	if (path == CullPath::Auto) {
+		path = m_Count >= PARALLEL_THRESHOLD ? CullPath::Parallel : CullPath::Simd;
+	}
+	if (path == CullPath::Parallel && m_Workers.empty()) {
+		//One chunk per hardware thread, the calling thread is one of them so a single core has no workers
+		size_t threads = std::max<unsigned int>(std::thread::hardware_concurrency(), 1);
+		m_ChunkVisible.resize(threads);
+		for (size_t chunk = 1; chunk < threads; chunk++) {
+			m_Workers.emplace_back(&FrustumCuller::workerLoop, this, chunk);
+		}
+	}
+	if (path != CullPath::Parallel || m_Workers.empty()) {
+		cullRange(frustum, 0, padded, path != CullPath::Scalar, visible);
+		return;
+	}
+
+	//Split on SIMD_WIDTH boundaries, the last chunks are empty when there are fewer objects than workers
+	size_t chunks = m_ChunkVisible.size();
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_JobFrustum = &frustum;
+		m_JobChunkSize = std::max((padded / chunks + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH, SIMD_WIDTH);
+		m_JobsRemaining = m_Workers.size();
+		m_JobGeneration++;
+	}
+	m_JobReady.notify_all();
+
+	//The calling thread takes the first chunk straight into the output
+	cullRange(frustum, 0, std::min(padded, m_JobChunkSize), true, visible);
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_JobDone.wait(lock, [this] { return m_JobsRemaining == 0; });
+	}
+
+	//Join in order so the draw order is unchanged
+	for (size_t chunk = 1; chunk < chunks; chunk++) {
+		visible.insert(visible.end(), m_ChunkVisible[chunk].begin(), m_ChunkVisible[chunk].end());
+	}
+}
@@ -0,0 +1,175 @@
+#include "GeometryArena.h"
+
+#include "VulkanEngine.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+uint32_t FreeList::allocate(uint32_t count)
+{
+	if (count == 0) return 0;
+
+	//First block big enough, the rest of it stays free
+	for (auto it = m_Free.begin(); it != m_Free.end(); ++it) {
+		if (it->second < count) continue;
+
+		uint32_t offset = it->first;
+		uint32_t remaining = it->second - count;
+		m_Free.erase(it);
+		if (remaining > 0) {
+			m_Free[offset + count] = remaining;
+		}
+		m_Used += count;
+		return offset;
+	}
+	return INVALID;
+}
+
+void FreeList::free(uint32_t offset, uint32_t count)
+{
+	if (count == 0) return;
+	m_Used -= count;
+
+	//Merge with the block after, then the block before
+	auto next = m_Free.lower_bound(offset);
+	if (next != m_Free.end() && offset + count == next->first) {
+		count += next->second;
+		next = m_Free.erase(next);
+	}
+	if (next != m_Free.begin()) {
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == offset) {
+			previous->second += count;
+			return;
+		}
+	}
+	m_Free[offset] = count;
+}
+
+void FreeList::grow(uint32_t capacity)
+{
+	if (capacity <= m_Capacity) return;
+
+	uint32_t added = capacity - m_Capacity;
+	uint32_t offset = m_Capacity;
+	m_Capacity = capacity;
+	m_Used += added; //free takes it back off
+	free(offset, added);
+}
+
+GeometryArena::GeometryArena(VulkanEngine* engine, VkDevice& device) : m_Engine(engine), m_Device(device) {}
+
+void GeometryArena::create(uint32_t vertexCapacity, uint32_t indexCapacity)
+{
+	//Transfer source as well so the buffers can be copied when they grow. The fin pass reads the vertices as a storage buffer
+	m_Engine->createBuffer(sizeof(Vertex) * vertexCapacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_VertexBuffer, m_VertexMemory, MemoryCategory::Mesh, "geometry arena vertices");
+	m_Engine->createBuffer(sizeof(uint32_t) * indexCapacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_IndexBuffer, m_IndexMemory, MemoryCategory::Mesh, "geometry arena indices");
+
+	m_Vertices = FreeList();
+	m_Vertices.grow(vertexCapacity);
+	m_Indices = FreeList();
+	m_Indices.grow(indexCapacity);
+}
+
+void GeometryArena::destroy()
+{
+	vkDestroyBuffer(m_Device, m_IndexBuffer, nullptr);
+	m_Engine->freeMemory(m_IndexMemory);
+	vkDestroyBuffer(m_Device, m_VertexBuffer, nullptr);
+	m_Engine->freeMemory(m_VertexMemory);
+	m_IndexBuffer = VK_NULL_HANDLE;
+	m_VertexBuffer = VK_NULL_HANDLE;
+}
+
+MeshRange GeometryArena::add(VkQueue& graphicsQueue, VkCommandPool& comPool, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const std::string& owner)
+{
+	uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+	uint32_t indexCount = static_cast<uint32_t>(indices.size());
+
+	//Double until the mesh fits, a fragmented arena may need more than its free total suggests
+	uint32_t vertexOffset = m_Vertices.allocate(vertexCount);
+	while (vertexOffset == FreeList::INVALID) {
+		uint32_t capacity = std::max(m_Vertices.Capacity() * 2, m_Vertices.Capacity() + vertexCount);
+		growBuffer(graphicsQueue, comPool, m_VertexBuffer, m_VertexMemory, sizeof(Vertex) * m_Vertices.Capacity(), sizeof(Vertex) * capacity,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, "geometry arena vertices");
+		m_Vertices.grow(capacity);
+		vertexOffset = m_Vertices.allocate(vertexCount);
+	}
+	uint32_t firstIndex = m_Indices.allocate(indexCount);
+	while (firstIndex == FreeList::INVALID) {
+		uint32_t capacity = std::max(m_Indices.Capacity() * 2, m_Indices.Capacity() + indexCount);
+		growBuffer(graphicsQueue, comPool, m_IndexBuffer, m_IndexMemory, sizeof(uint32_t) * m_Indices.Capacity(), sizeof(uint32_t) * capacity,
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT, "geometry arena indices");
+		m_Indices.grow(capacity);
+		firstIndex = m_Indices.allocate(indexCount);
+	}
+
+	//Indices stay relative to the mesh, the draw's vertex offset moves them to its vertices
+	upload(graphicsQueue, comPool, m_VertexBuffer, sizeof(Vertex) * vertexOffset, vertices.data(), sizeof(Vertex) * vertexCount, owner + " vertices");
+	upload(graphicsQueue, comPool, m_IndexBuffer, sizeof(uint32_t) * firstIndex, indices.data(), sizeof(uint32_t) * indexCount, owner + " indices");
+
+	MeshRange mesh;
+	mesh.firstIndex = firstIndex;
+	mesh.indexCount = indexCount;
+	mesh.vertexOffset = static_cast<int32_t>(vertexOffset);
+	mesh.vertexCount = vertexCount;
+	return mesh;
+}
+
+void GeometryArena::remove(const MeshRange& mesh)
+{
+	m_Vertices.free(static_cast<uint32_t>(mesh.vertexOffset), mesh.vertexCount);
+	m_Indices.free(mesh.firstIndex, mesh.indexCount);
+}
+
+void GeometryArena::bind(VkCommandBuffer commandBuffer)
+{
+	VkDeviceSize offsets[] = { 0 };
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_VertexBuffer, offsets);
+	vkCmdBindIndexBuffer(commandBuffer, m_IndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+void GeometryArena::growBuffer(VkQueue& graphicsQueue, VkCommandPool& comPool, VkBuffer& buffer, VkDeviceMemory& memory, VkDeviceSize oldSize, VkDeviceSize newSize, VkBufferUsageFlags usage, const std::string& owner)
+{
+	VkBuffer newBuffer;
+	VkDeviceMemory newMemory;
+	m_Engine->createBuffer(newSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, newBuffer, newMemory, MemoryCategory::Mesh, owner);
+
+	//The copy waits for the queue, so no frame still reads the old buffer when it is destroyed
+	if (oldSize > 0) {
+		m_Engine->copyBuffer(graphicsQueue, comPool, buffer, newBuffer, oldSize);
+	}
+	vkDestroyBuffer(m_Device, buffer, nullptr);
+	m_Engine->freeMemory(memory);
+
+	buffer = newBuffer;
+	memory = newMemory;
+}
+
+void GeometryArena::upload(VkQueue& graphicsQueue, VkCommandPool& comPool, VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size, const std::string& owner)
+{
+	if (size == 0) return;
+
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	m_Engine->createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory, MemoryCategory::Staging, owner);
+
+	void* mapped;
+	vkMapMemory(m_Device, stagingBufferMemory, 0, size, 0, &mapped);
+	memcpy(mapped, data, static_cast<size_t>(size));
+	vkUnmapMemory(m_Device, stagingBufferMemory);
+
+	//Into the mesh's range, copyBuffer only copies to the start of a buffer
+	VkCommandBuffer commandBuffer = m_Engine->beginSingleTimeCommands(comPool);
+	VkBufferCopy copyRegion = {};
+	copyRegion.dstOffset = offset;
+	copyRegion.size = size;
+	vkCmdCopyBuffer(commandBuffer, stagingBuffer, buffer, 1, &copyRegion);
+	m_Engine->endSingleTimeCommands(graphicsQueue, comPool, commandBuffer);
+
+	vkDestroyBuffer(m_Device, stagingBuffer, nullptr);
+	m_Engine->freeMemory(stagingBufferMemory);
+}
@@ -0,0 +1,244 @@
+#include "GpuCuller.h"
+
+#include "VulkanEngine.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+GpuCuller::GpuCuller(VulkanEngine* engine, VkDevice& device) : m_Engine(engine), m_Device(device) {}
+
+void GpuCuller::create(VkShaderModule cullShader, InstanceBuffers& instances, const std::vector<GpuMesh>& meshes, bool occlusion)
+{
+	m_InstanceCount = instances.InstanceCount();
+	m_ObjectCount = static_cast<uint32_t>(meshes.size());
+	m_Occlusion = occlusion;
+
+	//Frame uniforms, instances and meshes in, lists, draws and counts out, and the early pass's flags and the depth pyramid when occlusion culling
+	std::array<VkDescriptorSetLayoutBinding, 8> bindings = {};
+	bindings[0].binding = InstanceBuffers::FRAME_BINDING;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	bindings[1].binding = InstanceBuffers::INSTANCE_BINDING;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[2].binding = InstanceBuffers::VISIBLE_BINDING;
+	bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[3].binding = MESH_BINDING;
+	bindings[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[4].binding = DRAW_BINDING;
+	bindings[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[5].binding = COUNT_BINDING;
+	bindings[5].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[6].binding = DRAWN_EARLY_BINDING;
+	bindings[6].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[7].binding = PYRAMID_BINDING;
+	bindings[7].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	for (VkDescriptorSetLayoutBinding& binding : bindings) {
+		binding.descriptorCount = 1;
+		binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	uint32_t bindingCount = static_cast<uint32_t>(occlusion ? bindings.size() : bindings.size() - 2);
+	uint32_t storageCount = bindingCount - (occlusion ? 2 : 1);
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = bindingCount;
+	layoutInfo.pBindings = bindings.data();
+	if (vkCreateDescriptorSetLayout(m_Device, &layoutInfo, nullptr, &m_DescriptorSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create culling descriptor set layout!");
+	}
+
+	//The pass being culled is pushed as a constant
+	VkPushConstantRange pushConstant = {};
+	pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstant.size = sizeof(uint32_t);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &m_DescriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
+	if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, nullptr, &m_PipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create culling pipeline layout!");
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = cullShader;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = m_PipelineLayout;
+	if (vkCreateComputePipelines(m_Device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_Pipeline) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create culling pipeline!");
+	}
+
+	uint32_t frames = instances.Frames();
+	std::array<VkDescriptorPoolSize, 3> poolSizes = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSizes[0].descriptorCount = frames;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[1].descriptorCount = frames * storageCount;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[2].descriptorCount = frames;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = frames;
+	if (vkCreateDescriptorPool(m_Device, &poolInfo, nullptr, &m_DescriptorPool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create culling descriptor pool!");
+	}
+
+	//Every buffer needs at least one element, even with no objects. The late pass has its own draws after the early pass's
+	const VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	uint32_t passes = occlusion ? static_cast<uint32_t>(CullPass::Count) : 1;
+	VkDeviceSize meshesSize = sizeof(GpuMesh) * std::max(m_ObjectCount, 1u);
+	VkDeviceSize drawsSize = sizeof(VkDrawIndexedIndirectCommand) * passes * static_cast<uint32_t>(DrawPhase::Count) * std::max(m_ObjectCount, 1u);
+	VkDeviceSize countsSize = sizeof(uint32_t) * 2;
+	VkDeviceSize drawnEarlySize = sizeof(uint32_t) * std::max(m_InstanceCount, 1u);
+
+	//The meshes don't change, write them once
+	m_Engine->createBuffer(meshesSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible, m_Meshes, m_MeshesMemory, MemoryCategory::Other, "culling meshes");
+	void* meshData;
+	vkMapMemory(m_Device, m_MeshesMemory, 0, meshesSize, 0, &meshData);
+	memcpy(meshData, meshes.data(), sizeof(GpuMesh) * meshes.size());
+	vkUnmapMemory(m_Device, m_MeshesMemory);
+
+	m_Frames.resize(frames);
+	for (uint32_t f = 0; f < frames; f++) {
+		FrameBuffers& frame = m_Frames[f];
+		m_Engine->createBuffer(drawsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.draws, frame.drawsMemory, MemoryCategory::Other, "indirect draws");
+		m_Engine->createBuffer(countsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, hostVisible, frame.counts, frame.countsMemory, MemoryCategory::Other, "culling counts");
+		if (occlusion) {
+			m_Engine->createBuffer(drawnEarlySize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.drawnEarly, frame.drawnEarlyMemory, MemoryCategory::Other, "drawn early flags");
+		}
+
+		//Kept mapped for the whole run, read once the slot's fence has signalled
+		void* data;
+		vkMapMemory(m_Device, frame.countsMemory, 0, countsSize, 0, &data);
+		frame.mappedCounts = static_cast<const uint32_t*>(data);
+
+		VkDescriptorSetAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = m_DescriptorPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &m_DescriptorSetLayout;
+		if (vkAllocateDescriptorSets(m_Device, &allocInfo, &frame.descriptorSet) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate culling descriptor set!");
+		}
+
+		//In binding order, the pyramid is written by setDepthPyramid
+		std::array<VkDescriptorBufferInfo, 7> bufferInfos = {};
+		bufferInfos[0] = { instances.FrameBuffer(f), 0, sizeof(GpuFrame) };
+		bufferInfos[1] = { instances.InstanceBuffer(f), 0, VK_WHOLE_SIZE };
+		bufferInfos[2] = { instances.VisibleBuffer(f), 0, VK_WHOLE_SIZE };
+		bufferInfos[3] = { m_Meshes, 0, meshesSize };
+		bufferInfos[4] = { frame.draws, 0, drawsSize };
+		bufferInfos[5] = { frame.counts, 0, countsSize };
+		bufferInfos[6] = { frame.drawnEarly, 0, drawnEarlySize };
+
+		std::array<VkWriteDescriptorSet, 7> writes = {};
+		uint32_t writeCount = occlusion ? 7 : 6;
+		for (uint32_t i = 0; i < writeCount; i++) {
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = frame.descriptorSet;
+			writes[i].dstBinding = bindings[i].binding;
+			writes[i].descriptorType = bindings[i].descriptorType;
+			writes[i].descriptorCount = 1;
+			writes[i].pBufferInfo = &bufferInfos[i];
+		}
+		vkUpdateDescriptorSets(m_Device, writeCount, writes.data(), 0, nullptr);
+	}
+}
+
+void GpuCuller::setDepthPyramid(VkImageView pyramidView, VkSampler sampler)
+{
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.sampler = sampler;
+	imageInfo.imageView = pyramidView;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	for (FrameBuffers& frame : m_Frames) {
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = frame.descriptorSet;
+		write.dstBinding = PYRAMID_BINDING;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.descriptorCount = 1;
+		write.pImageInfo = &imageInfo;
+		vkUpdateDescriptorSets(m_Device, 1, &write, 0, nullptr);
+	}
+}
+
+void GpuCuller::destroy()
+{
+	for (FrameBuffers& frame : m_Frames) {
+		vkDestroyBuffer(m_Device, frame.draws, nullptr);
+		m_Engine->freeMemory(frame.drawsMemory);
+		vkDestroyBuffer(m_Device, frame.counts, nullptr);
+		m_Engine->freeMemory(frame.countsMemory);
+		if (frame.drawnEarly != VK_NULL_HANDLE) {
+			vkDestroyBuffer(m_Device, frame.drawnEarly, nullptr);
+			m_Engine->freeMemory(frame.drawnEarlyMemory);
+		}
+	}
+	m_Frames.clear();
+	vkDestroyBuffer(m_Device, m_Meshes, nullptr);
+	m_Engine->freeMemory(m_MeshesMemory);
+	m_Meshes = VK_NULL_HANDLE;
+
+	//Destroying the pool frees the sets
+	vkDestroyDescriptorPool(m_Device, m_DescriptorPool, nullptr);
+	vkDestroyPipeline(m_Device, m_Pipeline, nullptr);
+	vkDestroyPipelineLayout(m_Device, m_PipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(m_Device, m_DescriptorSetLayout, nullptr);
+	m_DescriptorPool = VK_NULL_HANDLE;
+	m_Pipeline = VK_NULL_HANDLE;
+	m_PipelineLayout = VK_NULL_HANDLE;
+	m_DescriptorSetLayout = VK_NULL_HANDLE;
+}
+
+void GpuCuller::record(VkCommandBuffer commandBuffer, uint32_t frame, CullPass pass)
+{
+	const FrameBuffers& buffers = m_Frames[frame];
+
+	if (pass == CullPass::Early) {
+		//Clear the counts and the draws for the instances to add themselves to, and wait for last use of the draws and lists
+		//(the previous frame in this slot) and the pyramid before writing or reading them again
+		vkCmdFillBuffer(commandBuffer, buffers.counts, 0, VK_WHOLE_SIZE, 0);
+		vkCmdFillBuffer(commandBuffer, buffers.draws, 0, VK_WHOLE_SIZE, 0);
+
+		VkMemoryBarrier clearBarrier = {};
+		clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+	}
+	else {
+		//The late pass reads which instances the early pass drew, and adds to its counts
+		VkMemoryBarrier earlyBarrier = {};
+		earlyBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		earlyBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		earlyBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 1, &earlyBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	uint32_t passIndex = static_cast<uint32_t>(pass);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_Pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_PipelineLayout, 0, 1, &buffers.descriptorSet, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, m_PipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &passIndex);
+	vkCmdDispatch(commandBuffer, (m_InstanceCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+	//The draws are read as indirect commands, the lists by the vertex shaders, and the count by the host once the frame is done
+	VkMemoryBarrier drawBarrier = {};
+	drawBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	drawBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	drawBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+		0, 1, &drawBarrier, 0, nullptr, 0, nullptr);
+}
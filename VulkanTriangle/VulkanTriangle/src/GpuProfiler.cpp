@@ -0,0 +1,262 @@
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+
+PipelineStats& PipelineStats::operator+=(const PipelineStats& other)
+{
+	vertexInvocations += other.vertexInvocations;
+	geometryInvocations += other.geometryInvocations;
+	clippingInvocations += other.clippingInvocations;
+	clippingPrimitives += other.clippingPrimitives;
+	fragmentInvocations += other.fragmentInvocations;
+	return *this;
+}
+
+//Statistics we query, the results come back in bit order which matches the PipelineStats members
+static const VkQueryPipelineStatisticFlags STATISTICS_FLAGS =
+	VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_GEOMETRY_SHADER_INVOCATIONS_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+double GpuFrameTimes::zone(const std::string& name) const
+{
+	for (auto& zoneTime : zones) {
+		if (zoneTime.name == name) return zoneTime.ms;
+	}
+	return 0.0;
+}
+
+GpuProfiler::GpuProfiler(VkPhysicalDevice& phyDevice, VkDevice& device, uint32_t queueFamily, uint32_t slots, bool pipelineStatistics, uint32_t maxZones, size_t historySize)
+	: m_Device(device), m_Slots(slots), m_MaxZones(maxZones), m_HistorySize(historySize)
+{
+	m_SlotFrame.assign(slots, 0);
+	m_SlotZones.resize(slots);
+	m_SlotPending.assign(slots, false);
+
+	//Check the queue can write timestamps at all
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(phyDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(phyDevice, &queueFamilyCount, queueFamilies.data());
+
+	uint32_t validBits = queueFamilies[queueFamily].timestampValidBits;
+	if (validBits == 0) {
+		std::cout << "timestamps not supported on the graphics queue, GPU times will not be recorded" << std::endl;
+		return;
+	}
+	m_TimestampMask = (validBits >= 64) ? ~0ull : ((1ull << validBits) - 1);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(phyDevice, &properties);
+	m_TimestampPeriod = properties.limits.timestampPeriod;
+
+	//Start and end timestamp for the frame and each zone, for each slot
+	VkQueryPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	poolInfo.queryCount = slots * QueriesPerSlot();
+
+	if (vkCreateQueryPool(m_Device, &poolInfo, nullptr, &m_QueryPool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create timestamp query pool!");
+	}
+
+	if (pipelineStatistics) {
+		VkQueryPoolCreateInfo statsInfo = {};
+		statsInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		statsInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		statsInfo.queryCount = slots * m_MaxZones;
+		statsInfo.pipelineStatistics = STATISTICS_FLAGS;
+
+		if (vkCreateQueryPool(m_Device, &statsInfo, nullptr, &m_StatsPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline statistics query pool!");
+		}
+	}
+}
+
+GpuProfiler::~GpuProfiler()
+{
+	destroy();
+}
+
+GpuProfiler::Scope::Scope(GpuProfiler& profiler, VkCommandBuffer commandBuffer, uint32_t slot, const char* name)
+	: m_Profiler(profiler), m_CommandBuffer(commandBuffer), m_Slot(slot)
+{
+	m_Zone = m_Profiler.beginZone(commandBuffer, slot, name);
+}
+
+GpuProfiler::Scope::~Scope()
+{
+	m_Profiler.endZone(m_CommandBuffer, m_Slot, m_Zone);
+}
+
+double GpuProfiler::toMs(uint64_t start, uint64_t end) const
+{
+	uint64_t ticks = (end - start) & m_TimestampMask;
+	return static_cast<double>(ticks) * m_TimestampPeriod / 1000000.0;
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer commandBuffer, uint32_t slot, size_t frame)
+{
+	if (!Supported()) return;
+
+	//Queries have to be reset before they can be written again, this can't be done inside a render pass
+	vkCmdResetQueryPool(commandBuffer, m_QueryPool, slot * QueriesPerSlot(), QueriesPerSlot());
+	if (StatisticsEnabled()) {
+		vkCmdResetQueryPool(commandBuffer, m_StatsPool, slot * m_MaxZones, m_MaxZones);
+	}
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_QueryPool, slot * QueriesPerSlot());
+
+	m_SlotFrame[slot] = frame;
+	m_SlotZones[slot].clear();
+	m_SlotPending[slot] = true;
+}
+
+void GpuProfiler::endFrame(VkCommandBuffer commandBuffer, uint32_t slot)
+{
+	if (!Supported()) return;
+
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_QueryPool, slot * QueriesPerSlot() + 1);
+}
+
+uint32_t GpuProfiler::beginZone(VkCommandBuffer commandBuffer, uint32_t slot, const char* name)
+{
+	if (!Supported() || m_SlotZones[slot].size() >= m_MaxZones) return UINT32_MAX;
+
+	uint32_t zone = static_cast<uint32_t>(m_SlotZones[slot].size());
+	m_SlotZones[slot].push_back(name);
+
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_QueryPool, slot * QueriesPerSlot() + 2 + zone * 2);
+	if (StatisticsEnabled()) {
+		vkCmdBeginQuery(commandBuffer, m_StatsPool, slot * m_MaxZones + zone, 0);
+	}
+	return zone;
+}
+
+void GpuProfiler::endZone(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t zone)
+{
+	if (!Supported() || zone == UINT32_MAX) return;
+
+	if (StatisticsEnabled()) {
+		vkCmdEndQuery(commandBuffer, m_StatsPool, slot * m_MaxZones + zone);
+	}
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_QueryPool, slot * QueriesPerSlot() + 3 + zone * 2);
+}
+
+bool GpuProfiler::collect(uint32_t slot)
+{
+	if (!Supported() || !m_SlotPending[slot]) return false;
+
+	//Only read the queries this frame wrote, without waiting. If they aren't ready yet try again next time round
+	uint32_t zoneCount = static_cast<uint32_t>(m_SlotZones[slot].size());
+	uint32_t queryCount = 2 + zoneCount * 2;
+	std::vector<uint64_t> timestamps(queryCount);
+	if (vkGetQueryPoolResults(m_Device, m_QueryPool, slot * QueriesPerSlot(), queryCount, timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+		return false;
+	}
+
+	std::vector<PipelineStats> stats(zoneCount);
+	if (StatisticsEnabled() && zoneCount > 0) {
+		if (vkGetQueryPoolResults(m_Device, m_StatsPool, slot * m_MaxZones, zoneCount, stats.size() * sizeof(PipelineStats), stats.data(), sizeof(PipelineStats), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+			return false;
+		}
+	}
+	m_SlotPending[slot] = false;
+
+	GpuFrameTimes times;
+	times.frame = m_SlotFrame[slot];
+	times.gpuMs = toMs(timestamps[0], timestamps[1]);
+	times.hasStatistics = StatisticsEnabled();
+
+	//Add zones with the same name together
+	for (size_t i = 0; i < m_SlotZones[slot].size(); i++) {
+		double ms = toMs(timestamps[2 + i * 2], timestamps[3 + i * 2]);
+
+		auto found = std::find_if(times.zones.begin(), times.zones.end(), [&](const GpuZoneTime& zoneTime) { return zoneTime.name == m_SlotZones[slot][i]; });
+		if (found != times.zones.end()) {
+			found->ms += ms;
+			found->stats += stats[i];
+		}
+		else {
+			times.zones.push_back({ m_SlotZones[slot][i], ms, stats[i] });
+		}
+	}
+
+	m_History.push_back(times);
+	if (m_History.size() > m_HistorySize) {
+		m_History.pop_front();
+	}
+	return true;
+}
+
+GpuFrameTimes GpuProfiler::average(size_t count) const
+{
+	GpuFrameTimes result;
+	count = std::min(count, m_History.size());
+	if (count == 0) return result;
+
+	for (size_t i = m_History.size() - count; i < m_History.size(); i++) {
+		const GpuFrameTimes& times = m_History[i];
+		result.frame = times.frame;
+		result.gpuMs += times.gpuMs;
+		result.hasStatistics = times.hasStatistics;
+
+		for (auto& zoneTime : times.zones) {
+			auto found = std::find_if(result.zones.begin(), result.zones.end(), [&](const GpuZoneTime& total) { return total.name == zoneTime.name; });
+			if (found != result.zones.end()) {
+				found->ms += zoneTime.ms;
+				found->stats += zoneTime.stats;
+			}
+			else {
+				result.zones.push_back(zoneTime);
+			}
+		}
+	}
+
+	//Zones missing from some frames (e.g. before their pipeline was ready) count as zero for those frames
+	result.gpuMs /= count;
+	for (auto& zoneTime : result.zones) {
+		zoneTime.ms /= count;
+		zoneTime.stats.vertexInvocations /= count;
+		zoneTime.stats.geometryInvocations /= count;
+		zoneTime.stats.clippingInvocations /= count;
+		zoneTime.stats.clippingPrimitives /= count;
+		zoneTime.stats.fragmentInvocations /= count;
+	}
+	return result;
+}
+
+void GpuProfiler::printAverage(size_t count) const
+{
+	GpuFrameTimes times = average(count);
+
+	std::cout << "gpu (frame " << times.frame << ", " << std::min(count, m_History.size()) << " frame average): " << times.gpuMs << "ms";
+	for (auto& zoneTime : times.zones) {
+		std::cout << " " << zoneTime.name << " " << zoneTime.ms << "ms";
+	}
+	std::cout << std::endl;
+
+	//Invocation counts per phase, fragment invocations divided by pixels gives the overdraw
+	if (times.hasStatistics) {
+		for (auto& zoneTime : times.zones) {
+			std::cout << "\t" << zoneTime.name << ": vs " << zoneTime.stats.vertexInvocations << " gs " << zoneTime.stats.geometryInvocations
+				<< " clip " << zoneTime.stats.clippingInvocations << "/" << zoneTime.stats.clippingPrimitives << " fs " << zoneTime.stats.fragmentInvocations << std::endl;
+		}
+	}
+}
+
+void GpuProfiler::destroy()
+{
+	if (m_QueryPool != VK_NULL_HANDLE) {
+		vkDestroyQueryPool(m_Device, m_QueryPool, nullptr);
+		m_QueryPool = VK_NULL_HANDLE;
+	}
+	if (m_StatsPool != VK_NULL_HANDLE) {
+		vkDestroyQueryPool(m_Device, m_StatsPool, nullptr);
+		m_StatsPool = VK_NULL_HANDLE;
+	}
+}
@@ -0,0 +1,74 @@
+#include "InstanceBuffers.h"
+
+#include "VulkanEngine.h"
+
+#include <algorithm>
+
+InstanceBuffers::InstanceBuffers(VulkanEngine* engine, VkDevice& device) : m_Engine(engine), m_Device(device) {}
+
+void InstanceBuffers::create(uint32_t frames, uint32_t instanceCount, uint32_t lists)
+{
+	m_InstanceCount = instanceCount;
+	m_Lists = lists;
+
+	//Every buffer needs at least one element, even with no instances
+	VkDeviceSize instancesSize = sizeof(GpuInstance) * std::max(instanceCount, 1u);
+	VkDeviceSize visibleSize = sizeof(uint32_t) * std::max(instanceCount * lists, 1u);
+
+	m_Frames.resize(frames);
+	for (FrameBuffers& frame : m_Frames) {
+		const VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		m_Engine->createBuffer(sizeof(GpuFrame), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, hostVisible, frame.frame, frame.frameMemory, MemoryCategory::Uniform, "frame uniforms");
+		m_Engine->createBuffer(instancesSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible, frame.instances, frame.instancesMemory, MemoryCategory::Uniform, "instances");
+		m_Engine->createBuffer(visibleSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible, frame.visible, frame.visibleMemory, MemoryCategory::Other, "visible instances");
+
+		//Kept mapped for the whole run, the slot's fence is what stops the CPU writing while the GPU reads
+		void* data;
+		vkMapMemory(m_Device, frame.frameMemory, 0, sizeof(GpuFrame), 0, &data);
+		frame.mappedFrame = static_cast<GpuFrame*>(data);
+		vkMapMemory(m_Device, frame.instancesMemory, 0, instancesSize, 0, &data);
+		frame.mappedInstances = static_cast<GpuInstance*>(data);
+		vkMapMemory(m_Device, frame.visibleMemory, 0, visibleSize, 0, &data);
+		frame.mappedVisible = static_cast<uint32_t*>(data);
+
+		frame.changedFlags.assign(instanceCount, 0);
+		frame.changed.clear();
+	}
+
+	//Nothing has been written yet
+	for (uint32_t i = 0; i < instanceCount; i++) {
+		markChanged(i);
+	}
+}
+
+void InstanceBuffers::destroy()
+{
+	for (FrameBuffers& frame : m_Frames) {
+		vkDestroyBuffer(m_Device, frame.frame, nullptr);
+		m_Engine->freeMemory(frame.frameMemory);
+		vkDestroyBuffer(m_Device, frame.instances, nullptr);
+		m_Engine->freeMemory(frame.instancesMemory);
+		vkDestroyBuffer(m_Device, frame.visible, nullptr);
+		m_Engine->freeMemory(frame.visibleMemory);
+	}
+	m_Frames.clear();
+}
+
+void InstanceBuffers::markChanged(uint32_t instance)
+{
+	for (FrameBuffers& frame : m_Frames) {
+		if (!frame.changedFlags[instance]) {
+			frame.changedFlags[instance] = 1;
+			frame.changed.push_back(instance);
+		}
+	}
+}
+
+void InstanceBuffers::clearChanged(uint32_t frame)
+{
+	FrameBuffers& buffers = m_Frames[frame];
+	for (uint32_t instance : buffers.changed) {
+		buffers.changedFlags[instance] = 0;
+	}
+	buffers.changed.clear();
+}
@@ -0,0 +1,91 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& filename)
+{
+#ifdef _WIN32
+	//Open the file for reading and get its size
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("failed to open file: " + filename);
+	}
+	m_File = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		close();
+		throw std::runtime_error("failed to get file size: " + filename);
+	}
+	m_Size = static_cast<size_t>(size.QuadPart);
+
+	//Empty files can't be mapped, leave the data as null
+	if (m_Size == 0) return;
+
+	//Map the whole file as read only
+	m_Mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_Mapping == nullptr) {
+		close();
+		throw std::runtime_error("failed to map file: " + filename);
+	}
+
+	m_Data = MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	//Open the file for reading and get its size
+	m_File = open(filename.c_str(), O_RDONLY);
+	if (m_File < 0) {
+		throw std::runtime_error("failed to open file: " + filename);
+	}
+
+	struct stat info;
+	if (fstat(m_File, &info) != 0) {
+		close();
+		throw std::runtime_error("failed to get file size: " + filename);
+	}
+	m_Size = static_cast<size_t>(info.st_size);
+
+	//Empty files can't be mapped, leave the data as null
+	if (m_Size == 0) return;
+
+	//Map the whole file as read only
+	void* data = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, m_File, 0);
+	m_Data = (data == MAP_FAILED) ? nullptr : data;
+#endif
+
+	if (m_Data == nullptr) {
+		close();
+		throw std::runtime_error("failed to map file: " + filename);
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (m_Data) UnmapViewOfFile(m_Data);
+	if (m_Mapping) CloseHandle(m_Mapping);
+	if (m_File) CloseHandle(m_File);
+	m_Mapping = nullptr;
+	m_File = nullptr;
+#else
+	if (m_Data) munmap(const_cast<void*>(m_Data), m_Size);
+	if (m_File >= 0) ::close(m_File);
+	m_File = -1;
+#endif
+	m_Data = nullptr;
+}
@@ -0,0 +1,156 @@
+#include "MemoryTracker.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+const char* toString(MemoryCategory category)
+{
+	switch (category) {
+	case MemoryCategory::Uniform: return "uniform";
+	case MemoryCategory::Mesh: return "mesh";
+	case MemoryCategory::Texture: return "texture";
+	case MemoryCategory::Depth: return "depth";
+	case MemoryCategory::RenderTarget: return "render target";
+	case MemoryCategory::Staging: return "staging";
+	default: return "other";
+	}
+}
+
+//Bytes to mebibytes for printing
+static double toMiB(VkDeviceSize bytes)
+{
+	return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+MemoryTracker::MemoryTracker(VkPhysicalDevice& phyDevice, bool budgetExtension) : m_PhyDevice(phyDevice)
+{
+	vkGetPhysicalDeviceMemoryProperties(m_PhyDevice, &m_MemoryProperties);
+	m_HeapBytes.assign(m_MemoryProperties.memoryHeapCount, 0);
+	m_HeapLevel.assign(m_MemoryProperties.memoryHeapCount, 0);
+
+	//The budget is read through the properties2 query, which is an extension function on Vulkan 1.0 loaded with the instance
+	if (budgetExtension) {
+		m_GetMemoryProperties2 = vkGetPhysicalDeviceMemoryProperties2KHR;
+	}
+	if (!m_GetMemoryProperties2) {
+		std::cout << "memory budget extension not available, thresholds are against the heap sizes" << std::endl;
+	}
+}
+
+void MemoryTracker::track(VkDeviceMemory memory, VkDeviceSize size, uint32_t memoryTypeIndex, MemoryCategory category, const std::string& owner)
+{
+	uint32_t heap = m_MemoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+	m_Allocations[memory] = { size, heap, category, owner };
+	m_HeapBytes[heap] += size;
+	m_CategoryBytes[static_cast<size_t>(category)] += size;
+	m_PeakBytes = std::max(m_PeakBytes, TotalBytes());
+
+	checkThresholds();
+}
+
+void MemoryTracker::release(VkDeviceMemory memory)
+{
+	auto found = m_Allocations.find(memory);
+	if (found == m_Allocations.end()) return; //Not allocated through the tracker (or already released)
+
+	m_HeapBytes[found->second.heap] -= found->second.size;
+	m_CategoryBytes[static_cast<size_t>(found->second.category)] -= found->second.size;
+	m_Allocations.erase(found);
+}
+
+void MemoryTracker::setThresholds(std::vector<double> thresholds)
+{
+	std::sort(thresholds.begin(), thresholds.end());
+	m_Thresholds = thresholds;
+	m_HeapLevel.assign(m_HeapLevel.size(), 0);
+}
+
+std::vector<MemoryHeapUsage> MemoryTracker::heapUsage() const
+{
+	std::vector<MemoryHeapUsage> heaps(m_MemoryProperties.memoryHeapCount);
+	for (uint32_t i = 0; i < m_MemoryProperties.memoryHeapCount; i++) {
+		heaps[i].size = m_MemoryProperties.memoryHeaps[i].size;
+		heaps[i].tracked = m_HeapBytes[i];
+		heaps[i].budget = heaps[i].size;
+		heaps[i].usage = heaps[i].tracked;
+		heaps[i].deviceLocal = (m_MemoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+	}
+
+	if (BudgetSupported()) {
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {};
+		budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+		VkPhysicalDeviceMemoryProperties2 properties = {};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+		properties.pNext = &budget;
+		m_GetMemoryProperties2(m_PhyDevice, &properties);
+
+		for (uint32_t i = 0; i < m_MemoryProperties.memoryHeapCount; i++) {
+			heaps[i].budget = budget.heapBudget[i];
+			heaps[i].usage = budget.heapUsage[i];
+		}
+	}
+	return heaps;
+}
+
+void MemoryTracker::checkThresholds()
+{
+	if (m_Thresholds.empty()) return;
+
+	std::vector<MemoryHeapUsage> heaps = heapUsage();
+	for (uint32_t i = 0; i < heaps.size(); i++) {
+		if (heaps[i].budget == 0) continue;
+		double fraction = static_cast<double>(heaps[i].usage) / heaps[i].budget;
+
+		//How many thresholds the heap is over now, only report going up so a heap sitting over a threshold doesn't spam
+		size_t level = 0;
+		while (level < m_Thresholds.size() && fraction >= m_Thresholds[level]) level++;
+
+		if (level > m_HeapLevel[i] && m_Callback) {
+			MemoryThresholdEvent event;
+			event.heap = i;
+			event.threshold = m_Thresholds[level - 1];
+			event.fraction = fraction;
+			event.usage = heaps[i];
+			m_Callback(event);
+		}
+		m_HeapLevel[i] = level;
+	}
+}
+
+VkDeviceSize MemoryTracker::TotalBytes() const
+{
+	VkDeviceSize total = 0;
+	for (VkDeviceSize bytes : m_HeapBytes) {
+		total += bytes;
+	}
+	return total;
+}
+
+void MemoryTracker::printReport() const
+{
+	std::cout << "memory: " << toMiB(TotalBytes()) << "MiB live in " << m_Allocations.size() << " allocations, peak " << toMiB(m_PeakBytes) << "MiB" << std::endl;
+
+	for (size_t i = 0; i < m_CategoryBytes.size(); i++) {
+		if (m_CategoryBytes[i] == 0) continue;
+		std::cout << "\t" << toString(static_cast<MemoryCategory>(i)) << " " << toMiB(m_CategoryBytes[i]) << "MiB" << std::endl;
+	}
+
+	std::vector<MemoryHeapUsage> heaps = heapUsage();
+	for (size_t i = 0; i < heaps.size(); i++) {
+		std::cout << "\theap " << i << (heaps[i].deviceLocal ? " (device local)" : "") << ": tracked " << toMiB(heaps[i].tracked) << "MiB, usage "
+			<< toMiB(heaps[i].usage) << "MiB of " << toMiB(heaps[i].budget) << "MiB budget (" << toMiB(heaps[i].size) << "MiB heap)" << std::endl;
+	}
+
+	//Largest owners, allocations with the same owner and category are added together
+	std::unordered_map<std::string, VkDeviceSize> owners;
+	for (auto& allocation : m_Allocations) {
+		owners[allocation.second.owner + " (" + toString(allocation.second.category) + ")"] += allocation.second.size;
+	}
+	std::vector<std::pair<std::string, VkDeviceSize>> sorted(owners.begin(), owners.end());
+	std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+	for (size_t i = 0; i < sorted.size() && i < 8; i++) {
+		std::cout << "\t\t" << sorted[i].first << " " << toMiB(sorted[i].second) << "MiB" << std::endl;
+	}
+}
@@ -0,0 +1,97 @@
+#include "Microbench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+volatile uint64_t Microbench::s_Sink = 0;
+
+Microbench::Microbench(size_t repetitions, const std::string& filter) : m_Repetitions(std::max<size_t>(repetitions, 1)), m_Filter(filter)
+{
+}
+
+void Microbench::run(const std::string& name, uint64_t bytes, const std::function<void()>& body)
+{
+	if (!m_Filter.empty() && name.find(m_Filter) == std::string::npos) return;
+
+	for (size_t i = 0; i < WARMUP_RUNS; i++) {
+		body();
+	}
+
+	std::vector<double> times(m_Repetitions);
+	for (size_t i = 0; i < m_Repetitions; i++) {
+		auto start = std::chrono::steady_clock::now();
+		body();
+		times[i] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	MicrobenchResult result;
+	result.name = name;
+	result.repetitions = m_Repetitions;
+	result.bytes = bytes;
+
+	double total = 0.0;
+	for (double time : times) {
+		total += time;
+	}
+	result.meanMs = total / times.size();
+
+	//Median of an even count is the mean of the middle two
+	std::sort(times.begin(), times.end());
+	size_t middle = times.size() / 2;
+	result.medianMs = times.size() % 2 == 0 ? (times[middle - 1] + times[middle]) * 0.5 : times[middle];
+	result.minMs = times.front();
+	result.maxMs = times.back();
+
+	m_Results.push_back(result);
+}
+
+//Throughput at the median time, 0 if the case doesn't have one
+static double megabytesPerSecond(const MicrobenchResult& result)
+{
+	if (result.bytes == 0 || result.medianMs <= 0.0) return 0.0;
+	return (result.bytes / (1024.0 * 1024.0)) / (result.medianMs / 1000.0);
+}
+
+void Microbench::print() const
+{
+	std::cout << std::fixed << std::setprecision(4);
+	std::cout << std::left << std::setw(40) << "case" << std::right << std::setw(8) << "reps" << std::setw(12) << "min ms"
+		<< std::setw(12) << "median ms" << std::setw(12) << "mean ms" << std::setw(12) << "max ms" << std::setw(12) << "MiB/s" << std::endl;
+	for (auto& result : m_Results) {
+		std::cout << std::left << std::setw(40) << result.name << std::right << std::setw(8) << result.repetitions << std::setw(12) << result.minMs
+			<< std::setw(12) << result.medianMs << std::setw(12) << result.meanMs << std::setw(12) << result.maxMs;
+		if (result.bytes > 0) {
+			std::cout << std::setw(12) << std::setprecision(1) << megabytesPerSecond(result) << std::setprecision(4);
+		}
+		std::cout << std::endl;
+	}
+	std::cout << std::defaultfloat << std::setprecision(6);
+}
+
+void Microbench::writeJson(const std::string& filename) const
+{
+	std::ofstream out(filename);
+	if (!out.is_open()) {
+		throw std::runtime_error("failed to open microbench output: " + filename);
+	}
+
+	out << "{\n";
+	out << "\t\"repetitions\": " << m_Repetitions << ",\n";
+	out << "\t\"warmup\": " << WARMUP_RUNS << ",\n";
+	out << "\t\"cases\": [\n";
+	for (size_t i = 0; i < m_Results.size(); i++) {
+		const MicrobenchResult& result = m_Results[i];
+		out << "\t\t{ \"name\": \"" << result.name << "\", \"minMs\": " << result.minMs << ", \"medianMs\": " << result.medianMs
+			<< ", \"meanMs\": " << result.meanMs << ", \"maxMs\": " << result.maxMs << ", \"bytes\": " << result.bytes
+			<< ", \"bytesPerSecond\": " << megabytesPerSecond(result) * 1024.0 * 1024.0 << " }";
+		out << (i + 1 < m_Results.size() ? ",\n" : "\n");
+	}
+	out << "\t]\n";
+	out << "}\n";
+
+	std::cout << "microbench: " << m_Results.size() << " cases written to " << filename << std::endl;
+}
@@ -0,0 +1,295 @@
+#include "OitCompositor.h"
+
+#include "VulkanEngine.h"
+
+#include <array>
+#include <stdexcept>
+
+OitCompositor::OitCompositor(VulkanEngine* engine, VkDevice& device) : m_Engine(engine), m_Device(device) {}
+
+void OitCompositor::createLayout()
+{
+	//Accumulation then revealage, read by the composite's fragment shader
+	std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+	for (uint32_t i = 0; i < bindings.size(); i++) {
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+	if (vkCreateDescriptorSetLayout(m_Device, &layoutInfo, nullptr, &m_DescriptorSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create transparency descriptor set layout!");
+	}
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &m_DescriptorSetLayout;
+	if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, nullptr, &m_PipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create transparency pipeline layout!");
+	}
+
+	//The set is rewritten whenever the targets are recreated, every frame in flight shares it like they share the targets
+	VkDescriptorPoolSize poolSize = {};
+	poolSize.type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+	poolSize.descriptorCount = static_cast<uint32_t>(bindings.size());
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+	poolInfo.maxSets = 1;
+	if (vkCreateDescriptorPool(m_Device, &poolInfo, nullptr, &m_DescriptorPool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create transparency descriptor pool!");
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_DescriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &m_DescriptorSetLayout;
+	if (vkAllocateDescriptorSets(m_Device, &allocInfo, &m_DescriptorSet) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate transparency descriptor set!");
+	}
+}
+
+void OitCompositor::destroyLayout()
+{
+	vkDestroyDescriptorPool(m_Device, m_DescriptorPool, nullptr);
+	vkDestroyPipelineLayout(m_Device, m_PipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(m_Device, m_DescriptorSetLayout, nullptr);
+	m_DescriptorSet = VK_NULL_HANDLE;
+	m_DescriptorPool = VK_NULL_HANDLE;
+	m_PipelineLayout = VK_NULL_HANDLE;
+	m_DescriptorSetLayout = VK_NULL_HANDLE;
+}
+
+void OitCompositor::createRenderPass(VkFormat colorFormat, VkFormat depthFormat, VkImageLayout finalLayout)
+{
+	//Frame colour, kept from the passes before and only written by the composite
+	VkAttachmentDescription colorAttachment = {};
+	colorAttachment.format = colorFormat;
+	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorAttachment.finalLayout = finalLayout;
+
+	//Base mesh depth, only tested against and not needed after the frame
+	VkAttachmentDescription depthAttachment = {};
+	depthAttachment.format = depthFormat;
+	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+	//Accumulation clears to nothing and revealage to fully revealed, neither is needed after the composite
+	VkAttachmentDescription accumAttachment = {};
+	accumAttachment.format = ACCUM_FORMAT;
+	accumAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	accumAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	accumAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	accumAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	accumAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	accumAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	accumAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkAttachmentDescription revealAttachment = accumAttachment;
+	revealAttachment.format = REVEAL_FORMAT;
+
+	std::array<VkAttachmentReference, 2> targetRefs = {};
+	targetRefs[0] = { 2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+	targetRefs[1] = { 3, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+	VkAttachmentReference depthAttachmentRef = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+
+	std::array<VkAttachmentReference, 2> inputRefs = {};
+	inputRefs[0] = { 2, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	inputRefs[1] = { 3, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	VkAttachmentReference colorAttachmentRef = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+
+	std::array<VkSubpassDescription, 2> subpasses = {};
+	subpasses[SHELL_SUBPASS].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpasses[SHELL_SUBPASS].colorAttachmentCount = static_cast<uint32_t>(targetRefs.size());
+	subpasses[SHELL_SUBPASS].pColorAttachments = targetRefs.data();
+	subpasses[SHELL_SUBPASS].pDepthStencilAttachment = &depthAttachmentRef;
+
+	subpasses[COMPOSITE_SUBPASS].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpasses[COMPOSITE_SUBPASS].inputAttachmentCount = static_cast<uint32_t>(inputRefs.size());
+	subpasses[COMPOSITE_SUBPASS].pInputAttachments = inputRefs.data();
+	subpasses[COMPOSITE_SUBPASS].colorAttachmentCount = 1;
+	subpasses[COMPOSITE_SUBPASS].pColorAttachments = &colorAttachmentRef;
+
+	std::array<VkSubpassDependency, 4> dependencies = {};
+
+	//Wait for the depth and colour of the passes before, and for the last frame's composite to finish reading the targets
+	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].dstSubpass = SHELL_SUBPASS;
+	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+	dependencies[1].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[1].dstSubpass = COMPOSITE_SUBPASS;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+	//The composite reads each pixel of the targets the shells wrote at that pixel, so it can stay on tile
+	dependencies[2].srcSubpass = SHELL_SUBPASS;
+	dependencies[2].dstSubpass = COMPOSITE_SUBPASS;
+	dependencies[2].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[2].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependencies[2].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[2].dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+	dependencies[2].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+	//Hand the finished frame on to the present, or to the readback copy when headless
+	dependencies[3].srcSubpass = COMPOSITE_SUBPASS;
+	dependencies[3].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[3].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[3].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+	dependencies[3].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[3].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+	if (finalLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
+		dependencies[3].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		dependencies[3].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	}
+
+	std::array<VkAttachmentDescription, 4> attachments = { colorAttachment, depthAttachment, accumAttachment, revealAttachment };
+	VkRenderPassCreateInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	renderPassInfo.pAttachments = attachments.data();
+	renderPassInfo.subpassCount = static_cast<uint32_t>(subpasses.size());
+	renderPassInfo.pSubpasses = subpasses.data();
+	renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	renderPassInfo.pDependencies = dependencies.data();
+
+	if (vkCreateRenderPass(m_Device, &renderPassInfo, nullptr, &m_RenderPass) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create transparency render pass!");
+	}
+}
+
+void OitCompositor::destroyRenderPass()
+{
+	vkDestroyRenderPass(m_Device, m_RenderPass, nullptr);
+	m_RenderPass = VK_NULL_HANDLE;
+}
+
+void OitCompositor::createTargets(VkExtent2D extent, VkImageView depthImageView, const std::vector<VkImageView>& colorImageViews)
+{
+	m_Extent = extent;
+
+	//The targets never leave the pass, so tiled GPUs need not give them memory of their own
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+	m_Engine->createImage(extent.width, extent.height, ACCUM_FORMAT, VK_IMAGE_TILING_OPTIMAL, usage,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_AccumImage, m_AccumImageMemory, MemoryCategory::RenderTarget, "transparency accumulation");
+	m_AccumImageView = m_Engine->createImageView(m_AccumImage, ACCUM_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT);
+	m_Engine->createImage(extent.width, extent.height, REVEAL_FORMAT, VK_IMAGE_TILING_OPTIMAL, usage,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_RevealImage, m_RevealImageMemory, MemoryCategory::RenderTarget, "transparency revealage");
+	m_RevealImageView = m_Engine->createImageView(m_RevealImage, REVEAL_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT);
+
+	m_Framebuffers.resize(colorImageViews.size());
+	for (size_t i = 0; i < colorImageViews.size(); i++) {
+		std::array<VkImageView, 4> attachments = { colorImageViews[i], depthImageView, m_AccumImageView, m_RevealImageView };
+
+		VkFramebufferCreateInfo framebufferInfo = {};
+		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferInfo.renderPass = m_RenderPass;
+		framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		framebufferInfo.pAttachments = attachments.data();
+		framebufferInfo.width = extent.width;
+		framebufferInfo.height = extent.height;
+		framebufferInfo.layers = 1;
+
+		if (vkCreateFramebuffer(m_Device, &framebufferInfo, nullptr, &m_Framebuffers[i]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create transparency framebuffer!");
+		}
+	}
+
+	//Point the composite at the new targets
+	std::array<VkDescriptorImageInfo, 2> imageInfos = {};
+	imageInfos[0].imageView = m_AccumImageView;
+	imageInfos[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfos[1].imageView = m_RevealImageView;
+	imageInfos[1].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkWriteDescriptorSet write = {};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = m_DescriptorSet;
+	write.dstBinding = 0;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+	write.descriptorCount = static_cast<uint32_t>(imageInfos.size());
+	write.pImageInfo = imageInfos.data();
+	vkUpdateDescriptorSets(m_Device, 1, &write, 0, nullptr);
+}
+
+void OitCompositor::destroyTargets()
+{
+	for (VkFramebuffer framebuffer : m_Framebuffers) {
+		vkDestroyFramebuffer(m_Device, framebuffer, nullptr);
+	}
+	m_Framebuffers.clear();
+
+	vkDestroyImageView(m_Device, m_AccumImageView, nullptr);
+	vkDestroyImage(m_Device, m_AccumImage, nullptr);
+	m_Engine->freeMemory(m_AccumImageMemory);
+	vkDestroyImageView(m_Device, m_RevealImageView, nullptr);
+	vkDestroyImage(m_Device, m_RevealImage, nullptr);
+	m_Engine->freeMemory(m_RevealImageMemory);
+	m_AccumImageView = VK_NULL_HANDLE;
+	m_AccumImage = VK_NULL_HANDLE;
+	m_AccumImageMemory = VK_NULL_HANDLE;
+	m_RevealImageView = VK_NULL_HANDLE;
+	m_RevealImage = VK_NULL_HANDLE;
+	m_RevealImageMemory = VK_NULL_HANDLE;
+}
+
+void OitCompositor::begin(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	//Colour and depth are loaded, their clear values are unused
+	std::array<VkClearValue, 4> clearValues = {};
+	clearValues[2].color = { 0.0f, 0.0f, 0.0f, 0.0f };
+	clearValues[3].color = { 1.0f, 0.0f, 0.0f, 0.0f };
+
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = m_RenderPass;
+	renderPassInfo.framebuffer = m_Framebuffers[imageIndex];
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = m_Extent;
+	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	renderPassInfo.pClearValues = clearValues.data();
+
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+}
+
+void OitCompositor::beginComposite(VkCommandBuffer commandBuffer)
+{
+	vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+}
+
+void OitCompositor::composite(VkCommandBuffer commandBuffer, VkPipeline compositePipeline)
+{
+	//One triangle covering the screen, its vertices come from the vertex index
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, compositePipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 0, 1, &m_DescriptorSet, 0, nullptr);
+	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+}
+
+void OitCompositor::end(VkCommandBuffer commandBuffer)
+{
+	vkCmdEndRenderPass(commandBuffer);
+}
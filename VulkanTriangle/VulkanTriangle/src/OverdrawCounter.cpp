@@ -0,0 +1,248 @@
+#include "OverdrawCounter.h"
+
+#include "VulkanEngine.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+//Convert an IEEE half float to a float, the counts are whole numbers so we don't need to worry about speed here
+static float halfToFloat(uint16_t half)
+{
+	uint32_t sign = (half >> 15) & 0x1;
+	uint32_t exponent = (half >> 10) & 0x1f;
+	uint32_t mantissa = half & 0x3ff;
+
+	float value;
+	if (exponent == 0) {
+		value = std::ldexp(static_cast<float>(mantissa), -24); //Subnormal
+	}
+	else if (exponent == 31) {
+		value = mantissa ? NAN : INFINITY;
+	}
+	else {
+		value = std::ldexp(static_cast<float>(mantissa | 0x400), static_cast<int>(exponent) - 25);
+	}
+	return sign ? -value : value;
+}
+
+OverdrawCounter::OverdrawCounter(VulkanEngine* engine, VkDevice& device) : m_Engine(engine), m_Device(device) {}
+
+void OverdrawCounter::createRenderPass(VkFormat depthFormat)
+{
+	//Count target, cleared to zero and left ready to copy out
+	VkAttachmentDescription countAttachment = {};
+	countAttachment.format = FORMAT;
+	countAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	countAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	countAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	countAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	countAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	countAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	countAttachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+	//Depth is cleared again so the overdraw pass tests exactly like the main pass
+	VkAttachmentDescription depthAttachment = {};
+	depthAttachment.format = depthFormat;
+	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference countAttachmentRef = {};
+	countAttachmentRef.attachment = 0;
+	countAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference depthAttachmentRef = {};
+	depthAttachmentRef.attachment = 1;
+	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDescription subpass = {};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &countAttachmentRef;
+	subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+	//Wait for the main pass to finish with the depth buffer, and make the counts visible to the copy
+	std::array<VkSubpassDependency, 2> dependencies = {};
+
+	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].dstSubpass = 0;
+	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+	dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+	dependencies[1].srcSubpass = 0;
+	dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+	std::array<VkAttachmentDescription, 2> attachments = { countAttachment, depthAttachment };
+	VkRenderPassCreateInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	renderPassInfo.pAttachments = attachments.data();
+	renderPassInfo.subpassCount = 1;
+	renderPassInfo.pSubpasses = &subpass;
+	renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	renderPassInfo.pDependencies = dependencies.data();
+
+	if (vkCreateRenderPass(m_Device, &renderPassInfo, nullptr, &m_RenderPass) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create overdraw render pass!");
+	}
+}
+
+void OverdrawCounter::destroyRenderPass()
+{
+	vkDestroyRenderPass(m_Device, m_RenderPass, nullptr);
+	m_RenderPass = VK_NULL_HANDLE;
+}
+
+void OverdrawCounter::createTarget(VkExtent2D extent, VkImageView depthImageView)
+{
+	m_Extent = extent;
+	m_HasCounts = false;
+
+	m_Engine->createImage(extent.width, extent.height, FORMAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_Image, m_ImageMemory, MemoryCategory::RenderTarget, "overdraw counts");
+	m_ImageView = m_Engine->createImageView(m_Image, FORMAT, VK_IMAGE_ASPECT_COLOR_BIT);
+
+	std::array<VkImageView, 2> attachments = { m_ImageView, depthImageView };
+
+	VkFramebufferCreateInfo framebufferInfo = {};
+	framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebufferInfo.renderPass = m_RenderPass;
+	framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	framebufferInfo.pAttachments = attachments.data();
+	framebufferInfo.width = extent.width;
+	framebufferInfo.height = extent.height;
+	framebufferInfo.layers = 1;
+
+	if (vkCreateFramebuffer(m_Device, &framebufferInfo, nullptr, &m_Framebuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create overdraw framebuffer!");
+	}
+}
+
+void OverdrawCounter::destroyTarget()
+{
+	vkDestroyFramebuffer(m_Device, m_Framebuffer, nullptr);
+	vkDestroyImageView(m_Device, m_ImageView, nullptr);
+	vkDestroyImage(m_Device, m_Image, nullptr);
+	m_Engine->freeMemory(m_ImageMemory);
+	m_Framebuffer = VK_NULL_HANDLE;
+	m_ImageView = VK_NULL_HANDLE;
+	m_Image = VK_NULL_HANDLE;
+	m_ImageMemory = VK_NULL_HANDLE;
+}
+
+void OverdrawCounter::begin(VkCommandBuffer commandBuffer)
+{
+	std::array<VkClearValue, 2> clearValues = {};
+	clearValues[0].color = { 0.0f, 0.0f, 0.0f, 0.0f };
+	clearValues[1].depthStencil = { 1.0f, 0 };
+
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = m_RenderPass;
+	renderPassInfo.framebuffer = m_Framebuffer;
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = m_Extent;
+	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	renderPassInfo.pClearValues = clearValues.data();
+
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+}
+
+void OverdrawCounter::end(VkCommandBuffer commandBuffer)
+{
+	vkCmdEndRenderPass(commandBuffer);
+	m_HasCounts = true;
+}
+
+OverdrawStats OverdrawCounter::readback(VkQueue& graphicsQueue, VkCommandPool& commandPool)
+{
+	//Copy the counts into a host visible buffer
+	VkDeviceSize size = static_cast<VkDeviceSize>(m_Extent.width) * m_Extent.height * sizeof(uint16_t);
+
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	m_Engine->createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory, MemoryCategory::Staging, "overdraw readback");
+
+	VkCommandBuffer commandBuffer = m_Engine->beginSingleTimeCommands(commandPool);
+
+	VkBufferImageCopy region = {};
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.layerCount = 1;
+	region.imageExtent = { m_Extent.width, m_Extent.height, 1 };
+	vkCmdCopyImageToBuffer(commandBuffer, m_Image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, stagingBuffer, 1, &region);
+
+	m_Engine->endSingleTimeCommands(graphicsQueue, commandPool, commandBuffer);
+
+	//Convert to whole counts
+	std::vector<uint32_t> counts(static_cast<size_t>(m_Extent.width) * m_Extent.height);
+	void* data;
+	vkMapMemory(m_Device, stagingBufferMemory, 0, size, 0, &data);
+	const uint16_t* halfs = static_cast<const uint16_t*>(data);
+	for (size_t i = 0; i < counts.size(); i++) {
+		counts[i] = static_cast<uint32_t>(std::lround(halfToFloat(halfs[i])));
+	}
+	vkUnmapMemory(m_Device, stagingBufferMemory);
+
+	vkDestroyBuffer(m_Device, stagingBuffer, nullptr);
+	m_Engine->freeMemory(stagingBufferMemory);
+
+	//Build the stats from the covered pixels
+	OverdrawStats stats;
+	stats.pixels = static_cast<uint32_t>(counts.size());
+
+	std::vector<uint32_t> covered;
+	for (uint32_t count : counts) {
+		if (count == 0) continue;
+		covered.push_back(count);
+		stats.fragments += count;
+
+		//Find the last bucket this count reaches
+		size_t bucket = 0;
+		while (bucket + 1 < OverdrawStats::HISTOGRAM_BUCKETS.size() && count >= OverdrawStats::HISTOGRAM_BUCKETS[bucket + 1]) bucket++;
+		stats.histogram[bucket]++;
+	}
+
+	stats.coveredPixels = static_cast<uint32_t>(covered.size());
+	if (covered.empty()) return stats;
+
+	std::sort(covered.begin(), covered.end());
+	stats.mean = static_cast<double>(stats.fragments) / covered.size();
+	stats.p50 = covered[(covered.size() - 1) / 2];
+	stats.p95 = covered[static_cast<size_t>((covered.size() - 1) * 0.95)];
+	stats.max = covered.back();
+	return stats;
+}
+
+void OverdrawCounter::print(const OverdrawStats& stats)
+{
+	std::cout << "overdraw: " << stats.coveredPixels << "/" << stats.pixels << " pixels covered, " << stats.fragments << " fragments, mean "
+		<< stats.mean << " p50 " << stats.p50 << " p95 " << stats.p95 << " max " << stats.max << std::endl;
+
+	//Histogram of how many covered pixels were shaded each number of times
+	std::cout << "\t";
+	for (size_t i = 0; i < stats.histogram.size(); i++) {
+		std::cout << OverdrawStats::HISTOGRAM_BUCKETS[i];
+		if (i + 1 == stats.histogram.size()) {
+			std::cout << "+";
+		}
+		else if (OverdrawStats::HISTOGRAM_BUCKETS[i + 1] - 1 != OverdrawStats::HISTOGRAM_BUCKETS[i]) {
+			std::cout << "-" << OverdrawStats::HISTOGRAM_BUCKETS[i + 1] - 1;
+		}
+		std::cout << ": " << stats.histogram[i] << (i + 1 < stats.histogram.size() ? ", " : "");
+	}
+	std::cout << std::endl;
+}
@@ -0,0 +1,420 @@
+#include "PipelineLibrary.h"
+
+#include "CpuProfiler.h"
+#include "VulkanObject.h"
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+
+//Mix a value into a running hash
+template<typename T>
+static void hashCombine(size_t& seed, const T& value)
+{
+	seed ^= std::hash<T>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+bool FurConstants::operator==(const FurConstants& other) const
+{
+	return shellCount == other.shellCount && lighting == other.lighting &&
+		furColour[0] == other.furColour[0] && furColour[1] == other.furColour[1] && furColour[2] == other.furColour[2];
+}
+
+bool PipelineDesc::operator==(const PipelineDesc& other) const
+{
+	return vertShader == other.vertShader && geomShader == other.geomShader && fragShader == other.fragShader && vertexInput == other.vertexInput &&
+		layout == other.layout && renderPass == other.renderPass && subpass == other.subpass &&
+		depthTest == other.depthTest && depthWrite == other.depthWrite && cullMode == other.cullMode && blend == other.blend && additive == other.additive &&
+		weightedBlend == other.weightedBlend &&
+		constants == other.constants;
+}
+
+size_t PipelineDescHash::operator()(const PipelineDesc& desc) const
+{
+	size_t seed = 0;
+	hashCombine(seed, desc.vertShader);
+	hashCombine(seed, desc.geomShader);
+	hashCombine(seed, desc.fragShader);
+	hashCombine(seed, desc.vertexInput);
+	hashCombine(seed, reinterpret_cast<uintptr_t>(desc.layout));
+	hashCombine(seed, reinterpret_cast<uintptr_t>(desc.renderPass));
+	hashCombine(seed, desc.subpass);
+	hashCombine(seed, desc.depthTest);
+	hashCombine(seed, desc.depthWrite);
+	hashCombine(seed, desc.cullMode);
+	hashCombine(seed, desc.blend);
+	hashCombine(seed, desc.additive);
+	hashCombine(seed, desc.weightedBlend);
+	hashCombine(seed, desc.constants.shellCount);
+	hashCombine(seed, desc.constants.lighting);
+	hashCombine(seed, desc.constants.furColour[0]);
+	hashCombine(seed, desc.constants.furColour[1]);
+	hashCombine(seed, desc.constants.furColour[2]);
+	return seed;
+}
+
+PipelineLibrary::PipelineLibrary(VkDevice& device, ShaderLibrary& shaders, unsigned int workerCount) : m_Device(device), m_Shaders(shaders)
+{
+	VkPipelineCacheCreateInfo cacheInfo = {};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+	if (vkCreatePipelineCache(m_Device, &cacheInfo, nullptr, &m_PipelineCache) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline cache!");
+	}
+
+	//Start the compile workers
+	for (unsigned int i = 0; i < workerCount; i++) {
+		m_Workers.emplace_back(&PipelineLibrary::workerLoop, this);
+	}
+}
+
+PipelineLibrary::~PipelineLibrary()
+{
+	destroy();
+}
+
+VkPipeline PipelineLibrary::get(const PipelineDesc& desc, const std::string& name)
+{
+	PipelineEntry* entry = nullptr;
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+
+		//Return the pipeline if this state has already been built, if it is still queued wait for the worker
+		auto found = m_Pipelines.find(desc);
+		if (found != m_Pipelines.end()) {
+			entry = found->second.get();
+			m_JobDone.wait(lock, [entry] { return entry->ready() || entry->failed.load(); });
+			if (entry->failed.load()) {
+				throw std::runtime_error("failed to create graphics pipeline " + entry->name + ": " + entry->error);
+			}
+			return entry->get();
+		}
+
+		auto newEntry = std::make_unique<PipelineEntry>();
+		entry = newEntry.get();
+		entry->name = name;
+		m_Pipelines.emplace(desc, std::move(newEntry));
+	}
+
+	//Build on this thread, outside the lock so the workers can keep going
+	buildEntry(desc, entry);
+	if (entry->failed.load()) {
+		throw std::runtime_error("failed to create graphics pipeline " + entry->name + ": " + entry->error);
+	}
+	return entry->get();
+}
+
+const PipelineEntry* PipelineLibrary::getAsync(const PipelineDesc& desc, const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	auto found = m_Pipelines.find(desc);
+	if (found != m_Pipelines.end()) {
+		return found->second.get();
+	}
+
+	//First request for this state, queue it for the workers
+	auto newEntry = std::make_unique<PipelineEntry>();
+	PipelineEntry* entry = newEntry.get();
+	entry->name = name;
+	entry->async = true;
+	m_Pipelines.emplace(desc, std::move(newEntry));
+
+	m_Jobs.push_back({ desc, entry, std::chrono::high_resolution_clock::now() });
+	m_Pending++;
+	m_JobAdded.notify_one();
+
+	return entry;
+}
+
+void PipelineLibrary::buildEntry(const PipelineDesc& desc, PipelineEntry* entry)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	try {
+		pipeline = build(desc);
+	}
+	catch (const std::exception& e) {
+		entry->error = e.what();
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+	entry->compileMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+	//Publish the result, the renderer picks the pipeline up on its next frame
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (pipeline != VK_NULL_HANDLE) {
+			entry->pipeline.store(pipeline, std::memory_order_release);
+		}
+		else {
+			entry->failed.store(true);
+		}
+	}
+	m_JobDone.notify_all();
+}
+
+void PipelineLibrary::workerLoop()
+{
+	PROFILE_THREAD_NAME("pipeline worker");
+	while (true) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_JobAdded.wait(lock, [this] { return m_Stopping || !m_Jobs.empty(); });
+			if (m_Jobs.empty()) return; //Stopping and nothing left to do
+
+			job = m_Jobs.front();
+			m_Jobs.pop_front();
+		}
+
+		job.entry->waitMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - job.queued).count();
+		buildEntry(job.desc, job.entry);
+
+		if (job.entry->failed.load()) {
+			std::cerr << "pipeline " << job.entry->name << " failed to build: " << job.entry->error << std::endl;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Pending--;
+		}
+		m_JobDone.notify_all();
+	}
+}
+
+void PipelineLibrary::waitIdle()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_JobDone.wait(lock, [this] { return m_Pending == 0; });
+}
+
+void PipelineLibrary::printTelemetry()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	for (auto& pipeline : m_Pipelines) {
+		const PipelineEntry& entry = *pipeline.second;
+		std::cout << "pipeline " << (entry.name.empty() ? "(unnamed)" : entry.name)
+			<< (entry.async ? " async" : " sync")
+			<< " compile " << entry.compileMs << "ms";
+		if (entry.async) {
+			std::cout << " queued " << entry.waitMs << "ms";
+		}
+		if (entry.failed.load()) {
+			std::cout << " FAILED";
+		}
+		std::cout << std::endl;
+	}
+}
+
+void PipelineLibrary::clear()
+{
+	//The workers may still be using the render pass or layouts, let them finish first
+	waitIdle();
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	for (auto& pipeline : m_Pipelines) {
+		if (pipeline.second->ready()) {
+			vkDestroyPipeline(m_Device, pipeline.second->get(), nullptr);
+		}
+	}
+	m_Pipelines.clear();
+}
+
+void PipelineLibrary::destroy()
+{
+	clear();
+
+	//Stop the workers
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stopping = true;
+	}
+	m_JobAdded.notify_all();
+	for (auto& worker : m_Workers) {
+		worker.join();
+	}
+	m_Workers.clear();
+
+	if (m_PipelineCache != VK_NULL_HANDLE) {
+		vkDestroyPipelineCache(m_Device, m_PipelineCache, nullptr);
+		m_PipelineCache = VK_NULL_HANDLE;
+	}
+}
+
+VkPipeline PipelineLibrary::build(const PipelineDesc& desc)
+{
+	PROFILE_SCOPE("build pipeline");
+	//Map each fur constant to its constant_id, the same data is passed to every stage and ids a stage doesn't use are ignored
+	std::array<VkSpecializationMapEntry, 5> specEntries = {};
+	specEntries[0] = { 0, offsetof(FurConstants, shellCount), sizeof(int32_t) };
+	specEntries[1] = { 2, offsetof(FurConstants, lighting), sizeof(VkBool32) };
+	specEntries[2] = { 3, offsetof(FurConstants, furColour) + sizeof(float) * 0, sizeof(float) };
+	specEntries[3] = { 4, offsetof(FurConstants, furColour) + sizeof(float) * 1, sizeof(float) };
+	specEntries[4] = { 5, offsetof(FurConstants, furColour) + sizeof(float) * 2, sizeof(float) };
+
+	VkSpecializationInfo specInfo = {};
+	specInfo.mapEntryCount = static_cast<uint32_t>(specEntries.size());
+	specInfo.pMapEntries = specEntries.data();
+	specInfo.dataSize = sizeof(FurConstants);
+	specInfo.pData = &desc.constants;
+
+	//Set up the shader stages, vertex -> (geometry) -> fragment
+	std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+
+	VkPipelineShaderStageCreateInfo stageInfo = {};
+	stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stageInfo.pName = "main"; //Main function as entry point
+	stageInfo.pSpecializationInfo = &specInfo;
+
+	stageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	stageInfo.module = m_Shaders.get(desc.vertShader);
+	shaderStages.push_back(stageInfo);
+
+	if (!desc.geomShader.empty()) {
+		stageInfo.stage = VK_SHADER_STAGE_GEOMETRY_BIT;
+		stageInfo.module = m_Shaders.get(desc.geomShader);
+		shaderStages.push_back(stageInfo);
+	}
+
+	stageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	stageInfo.module = m_Shaders.get(desc.fragShader);
+	shaderStages.push_back(stageInfo);
+
+	//Set up vertex input pipline info
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+	//Get descriptions
+	auto bindingDescription = Vertex::getBindingDescription();
+	auto attributeDescriptions = Vertex::getAttributeDescriptions();
+
+	if (desc.vertexInput) {
+		vertexInputInfo.vertexBindingDescriptionCount = 1;
+		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+		vertexInputInfo.pVertexBindingDescriptions = &bindingDescription; //Give binding desc
+		vertexInputInfo.pVertexAttributeDescriptions = &attributeDescriptions[0]; //Give attribute data
+	}
+
+	//Assembly state info (rendering type)
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST; //Rendering using triangle lists
+	inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+	//Viewport and scissor are dynamic state so the pipeline doesn't depend on the resolution, only the counts are needed here
+	VkPipelineViewportStateCreateInfo viewportState = {};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	//Rasterizer info
+	VkPipelineRasterizationStateCreateInfo rasterizer = {};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable = VK_FALSE; //Dont clamp depth
+	rasterizer.rasterizerDiscardEnable = VK_FALSE; //Dont discard (wont draw to framebuffer otherwise)
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL; //We want to draw full polygons not lines or points
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = desc.cullMode;
+	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE; //Set clockwise
+	rasterizer.depthBiasEnable = VK_FALSE;
+
+	//Default multisamplign settings (disabled for now)
+	VkPipelineMultisampleStateCreateInfo multisampling = {};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.sampleShadingEnable = VK_FALSE;
+	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.depthTestEnable = desc.depthTest;
+	depthStencil.depthWriteEnable = desc.depthWrite;
+	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+	depthStencil.depthBoundsTestEnable = VK_FALSE;
+	depthStencil.stencilTestEnable = VK_FALSE;
+	depthStencil.minDepthBounds = 0.0f; // Optional
+	depthStencil.maxDepthBounds = 1.0f; // Optional
+
+	//Set up colour blending settings (standard alpha blending)
+	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachment.blendEnable = desc.blend;
+	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+	//Additive blending, used for counting (e.g. overdraw)
+	if (desc.additive) {
+		colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	}
+
+	//Weighted blended transparency, the weighted colours and alphas are summed in the first target and the second
+	//is multiplied by one minus each alpha, so neither depends on the order the fragments arrive in
+	std::array<VkPipelineColorBlendAttachmentState, 2> colorBlendAttachments = { colorBlendAttachment, colorBlendAttachment };
+	if (desc.weightedBlend) {
+		colorBlendAttachments[0].blendEnable = VK_TRUE;
+		colorBlendAttachments[0].srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		colorBlendAttachments[0].dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		colorBlendAttachments[0].srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		colorBlendAttachments[0].dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+
+		colorBlendAttachments[1].colorWriteMask = VK_COLOR_COMPONENT_R_BIT;
+		colorBlendAttachments[1].blendEnable = VK_TRUE;
+		colorBlendAttachments[1].srcColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+		colorBlendAttachments[1].dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR;
+		colorBlendAttachments[1].srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+		colorBlendAttachments[1].dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	}
+
+	VkPipelineColorBlendStateCreateInfo colorBlending = {};
+	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.logicOpEnable = VK_FALSE;
+	colorBlending.logicOp = VK_LOGIC_OP_COPY;
+	colorBlending.attachmentCount = desc.weightedBlend ? 2 : 1;
+	colorBlending.pAttachments = colorBlendAttachments.data();
+
+	std::vector<VkDynamicState> dynamicStateEnables = {
+			VK_DYNAMIC_STATE_VIEWPORT,
+			VK_DYNAMIC_STATE_SCISSOR,
+			VK_DYNAMIC_STATE_LINE_WIDTH
+	};
+	VkPipelineDynamicStateCreateInfo dynamicState = {};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.pDynamicStates = dynamicStateEnables.data();
+	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStateEnables.size());
+
+	//Set up graphics pipline info passing in all data set up before this
+	VkGraphicsPipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+	pipelineInfo.pStages = shaderStages.data();
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pDepthStencilState = &depthStencil;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = desc.layout;
+	pipelineInfo.renderPass = desc.renderPass;
+	pipelineInfo.subpass = desc.subpass;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+	//Create pipeline and error check
+	VkPipeline pipeline;
+	if (vkCreateGraphicsPipelines(m_Device, m_PipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create graphics pipeline!");
+	}
+
+	return pipeline;
+}
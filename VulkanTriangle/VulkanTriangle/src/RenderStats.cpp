@@ -0,0 +1,100 @@
+#include "RenderStats.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+RenderStats::RenderStats(size_t historySize)
+{
+	m_History.resize(historySize > 0 ? historySize : 1);
+}
+
+void RenderStats::beginFrame(size_t frame)
+{
+	m_Current = FrameStats();
+	m_Current.frame = frame;
+}
+
+void RenderStats::endFrame()
+{
+	m_History[m_Next] = m_Current;
+	m_Next = (m_Next + 1) % m_History.size();
+	if (m_Count < m_History.size()) m_Count++;
+}
+
+const FrameStats* RenderStats::Latest() const
+{
+	if (m_Count == 0) return nullptr;
+	return &m_History[(m_Next + m_History.size() - 1) % m_History.size()];
+}
+
+std::vector<FrameStats> RenderStats::History() const
+{
+	std::vector<FrameStats> frames;
+	frames.reserve(m_Count);
+
+	//Oldest frame is at m_Next once the ring has wrapped
+	size_t start = (m_Next + m_History.size() - m_Count) % m_History.size();
+	for (size_t i = 0; i < m_Count; i++) {
+		frames.push_back(m_History[(start + i) % m_History.size()]);
+	}
+	return frames;
+}
+
+void RenderStats::dump(const std::string& filename) const
+{
+	std::ofstream out(filename);
+	if (!out.is_open()) {
+		throw std::runtime_error("failed to open render stats output: " + filename);
+	}
+
+	std::vector<FrameStats> frames = History();
+	bool csv = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".csv") == 0;
+
+	if (csv) {
+		out << "frame,drawCalls,instances,triangles,pipelineBinds,descriptorSetBinds,vertexBufferBinds,indexBufferBinds,bytesUploaded,commandBuffers,objectsCulled,objectsOccluded\n";
+		for (auto& stats : frames) {
+			out << stats.frame << "," << stats.drawCalls << "," << stats.instances << "," << stats.triangles << "," << stats.pipelineBinds << ","
+				<< stats.descriptorSetBinds << "," << stats.vertexBufferBinds << "," << stats.indexBufferBinds << "," << stats.bytesUploaded << ","
+				<< stats.commandBuffers << "," << stats.objectsCulled << "," << stats.objectsOccluded << "\n";
+		}
+	}
+	else {
+		//Readable table, with the average over the whole history at the bottom
+		FrameStats total;
+		out << std::setw(8) << "frame" << std::setw(8) << "draws" << std::setw(10) << "instances" << std::setw(12) << "triangles"
+			<< std::setw(10) << "pipelines" << std::setw(10) << "sets" << std::setw(10) << "vbuffers" << std::setw(10) << "ibuffers"
+			<< std::setw(12) << "uploadBytes" << std::setw(8) << "cmdbufs" << std::setw(8) << "culled" << std::setw(10) << "occluded" << "\n";
+		for (auto& stats : frames) {
+			out << std::setw(8) << stats.frame << std::setw(8) << stats.drawCalls << std::setw(10) << stats.instances << std::setw(12) << stats.triangles
+				<< std::setw(10) << stats.pipelineBinds << std::setw(10) << stats.descriptorSetBinds << std::setw(10) << stats.vertexBufferBinds
+				<< std::setw(10) << stats.indexBufferBinds << std::setw(12) << stats.bytesUploaded << std::setw(8) << stats.commandBuffers << std::setw(8) << stats.objectsCulled
+				<< std::setw(10) << stats.objectsOccluded << "\n";
+
+			total.drawCalls += stats.drawCalls;
+			total.instances += stats.instances;
+			total.triangles += stats.triangles;
+			total.pipelineBinds += stats.pipelineBinds;
+			total.descriptorSetBinds += stats.descriptorSetBinds;
+			total.vertexBufferBinds += stats.vertexBufferBinds;
+			total.indexBufferBinds += stats.indexBufferBinds;
+			total.bytesUploaded += stats.bytesUploaded;
+			total.commandBuffers += stats.commandBuffers;
+			total.objectsCulled += stats.objectsCulled;
+			total.objectsOccluded += stats.objectsOccluded;
+		}
+
+		if (!frames.empty()) {
+			double count = static_cast<double>(frames.size());
+			out << std::fixed << std::setprecision(1);
+			out << std::setw(8) << "average" << std::setw(8) << total.drawCalls / count << std::setw(10) << total.instances / count
+				<< std::setw(12) << total.triangles / count << std::setw(10) << total.pipelineBinds / count << std::setw(10) << total.descriptorSetBinds / count
+				<< std::setw(10) << total.vertexBufferBinds / count << std::setw(10) << total.indexBufferBinds / count
+				<< std::setw(12) << total.bytesUploaded / count << std::setw(8) << total.commandBuffers / count << std::setw(8) << total.objectsCulled / count
+				<< std::setw(10) << total.objectsOccluded / count << "\n";
+		}
+	}
+
+	std::cout << "render stats: " << frames.size() << " frames written to " << filename << std::endl;
+}
@@ -0,0 +1,360 @@
+#include "SceneBvh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+//Half the surface area of a box, the insertion cost
+static float area(const glm::vec3& min, const glm::vec3& max)
+{
+	glm::vec3 size = max - min;
+	return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+SceneBvh::SceneBvh(float margin) : m_Margin(margin)
+{
+}
+
+int32_t SceneBvh::allocateNode()
+{
+	int32_t node;
+	if (m_FreeList != NULL_NODE) {
+		node = m_FreeList;
+		m_FreeList = m_Links[node].parent;
+	}
+	else {
+		node = static_cast<int32_t>(m_Nodes.size());
+		m_Nodes.emplace_back();
+		m_Links.emplace_back();
+	}
+
+	m_Nodes[node].child1 = NULL_NODE;
+	m_Nodes[node].child2 = NULL_NODE;
+	m_Links[node].parent = NULL_NODE;
+	m_Links[node].height = 0;
+	return node;
+}
+
+void SceneBvh::freeNode(int32_t node)
+{
+	m_Links[node].parent = m_FreeList;
+	m_Links[node].height = -1;
+	m_FreeList = node;
+}
+
+void SceneBvh::clear()
+{
+	m_Nodes.clear();
+	m_Links.clear();
+	m_Root = NULL_NODE;
+	m_FreeList = NULL_NODE;
+	m_LeafCount = 0;
+}
+
+int32_t SceneBvh::insert(const Bounds& bounds, uint32_t object)
+{
+	int32_t leaf = allocateNode();
+
+	//The box can't be bigger than the sphere
+	glm::vec3 extents = glm::min(bounds.extents, glm::vec3(bounds.radius));
+	glm::vec3 margin(std::max(extents.x, std::max(extents.y, extents.z)) * 2.0f * m_Margin);
+	m_Nodes[leaf].min = bounds.centre - extents - margin;
+	m_Nodes[leaf].max = bounds.centre + extents + margin;
+	m_Nodes[leaf].child2 = static_cast<int32_t>(object);
+
+	insertLeaf(leaf);
+	m_LeafCount++;
+	return leaf;
+}
+
+bool SceneBvh::move(int32_t proxy, const Bounds& bounds)
+{
+	//Still inside the grown box, nothing to do
+	glm::vec3 extents = glm::min(bounds.extents, glm::vec3(bounds.radius));
+	glm::vec3 min = bounds.centre - extents;
+	glm::vec3 max = bounds.centre + extents;
+	const Node& node = m_Nodes[proxy];
+	if (glm::all(glm::greaterThanEqual(min, node.min)) && glm::all(glm::lessThanEqual(max, node.max))) {
+		return false;
+	}
+
+	removeLeaf(proxy);
+	glm::vec3 margin(std::max(extents.x, std::max(extents.y, extents.z)) * 2.0f * m_Margin);
+	m_Nodes[proxy].min = min - margin;
+	m_Nodes[proxy].max = max + margin;
+	insertLeaf(proxy);
+	return true;
+}
+
+void SceneBvh::remove(int32_t proxy)
+{
+	removeLeaf(proxy);
+	freeNode(proxy);
+	m_LeafCount--;
+}
+
+void SceneBvh::fit(int32_t node)
+{
+	const Node& child1 = m_Nodes[m_Nodes[node].child1];
+	const Node& child2 = m_Nodes[m_Nodes[node].child2];
+	m_Nodes[node].min = glm::min(child1.min, child2.min);
+	m_Nodes[node].max = glm::max(child1.max, child2.max);
+	m_Links[node].height = 1 + std::max(m_Links[m_Nodes[node].child1].height, m_Links[m_Nodes[node].child2].height);
+}
+
+void SceneBvh::setChildren(int32_t node, int32_t child1, int32_t child2)
+{
+	m_Nodes[node].child1 = child1;
+	m_Nodes[node].child2 = child2;
+	m_Links[child1].parent = node;
+	m_Links[child2].parent = node;
+	fit(node);
+}
+
+void SceneBvh::insertLeaf(int32_t leaf)
+{
+	if (m_Root == NULL_NODE) {
+		m_Root = leaf;
+		m_Links[leaf].parent = NULL_NODE;
+		return;
+	}
+
+	//Walk down to the sibling that adds the least area, counting the growth of every node above it
+	glm::vec3 leafMin = m_Nodes[leaf].min;
+	glm::vec3 leafMax = m_Nodes[leaf].max;
+	int32_t index = m_Root;
+	while (!m_Nodes[index].IsLeaf()) {
+		const Node& node = m_Nodes[index];
+		float nodeArea = area(node.min, node.max);
+		float combinedArea = area(glm::min(node.min, leafMin), glm::max(node.max, leafMax));
+
+		//Cost of making a new parent for this node and the leaf, and what pushing the leaf further down adds to this node
+		float cost = 2.0f * combinedArea;
+		float inheritance = 2.0f * (combinedArea - nodeArea);
+
+		auto childCost = [&](int32_t child) {
+			const Node& childNode = m_Nodes[child];
+			float grown = area(glm::min(childNode.min, leafMin), glm::max(childNode.max, leafMax));
+			return childNode.IsLeaf() ? grown + inheritance : grown - area(childNode.min, childNode.max) + inheritance;
+		};
+		float cost1 = childCost(node.child1);
+		float cost2 = childCost(node.child2);
+
+		if (cost < cost1 && cost < cost2) break;
+		index = cost1 < cost2 ? node.child1 : node.child2;
+	}
+
+	//New parent in the sibling's place
+	int32_t sibling = index;
+	int32_t oldParent = m_Links[sibling].parent;
+	int32_t newParent = allocateNode();
+	m_Links[newParent].parent = oldParent;
+	setChildren(newParent, sibling, leaf);
+
+	if (oldParent != NULL_NODE) {
+		if (m_Nodes[oldParent].child1 == sibling) m_Nodes[oldParent].child1 = newParent;
+		else m_Nodes[oldParent].child2 = newParent;
+	}
+	else {
+		m_Root = newParent;
+	}
+
+	refitUp(oldParent);
+}
+
+void SceneBvh::removeLeaf(int32_t leaf)
+{
+	if (leaf == m_Root) {
+		m_Root = NULL_NODE;
+		return;
+	}
+
+	//The sibling takes the parent's place
+	int32_t parent = m_Links[leaf].parent;
+	int32_t grandParent = m_Links[parent].parent;
+	int32_t sibling = m_Nodes[parent].child1 == leaf ? m_Nodes[parent].child2 : m_Nodes[parent].child1;
+
+	if (grandParent != NULL_NODE) {
+		if (m_Nodes[grandParent].child1 == parent) m_Nodes[grandParent].child1 = sibling;
+		else m_Nodes[grandParent].child2 = sibling;
+		m_Links[sibling].parent = grandParent;
+		freeNode(parent);
+		refitUp(grandParent);
+	}
+	else {
+		m_Root = sibling;
+		m_Links[sibling].parent = NULL_NODE;
+		freeNode(parent);
+	}
+}
+
+void SceneBvh::refitUp(int32_t node)
+{
+	while (node != NULL_NODE) {
+		node = balance(node);
+		fit(node);
+		node = m_Links[node].parent;
+	}
+}
+
+int32_t SceneBvh::balance(int32_t a)
+{
+	if (m_Nodes[a].IsLeaf() || m_Links[a].height < 2) return a;
+
+	int32_t b = m_Nodes[a].child1;
+	int32_t c = m_Nodes[a].child2;
+	int32_t difference = m_Links[c].height - m_Links[b].height;
+	if (difference >= -1 && difference <= 1) return a;
+
+	//Rotate the taller child up into a's place, a takes the taller child's shorter grandchild
+	int32_t up = difference > 1 ? c : b;
+	int32_t stay = difference > 1 ? b : c;
+	int32_t upChild1 = m_Nodes[up].child1;
+	int32_t upChild2 = m_Nodes[up].child2;
+	int32_t tall = m_Links[upChild1].height > m_Links[upChild2].height ? upChild1 : upChild2;
+	int32_t shortChild = tall == upChild1 ? upChild2 : upChild1;
+
+	int32_t parent = m_Links[a].parent;
+	m_Links[up].parent = parent;
+	if (parent != NULL_NODE) {
+		if (m_Nodes[parent].child1 == a) m_Nodes[parent].child1 = up;
+		else m_Nodes[parent].child2 = up;
+	}
+	else {
+		m_Root = up;
+	}
+
+	setChildren(a, stay, shortChild);
+	setChildren(up, a, tall);
+	return up;
+}
+
+void SceneBvh::queryFrustum(const Frustum& frustum, std::vector<uint32_t>& objects) const
+{
+	if (m_Root == NULL_NODE) return;
+
+	std::vector<int32_t> stack;
+	stack.reserve(64);
+	stack.push_back(m_Root);
+
+	//Subtrees entirely inside are collected on a second stack without any plane tests
+	std::vector<int32_t> inside;
+
+	while (!stack.empty()) {
+		int32_t index = stack.back();
+		stack.pop_back();
+		const Node& node = m_Nodes[index];
+
+		glm::vec3 centre = (node.min + node.max) * 0.5f;
+		glm::vec3 extents = (node.max - node.min) * 0.5f;
+		bool outside = false;
+		bool intersects = false;
+		for (const glm::vec4& plane : frustum.planes) {
+			float distance = plane.x * centre.x + plane.y * centre.y + plane.z * centre.z + plane.w;
+			float reach = std::abs(plane.x) * extents.x + std::abs(plane.y) * extents.y + std::abs(plane.z) * extents.z;
+			if (distance + reach < 0.0f) {
+				outside = true;
+				break;
+			}
+			if (distance - reach < 0.0f) intersects = true;
+		}
+		if (outside) continue;
+
+		if (node.IsLeaf()) {
+			objects.push_back(static_cast<uint32_t>(node.child2));
+		}
+		else if (intersects) {
+			stack.push_back(node.child1);
+			stack.push_back(node.child2);
+		}
+		else {
+			inside.push_back(index);
+			while (!inside.empty()) {
+				const Node& insideNode = m_Nodes[inside.back()];
+				inside.pop_back();
+				if (insideNode.IsLeaf()) {
+					objects.push_back(static_cast<uint32_t>(insideNode.child2));
+				}
+				else {
+					inside.push_back(insideNode.child1);
+					inside.push_back(insideNode.child2);
+				}
+			}
+		}
+	}
+}
+
+//Distance the ray enters the box, false if it misses or doesn't enter before maxDistance
+static bool rayBox(const glm::vec3& origin, const glm::vec3& inverseDirection, const glm::vec3& min, const glm::vec3& max, float maxDistance, float& entry)
+{
+	glm::vec3 t1 = (min - origin) * inverseDirection;
+	glm::vec3 t2 = (max - origin) * inverseDirection;
+	glm::vec3 near = glm::min(t1, t2);
+	glm::vec3 far = glm::max(t1, t2);
+	entry = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+	float exit = std::min(std::min(far.x, far.y), far.z);
+	return entry <= exit && entry < maxDistance;
+}
+
+bool SceneBvh::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const
+{
+	if (m_Root == NULL_NODE) return false;
+
+	glm::vec3 inverseDirection = 1.0f / direction;
+	float closest = maxDistance;
+	bool found = false;
+
+	std::vector<int32_t> stack;
+	stack.reserve(64);
+	stack.push_back(m_Root);
+	while (!stack.empty()) {
+		int32_t index = stack.back();
+		stack.pop_back();
+		const Node& node = m_Nodes[index];
+
+		float entry;
+		if (!rayBox(origin, inverseDirection, node.min, node.max, closest, entry)) continue;
+
+		if (node.IsLeaf()) {
+			closest = entry;
+			hit.object = static_cast<uint32_t>(node.child2);
+			hit.distance = entry;
+			found = true;
+			continue;
+		}
+
+		//Visit the nearer child first so the closest hit shrinks the search sooner
+		float entry1, entry2;
+		bool hit1 = rayBox(origin, inverseDirection, m_Nodes[node.child1].min, m_Nodes[node.child1].max, closest, entry1);
+		bool hit2 = rayBox(origin, inverseDirection, m_Nodes[node.child2].min, m_Nodes[node.child2].max, closest, entry2);
+		if (hit1 && hit2) {
+			stack.push_back(entry1 < entry2 ? node.child2 : node.child1);
+			stack.push_back(entry1 < entry2 ? node.child1 : node.child2);
+		}
+		else if (hit1) {
+			stack.push_back(node.child1);
+		}
+		else if (hit2) {
+			stack.push_back(node.child2);
+		}
+	}
+	return found;
+}
+
+int32_t SceneBvh::Height() const
+{
+	return m_Root == NULL_NODE ? 0 : m_Links[m_Root].height;
+}
+
+float SceneBvh::AreaRatio() const
+{
+	if (m_Root == NULL_NODE) return 0.0f;
+
+	float total = 0.0f;
+	for (size_t i = 0; i < m_Nodes.size(); i++) {
+		if (m_Links[i].height < 0) continue; //Free
+		total += area(m_Nodes[i].min, m_Nodes[i].max);
+	}
+	float rootArea = area(m_Nodes[m_Root].min, m_Nodes[m_Root].max);
+	return rootArea > 0.0f ? total / rootArea : 0.0f;
+}
@@ -0,0 +1,291 @@
+#include "ShaderCompiler.h"
+
+#include "CpuProfiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+#ifdef _WIN32
+static const char* NULL_DEVICE = "NUL";
+static const char* EXE_SUFFIX = ".exe";
+#else
+static const char* NULL_DEVICE = "/dev/null";
+static const char* EXE_SUFFIX = "";
+#endif
+
+//64 bit FNV-1a, enough to tell shader variants apart without pulling in a hashing library
+static const uint64_t FNV_OFFSET = 14695981039346656037ull;
+static const uint64_t FNV_PRIME = 1099511628211ull;
+
+static void fnv1a(uint64_t& hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+}
+
+static void fnv1a(uint64_t& hash, const std::string& text)
+{
+	//Hash the length too so "ab"+"c" and "a"+"bc" differ
+	uint64_t size = text.size();
+	fnv1a(hash, &size, sizeof(size));
+	fnv1a(hash, text.data(), text.size());
+}
+
+static std::string quote(const std::string& text)
+{
+	return "\"" + text + "\"";
+}
+
+static std::string hexHash(uint64_t hash)
+{
+	char text[17];
+	std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(hash));
+	return text;
+}
+
+static std::string stampPath(const ShaderSource& source)
+{
+	return source.fallbackSpv + ".hash";
+}
+
+ShaderCompiler::ShaderCompiler(const std::string& cacheDir, ShaderOptimisation optimisation) : m_CacheDir(cacheDir), m_Optimisation(optimisation)
+{
+	m_Validator = findTool("glslangValidator");
+	if (m_Optimisation != ShaderOptimisation::None) {
+		m_Optimiser = findTool("spirv-opt");
+	}
+
+	if (m_Validator.empty()) {
+		std::cout << "glslangValidator not found, using the pre-built SPIR-V" << std::endl;
+	}
+	else if (m_Optimisation != ShaderOptimisation::None && m_Optimiser.empty()) {
+		std::cout << "spirv-opt not found, shaders will not be optimised" << std::endl;
+	}
+}
+
+std::string ShaderCompiler::findTool(const std::string& name)
+{
+	//Prefer the SDK the app was set up with
+	const char* sdk = std::getenv("VULKAN_SDK");
+	if (sdk) {
+		for (const char* bin : { "Bin", "bin", "Bin32" }) {
+			fs::path tool = fs::path(sdk) / bin / (name + EXE_SUFFIX);
+			std::error_code error;
+			if (fs::exists(tool, error)) {
+				return tool.string();
+			}
+		}
+	}
+
+	//Otherwise see if it is on the path
+	if (run(name + " --version > " + NULL_DEVICE + " 2>&1") == 0) {
+		return name;
+	}
+
+	return "";
+}
+
+int ShaderCompiler::run(const std::string& command)
+{
+#ifdef _WIN32
+	//cmd strips the outer quotes when the command starts with one, so wrap the whole thing
+	return std::system(quote(command).c_str());
+#else
+	return std::system(command.c_str());
+#endif
+}
+
+void ShaderCompiler::hashFile(const std::string& path, uint64_t& hash, std::vector<std::string>& visited)
+{
+	//Only hash each file once, guards against include cycles
+	for (auto& file : visited) {
+		if (file == path) return;
+	}
+	visited.push_back(path);
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		//Let the compiler report missing includes, just make sure the key still changes
+		fnv1a(hash, "missing:" + path);
+		return;
+	}
+
+	std::stringstream contents;
+	contents << file.rdbuf();
+	std::string text = contents.str();
+
+	//Line endings depend on how the files were checked out, leave them out so a stamp matches on every machine
+	text.erase(std::remove(text.begin(), text.end(), '\r'), text.end());
+	fnv1a(hash, text);
+
+	//Follow any #include "file" lines so editing an include invalidates everything that uses it
+	std::istringstream lines(text);
+	std::string line;
+	while (std::getline(lines, line)) {
+		size_t start = line.find_first_not_of(" \t");
+		if (start == std::string::npos || line.compare(start, 8, "#include") != 0) continue;
+
+		size_t open = line.find('"', start);
+		size_t close = (open == std::string::npos) ? std::string::npos : line.find('"', open + 1);
+		if (close == std::string::npos) continue;
+
+		fs::path include = fs::path(path).parent_path() / line.substr(open + 1, close - open - 1);
+		hashFile(include.string(), hash, visited);
+	}
+}
+
+uint64_t ShaderCompiler::SourceHash(const ShaderSource& source)
+{
+	uint64_t hash = FNV_OFFSET;
+
+	std::vector<std::string> visited;
+	hashFile(source.path, hash, visited);
+
+	for (auto& define : source.defines) {
+		fnv1a(hash, define);
+	}
+	return hash;
+}
+
+uint64_t ShaderCompiler::hashSource(const ShaderSource& source)
+{
+	uint64_t hash = SourceHash(source);
+
+	//Changing the tools or the options needs a fresh compile as well
+	int optimisation = static_cast<int>(m_Optimiser.empty() ? ShaderOptimisation::None : m_Optimisation);
+	fnv1a(hash, &optimisation, sizeof(optimisation));
+	fnv1a(hash, m_Validator);
+	fnv1a(hash, m_Optimiser);
+
+	return hash;
+}
+
+void ShaderCompiler::compile(const ShaderSource& source, const std::string& output)
+{
+	PROFILE_SCOPE("compile shader");
+	std::string compiled = output + ".tmp";
+	std::string log = output + ".log";
+
+	//Compile to a temporary file so a failed or interrupted compile never leaves a bad cache entry
+	std::string command = quote(m_Validator) + " -V -o " + quote(compiled);
+	for (auto& define : source.defines) {
+		command += " -D" + define;
+	}
+	command += " " + quote(source.path) + " > " + quote(log) + " 2>&1";
+
+	if (run(command) != 0) {
+		std::ifstream file(log);
+		std::stringstream errors;
+		errors << file.rdbuf();
+		fs::remove(compiled);
+		throw std::runtime_error("failed to compile shader: " + source.path + "\n" + errors.str());
+	}
+
+	//Run the optimiser over the result, it's optional so fall back to the unoptimised SPIR-V if it fails
+	if (!m_Optimiser.empty()) {
+		std::string optimised = output + ".opt";
+		std::string level = (m_Optimisation == ShaderOptimisation::Size) ? " -Os" : " -O";
+
+		if (run(quote(m_Optimiser) + level + " " + quote(compiled) + " -o " + quote(optimised) + " > " + quote(log) + " 2>&1") == 0) {
+			fs::rename(optimised, compiled);
+		}
+		else {
+			std::cout << "spirv-opt failed on " << source.path << ", caching unoptimised SPIR-V" << std::endl;
+			fs::remove(optimised);
+		}
+	}
+
+	fs::remove(log);
+	fs::rename(compiled, output);
+}
+
+std::string ShaderCompiler::get(const ShaderSource& source)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	//Return the path if we've already resolved this variant
+	std::string key = source.path;
+	for (auto& define : source.defines) {
+		key += ";" + define;
+	}
+	auto found = m_Resolved.find(key);
+	if (found != m_Resolved.end()) {
+		return found->second;
+	}
+
+	std::error_code error;
+	std::string result;
+
+	if (!Available() || !fs::exists(source.path, error)) {
+		//No compiler, use the pre-built file if its stamp says it was built from this source
+		result = Prebuilt(source);
+		m_Fallbacks++;
+	}
+	else {
+		//Cache entries are named after the source so the folder is easy to read, the hash picks the variant
+		result = (fs::path(m_CacheDir) / (fs::path(source.path).filename().string() + "." + hexHash(hashSource(source)) + ".spv")).string();
+
+		if (fs::exists(result, error)) {
+			m_CacheHits++;
+		}
+		else {
+			fs::create_directories(m_CacheDir);
+			compile(source, result);
+			m_Compiled++;
+		}
+	}
+
+	m_Resolved[key] = result;
+	return result;
+}
+
+void ShaderCompiler::build(const ShaderSource& source)
+{
+	if (!Available()) {
+		throw std::runtime_error("failed to build " + source.fallbackSpv + ", glslangValidator not found!");
+	}
+	compile(source, source.fallbackSpv);
+
+	std::ofstream stamp(stampPath(source));
+	stamp << hexHash(SourceHash(source)) << std::endl;
+	if (!stamp) {
+		throw std::runtime_error("failed to write " + stampPath(source) + "!");
+	}
+}
+
+std::string ShaderCompiler::Prebuilt(const ShaderSource& source)
+{
+	//Without the source there is nothing to check against, e.g. a build that only ships the SPIR-V
+	std::error_code error;
+	if (!fs::exists(source.path, error)) {
+		return source.fallbackSpv;
+	}
+
+	std::ifstream file(stampPath(source));
+	std::string stamp;
+	file >> stamp;
+	if (stamp.empty()) {
+		throw std::runtime_error(source.fallbackSpv + " has no stamp to check it against " + source.path + ", rebuild it with --build-shaders!");
+	}
+	if (stamp != hexHash(SourceHash(source))) {
+		throw std::runtime_error(source.fallbackSpv + " was built from a different " + source.path + ", rebuild it with --build-shaders!");
+	}
+	return source.fallbackSpv;
+}
+
+void ShaderCompiler::printStats()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	std::cout << "shaders: " << m_CacheHits << " cache hits, " << m_Compiled << " compiled, " << m_Fallbacks << " pre-built" << std::endl;
+}
@@ -0,0 +1,75 @@
+#include "ShaderLibrary.h"
+
+#include "CpuProfiler.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <stdexcept>
+
+//First word of every SPIR-V module
+static const uint32_t SPIRV_MAGIC = 0x07230203;
+
+ShaderLibrary::ShaderLibrary(VkDevice& device) : m_Device(device) {}
+
+ShaderLibrary::~ShaderLibrary()
+{
+	clear();
+}
+
+VkShaderModule ShaderLibrary::get(const std::string& filename)
+{
+	PROFILE_SCOPE("load shader module");
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	//Return the module if we have already loaded this file
+	auto found = m_Modules.find(filename);
+	if (found != m_Modules.end()) {
+		return found->second;
+	}
+
+	//Map the file and create the module straight from the mapped memory, the mapping is released at the end of the scope
+	MappedFile file(filename);
+	VkShaderModule shaderModule = createShaderModule(file.Data(), file.Size(), filename);
+
+	m_Modules[filename] = shaderModule;
+	return shaderModule;
+}
+
+VkShaderModule ShaderLibrary::createShaderModule(const void* code, size_t size, const std::string& filename)
+{
+	//SPIR-V is a stream of 32 bit words, so the size and data must be word aligned
+	if (size < sizeof(uint32_t) || size % sizeof(uint32_t) != 0) {
+		throw std::runtime_error("invalid SPIR-V size: " + filename);
+	}
+	if (reinterpret_cast<uintptr_t>(code) % alignof(uint32_t) != 0) {
+		throw std::runtime_error("misaligned SPIR-V data: " + filename);
+	}
+	if (*static_cast<const uint32_t*>(code) != SPIRV_MAGIC) {
+		throw std::runtime_error("invalid SPIR-V magic number: " + filename);
+	}
+
+	//Set up up shader module info
+	VkShaderModuleCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	createInfo.codeSize = size; //Pass in shader size
+	createInfo.pCode = static_cast<const uint32_t*>(code); //Pass in shader code
+
+	//Create shader module and error check
+	VkShaderModule shaderModule;
+	if (vkCreateShaderModule(m_Device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create shader module!");
+	}
+
+	return shaderModule;
+}
+
+void ShaderLibrary::clear()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	//Destroy shader modules now we have finished with them
+	for (auto& shaderModule : m_Modules) {
+		vkDestroyShaderModule(m_Device, shaderModule.second, nullptr);
+	}
+	m_Modules.clear();
+}
@@ -0,0 +1,244 @@
+#include "TransformStore.h"
+
+#include <algorithm>
+#include <cmath>
+
+//Widest SIMD the compiler is allowed to use, as in FrustumCuller
+#if defined(__AVX__)
+#define TRANSFORM_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+#if defined(TRANSFORM_AVX)
+	typedef __m256 Lanes;
+	const size_t LANE_COUNT = 8;
+
+	inline Lanes gather(const std::vector<float>& values, const uint32_t* indices) {
+		return _mm256_setr_ps(values[indices[0]], values[indices[1]], values[indices[2]], values[indices[3]],
+			values[indices[4]], values[indices[5]], values[indices[6]], values[indices[7]]);
+	}
+	inline Lanes splat(float value) { return _mm256_set1_ps(value); }
+	inline Lanes add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+	inline Lanes sub(Lanes a, Lanes b) { return _mm256_sub_ps(a, b); }
+	inline Lanes mul(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+	inline void store(float* out, Lanes a) { _mm256_storeu_ps(out, a); }
+#elif defined(TRANSFORM_SSE)
+	typedef __m128 Lanes;
+	const size_t LANE_COUNT = 4;
+
+	inline Lanes gather(const std::vector<float>& values, const uint32_t* indices) {
+		return _mm_setr_ps(values[indices[0]], values[indices[1]], values[indices[2]], values[indices[3]]);
+	}
+	inline Lanes splat(float value) { return _mm_set1_ps(value); }
+	inline Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+	inline Lanes sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+	inline Lanes mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+	inline void store(float* out, Lanes a) { _mm_storeu_ps(out, a); }
+#endif
+}
+
+const char* TransformStore::SimdName()
+{
+#if defined(TRANSFORM_AVX)
+	return "AVX";
+#elif defined(TRANSFORM_SSE)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+glm::mat3 TransformStore::NormalMatrix(const glm::mat4& world)
+{
+	glm::mat3 basis(world);
+	float scale = glm::dot(basis[0], basis[0]);
+
+	//Axes at right angles and the same length are a rotation times s, whose inverse transpose is the rotation over s
+	const float tolerance = 1e-4f * scale;
+	bool uniform = std::abs(glm::dot(basis[1], basis[1]) - scale) <= tolerance && std::abs(glm::dot(basis[2], basis[2]) - scale) <= tolerance
+		&& std::abs(glm::dot(basis[0], basis[1])) <= tolerance && std::abs(glm::dot(basis[0], basis[2])) <= tolerance && std::abs(glm::dot(basis[1], basis[2])) <= tolerance;
+	if (uniform && scale > 0.0f) return basis / scale;
+
+	//The cofactors are the inverse transpose times the determinant. An axis scaled to nothing has no inverse, so rather than
+	//divide by a determinant near zero keep the cofactors. Those still point along the flattened axis, and are all zero if
+	//every axis is, so the normals stay finite either way
+	glm::mat3 cofactors(glm::cross(basis[1], basis[2]), glm::cross(basis[2], basis[0]), glm::cross(basis[0], basis[1]));
+	float determinant = glm::dot(basis[0], cofactors[0]);
+	float volume = glm::length(basis[0]) * glm::length(basis[1]) * glm::length(basis[2]);
+	if (std::abs(determinant) <= 1e-6f * volume) return cofactors;
+	return cofactors / determinant;
+}
+
+uint32_t TransformStore::create(uint32_t parent)
+{
+	uint32_t index = static_cast<uint32_t>(m_Parent.size());
+
+	m_PositionX.push_back(0.0f);
+	m_PositionY.push_back(0.0f);
+	m_PositionZ.push_back(0.0f);
+	m_RotationX.push_back(0.0f);
+	m_RotationY.push_back(0.0f);
+	m_RotationZ.push_back(0.0f);
+	m_RotationW.push_back(1.0f);
+	m_ScaleX.push_back(1.0f);
+	m_ScaleY.push_back(1.0f);
+	m_ScaleZ.push_back(1.0f);
+
+	//New children go on the front of their parent's list
+	m_Parent.push_back(parent);
+	m_FirstChild.push_back(INVALID);
+	m_NextSibling.push_back(parent == INVALID ? INVALID : m_FirstChild[parent]);
+	if (parent != INVALID) {
+		m_FirstChild[parent] = index;
+	}
+
+	m_Local.push_back(glm::mat4(1.0f));
+	m_World.push_back(parent == INVALID ? glm::mat4(1.0f) : m_World[parent]);
+
+	m_DirtyFlags.push_back(0);
+	m_ChangedFlags.push_back(0);
+	//Its world matrix is new, so the next update reports it as changed
+	markDirty(index);
+	return index;
+}
+
+void TransformStore::clear()
+{
+	for (std::vector<float>* values : { &m_PositionX, &m_PositionY, &m_PositionZ, &m_RotationX, &m_RotationY, &m_RotationZ, &m_RotationW, &m_ScaleX, &m_ScaleY, &m_ScaleZ }) {
+		values->clear();
+	}
+	m_Parent.clear();
+	m_FirstChild.clear();
+	m_NextSibling.clear();
+	m_Local.clear();
+	m_World.clear();
+	m_Dirty.clear();
+	m_DirtyFlags.clear();
+	m_Changed.clear();
+	m_ChangedFlags.clear();
+}
+
+void TransformStore::markDirty(uint32_t index)
+{
+	if (!m_DirtyFlags[index]) {
+		m_DirtyFlags[index] = 1;
+		m_Dirty.push_back(index);
+	}
+}
+
+void TransformStore::setPosition(uint32_t index, const glm::vec3& position)
+{
+	m_PositionX[index] = position.x;
+	m_PositionY[index] = position.y;
+	m_PositionZ[index] = position.z;
+	markDirty(index);
+}
+
+void TransformStore::setRotation(uint32_t index, const glm::quat& rotation)
+{
+	m_RotationX[index] = rotation.x;
+	m_RotationY[index] = rotation.y;
+	m_RotationZ[index] = rotation.z;
+	m_RotationW[index] = rotation.w;
+	markDirty(index);
+}
+
+void TransformStore::setScale(uint32_t index, const glm::vec3& scale)
+{
+	m_ScaleX[index] = scale.x;
+	m_ScaleY[index] = scale.y;
+	m_ScaleZ[index] = scale.z;
+	markDirty(index);
+}
+
+void TransformStore::composeLocals(const uint32_t* indices, size_t count, bool simd)
+{
+	//Translation * rotation * scale written out, the rotation's columns are those of glm::mat4_cast scaled by each axis
+	size_t i = 0;
+#if defined(TRANSFORM_AVX) || defined(TRANSFORM_SSE)
+	if (simd) {
+		const Lanes one = splat(1.0f);
+		const Lanes two = splat(2.0f);
+		float columns[9][LANE_COUNT];
+		for (; i + LANE_COUNT <= count; i += LANE_COUNT) {
+			const uint32_t* batch = indices + i;
+			Lanes x = gather(m_RotationX, batch), y = gather(m_RotationY, batch), z = gather(m_RotationZ, batch), w = gather(m_RotationW, batch);
+			Lanes scaleX = gather(m_ScaleX, batch), scaleY = gather(m_ScaleY, batch), scaleZ = gather(m_ScaleZ, batch);
+
+			Lanes xx = mul(x, x), yy = mul(y, y), zz = mul(z, z);
+			Lanes xy = mul(x, y), xz = mul(x, z), yz = mul(y, z);
+			Lanes wx = mul(w, x), wy = mul(w, y), wz = mul(w, z);
+
+			store(columns[0], mul(scaleX, sub(one, mul(two, add(yy, zz)))));
+			store(columns[1], mul(scaleX, mul(two, add(xy, wz))));
+			store(columns[2], mul(scaleX, mul(two, sub(xz, wy))));
+			store(columns[3], mul(scaleY, mul(two, sub(xy, wz))));
+			store(columns[4], mul(scaleY, sub(one, mul(two, add(xx, zz)))));
+			store(columns[5], mul(scaleY, mul(two, add(yz, wx))));
+			store(columns[6], mul(scaleZ, mul(two, add(xz, wy))));
+			store(columns[7], mul(scaleZ, mul(two, sub(yz, wx))));
+			store(columns[8], mul(scaleZ, sub(one, mul(two, add(xx, yy)))));
+
+			for (size_t lane = 0; lane < LANE_COUNT; lane++) {
+				uint32_t index = batch[lane];
+				glm::mat4& local = m_Local[index];
+				local[0] = glm::vec4(columns[0][lane], columns[1][lane], columns[2][lane], 0.0f);
+				local[1] = glm::vec4(columns[3][lane], columns[4][lane], columns[5][lane], 0.0f);
+				local[2] = glm::vec4(columns[6][lane], columns[7][lane], columns[8][lane], 0.0f);
+				local[3] = glm::vec4(m_PositionX[index], m_PositionY[index], m_PositionZ[index], 1.0f);
+			}
+		}
+	}
+#endif
+
+	//What's left over, or everything without SIMD
+	for (; i < count; i++) {
+		uint32_t index = indices[i];
+		float x = m_RotationX[index], y = m_RotationY[index], z = m_RotationZ[index], w = m_RotationW[index];
+		float scaleX = m_ScaleX[index], scaleY = m_ScaleY[index], scaleZ = m_ScaleZ[index];
+
+		glm::mat4& local = m_Local[index];
+		local[0] = glm::vec4(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y), 0.0f) * scaleX;
+		local[1] = glm::vec4(2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x), 0.0f) * scaleY;
+		local[2] = glm::vec4(2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y), 0.0f) * scaleZ;
+		local[3] = glm::vec4(m_PositionX[index], m_PositionY[index], m_PositionZ[index], 1.0f);
+	}
+}
+
+void TransformStore::update(bool simd)
+{
+	for (uint32_t index : m_Changed) {
+		m_ChangedFlags[index] = 0;
+	}
+	m_Changed.clear();
+
+	composeLocals(m_Dirty.data(), m_Dirty.size(), simd);
+
+	for (uint32_t index : m_Dirty) {
+		m_DirtyFlags[index] = 0;
+		m_ChangedFlags[index] = 1;
+		m_Changed.push_back(index);
+	}
+	m_Dirty.clear();
+
+	//Everything under a dirty transform moves with it, the list grows as the children are added
+	for (size_t i = 0; i < m_Changed.size(); i++) {
+		for (uint32_t child = m_FirstChild[m_Changed[i]]; child != INVALID; child = m_NextSibling[child]) {
+			if (!m_ChangedFlags[child]) {
+				m_ChangedFlags[child] = 1;
+				m_Changed.push_back(child);
+			}
+		}
+	}
+
+	//Parents have lower indices than their children, so in index order each parent's world matrix is ready first
+	std::sort(m_Changed.begin(), m_Changed.end());
+	for (uint32_t index : m_Changed) {
+		uint32_t parent = m_Parent[index];
+		m_World[index] = parent == INVALID ? m_Local[index] : m_World[parent] * m_Local[index];
+	}
+}
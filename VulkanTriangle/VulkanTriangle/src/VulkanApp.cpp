@@ -1,5 +1,29 @@
 #include <VulkanApp.h>
 
+#include "MappedFile.h"
+
+#include <random>
+
+//Every shader the app loads, with the pre-built SPIR-V used without a compiler. --build-shaders rebuilds all of them
+static const ShaderSource SHELL_VERT_SHADER = { "shaders/shader.vert", "shaders/vertS.spv", {} };
+static const ShaderSource SHELL_FRAG_SHADER = { "shaders/shader.frag", "shaders/fragS.spv", {} };
+static const ShaderSource SHELL_OIT_FRAG_SHADER = { "shaders/shader.frag", "shaders/fragS_oit.spv", { "OIT" } };
+static const ShaderSource BASE_VERT_SHADER = { "shaders/base.vert", "shaders/vert.spv", {} };
+static const ShaderSource FIN_GEOM_SHADER = { "shaders/shader.geom", "shaders/geom.spv", {} };
+static const ShaderSource FIN_VERT_SHADER = { "shaders/fin.vert", "shaders/fin_vert.spv", {} };
+static const ShaderSource FIN_FRAG_SHADER = { "shaders/base.frag", "shaders/frag.spv", {} };
+static const ShaderSource OVERDRAW_FRAG_SHADER = { "shaders/overdraw.frag", "shaders/overdraw.spv", {} };
+static const ShaderSource FULLSCREEN_VERT_SHADER = { "shaders/fullscreen.vert", "shaders/fullscreen_vert.spv", {} };
+static const ShaderSource OIT_COMPOSITE_FRAG_SHADER = { "shaders/oit_composite.frag", "shaders/oit_composite.spv", {} };
+static const ShaderSource CULL_SHADER = { "shaders/cull.comp", "shaders/cull.spv", {} };
+static const ShaderSource CULL_OCCLUSION_SHADER = { "shaders/cull.comp", "shaders/cull_occlusion.spv", { "OCCLUSION" } };
+static const ShaderSource DEPTH_REDUCE_SHADER = { "shaders/depth_reduce.comp", "shaders/depth_reduce.spv", {} };
+static const ShaderSource FINS_SHADER = { "shaders/fins.comp", "shaders/fins.spv", {} };
+
+static const std::array<const ShaderSource*, 14> ALL_SHADERS = { {
+	&SHELL_VERT_SHADER, &SHELL_FRAG_SHADER, &SHELL_OIT_FRAG_SHADER, &BASE_VERT_SHADER, &FIN_GEOM_SHADER, &FIN_VERT_SHADER, &FIN_FRAG_SHADER,
+	&OVERDRAW_FRAG_SHADER, &FULLSCREEN_VERT_SHADER, &OIT_COMPOSITE_FRAG_SHADER, &CULL_SHADER, &CULL_OCCLUSION_SHADER, &DEPTH_REDUCE_SHADER, &FINS_SHADER } };
+
 static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
 
 	//Get the glfw window pointer cast to the vulkan app class, enable resizing
@@ -7,57 +31,132 @@ static void framebufferResizeCallback(GLFWwindow* window, int width, int height)
 	app->framebufferResized = true;
 }
 
+static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
 
-static std::vector<char> readFile(const std::string& filename) {
-
-	//Open a file stream with the binary setting
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-	if (!file.is_open()) { //Check if file opened
-		throw std::runtime_error("failed to open file!");
+	//F2 writes out the render stats history
+	auto app = reinterpret_cast<VulkanApp*>(glfwGetWindowUserPointer(window));
+	if (key == GLFW_KEY_F2 && action == GLFW_PRESS) {
+		app->statsDumpRequested = true;
 	}
-
-	size_t fileSize = (size_t)file.tellg(); //Get file size
-	std::vector<char> buffer(fileSize); //Allocate enough memory
-
-	file.seekg(0); //Go to the start of the files
-	file.read(buffer.data(), fileSize); //Read all data into the buffer
-
-	file.close(); //close file stream
-
-	return buffer; //Return character buffer
 }
 
+
 const void VulkanApp::initWindow()
 {
-	window = new GLFW_Window(512, 512, "Hello Pyramid"); //Open the GLFW window with a given size and name
+	window = new GLFW_Window(m_Settings.width, m_Settings.height, "Hello Pyramid"); //Open the GLFW window with a given size and name
 
 	glfwSetWindowUserPointer(window->Window(), this); //Set the window pointer to this class (VulkanApp)
 	glfwSetFramebufferSizeCallback(window->Window(), framebufferResizeCallback); //Set resize call back to given function
+	glfwSetKeyCallback(window->Window(), keyCallback);
 }
 
 const void VulkanApp::initVulkan() {
+	PROFILE_SCOPE("initVulkan");
 
+	if (m_Settings.mockVulkan) {
+		VulkanLoader::loadMock();
+		enableValidationLayers = false;
+	}
+	else {
+		VulkanLoader::loadLibrary();
+	}
 	createInstance();
+	VulkanLoader::loadInstance(instance);
 	setupDebugMessenger();
-	createSurface();
+	if (!m_Settings.headless) {
+		createSurface();
+	}
 	pickPhysicalDevice();
 	createLogicalDevice();
-	createSwapChain();
+
+	//Track device memory from here on, warn when a heap gets close to its budget
+	m_Memory = new MemoryTracker(physicalDevice, m_HasMemoryBudget);
+	m_Memory->setThresholds(m_Settings.memoryThresholds);
+	m_Memory->setCallback([](const MemoryThresholdEvent& event) {
+		std::cout << "warning: memory heap " << event.heap << " is over " << event.threshold * 100.0 << "% of its budget ("
+			<< event.usage.usage / (1024 * 1024) << "/" << event.usage.budget / (1024 * 1024) << "MiB)" << std::endl;
+	});
+	m_Engine->setMemoryTracker(m_Memory);
+
+	//Occlusion culling adds the pyramid and the late pass's zones, each pass has its fin edges. OIT adds the composite
+	uint32_t gpuZones = (m_Settings.occlusionCulling ? 14 : 9) + (m_Settings.orderIndependentShells ? 1 : 0);
+	m_GpuProfiler = new GpuProfiler(physicalDevice, device, findQueueFamilies(physicalDevice).graphicsFamily.value(), MAX_FRAMES_IN_FLIGHT, m_Settings.pipelineStatistics, gpuZones);
+	if (m_Settings.overdrawInterval > 0) {
+		m_Overdraw = new OverdrawCounter(m_Engine, device);
+	}
+	if (m_Settings.gpuCulling) {
+		m_GpuCuller = new GpuCuller(m_Engine, device);
+	}
+	if (m_Settings.occlusionCulling) {
+		m_DepthPyramid = new DepthPyramid(m_Engine, device);
+	}
+	if (!m_Settings.geometryFins) {
+		m_FinGenerator = new FinGenerator(m_Engine, device);
+	}
+	if (m_Settings.orderIndependentShells) {
+		m_Oit = new OitCompositor(m_Engine, device);
+	}
+	m_Shaders = new ShaderLibrary(device);
+	if (m_Settings.compileShaders) {
+		m_Compiler = new ShaderCompiler("shaders/cache", m_Settings.shaderOptimisation);
+	}
+	m_Pipelines = new PipelineLibrary(device, *m_Shaders);
+	if (m_Settings.headless) {
+		createOffscreenImages();
+	}
+	else {
+		createSwapChain();
+	}
 	createImageViews();
 	createRenderPass();
 	createDescriptorSetLayout();
-	createGraphicsPipeline(VK_TRUE);
-	createGraphicsPipeline(VK_FALSE);
+	createPipelineLayouts();
+	m_FurConstants.shellCount = static_cast<int32_t>(m_Settings.shellCount);
+	createGraphicsPipelines();
 	createCommandPool();
 
-	//Creaate Objects after setting up required components
+	//Meshes are copied into the arena as the objects load, it grows if they don't fit
+	m_Geometry = new GeometryArena(m_Engine, device);
+	m_Geometry->create(GEOMETRY_VERTEX_CAPACITY, GEOMETRY_INDEX_CAPACITY);
 
-	m_Objects.push_back(new VulkanObject(m_Engine, physicalDevice, device, graphicsQueue, commandPool, "models/bunnySmooth.obj", "textures/wall.jpg"));
-	m_Objects[0]->SetPos(glm::vec3(0.0f, 0.0f, 0));
+	//Creaate Objects after setting up required components
 
-	/*m_Objects.push_back(new VulkanObject(m_Engine, physicalDevice, device, graphicsQueue, commandPool, "models/bunny.obj", "textures/wall.jpg"));
-	m_Objects[1]->SetPos(glm::vec3(1.0f, -1, 0));*/
+	//Lay the objects out on a square grid facing the camera, and pull the camera back so the whole grid fits
+	unsigned int gridSize = static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<float>(m_Settings.objectCount))));
+	const float spacing = 0.2f;
+	m_CameraDistance = spacing * gridSize;
+
+	//Each is an instance of the same object, so the bunny is only loaded once. They are placed under a root for the whole grid
+	m_SceneRoot = m_Transforms.create();
+	m_TransformInstances.push_back(TransformStore::INVALID);
+	for (unsigned int i = 0; i < m_Settings.objectCount; i++) {
+		float x = (static_cast<float>(i % gridSize) - (gridSize - 1) * 0.5f) * spacing;
+		float y = (static_cast<float>(i / gridSize) - (gridSize - 1) * 0.5f) * spacing;
+
+		FurInstance instance;
+		instance.object = loadObject("models/bunnySmooth.obj", "textures/wall.jpg");
+		instance.transform = m_Transforms.create(m_SceneRoot);
+		instance.passes = m_Settings.shellCount;
+		//Spread the spinning ones evenly through the grid
+		instance.spinning = static_cast<unsigned int>((i + 1) * m_Settings.spinningFraction) != static_cast<unsigned int>(i * m_Settings.spinningFraction);
+		m_Transforms.setPosition(instance.transform, glm::vec3(x, y, 0));
+		m_TransformInstances.push_back(i);
+		if (instance.spinning) m_SpinningTransforms.push_back(instance.transform);
+		m_Instances.push_back(instance);
+	}
+
+	/*FurInstance instance;
+	instance.object = loadObject("models/bunny.obj", "textures/wall.jpg");
+	instance.transform = m_Transforms.create(m_SceneRoot);
+	m_Transforms.setPosition(instance.transform, glm::vec3(1.0f, -1, 0));
+	m_TransformInstances.push_back(static_cast<uint32_t>(m_Instances.size()));
+	m_Instances.push_back(instance);*/
+
+	//The tree needs the world positions
+	m_Transforms.update();
+	for (unsigned int i = 0; i < m_Instances.size(); i++) {
+		m_InstanceProxies.push_back(m_SceneIndex.insert(sceneBounds(i), i));
+	}
 
 	m_Engine->createNoiseTextureImage(graphicsQueue, commandPool, furTextureImage, furTextureImageMemory, 0.25f);
 	furTextureImageView = m_Engine->createTextureImageView(furTextureImage);
@@ -68,9 +167,46 @@ const void VulkanApp::initVulkan() {
 	m_Engine->createTextureSampler(finTextureSampler);
 	
 
+	if (m_DepthPyramid) {
+		m_DepthPyramid->createPipeline(m_Shaders->get(shaderPath(DEPTH_REDUCE_SHADER)));
+	}
 	createDepthResources();
 	createFramebuffers();
-	createUniformBuffers();
+
+	//Every draw reads the instances from the same buffers, the culling pass fills in the visible lists when it does the culling.
+	//Occlusion culling lists the late pass's instances after the early pass's
+	m_InstanceBuffers = new InstanceBuffers(m_Engine, device);
+	m_InstanceBuffers->create(MAX_FRAMES_IN_FLIGHT, static_cast<uint32_t>(m_Instances.size()), m_DepthPyramid ? static_cast<uint32_t>(CullPass::Count) : 1);
+	m_ObjectDraws.resize(m_Objects.size());
+	if (m_GpuCuller) {
+		//Each object's instances are listed together, in the space left for all of them
+		std::vector<GpuMesh> meshes(m_Objects.size());
+		uint32_t firstVisible = 0;
+		for (size_t i = 0; i < m_Objects.size(); i++) {
+			const MeshRange& mesh = m_Objects[i]->GetMesh();
+			meshes[i] = { mesh.indexCount, mesh.firstIndex, mesh.vertexOffset, firstVisible };
+			for (const FurInstance& instance : m_Instances) {
+				if (instance.object == i) firstVisible++;
+			}
+		}
+
+		m_GpuCuller->create(m_Shaders->get(shaderPath(m_DepthPyramid ? CULL_OCCLUSION_SHADER : CULL_SHADER)), *m_InstanceBuffers, meshes, m_DepthPyramid != nullptr);
+		if (m_DepthPyramid) {
+			m_GpuCuller->setDepthPyramid(m_DepthPyramid->ImageView(), m_DepthPyramid->Sampler());
+		}
+	}
+	if (m_FinGenerator) {
+		//Every object is loaded, so the arena won't grow under the fin pass's view of its vertices
+		std::vector<FinMesh> finMeshes(m_Objects.size());
+		for (size_t i = 0; i < m_Objects.size(); i++) {
+			finMeshes[i].edges = m_Objects[i]->GetEdges();
+			finMeshes[i].vertexOffset = m_Objects[i]->GetMesh().vertexOffset;
+		}
+		for (const FurInstance& instance : m_Instances) {
+			finMeshes[instance.object].instanceCount++;
+		}
+		m_FinGenerator->create(m_Shaders->get(shaderPath(FINS_SHADER)), *m_InstanceBuffers, m_Geometry->VertexBuffer(), finMeshes, m_GpuCuller);
+	}
 	createDescriptorPool();
 	createDescriptorSets();
 	createCommandBuffers();
@@ -80,6 +216,7 @@ const void VulkanApp::initVulkan() {
 
 const void VulkanApp::createInstance()
 {
+	PROFILE_SCOPE("createInstance");
 
 	//Check if validation layers are supported, if not throw an error
 	if (enableValidationLayers && !checkValidationLayerSupport()) {
@@ -100,18 +237,6 @@ const void VulkanApp::createInstance()
 	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 	createInfo.pApplicationInfo = &appInfo;
 
-	uint32_t glfwExtensionCount = 0;
-	const char** glfwExtensions;
-
-	//Get required  instance extention
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-	//Pass extention count and names to info
-	createInfo.enabledExtensionCount = glfwExtensionCount;
-	createInfo.ppEnabledExtensionNames = glfwExtensions;
-
-	createInfo.enabledLayerCount = 0;
-
 	//If using validation layers pass in validation data to info
 	if (enableValidationLayers) {
 		createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -126,10 +251,7 @@ const void VulkanApp::createInstance()
 	createInfo.enabledExtensionCount = static_cast<uint32_t>(extensionsReq.size()); //Set data
 	createInfo.ppEnabledExtensionNames = extensionsReq.data();
 
-	//Create instance using set data/info
-	VkResult result = vkCreateInstance(&createInfo, nullptr, &instance);
-
-	//Check if the instance was created if note throw error
+	//Create instance using set data/info, check if the instance was created if note throw error
 	if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create instance!");
 	}
@@ -185,26 +307,313 @@ bool VulkanApp::checkValidationLayerSupport()
 }
 
 const void VulkanApp::mainLoop() {
-	//while window should not close keep looping
-	while (!window->ShouldClose())
+	//while window should not close keep looping (or until the requested number of frames have been drawn)
+	while (!window->ShouldClose() && (m_Settings.frameCount == 0 || m_FrameCount < m_Settings.frameCount))
 	{
 		//Update window
 		window->UpdateWindow();
 		//Draw frame
 		drawFrame();
+
+		if (statsDumpRequested) {
+			statsDumpRequested = false;
+			m_RenderStats.dump(m_Settings.statsOutput.empty() ? "render_stats.csv" : m_Settings.statsOutput);
+		}
+	}
+	//Wait for last frame to be processed before ending
+	vkDeviceWaitIdle(device);
+}
+
+void VulkanApp::benchmarkLoop() {
+
+	m_Benchmark = new Benchmark(m_Settings);
+
+	//Wait for the background pipelines so the warmup and measured frames all draw the full scene
+	m_Pipelines->waitIdle();
+
+	size_t totalFrames = static_cast<size_t>(m_Settings.warmupFrames) + m_Settings.frameCount;
+	while (m_FrameCount < totalFrames && (m_Settings.headless || !window->ShouldClose()))
+	{
+		size_t frame = m_FrameCount;
+		auto startTime = std::chrono::high_resolution_clock::now();
+
+		if (m_Settings.headless) {
+			drawFrameHeadless();
+		}
+		else {
+			window->UpdateWindow();
+			drawFrame();
+		}
+
+		//Frames skipped for a swap chain recreation aren't counted
+		if (m_FrameCount == frame) continue;
+
+		double cpuMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+		const FrameStats* stats = m_RenderStats.Latest();
+		m_Benchmark->addFrame(frame, cpuMs, stats->drawCalls, stats->triangles);
+	}
+
+	//Wait for the GPU to finish and pick up the last frames' timings
+	vkDeviceWaitIdle(device);
+	for (uint32_t i = 0; i < static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT); i++) {
+		collectGpuTime(i);
+	}
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	m_Benchmark->writeJson(properties.deviceName);
+
+	delete m_Benchmark;
+	m_Benchmark = nullptr;
+}
+
+void VulkanApp::headlessLoop() {
+
+	//Wait for the background pipelines so every frame draws the full scene
+	m_Pipelines->waitIdle();
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	while (m_FrameCount < m_Settings.frameCount) {
+		drawFrameHeadless();
 	}
 	//Wait for last frame to be processed before ending
 	vkDeviceWaitIdle(device);
+
+	double totalMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	std::cout << "rendered " << m_FrameCount << " frames at " << swapChainExtent.width << "x" << swapChainExtent.height
+		<< " in " << totalMs << "ms (" << totalMs / m_FrameCount << "ms per frame)" << std::endl;
+}
+
+void VulkanApp::buildShaders() {
+
+	ShaderCompiler compiler("shaders/cache", m_Settings.shaderOptimisation);
+	for (const ShaderSource* source : ALL_SHADERS) {
+		compiler.build(*source);
+		std::cout << "built " << source->fallbackSpv << std::endl;
+	}
+}
+
+void VulkanApp::microbenchLoop() {
+
+	Microbench bench(m_Settings.microbenchRepetitions, m_Settings.microbenchFilter);
+
+	//Background pipeline builds would share the CPU with the cases
+	m_Pipelines->waitIdle();
+
+	//Model parsing and vertex deduplication, reloading the first object's mesh in place
+	VulkanObject* object = m_Objects[0];
+	const std::string modelPath = object->Name();
+	bench.run("loadModel", MappedFile(modelPath).Size(), [&]() {
+		object->loadModel(modelPath.c_str());
+	});
+
+	const std::vector<Vertex>& vertices = object->GetVertices();
+	bench.run("std::hash<Vertex>", vertices.size() * sizeof(Vertex), [&]() {
+		std::hash<Vertex> hasher;
+		size_t combined = 0;
+		for (const Vertex& vertex : vertices) {
+			combined ^= hasher(vertex);
+		}
+		Microbench::keep(combined);
+	});
+
+	//Loading the mesh into the arena's free space and giving it back, the staging copies do nothing against the mock
+	const std::vector<uint32_t>& indices = object->GetIndices();
+	bench.run("arena add/remove", vertices.size() * sizeof(Vertex) + indices.size() * sizeof(uint32_t), [&]() {
+		MeshRange mesh = m_Geometry->add(graphicsQueue, commandPool, vertices, indices, modelPath);
+		m_Geometry->remove(mesh);
+		Microbench::keep(mesh.firstIndex);
+	});
+
+	//The noise texture is 256x256 vec4s
+	bench.run("createNoiseTextureImage", 256 * 256 * sizeof(glm::vec4), [&]() {
+		VkImage image;
+		VkDeviceMemory memory;
+		m_Engine->createNoiseTextureImage(graphicsQueue, commandPool, image, memory, 0.25f);
+		vkDestroyImage(device, image, nullptr);
+		m_Engine->freeMemory(memory);
+	});
+
+	//A frame's worth of instance data and visible lists, every instance visible and changed
+	cullObjects();
+	bench.run("updateInstances x" + std::to_string(m_Instances.size()), m_Instances.size() * (sizeof(GpuInstance) + sizeof(uint32_t)) + sizeof(GpuFrame), [&]() {
+		for (uint32_t i = 0; i < m_Instances.size(); i++) {
+			m_InstanceBuffers->markChanged(i);
+		}
+		updateInstances(0);
+	});
+
+	//Sets are never freed, the mock's pool doesn't run out
+	bench.run("createDescriptorSets x" + std::to_string(descriptorSets.size()), 0, [&]() {
+		createDescriptorSets();
+	});
+
+	//Mapping the pre-built shaders and touching every byte, which is how the shader library reads them
+	const std::array<const char*, 5> shaderFiles = { "shaders/vert.spv", "shaders/frag.spv", "shaders/vertS.spv", "shaders/fragS.spv", "shaders/geom.spv" };
+	uint64_t shaderBytes = 0;
+	for (const char* shaderFile : shaderFiles) {
+		shaderBytes += MappedFile(shaderFile).Size();
+	}
+	bench.run("map shader files", shaderBytes, [&]() {
+		for (const char* shaderFile : shaderFiles) {
+			MappedFile file(shaderFile);
+			const uint8_t* bytes = static_cast<const uint8_t*>(file.Data());
+			uint64_t sum = 0;
+			for (size_t i = 0; i < file.Size(); i++) {
+				sum += bytes[i];
+			}
+			Microbench::keep(sum);
+		}
+	});
+
+	//Culling 100k objects scattered through a box around the camera, only those in front of it and inside the view are visible
+	const size_t cullCount = 100000;
+	FrustumCuller culler;
+	culler.resize(cullCount);
+	std::default_random_engine generator;
+	std::uniform_real_distribution<float> spread(-1.0f, 1.0f);
+	std::vector<Bounds> cullBounds(cullCount, object->GetBounds().expanded(m_Instances[0].extrusion));
+	for (size_t i = 0; i < cullCount; i++) {
+		cullBounds[i].centre = glm::vec3(spread(generator), spread(generator), spread(generator)) * 10.0f;
+		culler.setBounds(i, cullBounds[i]);
+	}
+	Frustum frustum = Frustum::fromMatrix(projectionMatrix() * viewMatrix());
+	std::vector<uint32_t> visible;
+	const std::array<std::pair<const char*, CullPath>, 3> cullPaths = { {
+		{ "cull 100k scalar", CullPath::Scalar },
+		{ "cull 100k simd", CullPath::Simd },
+		{ "cull 100k parallel", CullPath::Parallel } } };
+	for (auto& cullPath : cullPaths) {
+		bench.run(cullPath.first, cullCount * 7 * sizeof(float), [&]() {
+			culler.cull(frustum, visible, cullPath.second);
+			Microbench::keep(visible.size());
+		});
+	}
+	culler.cull(frustum, visible, CullPath::Scalar);
+	size_t scalarVisible = visible.size();
+	culler.cull(frustum, visible, CullPath::Parallel);
+	std::cout << "culling with " << FrustumCuller::SimdName() << ", " << visible.size() << " of " << cullCount << " visible (" << scalarVisible << " scalar)" << std::endl;
+
+	//The same objects in the scene BVH, built from scratch, queried with the same frustum, and with rays and moves through it
+	SceneBvh bvh;
+	std::vector<int32_t> proxies(cullCount);
+	bench.run("bvh insert 100k", cullCount * sizeof(Bounds), [&]() {
+		bvh.clear();
+		for (size_t i = 0; i < cullCount; i++) {
+			proxies[i] = bvh.insert(cullBounds[i], static_cast<uint32_t>(i));
+		}
+		Microbench::keep(bvh.Size());
+	});
+	bench.run("bvh frustum 100k", 0, [&]() {
+		visible.clear();
+		bvh.queryFrustum(frustum, visible);
+		Microbench::keep(visible.size());
+	});
+	size_t bvhVisible = visible.size();
+
+	const size_t rayCount = 1000;
+	std::vector<glm::vec3> rayDirections(rayCount);
+	for (glm::vec3& direction : rayDirections) {
+		direction = glm::vec3(spread(generator), spread(generator), spread(generator));
+	}
+	SceneBvh::RayHit hit;
+	size_t rayHits = 0;
+	bench.run("bvh raycast x1000", 0, [&]() {
+		rayHits = 0;
+		for (const glm::vec3& direction : rayDirections) {
+			if (bvh.raycast(glm::vec3(0.0f), direction, 100.0f, hit)) rayHits++;
+		}
+		Microbench::keep(rayHits);
+	});
+
+	//Every move nudges a different object along a little, most stay inside their leaf's margin
+	const size_t moveCount = 10000;
+	size_t reinserted = 0;
+	size_t moveOffset = 0;
+	bench.run("bvh move x10000", 0, [&]() {
+		reinserted = 0;
+		for (size_t m = 0; m < moveCount; m++) {
+			size_t i = (moveOffset + m * 7919) % cullCount;
+			cullBounds[i].centre += rayDirections[m % rayCount] * 0.05f;
+			if (bvh.move(proxies[i], cullBounds[i])) reinserted++;
+		}
+		moveOffset += moveCount;
+		Microbench::keep(reinserted);
+	});
+	if (bvh.Size() > 0) std::cout << "bvh height " << bvh.Height() << ", area ratio " << bvh.AreaRatio() << ", " << bvhVisible << " visible, " << rayHits << " of " << rayCount << " rays hit, " << reinserted << " of " << moveCount << " moves reinserted" << std::endl;
+
+	//A 100k transform hierarchy, 1000 groups of 100 under a root, with everything moving or only 1% of the leaves
+	TransformStore transforms;
+	uint32_t root = transforms.create();
+	std::vector<uint32_t> leaves;
+	for (uint32_t group = 0; group < 1000; group++) {
+		uint32_t parent = transforms.create(root);
+		transforms.setPosition(parent, glm::vec3(spread(generator), spread(generator), spread(generator)) * 10.0f);
+		for (uint32_t child = 0; child < 100; child++) {
+			leaves.push_back(transforms.create(parent));
+			transforms.setPosition(leaves.back(), glm::vec3(spread(generator), spread(generator), spread(generator)));
+		}
+	}
+	transforms.update();
+	const std::array<std::pair<const char*, size_t>, 2> movedCounts = { { { "all moved", leaves.size() }, { "1% moved", leaves.size() / 100 } } };
+	for (const auto& moved : movedCounts) {
+		for (bool simd : { true, false }) {
+			std::string name = std::string("transforms x") + std::to_string(transforms.Size()) + " " + moved.first + " " + (simd ? TransformStore::SimdName() : "scalar");
+			float angle = 0.0f;
+			bench.run(name, moved.second * sizeof(glm::mat4), [&]() {
+				//Every 100th leaf for the 1%, so the moves are spread through the groups
+				size_t step = leaves.size() / moved.second;
+				angle += 0.01f;
+				glm::quat rotation = glm::angleAxis(angle, glm::vec3(0.0f, 1.0f, 0.0f));
+				for (size_t i = 0; i < leaves.size(); i += step) {
+					transforms.setRotation(leaves[i], rotation);
+				}
+				transforms.update(simd);
+				Microbench::keep(transforms.Changed().size());
+			});
+		}
+	}
+
+	//Normal matrices for the whole hierarchy, which only rotates and translates, against the full inverse the vertex shader used to do
+	bench.run("normal matrix x" + std::to_string(transforms.Size()), transforms.Size() * sizeof(glm::mat3), [&]() {
+		glm::mat3 sum(0.0f);
+		for (uint32_t i = 0; i < transforms.Size(); i++) {
+			sum += TransformStore::NormalMatrix(transforms.World(i));
+		}
+		Microbench::keep(sum[0][0]);
+	});
+	bench.run("normal matrix inverse x" + std::to_string(transforms.Size()), transforms.Size() * sizeof(glm::mat3), [&]() {
+		glm::mat3 sum(0.0f);
+		for (uint32_t i = 0; i < transforms.Size(); i++) {
+			sum += glm::mat3(glm::transpose(glm::inverse(transforms.World(i))));
+		}
+		Microbench::keep(sum[0][0]);
+	});
+
+	bench.print();
+	if (!m_Settings.microbenchOutput.empty()) {
+		bench.writeJson(m_Settings.microbenchOutput);
+	}
 }
 
 void VulkanApp::drawFrame() {
+	PROFILE_SCOPE("drawFrame");
 	
 	//Wait for current frame to be processed before drawing a new one (stop memory leak)
-	vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	{
+		PROFILE_SCOPE("wait for frame fence");
+		vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+	collectGpuTime(static_cast<uint32_t>(currentFrame));
 
 	//Get next image to render too, if failed recreate swap chain and wait till next frame
 	uint32_t imageIndex;
-	VkResult result = vkAcquireNextImageKHR(device, swapChain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+	VkResult result;
+	{
+		PROFILE_SCOPE("acquire image");
+		result = vkAcquireNextImageKHR(device, swapChain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+	}
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 		recreateSwapChain();
@@ -214,14 +623,23 @@ void VulkanApp::drawFrame() {
 		throw std::runtime_error("failed to acquire swap chain image!");
 	}
 
-	for (unsigned int j = 0; j < m_Objects.size(); j++)
-	{
-		for (unsigned int p = 0; p < m_Objects[j]->Passes(); p++)
-		{
-			//Update shader buffers
-			updateUniformBuffer(imageIndex, j, p);
-		}
+	//Only count the frame once we know it will be drawn, a frame lost to a resize is never ended
+	m_RenderStats.beginFrame(m_FrameCount);
+
+	//Wait if a previous frame is still drawing to this image
+	if (imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
+		PROFILE_SCOPE("wait for image fence");
+		vkWaitForFences(device, 1, &imagesInFlight[imageIndex], VK_TRUE, std::numeric_limits<uint64_t>::max());
 	}
+	imagesInFlight[imageIndex] = inFlightFences[currentFrame];
+
+	updateSceneTime();
+	updateTransforms();
+	cullObjects();
+	updateInstances(static_cast<uint32_t>(currentFrame));
+
+	//Record this frame's commands, the fence wait above means the buffer is no longer in use
+	recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
 
 	//Set up submit info
 	VkSubmitInfo submitInfo = {};
@@ -240,15 +658,18 @@ void VulkanApp::drawFrame() {
 
 	//Pass in command buffer data
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
+	submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
 
 	//Reset wait fence 
 	vkResetFences(device, 1, &inFlightFences[currentFrame]);
 
 
 	//Submit data, graphics queue
-	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
-		throw std::runtime_error("failed to submit draw command buffer!");
+	{
+		PROFILE_SCOPE("vkQueueSubmit");
+		if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit draw command buffer!");
+		}
 	}
 
 
@@ -266,7 +687,10 @@ void VulkanApp::drawFrame() {
 	presentInfo.pImageIndices = &imageIndex;
 
 	//Add info to queue
-	result = vkQueuePresentKHR(presentQueue, &presentInfo);
+	{
+		PROFILE_SCOPE("present");
+		result = vkQueuePresentKHR(presentQueue, &presentInfo);
+	}
 
 	//Check if not valid or if the framebuffer has been resized, is not recreate swap chain
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized) {
@@ -277,48 +701,215 @@ void VulkanApp::drawFrame() {
 		throw std::runtime_error("failed to present swap chain image!");
 	}
 
+	endFrame();
+}
+
+void VulkanApp::drawFrameHeadless() {
+	PROFILE_SCOPE("drawFrameHeadless");
+
+	//Wait for this slot's previous frame, after that its image and command buffer are free to reuse
+	{
+		PROFILE_SCOPE("wait for frame fence");
+		vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+	collectGpuTime(static_cast<uint32_t>(currentFrame));
+	m_RenderStats.beginFrame(m_FrameCount);
+
+	//There's an offscreen image per frame in flight, so no need to acquire one
+	uint32_t imageIndex = static_cast<uint32_t>(currentFrame);
+
+	updateSceneTime();
+	updateTransforms();
+	cullObjects();
+	updateInstances(static_cast<uint32_t>(currentFrame));
+
+	recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+
+	//Submit without semaphores, nothing is presented
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+
+	vkResetFences(device, 1, &inFlightFences[currentFrame]);
+
+	{
+		PROFILE_SCOPE("vkQueueSubmit");
+		if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit draw command buffer!");
+		}
+	}
+
+	//Read back the last frame, and every Nth frame if asked for
+	bool lastFrame = m_FrameCount + 1 == m_Settings.frameCount;
+	bool intervalFrame = m_Settings.readbackInterval > 0 && m_FrameCount % m_Settings.readbackInterval == 0;
+	if (!m_Settings.readbackPath.empty() && (lastFrame || intervalFrame)) {
+		vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+
+		char frame[16];
+		snprintf(frame, sizeof(frame), "_%05zu.ppm", m_FrameCount);
+		std::vector<unsigned char> pixels = readbackImage(swapChainImages[imageIndex], m_Settings.readbackPath + frame);
+
+		//Check the last frame against one drawn another way, e.g. --oit against the in order shells
+		if (lastFrame && !m_Settings.readbackReference.empty()) {
+			FrameDifference difference = FrameComparison::compare(pixels, swapChainExtent.width, swapChainExtent.height, m_Settings.readbackReference);
+			FrameComparison::print(difference, m_Settings.readbackReference);
+			if (difference.differingFraction() > m_Settings.readbackTolerance) {
+				throw std::runtime_error("frame differs from " + m_Settings.readbackReference + " in more than " +
+					std::to_string(m_Settings.readbackTolerance * 100.0f) + "% of the covered pixels!");
+			}
+		}
+	}
+
+	endFrame();
+}
+
+std::vector<unsigned char> VulkanApp::readbackImage(VkImage image, const std::string& filename) {
+
+	//Copy the image into a host visible buffer
+	VkDeviceSize imageSize = static_cast<VkDeviceSize>(swapChainExtent.width) * swapChainExtent.height * 4;
+
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	m_Engine->createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory, MemoryCategory::Staging, "frame readback");
+
+	VkCommandBuffer commandBuffer = m_Engine->beginSingleTimeCommands(commandPool);
+
+	VkBufferImageCopy region = {};
+	region.bufferOffset = 0;
+	region.bufferRowLength = 0; //Tightly packed
+	region.bufferImageHeight = 0;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = 1;
+	region.imageOffset = { 0, 0, 0 };
+	region.imageExtent = { swapChainExtent.width, swapChainExtent.height, 1 };
+
+	//The render pass leaves the image ready to copy from
+	vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, stagingBuffer, 1, &region);
+
+	m_Engine->endSingleTimeCommands(graphicsQueue, commandPool, commandBuffer);
+
+	//Write it out as a binary PPM, swizzling BGRA to RGB
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		throw std::runtime_error("failed to open readback file: " + filename);
+	}
+	file << "P6\n" << swapChainExtent.width << " " << swapChainExtent.height << "\n255\n";
+
+	void* data;
+	vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
+	const unsigned char* pixels = static_cast<const unsigned char*>(data);
+	std::vector<unsigned char> rgb(static_cast<size_t>(swapChainExtent.width) * swapChainExtent.height * 3);
+	for (size_t i = 0; i < static_cast<size_t>(swapChainExtent.width) * swapChainExtent.height; i++) {
+		rgb[i * 3 + 0] = pixels[i * 4 + 2];
+		rgb[i * 3 + 1] = pixels[i * 4 + 1];
+		rgb[i * 3 + 2] = pixels[i * 4 + 0];
+	}
+	file.write(reinterpret_cast<const char*>(rgb.data()), rgb.size());
+	vkUnmapMemory(device, stagingBufferMemory);
+
+	vkDestroyBuffer(device, stagingBuffer, nullptr);
+	m_Engine->freeMemory(stagingBufferMemory);
+
+	std::cout << "wrote " << filename << std::endl;
+	return rgb;
+}
+
+void VulkanApp::endFrame() {
+
+	//Read the overdraw counts back, this stalls until the frame is done so it is only done every few frames.
+	//Skipped if a resize has thrown the counts away
+	if (overdrawFrame() && m_Overdraw->HasCounts()) {
+		vkQueueWaitIdle(graphicsQueue);
+		OverdrawCounter::print(m_Overdraw->readback(graphicsQueue, commandPool));
+	}
+
 	//Update frame count
 	currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+
+	//Report how long it took to get the first frame out and when the full pipelines took over from the fallback
+	if (m_FrameCount == 0) {
+		std::cout << "first frame after " << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_StartTime).count() << "ms" << std::endl;
+	}
+	if (!m_FullPipelinesReady && m_ShellPipeline->ready() && m_FinPipeline->ready()) {
+		m_FullPipelinesReady = true;
+		std::cout << "full pipelines ready after " << m_FrameCount << " fallback frames" << std::endl;
+	}
+	m_RenderStats.endFrame();
+
+	//The budget changes with other apps' usage too, so check it every so often rather than only on allocation
+	if (m_FrameCount % 60 == 0) {
+		m_Memory->checkThresholds();
+	}
+	if (m_Settings.memoryLogInterval > 0 && m_FrameCount % m_Settings.memoryLogInterval == 0) {
+		m_Memory->printReport();
+	}
+	m_FrameCount++;
 }
 
 
 
 const void VulkanApp::cleanup() {
 
-	//Clean up memory from swap chain
+	//Memory in use at the end of the run
+	m_Memory->printReport();
+
+	//Clean up memory from swap chain, the pipelines and the swap chain itself (or the offscreen images when headless)
 	cleanupSwapChain();
+	cleanupPipelines();
+	if (m_Settings.headless) {
+		for (size_t i = 0; i < swapChainImages.size(); i++) {
+			vkDestroyImage(device, swapChainImages[i], nullptr);
+			m_Engine->freeMemory(m_OffscreenMemory[i]);
+		}
+	}
+	else {
+		vkDestroySwapchainKHR(device, swapChain, nullptr);
+	}
 
-	
+	//free memory from command buffers
+	vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+
+	//Destroy the pipeline layout
+	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+	if (m_Oit) {
+		m_Oit->destroyLayout();
+		delete m_Oit;
+	}
 
 	//Cleanup Textures
 	vkDestroyImageView(device, furTextureImageView, nullptr);
 	vkDestroyImage(device, furTextureImage, nullptr);
-	vkFreeMemory(device, furTextureImageMemory, nullptr);
+	m_Engine->freeMemory(furTextureImageMemory);
 	vkDestroyImageView(device, finTextureImageView, nullptr);
 	vkDestroyImage(device, finTextureImage, nullptr);
-	vkFreeMemory(device, finTextureImageMemory, nullptr);
+	m_Engine->freeMemory(finTextureImageMemory);
 
-	//Clean up descipter pool memory
+	//Clean up descipter pool memory, this frees the descriptor sets too
 	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
 
+	//Clean up the fin and culling buffers and the instance buffers they fill, the fins read the culling pass's draws
+	if (m_FinGenerator) {
+		m_FinGenerator->destroy();
+		delete m_FinGenerator;
+	}
+	if (m_GpuCuller) {
+		m_GpuCuller->destroy();
+		delete m_GpuCuller;
+	}
+	m_InstanceBuffers->destroy();
+	delete m_InstanceBuffers;
+
 	//Clean up layout memory
 	vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
-	vkDestroyDescriptorSetLayout(device, descriptorSetLayoutGeom, nullptr);
-	//Clean up shader buffers
-	for (size_t i = 0; i < swapChainImages.size(); i++) {
-		for (unsigned int j = 0; j < m_Objects.size(); j++)
-		{
-			for (unsigned int p = 0; p < m_Objects[j]->Passes(); p++)
-			{
-				unsigned int index = m_Objects[j]->Passes() * i + j + p;
-				vkDestroyBuffer(device, uniformBuffers[index], nullptr);
-				vkFreeMemory(device, uniformBuffersMemory[index], nullptr);
-				vkDestroyBuffer(device, geomUniformBuffers[index], nullptr);
-				vkFreeMemory(device, geomUniformBuffersMemory[index], nullptr);
-			}
-		}
+
+	for (auto object : m_Objects) {
+		delete object;
 	}
-	delete m_Objects[0];
+	m_Geometry->destroy();
+	delete m_Geometry;
 
 	//Clean up semaphore/sync objects
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
@@ -330,6 +921,33 @@ const void VulkanApp::cleanup() {
 	//clean up command pools
 	vkDestroyCommandPool(device, commandPool, nullptr);
 
+	m_GpuProfiler->destroy();
+	delete m_GpuProfiler;
+	delete m_Overdraw;
+	if (m_DepthPyramid) {
+		m_DepthPyramid->destroyPipeline();
+		delete m_DepthPyramid;
+	}
+
+	//Clean up the pipeline cache and shader modules
+	m_Pipelines->printTelemetry();
+	m_Pipelines->destroy();
+	delete m_Pipelines;
+	m_Shaders->clear();
+	delete m_Shaders;
+	if (m_Compiler) {
+		m_Compiler->printStats();
+		delete m_Compiler;
+	}
+
+	//Anything still tracked now was never freed
+	if (m_Memory->TotalBytes() > 0) {
+		std::cout << "leaked device memory:" << std::endl;
+		m_Memory->printReport();
+	}
+	m_Engine->setMemoryTracker(nullptr);
+	delete m_Memory;
+
 	//Clean up device
 	vkDestroyDevice(device, nullptr);
 
@@ -340,32 +958,57 @@ const void VulkanApp::cleanup() {
 	}
 
 	//Clean up instance.surface
-	vkDestroySurfaceKHR(instance, surface, nullptr);
+	if (surface != VK_NULL_HANDLE) {
+		vkDestroySurfaceKHR(instance, surface, nullptr);
+	}
 	vkDestroyInstance(instance, nullptr);
+	VulkanLoader::unload();
 
 	//Clean up glfw window
 	delete window;
+
+	printRecreateTimes();
 }
 
 std::vector<const char*> VulkanApp::getRequiredExtensions() {
 
-	//Get extention count
-	uint32_t glfwExtensionCount = 0;
-	const char** glfwExtensions;
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+	std::vector<const char*> extensions;
+
+	//Headless runs don't present, so only need the glfw surface extentions when there is a window
+	if (!m_Settings.headless) {
+		//Get extention count
+		uint32_t glfwExtensionCount = 0;
+		const char** glfwExtensions;
+		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-	//Allocate vector memory
-	std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+		//Allocate vector memory
+		extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	}
 
 	//Add extention names too vector
 	if (enableValidationLayers) {
 		extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 	}
+
+	//Optional, needed to query the memory budget on Vulkan 1.0
+	m_HasProperties2 = instanceExtensionSupported(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+	if (m_HasProperties2) {
+		extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+	}
 	//Return vector
 	return extensions;
 }
 
 
+std::vector<const char*> VulkanApp::getRequiredDeviceExtensions() {
+
+	//No swap chain when headless
+	if (m_Settings.headless) {
+		return {};
+	}
+	return deviceExtensions;
+}
+
 VKAPI_ATTR VkBool32 VKAPI_CALL VulkanApp::debugCallback(
 	VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
 	VkDebugUtilsMessageTypeFlagsEXT messageType,
@@ -399,10 +1042,9 @@ void VulkanApp::setupDebugMessenger() {
 
 VkResult VulkanApp::CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger) {
 	
-
-	auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
-	if (func != nullptr) {
-		return func(instance, pCreateInfo, pAllocator, pDebugMessenger);
+	//Loaded with the instance, null if the debug utils extension isn't enabled
+	if (vkCreateDebugUtilsMessengerEXT != nullptr) {
+		return vkCreateDebugUtilsMessengerEXT(instance, pCreateInfo, pAllocator, pDebugMessenger);
 	}
 	else {
 		return VK_ERROR_EXTENSION_NOT_PRESENT;
@@ -411,14 +1053,14 @@ VkResult VulkanApp::CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDe
 
 void VulkanApp::DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger, const VkAllocationCallbacks* pAllocator) {
 	
-	//Get destroy proxy function for cleaning up the debug messenger
-	auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
-	if (func != nullptr) {
-		func(instance, debugMessenger, pAllocator);
+	//Clean up the debug messenger
+	if (vkDestroyDebugUtilsMessengerEXT != nullptr) {
+		vkDestroyDebugUtilsMessengerEXT(instance, debugMessenger, pAllocator);
 	}
 }
 
 void VulkanApp::pickPhysicalDevice() {
+	PROFILE_SCOPE("pickPhysicalDevice");
 
 	//Get physical device count
 	uint32_t deviceCount = 0;
@@ -458,9 +1100,9 @@ bool VulkanApp::isDeviceSuitable(VkPhysicalDevice device) {
 	//Check tha all extentions needed are supported
 	bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-	//Make sure the swap chain is supported on the device
-	bool swapChainAdequate = false;
-	if (extensionsSupported) {
+	//Make sure the swap chain is supported on the device (headless doesn't need one)
+	bool swapChainAdequate = m_Settings.headless;
+	if (extensionsSupported && !m_Settings.headless) {
 		SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
 		swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
 	}
@@ -483,7 +1125,8 @@ bool VulkanApp::checkDeviceExtensionSupport(VkPhysicalDevice device) {
 	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
 	//Get a vector of all required extentions
-	std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+	std::vector<const char*> deviceExtensionsReq = getRequiredDeviceExtensions();
+	std::set<std::string> requiredExtensions(deviceExtensionsReq.begin(), deviceExtensionsReq.end());
 
 	//Go through and remove extention names in teh vector
 	for (const auto& extension : availableExtensions) {
@@ -494,6 +1137,26 @@ bool VulkanApp::checkDeviceExtensionSupport(VkPhysicalDevice device) {
 	return requiredExtensions.empty();
 }
 
+bool VulkanApp::instanceExtensionSupported(const char* name) {
+
+	uint32_t extensionCount = 0;
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> extensions(extensionCount);
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensions.data());
+
+	return std::any_of(extensions.begin(), extensions.end(), [name](const VkExtensionProperties& extension) { return strcmp(extension.extensionName, name) == 0; });
+}
+
+bool VulkanApp::deviceExtensionSupported(VkPhysicalDevice device, const char* name) {
+
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> extensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, extensions.data());
+
+	return std::any_of(extensions.begin(), extensions.end(), [name](const VkExtensionProperties& extension) { return strcmp(extension.extensionName, name) == 0; });
+}
+
 VulkanApp::QueueFamilyIndices VulkanApp::findQueueFamilies(VkPhysicalDevice device) {
 	QueueFamilyIndices indices;
 
@@ -513,9 +1176,14 @@ VulkanApp::QueueFamilyIndices VulkanApp::findQueueFamilies(VkPhysicalDevice devi
 		if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
 			indices.graphicsFamily = i;
 		}
-		//Check if the support is present
+		//Check if the support is present, without a surface the graphics queue is used for everything
 		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+		if (m_Settings.headless) {
+			presentSupport = queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT;
+		}
+		else {
+			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+		}
 
 		//IF support is found and queue count is greater than 0 update presentFamily
 		if (queueFamily.queueCount > 0 && presentSupport) {
@@ -534,6 +1202,7 @@ VulkanApp::QueueFamilyIndices VulkanApp::findQueueFamilies(VkPhysicalDevice devi
 }
 
 void VulkanApp::createLogicalDevice() {
+	PROFILE_SCOPE("createLogicalDevice");
 
 	//Get queue family data
 	QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
@@ -555,10 +1224,49 @@ void VulkanApp::createLogicalDevice() {
 
 
 
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 
-	deviceFeatures.geometryShader = VK_TRUE;
-	deviceFeatures.wideLines = VK_TRUE;
+	//Only the old fins need a geometry shader, which some drivers emulate or don't have. Use the compute fins without it
+	if (m_Settings.geometryFins && !supportedFeatures.geometryShader) {
+		std::cout << "geometry shaders not supported, building the fins in a compute pass" << std::endl;
+		m_Settings.geometryFins = false;
+	}
+	deviceFeatures.geometryShader = m_Settings.geometryFins ? VK_TRUE : VK_FALSE;
+
+	//The weighted blend adds into one target and multiplies into the other, which needs each attachment to have its own blend
+	if (m_Settings.orderIndependentShells && !supportedFeatures.independentBlend) {
+		std::cout << "independent blending not supported, drawing the shells in order" << std::endl;
+		m_Settings.orderIndependentShells = false;
+	}
+	deviceFeatures.independentBlend = m_Settings.orderIndependentShells ? VK_TRUE : VK_FALSE;
+	deviceFeatures.samplerAnisotropy = VK_TRUE;
+	deviceFeatures.wideLines = supportedFeatures.wideLines; //Only used for debug lines, software rasterisers may not have it
+
+	//Pipeline statistics are optional, carry on without them if the device can't count
+	if (m_Settings.pipelineStatistics && !supportedFeatures.pipelineStatisticsQuery) {
+		std::cout << "pipeline statistics queries not supported, statistics will not be recorded" << std::endl;
+		m_Settings.pipelineStatistics = false;
+	}
+	deviceFeatures.pipelineStatisticsQuery = m_Settings.pipelineStatistics ? VK_TRUE : VK_FALSE;
+
+	//GPU culling picks each draw's object with its first instance
+	if (m_Settings.gpuCulling && !supportedFeatures.drawIndirectFirstInstance) {
+		std::cout << "drawIndirectFirstInstance not supported, culling on the CPU" << std::endl;
+		m_Settings.gpuCulling = false;
+	}
+	deviceFeatures.drawIndirectFirstInstance = m_Settings.gpuCulling ? VK_TRUE : VK_FALSE;
+
+	//With every mesh in the arena a phase's draws can go in one call, otherwise each is its own
+	if (m_Settings.gpuCulling && supportedFeatures.multiDrawIndirect) {
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		m_MaxDrawIndirectCount = std::max(properties.limits.maxDrawIndirectCount, 1u);
+		deviceFeatures.multiDrawIndirect = VK_TRUE;
+	}
+	m_Settings.occlusionCulling = m_Settings.occlusionCulling && m_Settings.gpuCulling;
 
 	//Set up logical device info
 	VkDeviceCreateInfo createInfo = {};
@@ -571,9 +1279,14 @@ void VulkanApp::createLogicalDevice() {
 	//Set Enabled devices features
 	createInfo.pEnabledFeatures = &deviceFeatures;
 
-	//Set extentions
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	//Set extentions, plus the memory budget if we can query it
+	std::vector<const char*> deviceExtensionsReq = getRequiredDeviceExtensions();
+	m_HasMemoryBudget = m_HasProperties2 && deviceExtensionSupported(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	if (m_HasMemoryBudget) {
+		deviceExtensionsReq.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	}
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensionsReq.size());
+	createInfo.ppEnabledExtensionNames = deviceExtensionsReq.data();
 
 
 	//Set up validation layers for logical device if enabled
@@ -589,6 +1302,8 @@ void VulkanApp::createLogicalDevice() {
 	if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create logical device!");
 	}
+	//Device functions straight from the driver from here on, skipping the loader's dispatch
+	VulkanLoader::loadDevice(device);
 
 	vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
 	vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
@@ -685,6 +1400,7 @@ VkExtent2D VulkanApp::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilit
 }
 
 void VulkanApp::createSwapChain() {
+	PROFILE_SCOPE("createSwapChain");
 
 	//Check for swap chain support data
 	SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
@@ -733,8 +1449,9 @@ void VulkanApp::createSwapChain() {
 	createInfo.presentMode = presentMode; //Pass in resent mode
 	createInfo.clipped = VK_TRUE; //Clip pixels that are obscured
 
-	//For now only ever create one swap chain
-	createInfo.oldSwapchain = VK_NULL_HANDLE;
+	//Hand over the previous swap chain (if any) so the driver can reuse its resources when resizing
+	VkSwapchainKHR oldSwapChain = swapChain;
+	createInfo.oldSwapchain = oldSwapChain;
 
 
 	//Create swap chain and error check
@@ -742,6 +1459,11 @@ void VulkanApp::createSwapChain() {
 		throw std::runtime_error("failed to create swap chain!");
 	}
 
+	//The old swap chain is retired now, we can destroy it
+	if (oldSwapChain != VK_NULL_HANDLE) {
+		vkDestroySwapchainKHR(device, oldSwapChain, nullptr);
+	}
+
 	//Set up memory for the swap chain images and store the inital data
 	vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
 	swapChainImages.resize(imageCount);
@@ -751,6 +1473,23 @@ void VulkanApp::createSwapChain() {
 	swapChainExtent = extent;
 }
 
+void VulkanApp::createOffscreenImages() {
+	PROFILE_SCOPE("createOffscreenImages");
+
+	//Stand in for the swap chain when headless, render to our own images at the requested resolution
+	swapChainImageFormat = VK_FORMAT_B8G8R8A8_UNORM;
+	swapChainExtent = { m_Settings.width, m_Settings.height };
+
+	//One image per frame in flight, so the CPU can record a frame while the last one renders
+	swapChainImages.resize(MAX_FRAMES_IN_FLIGHT);
+	m_OffscreenMemory.resize(MAX_FRAMES_IN_FLIGHT);
+
+	for (size_t i = 0; i < swapChainImages.size(); i++) {
+		m_Engine->createImage(swapChainExtent.width, swapChainExtent.height, swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, swapChainImages[i], m_OffscreenMemory[i], MemoryCategory::RenderTarget, "offscreen image");
+	}
+}
+
 void VulkanApp::createImageViews() {
 	
 	//Allocate enough memory for each image
@@ -763,267 +1502,129 @@ void VulkanApp::createImageViews() {
 
 }
 
-void VulkanApp::createGraphicsPipeline(VkBool32 depthOn) {
-
-	//Read in shader files
-	//Base mesh and Shell rendering
-	auto vertShaderCode = readFile("shaders/vertS.spv");
-	auto fragShaderCode = readFile("shaders/fragS.spv");
-
-	//Fins rendering
-	auto gVertShaderCode = readFile("shaders/vert.spv");
-	auto geomShaderCode = readFile("shaders/geom.spv");
-	auto gFragShaderCode = readFile("shaders/frag.spv");
-
-
-	//Set up shader modules for both vertex and fragment shaders
-	VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-	VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
-	VkShaderModule geomShaderModule = createShaderModule(geomShaderCode);
-
-	//Set up vertex info
-	VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
-	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT; //Vertex stage
-	vertShaderStageInfo.module = vertShaderModule; //Vertex shader
-	vertShaderStageInfo.pName = "main"; //Main function as entry point
-
-	//Set up Geometry state info
-	VkPipelineShaderStageCreateInfo geomShaderStageInfo = {};
-	geomShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	geomShaderStageInfo.stage = VK_SHADER_STAGE_GEOMETRY_BIT; //Geometry stage
-	geomShaderStageInfo.module = geomShaderModule; //Geometry shader
-	geomShaderStageInfo.pName = "main"; //Main function as entry point
-
-	//Set up fragment info
-	VkPipelineShaderStageCreateInfo fragShaderStageInfo = {};
-	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT; //Fragment stage
-	fragShaderStageInfo.module = fragShaderModule; //Fragment shader
-	fragShaderStageInfo.pName = "main"; //Main function as entry point
-
-	//List shader stage info in order
-	//VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, geomShaderStageInfo, fragShaderStageInfo };
-	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
-
-	//Set up vertex input pipline info
-	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
-	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-
-	//Get descriptions
-	auto bindingDescription = Vertex::getBindingDescription();
-	auto attributeDescriptions = Vertex::getAttributeDescriptions();
-
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
-	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-	vertexInputInfo.pVertexBindingDescriptions = &bindingDescription; //Give binding desc
-	vertexInputInfo.pVertexAttributeDescriptions = &attributeDescriptions[0]; //Give attribute data
-
-	//Assembly state info (rendering type)
-	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
-	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST; //Rendering using triangle lists
-	inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-	//Set up viewport
-	viewport = {};
-	viewport.x = 0.0f; //No offset
-	viewport.y = 0.0f;//No offset
-	//Resolution
-	viewport.width = (float)swapChainExtent.width; 
-	viewport.height = (float)swapChainExtent.height;
-	//Depth buffer range
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	//No scissor ( dont want to cut any of the image out)
-	VkRect2D scissor = {};
-	scissor.offset = { 0, 0 };
-	scissor.extent = swapChainExtent;
-
-	//Viewport info
-	VkPipelineViewportStateCreateInfo viewportState = {};
-	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
-	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
-
-	//Rasterizer info
-	VkPipelineRasterizationStateCreateInfo rasterizer = {};
-	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizer.depthClampEnable = VK_FALSE; //Dont clamp depth
-	rasterizer.rasterizerDiscardEnable = VK_FALSE; //Dont discard (wont draw to framebuffer otherwise)
-	rasterizer.polygonMode = VK_POLYGON_MODE_FILL; //We want to draw full polygons not lines or points
-	rasterizer.lineWidth = 1.0f; 
-	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT; //Cull back faces
-	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE; //Set clockwise 
-	rasterizer.depthBiasEnable = VK_FALSE;
-
-	//Default multisamplign settings (disabled for now)
-	VkPipelineMultisampleStateCreateInfo multisampling = {};
-	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampling.sampleShadingEnable = VK_FALSE;
-	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-	VkPipelineDepthStencilStateCreateInfo depthStencil = {};
-	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencil.depthTestEnable = VK_TRUE;
-	depthStencil.depthWriteEnable = depthOn;
-	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-	depthStencil.depthBoundsTestEnable = VK_FALSE;
-	depthStencil.stencilTestEnable = VK_FALSE;
-	depthStencil.minDepthBounds = 0.0f; // Optional
-	depthStencil.maxDepthBounds = 1.0f; // Optional
-
-	//Set up colour blending settings (Default blending settings)
-	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colorBlendAttachment.blendEnable = VK_TRUE;
-	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-	colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-
-	VkPipelineColorBlendStateCreateInfo colorBlending = {};
-	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlending.logicOpEnable = VK_FALSE;
-	colorBlending.logicOp = VK_LOGIC_OP_COPY;
-	colorBlending.attachmentCount = 1;
-	colorBlending.pAttachments = &colorBlendAttachment;
-	colorBlending.blendConstants[0] = 0.0f;
-	colorBlending.blendConstants[1] = 0.0f;
-	colorBlending.blendConstants[2] = 0.0f;
-	colorBlending.blendConstants[3] = 0.0f;
-
-	//Layout info (mainly default)
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = 1;
-	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+void VulkanApp::createGraphicsPipelines() {
+	PROFILE_SCOPE("createGraphicsPipelines");
 
-	std::vector<VkDynamicState> dynamicStateEnables = {
-			VK_DYNAMIC_STATE_VIEWPORT,
-			VK_DYNAMIC_STATE_SCISSOR,
-			VK_DYNAMIC_STATE_LINE_WIDTH
-	};
-	VkPipelineDynamicStateCreateInfo dynamicState{};
-	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	dynamicState.pDynamicStates = dynamicStateEnables.data();
-	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStateEnables.size());
-	dynamicState.flags = 0;
+	//The base mesh pipeline is built now so we can draw straight away, any state that was already built is reused
+	graphicsPipeline = m_Pipelines->get(shellPipelineDesc(VK_TRUE), "base");
 
-	//Create layout and error check
-	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create pipeline layout!");
-	}
-	VkPipelineLayoutCreateInfo pipelineLayoutInfoGeom = {};
-	pipelineLayoutInfoGeom.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfoGeom.setLayoutCount = 1;
-	pipelineLayoutInfoGeom.pSetLayouts = &descriptorSetLayoutGeom;
-	if (vkCreatePipelineLayout(device, &pipelineLayoutInfoGeom, nullptr, &pipelineLayoutGeom) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create pipeline layout geom!");
-	}
-
-	//Set up graphics pipline info
-	VkGraphicsPipelineCreateInfo pipelineInfo = {};
-	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineInfo.stageCount = 2; //3 shader stages
-	//Pass in all data set up before this
-	pipelineInfo.pStages = shaderStages;
-	pipelineInfo.pVertexInputState = &vertexInputInfo;
-	pipelineInfo.pInputAssemblyState = &inputAssembly;
-	pipelineInfo.pViewportState = &viewportState;
-	pipelineInfo.pRasterizationState = &rasterizer;
-	pipelineInfo.pMultisampleState = &multisampling;
-	pipelineInfo.pColorBlendState = &colorBlending;
-	pipelineInfo.layout = pipelineLayout;
-	pipelineInfo.renderPass = renderPass;
-	pipelineInfo.subpass = 0;
-	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; //Only going to be using one pipline for now, dont need to refrence the base
-	pipelineInfo.pDepthStencilState = &depthStencil;
-	pipelineInfo.pDynamicState = &dynamicState;
-
-
-	if (depthOn == VK_TRUE)
-	{
-		//Create pipeline and error check
-		if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create graphics pipeline!");
-		}
-		vkDestroyShaderModule(device, fragShaderModule, nullptr);
-		vkDestroyShaderModule(device, vertShaderModule, nullptr);
-		pipelineInfo.stageCount = 3;
-		//Set up shader modules for both vertex and fragment shaders
-		vertShaderModule = createShaderModule(gVertShaderCode);
-		fragShaderModule = createShaderModule(gFragShaderCode);
-
-		//Set up vertex info
-		vertShaderStageInfo = {};
-		vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT; //Vertex stage
-		vertShaderStageInfo.module = vertShaderModule; //Vertex shader
-		vertShaderStageInfo.pName = "main"; //Main function as entry point
-
-		//Set up fragment info
-		fragShaderStageInfo = {};
-		fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT; //Fragment stage
-		fragShaderStageInfo.module = fragShaderModule; //Fragment shader
-		fragShaderStageInfo.pName = "main"; //Main function as entry point
-
-		VkPipelineShaderStageCreateInfo shaderStagesGeom[] = { vertShaderStageInfo, geomShaderStageInfo, fragShaderStageInfo };
-		pipelineInfo.pStages = shaderStagesGeom;
-		pipelineInfo.layout = pipelineLayoutGeom;
-
-		//Don't want to cull any faces for this
-		rasterizer.cullMode = VK_CULL_MODE_NONE;
-		//Need to render this behind the rest so give an accurate effect
-		depthStencil.depthTestEnable = VK_FALSE;
-
-
-		if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipelineGeom) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create graphics pipeline!");
-		}
+	//The shells and the fins are compiled on the worker threads, frames are drawn without them until they are ready
+	m_ShellPipeline = m_Pipelines->getAsync(m_Oit ? oitShellPipelineDesc() : shellPipelineDesc(VK_FALSE), "shells");
+	m_FinPipeline = m_Pipelines->getAsync(finPipelineDesc(VK_FALSE), "fins");
+	if (m_DepthPyramid) {
+		m_LateFinPipeline = m_Pipelines->getAsync(finPipelineDesc(VK_TRUE), "late fins");
 	}
-	else
-	{
-		//Create pipeline and error check
-		if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipelineNoDepth) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create graphics pipeline!");
-		}
+
+	//Overdraw counting versions of each phase, same geometry and depth state but every fragment adds one to the count target.
+	//These are only used for the occasional measured frame so they are built now rather than falling back
+	if (m_Overdraw) {
+		auto overdrawDesc = [this](PipelineDesc desc) {
+			desc.fragShader = shaderPath(OVERDRAW_FRAG_SHADER);
+			desc.renderPass = m_Overdraw->RenderPass();
+			desc.blend = VK_TRUE;
+			desc.additive = VK_TRUE;
+			return desc;
+		};
+		m_OverdrawFinPipeline = m_Pipelines->get(overdrawDesc(finPipelineDesc(VK_FALSE)), "overdraw fins");
+		m_OverdrawBasePipeline = m_Pipelines->get(overdrawDesc(shellPipelineDesc(VK_TRUE)), "overdraw base");
+		m_OverdrawShellPipeline = m_Pipelines->get(overdrawDesc(shellPipelineDesc(VK_FALSE)), "overdraw shells");
+	}
+
+	//The composite is a single full screen triangle, built now as the frame can't be finished without it
+	if (m_Oit) {
+		PipelineDesc desc;
+		desc.vertShader = shaderPath(FULLSCREEN_VERT_SHADER);
+		desc.fragShader = shaderPath(OIT_COMPOSITE_FRAG_SHADER);
+		desc.vertexInput = false;
+		desc.layout = m_Oit->PipelineLayout();
+		desc.renderPass = m_Oit->RenderPass();
+		desc.subpass = OitCompositor::COMPOSITE_SUBPASS;
+		desc.depthTest = VK_FALSE;
+		desc.depthWrite = VK_FALSE;
+		desc.cullMode = VK_CULL_MODE_NONE;
+		m_OitCompositePipeline = m_Pipelines->get(desc, "oit composite");
 	}
+}
 
+PipelineDesc VulkanApp::shellPipelineDesc(VkBool32 depthWrite) {
+
+	//Base mesh and Shell rendering, the base writes depth and the shells blend on top without writing it
+	PipelineDesc desc;
+	desc.vertShader = shaderPath(SHELL_VERT_SHADER);
+	desc.layout = pipelineLayout;
+	desc.fragShader = shaderPath(SHELL_FRAG_SHADER);
+	desc.renderPass = renderPass;
+	desc.depthTest = VK_TRUE;
+	desc.depthWrite = depthWrite;
+	desc.cullMode = VK_CULL_MODE_BACK_BIT; //Cull back faces
+	desc.constants = m_FurConstants;
+	return desc;
+}
 
+PipelineDesc VulkanApp::oitShellPipelineDesc() {
 
-	
+	//Shells into the accumulation and revealage targets, tested against the base meshes' depth in the transparency pass
+	PipelineDesc desc = shellPipelineDesc(VK_FALSE);
+	desc.fragShader = shaderPath(SHELL_OIT_FRAG_SHADER);
+	desc.renderPass = m_Oit->RenderPass();
+	desc.subpass = OitCompositor::SHELL_SUBPASS;
+	desc.weightedBlend = VK_TRUE;
+	return desc;
+}
 
+PipelineDesc VulkanApp::finPipelineDesc(VkBool32 depthTest) {
 
+	//Fins rendering, depth tested only when drawn after other objects' base meshes. Either the geometry shader builds a fin on every
+	//triangle, or the compute pass has built the silhouette's and the vertex shader reads them
+	PipelineDesc desc;
+	if (m_Settings.geometryFins) {
+		desc.vertShader = shaderPath(BASE_VERT_SHADER);
+		desc.geomShader = shaderPath(FIN_GEOM_SHADER);
+	}
+	else {
+		desc.vertShader = shaderPath(FIN_VERT_SHADER);
+		desc.vertexInput = false;
+	}
+	desc.layout = pipelineLayout;
+	desc.fragShader = shaderPath(FIN_FRAG_SHADER);
+	desc.renderPass = renderPass;
+	desc.depthTest = depthTest; //Need to render this behind the rest so give an accurate effect
+	desc.depthWrite = VK_FALSE;
+	desc.cullMode = VK_CULL_MODE_NONE; //Don't want to cull any faces for this
+	desc.constants = m_FurConstants;
+	return desc;
+}
 
-	//Destroy shader modules now we have finished with them
-	vkDestroyShaderModule(device, fragShaderModule, nullptr);
-	vkDestroyShaderModule(device, vertShaderModule, nullptr);
-	vkDestroyShaderModule(device, geomShaderModule, nullptr);
-	
+std::string VulkanApp::shaderPath(const ShaderSource& source) {
+
+	//Use the pre-built SPIR-V if runtime compilation is turned off, as long as it was built from the current source
+	if (!m_Compiler) return ShaderCompiler::Prebuilt(source);
+	return m_Compiler->get(source);
 }
 
-VkShaderModule VulkanApp::createShaderModule(const std::vector<char>& code) {
+void VulkanApp::createPipelineLayouts()
+{
+	//Which of each instance's passes a draw covers is pushed to the vertex stage, see shader.vert
+	VkPushConstantRange pushConstant = {};
+	pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	pushConstant.size = sizeof(uint32_t) * 2;
 
-	//Set up up shader module info
-	VkShaderModuleCreateInfo createInfo = {};
-	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = code.size(); //Pass in shader size
-	createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data()); //Pass in shader code
+	//Layout info (mainly default), the layout only depends on the descriptor set layout so it lives for the whole app
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
 
-	//Create shader module and error check
-	VkShaderModule shaderModule;
-	if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create shader module!");
+	//Create layout and error check
+	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline layout!");
 	}
 
-	return shaderModule;
+	if (m_Oit) {
+		m_Oit->createLayout();
+	}
 }
 
 void VulkanApp::createRenderPass() {
@@ -1039,6 +1640,11 @@ void VulkanApp::createRenderPass() {
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;  //Ignore previos layout
 	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; //Use image in the swap buffer
 
+	//When headless the image is copied out instead of presented
+	if (m_Settings.headless) {
+		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	}
+
 	VkAttachmentDescription depthAttachment = {};
 	depthAttachment.format = findDepthFormat();
 	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
@@ -1083,6 +1689,73 @@ void VulkanApp::createRenderPass() {
 	dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
 	dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
+	//Make the colour writes visible to the readback copy
+	if (m_Settings.headless) {
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		dependencies[1].dependencyFlags = 0;
+	}
+
+	//With OIT the transparency pass finishes the frame, so the colour is handed over to it rather than presented
+	//and the depth is kept for the shells to test against
+	VkImageLayout presentLayout = colorAttachment.finalLayout;
+	if (m_Oit) {
+		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	}
+
+	//Occlusion culling splits the frame in two. The late pass carries on drawing into the targets after the depth pyramid is built,
+	//so the early pass keeps them and hands the depth over for the pyramid to read
+	if (m_DepthPyramid) {
+		VkAttachmentDescription lateColorAttachment = colorAttachment;
+		lateColorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		lateColorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentDescription lateDepthAttachment = depthAttachment;
+		lateDepthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		lateDepthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+		//Wait for the pyramid to finish reading the depth before writing it again
+		std::array<VkSubpassDependency, 2> lateDependencies = dependencies;
+		lateDependencies[0].srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		lateDependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		lateDependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		lateDependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+			VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		lateDependencies[0].dependencyFlags = 0;
+
+		std::array<VkAttachmentDescription, 2> lateAttachments = { lateColorAttachment, lateDepthAttachment };
+		VkRenderPassCreateInfo lateRenderPassInfo = {};
+		lateRenderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		lateRenderPassInfo.attachmentCount = static_cast<uint32_t>(lateAttachments.size());
+		lateRenderPassInfo.pAttachments = lateAttachments.data();
+		lateRenderPassInfo.subpassCount = 1;
+		lateRenderPassInfo.pSubpasses = &subpass;
+		lateRenderPassInfo.dependencyCount = static_cast<uint32_t>(lateDependencies.size());
+		lateRenderPassInfo.pDependencies = lateDependencies.data();
+
+		if (vkCreateRenderPass(device, &lateRenderPassInfo, nullptr, &m_LateRenderPass) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create late render pass!");
+		}
+
+		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+		//The last frame's pyramid reads the depth before this clears it
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dependencyFlags = 0;
+
+		//Depth writes have to land before the pyramid reads them, and colour before the late pass draws on top
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dependencyFlags = 0;
+	}
 
 	std::array<VkSubpassDescription, 1> subpasses = { subpass };
 	std::array<VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
@@ -1100,6 +1773,14 @@ void VulkanApp::createRenderPass() {
 	if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create render pass!");
 	}
+
+	//The overdraw pass shares the depth buffer so it is created alongside the main one
+	if (m_Overdraw) {
+		m_Overdraw->createRenderPass(findDepthFormat());
+	}
+	if (m_Oit) {
+		m_Oit->createRenderPass(swapChainImageFormat, findDepthFormat(), presentLayout);
+	}
 }
 
 void VulkanApp::createFramebuffers() {
@@ -1128,6 +1809,13 @@ void VulkanApp::createFramebuffers() {
 			throw std::runtime_error("failed to create framebuffer!");
 		}
 	}
+
+	if (m_Overdraw) {
+		m_Overdraw->createTarget(swapChainExtent, depthImageView);
+	}
+	if (m_Oit) {
+		m_Oit->createTargets(swapChainExtent, depthImageView, swapChainImageViews);
+	}
 }
 
 void VulkanApp::createCommandPool() {
@@ -1138,6 +1826,7 @@ void VulkanApp::createCommandPool() {
 	VkCommandPoolCreateInfo poolInfo = {};
 	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value(); //Pass in the graphics family value
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT; //Let us re-record the command buffers on resize without reallocating
 
 	//Create command pool and error check
 	if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
@@ -1147,8 +1836,8 @@ void VulkanApp::createCommandPool() {
 
 void VulkanApp::createCommandBuffers() {
 	
-	//Allocate memory
-	commandBuffers.resize(swapChainFramebuffers.size());
+	//Allocate memory, one command buffer per frame in flight as they are re-recorded every frame
+	commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
 
 	//Set up command buffer info
 	VkCommandBufferAllocateInfo allocInfo = {};
@@ -1161,109 +1850,262 @@ void VulkanApp::createCommandBuffers() {
 	if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
 		throw std::runtime_error("failed to allocate command buffers!");
 	}
+}
 
-	//For each command buffer set up info and bind the required data
-	for (size_t i = 0; i < commandBuffers.size(); i++) {
-		VkCommandBufferBeginInfo beginInfo = {};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+void VulkanApp::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+	PROFILE_SCOPE("recordCommandBuffer");
 
-		if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) != VK_SUCCESS) {
-			throw std::runtime_error("failed to begin recording command buffer!");
-		}
+	//Pick up any pipelines the workers have finished since the last frame, draw without them until then
+	VkPipeline shellPipeline = m_ShellPipeline->get();
+	VkPipeline finPipeline = m_FinPipeline->get();
+	VkPipeline lateFinPipeline = m_LateFinPipeline ? m_LateFinPipeline->get() : VK_NULL_HANDLE;
 
+	//Viewport and scissor are dynamic state, so only the command buffers need to know about the current resolution
+	VkViewport viewport = {};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)swapChainExtent.width;
+	viewport.height = (float)swapChainExtent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+
+	//Set up info and bind the required data (beginning a buffer from a resettable pool resets it)
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-		std::array<VkClearValue, 2> clearValues = {};
-		clearValues[0].color = { 0.2f, 0.2f, 0.2f, 1.0f };//Set clear colour
-		clearValues[1].depthStencil = { 1.0f, 0 };  
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+		throw std::runtime_error("failed to begin recording command buffer!");
+	}
+
+	//Time the frame on the GPU and count the work we submit
+	m_GpuProfiler->beginFrame(commandBuffer, static_cast<uint32_t>(currentFrame), m_FrameCount);
+	m_RenderStats.commandBufferRecorded();
 
-		VkRenderPassBeginInfo renderPassInfo = {};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = renderPass; //Pass renderpass
-		renderPassInfo.framebuffer = swapChainFramebuffers[i]; //Pass frame buffer
-		renderPassInfo.renderArea.offset = { 0, 0 }; //No offset
-		renderPassInfo.renderArea.extent = swapChainExtent; //Set resolution
-		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size()); //Clear value to 1
-		renderPassInfo.pClearValues = clearValues.data(); //Pass in clear colour
+	//Cull and write this frame's draws before the render pass reads them
+	if (m_GpuCuller) {
+		GpuProfiler::Scope zone(*m_GpuProfiler, commandBuffer, static_cast<uint32_t>(currentFrame), "cull");
+		m_GpuCuller->record(commandBuffer, static_cast<uint32_t>(currentFrame));
+	}
+	if (m_FinGenerator) {
+		GpuProfiler::Scope zone(*m_GpuProfiler, commandBuffer, static_cast<uint32_t>(currentFrame), "fin edges");
+		m_FinGenerator->record(commandBuffer, static_cast<uint32_t>(currentFrame));
+	}
 
+	//Every pass draws from the arena, the binds last the whole command buffer
+	m_Geometry->bind(commandBuffer);
+	m_RenderStats.vertexBufferBind();
+	m_RenderStats.indexBufferBind();
 
 
+	std::array<VkClearValue, 2> clearValues = {};
+	clearValues[0].color = { 0.2f, 0.2f, 0.2f, 1.0f };//Set clear colour
+	clearValues[1].depthStencil = { 1.0f, 0 };  
 
-		//Begin render pass so we can bind
-		vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = renderPass; //Pass renderpass
+	renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex]; //Pass frame buffer
+	renderPassInfo.renderArea.offset = { 0, 0 }; //No offset
+	renderPassInfo.renderArea.extent = swapChainExtent; //Set resolution
+	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size()); //Clear value to 1
+	renderPassInfo.pClearValues = clearValues.data(); //Pass in clear colour
 
+	//Begin render pass so we can bind
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-		
+	//Set up dynamic viewport, every pipeline uses the same dynamic state so it only needs setting once
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-		//Set up and bind in vertex infomation
-		std::vector<VkBuffer> vertexBuffers;
-		for (unsigned int v = 0; v < m_Objects.size(); v++)
+	VkRect2D scissor{};
+	scissor.extent.width = swapChainExtent.width;
+	scissor.extent.height = swapChainExtent.height;
+	scissor.offset.x = 0;
+	scissor.offset.y = 0;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	//Set line width (used for debugging vertex normals int he geometry stage)
+	vkCmdSetLineWidth(commandBuffer, 1.0f);
+
+	//Draw in phases so each one can be timed on its own. With OIT the shells are left for the transparency pass
+	VkPipeline sceneShellPipeline = m_Oit ? VK_NULL_HANDLE : shellPipeline;
+	drawScene(commandBuffer, finPipeline, graphicsPipeline, sceneShellPipeline, true, CullPass::Early);
+
+	//End pass
+	vkCmdEndRenderPass(commandBuffer);
+
+	//Build the pyramid from the base meshes drawn so far, then draw the objects it shows have come into view.
+	//The late pass's phases add to the early pass's zones
+	if (m_DepthPyramid) {
 		{
-			for (unsigned int p = 0; p < m_Objects[v]->Passes(); p++)
-			{
-				vertexBuffers.push_back(m_Objects[v]->GetVertexBuffer());
-			}
+			GpuProfiler::Scope zone(*m_GpuProfiler, commandBuffer, static_cast<uint32_t>(currentFrame), "depth pyramid");
+			m_DepthPyramid->record(commandBuffer, projectionMatrix() * viewMatrix());
+		}
+		{
+			GpuProfiler::Scope zone(*m_GpuProfiler, commandBuffer, static_cast<uint32_t>(currentFrame), "cull");
+			m_GpuCuller->record(commandBuffer, static_cast<uint32_t>(currentFrame), CullPass::Late);
+		}
+		if (m_FinGenerator) {
+			GpuProfiler::Scope zone(*m_GpuProfiler, commandBuffer, static_cast<uint32_t>(currentFrame), "fin edges");
+			m_FinGenerator->record(commandBuffer, static_cast<uint32_t>(currentFrame), CullPass::Late);
 		}
 
-		//VkBuffer vertexBuffers[] = { m_Objects[j]->GetVertexBuffer() };
-		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, vertexBuffers.data(), offsets);
+		renderPassInfo.renderPass = m_LateRenderPass;
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		drawScene(commandBuffer, lateFinPipeline, graphicsPipeline, sceneShellPipeline, true, CullPass::Late);
+		vkCmdEndRenderPass(commandBuffer);
+	}
 
-		for (unsigned int j = 0; j < m_Objects.size(); j++)
+	//Every pass's shells go into the transparency targets together, in any order, then are composited over the frame
+	if (m_Oit) {
+		m_Oit->begin(commandBuffer, imageIndex);
+		if (shellPipeline != VK_NULL_HANDLE) {
+			drawShells(commandBuffer, shellPipeline, true, CullPass::Early);
+			if (m_DepthPyramid) {
+				drawShells(commandBuffer, shellPipeline, true, CullPass::Late);
+			}
+		}
+		m_Oit->beginComposite(commandBuffer);
 		{
-			for (unsigned int pass = 0; pass < m_Objects[j]->Passes(); pass++)
-			{
-				unsigned int index = m_Objects[j]->Passes() * i + j + pass;
-				std::cout << index << std::endl;
-
-				//Set up dynamic viewport
-				vkCmdSetViewport(commandBuffers[i], 0, 1, &viewport);
-
-				VkRect2D scissor{};
-				scissor.extent.width = swapChainExtent.width;
-				scissor.extent.height = swapChainExtent.height;
-				scissor.offset.x = 0;
-				scissor.offset.y = 0;
-				vkCmdSetScissor(commandBuffers[i], 0, 1, &scissor);
-
-				//Set line width (used for debugging vertex normals int he geometry stage)
-				vkCmdSetLineWidth(commandBuffers[i], 1.0f);
-
-				
-
-				//Bind index buffer
-				vkCmdBindIndexBuffer(commandBuffers[i], m_Objects[j]->GetIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
-
-				//On the first pass, draw the fins first
-				if (pass == 0)
-				{
-					vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineGeom);
-					vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayoutGeom, 0, 1, &descriptorSetsGeom[index], 0, nullptr);
-					vkCmdDrawIndexed(commandBuffers[i], static_cast<uint32_t>(m_Objects[j]->GetIndices().size()), 1, 0, 0, 0);
-				}
+			GpuProfiler::Scope zone(*m_GpuProfiler, commandBuffer, static_cast<uint32_t>(currentFrame), "oit composite");
+			m_Oit->composite(commandBuffer, m_OitCompositePipeline);
+			m_RenderStats.pipelineBind();
+			m_RenderStats.descriptorSetBind();
+			m_RenderStats.draw(3, 1);
+		}
+		m_Oit->end(commandBuffer);
+	}
+
+	//Redraw the same phases into the count target, timed as one zone so the phase times above stay clean
+	if (overdrawFrame()) {
+		FrameStats stats = m_RenderStats.Current();
 
-				//Bind the graphics pipeline
-				if (pass == 0)
-					vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-				else
-					vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineNoDepth);
+		GpuProfiler::Scope zone(*m_GpuProfiler, commandBuffer, static_cast<uint32_t>(currentFrame), "overdraw");
+		m_Overdraw->begin(commandBuffer);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+		vkCmdSetLineWidth(commandBuffer, 1.0f);
+		drawScene(commandBuffer, finPipeline != VK_NULL_HANDLE ? m_OverdrawFinPipeline : VK_NULL_HANDLE, m_OverdrawBasePipeline, shellPipeline != VK_NULL_HANDLE ? m_OverdrawShellPipeline : VK_NULL_HANDLE, false, CullPass::Early);
+		if (m_DepthPyramid) {
+			drawScene(commandBuffer, finPipeline != VK_NULL_HANDLE ? m_OverdrawFinPipeline : VK_NULL_HANDLE, m_OverdrawBasePipeline, shellPipeline != VK_NULL_HANDLE ? m_OverdrawShellPipeline : VK_NULL_HANDLE, false, CullPass::Late);
+		}
+		m_Overdraw->end(commandBuffer);
+
+		//Only count the work of the real frame
+		m_RenderStats.Current() = stats;
+	}
+
+	m_GpuProfiler->endFrame(commandBuffer, static_cast<uint32_t>(currentFrame));
+	
+	//Check the command has ended and error check
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to record command buffer!");
+	}
+}
 
-				////Set the descipter to graphics
-				vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[index], 0, nullptr);
+void VulkanApp::drawScene(VkCommandBuffer commandBuffer, VkPipeline finPipeline, VkPipeline basePipeline, VkPipeline shellPipeline, bool profilePhases, CullPass pass) {
 
-				////Call the draw command
-				vkCmdDrawIndexed(commandBuffers[i], static_cast<uint32_t>(m_Objects[j]->GetIndices().size()), 1, 0, 0, 0);
+	//Draw in phases, one pipeline bind per phase. Each phase is its own GPU zone unless the caller is timing the whole scene
+	uint32_t slot = static_cast<uint32_t>(currentFrame);
+	auto beginPhase = [&](const char* name) { return profilePhases ? m_GpuProfiler->beginZone(commandBuffer, slot, name) : UINT32_MAX; };
+	uint32_t objectCount = static_cast<uint32_t>(m_Objects.size());
 
-				
-			}
+	//Which of each instance's passes a phase's draws cover, see the Layers push constants in shader.vert
+	auto bindPhase = [&](DrawPhase phase, uint32_t object, const std::array<uint32_t, 2>& layers) {
+		VkDescriptorSet descriptorSet = descriptorSets[descriptorSetIndex(slot, phase, object)];
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(layers), layers.data());
+		m_RenderStats.descriptorSetBind();
+	};
+
+	//Fins first, they don't depth test so they end up behind everything drawn after them (skipped until the fin pipeline is ready)
+	if (finPipeline != VK_NULL_HANDLE)
+	{
+		uint32_t zone = beginPhase("fins");
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, finPipeline);
+		m_RenderStats.pipelineBind();
+		//Every object's fins share the fin texture, so one set covers them. Instances without shells get no fins, see fins.comp and base.vert
+		bindPhase(DrawPhase::Fins, 0, { 1, 0 });
+		if (m_FinGenerator) {
+			m_FinGenerator->draw(commandBuffer, slot, pass);
+			m_RenderStats.indirectDraw();
+		}
+		else {
+			drawInstances(commandBuffer, DrawPhase::Fins, pass, 0, objectCount);
 		}
-		//End pass
-		vkCmdEndRenderPass(commandBuffers[i]);
-		
-		//Check the command has ended and error check
-		if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
-			throw std::runtime_error("failed to record command buffer!");
+		m_GpuProfiler->endZone(commandBuffer, slot, zone);
+	}
+
+	//Base mesh, writes depth for the shells to test against. Each object has its own texture
+	{
+		uint32_t zone = beginPhase("base");
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, basePipeline);
+		m_RenderStats.pipelineBind();
+		for (uint32_t j = 0; j < objectCount; j++)
+		{
+			bindPhase(DrawPhase::Base, j, { 1, 0 });
+			drawInstances(commandBuffer, DrawPhase::Base, pass, j, 1);
 		}
+		m_GpuProfiler->endZone(commandBuffer, slot, zone);
+	}
+
+	//Blended shells (fallback until the shell pipeline is ready, just draw the base mesh)
+	if (shellPipeline != VK_NULL_HANDLE)
+	{
+		drawShells(commandBuffer, shellPipeline, profilePhases, pass);
+	}
+}
+
+void VulkanApp::drawShells(VkCommandBuffer commandBuffer, VkPipeline shellPipeline, bool profilePhases, CullPass pass) {
+
+	//Every shell of an instance in one draw, drawn in order so they go inner to outer. With OIT the order doesn't matter
+	uint32_t slot = static_cast<uint32_t>(currentFrame);
+	uint32_t zone = profilePhases ? m_GpuProfiler->beginZone(commandBuffer, slot, "shells") : UINT32_MAX;
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shellPipeline);
+	m_RenderStats.pipelineBind();
+
+	std::array<uint32_t, 2> layers = { shellsPerInstance(), 1 };
+	VkDescriptorSet descriptorSet = descriptorSets[descriptorSetIndex(slot, DrawPhase::Shells, 0)];
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(layers), layers.data());
+	m_RenderStats.descriptorSetBind();
+
+	drawInstances(commandBuffer, DrawPhase::Shells, pass, 0, static_cast<uint32_t>(m_Objects.size()));
+	m_GpuProfiler->endZone(commandBuffer, slot, zone);
+}
+
+bool VulkanApp::overdrawFrame() const {
+
+	//The overdraw pass is only recorded on the frames that get read back
+	return m_Overdraw && m_FrameCount % m_Settings.overdrawInterval == 0;
+}
+
+void VulkanApp::drawInstances(VkCommandBuffer commandBuffer, DrawPhase phase, CullPass pass, uint32_t firstObject, uint32_t objectCount) {
+
+	//Instances of the draw per visible instance, the vertex shader picks the shell from the rest
+	uint32_t perInstance = phase == DrawPhase::Shells ? shellsPerInstance() : 1;
+	if (perInstance == 0) return;
+
+	//The culling pass wrote the draws. An object's draws sit next to each other and all read the arena, so they go in as few
+	//calls as the device allows. Objects with nothing visible have no instances
+	if (m_GpuCuller) {
+		uint32_t slot = static_cast<uint32_t>(currentFrame);
+		for (uint32_t first = firstObject; first < firstObject + objectCount; first += m_MaxDrawIndirectCount) {
+			uint32_t drawCount = std::min(m_MaxDrawIndirectCount, firstObject + objectCount - first);
+			vkCmdDrawIndexedIndirect(commandBuffer, m_GpuCuller->DrawBuffer(slot), m_GpuCuller->DrawOffset(pass, phase, first), drawCount, sizeof(VkDrawIndexedIndirectCommand));
+			m_RenderStats.indirectDraw();
+		}
+		return;
+	}
+
+	//One draw per object for all of its visible instances, listed together by updateInstances
+	for (uint32_t j = firstObject; j < firstObject + objectCount; j++) {
+		const ObjectDraw& draw = m_ObjectDraws[j];
+		if (draw.count == 0) continue;
+
+		const MeshRange& mesh = m_Objects[j]->GetMesh();
+		vkCmdDrawIndexed(commandBuffer, mesh.indexCount, draw.count * perInstance, mesh.firstIndex, mesh.vertexOffset, draw.firstVisible * perInstance);
+		m_RenderStats.draw(mesh.indexCount, draw.count * perInstance);
 	}
 }
 
@@ -1274,6 +2116,7 @@ void VulkanApp::createSyncObjects()
 	imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
 	renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
 	inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+	imagesInFlight.assign(swapChainImages.size(), VK_NULL_HANDLE);
 
 	//Set up semaphore info
 	VkSemaphoreCreateInfo semaphoreInfo = {};
@@ -1298,72 +2141,141 @@ void VulkanApp::createSyncObjects()
 }
 
 void VulkanApp::recreateSwapChain() {
+	PROFILE_SCOPE("recreateSwapChain");
 	
-	//Get the new width and height if either are set to 0
+	//Get the new width and height, if either are set to 0 (minimised) wait until the window is visible again
 	int width = 0, height = 0;
+	glfwGetFramebufferSize(window->Window(), &width, &height);
 	while (width == 0 || height == 0) {
-		glfwGetFramebufferSize(window->Window(), &width, &height);
-		window->setSize(glm::vec2(width, height));
 		glfwWaitEvents();
+		glfwGetFramebufferSize(window->Window(), &width, &height);
 	}
+	window->setSize(glm::vec2(width, height));
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+
 	//Wait for end of frame
 	vkDeviceWaitIdle(device);
 
-	//Delete current swapchain data
+	//Delete current extent dependent data
 	cleanupSwapChain();
 
+	VkFormat oldFormat = swapChainImageFormat;
 
-	//Create all parts of the swap chain
+	//Create the new swap chain, retiring the old one
 	createSwapChain();
 	createImageViews();
-	createRenderPass();
-	createGraphicsPipeline(VK_TRUE);
-	createGraphicsPipeline(VK_FALSE);
+
+	//The render pass and pipelines only depend on the image format (viewport and scissor are dynamic) so keep them unless it changed
+	if (swapChainImageFormat != oldFormat) {
+		cleanupPipelines();
+		createRenderPass();
+		createGraphicsPipelines();
+	}
+
 	createDepthResources();
 	createFramebuffers();
-	createCommandBuffers();
+	if (m_DepthPyramid) {
+		m_GpuCuller->setDepthPyramid(m_DepthPyramid->ImageView(), m_DepthPyramid->Sampler());
+	}
+
+	imagesInFlight.assign(swapChainImages.size(), VK_NULL_HANDLE);
+
+	auto endTime = std::chrono::high_resolution_clock::now();
+	m_RecreateTimes.push_back(std::chrono::duration<double, std::milli>(endTime - startTime).count());
+}
+
+void VulkanApp::runResizeStorm(unsigned int count) {
+
+	glm::vec2 startSize = window->getSize();
+
+	//Alternate the window between two sizes, recreating the swap chain for each one like a window drag would
+	for (unsigned int i = 0; i < count; i++) {
+		int width = static_cast<int>(startSize.x) + ((i % 2 == 0) ? 64 : 0) + static_cast<int>(i % 7) * 8;
+		int height = static_cast<int>(startSize.y) + ((i % 2 == 0) ? 32 : 0) + static_cast<int>(i % 5) * 8;
+		glfwSetWindowSize(window->Window(), width, height);
+		window->UpdateWindow();
+
+		recreateSwapChain();
+		framebufferResized = false; //We already handled the resize event
+		drawFrame();
+	}
+
+	//Restore the original size
+	glfwSetWindowSize(window->Window(), static_cast<int>(startSize.x), static_cast<int>(startSize.y));
+	window->UpdateWindow();
+	framebufferResized = true;
+
+	printRecreateTimes();
+}
+
+void VulkanApp::printRecreateTimes() {
+
+	if (m_RecreateTimes.empty()) return;
+
+	//Print min, average and max recreation time
+	double total = 0.0;
+	double minTime = m_RecreateTimes[0];
+	double maxTime = m_RecreateTimes[0];
+	for (double time : m_RecreateTimes) {
+		total += time;
+		minTime = std::min(minTime, time);
+		maxTime = std::max(maxTime, time);
+	}
+
+	std::cout << "swap chain recreations: " << m_RecreateTimes.size()
+		<< " min " << minTime << "ms avg " << total / m_RecreateTimes.size() << "ms max " << maxTime << "ms" << std::endl;
 }
 
 void VulkanApp::cleanupSwapChain() {
 
+	if (m_Overdraw) {
+		m_Overdraw->destroyTarget();
+	}
+	if (m_Oit) {
+		m_Oit->destroyTargets();
+	}
+	if (m_DepthPyramid) {
+		m_DepthPyramid->destroyTarget();
+	}
+
 	vkDestroyImageView(device, depthImageView, nullptr);
 	vkDestroyImage(device, depthImage, nullptr);
-	vkFreeMemory(device, depthImageMemory, nullptr);
+	m_Engine->freeMemory(depthImageMemory);
 
 	//Destroy all frame buffers
 	for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
 		vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
 	}
-	//free memory from command buffers
-	vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
-
-	//Destroy graphics pipline and layout
-	vkDestroyPipeline(device, graphicsPipeline, nullptr);
-	vkDestroyPipeline(device, graphicsPipelineNoDepth, nullptr);
-	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-	vkDestroyPipeline(device, graphicsPipelineGeom, nullptr);
-	vkDestroyPipelineLayout(device, pipelineLayoutGeom, nullptr);
-	vkDestroyRenderPass(device, renderPass, nullptr); //Clean up render pass data
-
-	//Destroy all image views
+	//Destroy all image views, the swap chain itself is retired when the new one is created
 	for (size_t i = 0; i < swapChainImageViews.size(); i++) {
 		vkDestroyImageView(device, swapChainImageViews[i], nullptr);
 	}
-	//Destroy the actual swapchain object
-	vkDestroySwapchainKHR(device, swapChain, nullptr);
 }
 
+void VulkanApp::cleanupPipelines() {
 
-
+	//Destroy graphics piplines, they all reference the render pass
+	m_Pipelines->clear();
+	vkDestroyRenderPass(device, renderPass, nullptr); //Clean up render pass data
+	vkDestroyRenderPass(device, m_LateRenderPass, nullptr);
+	if (m_Overdraw) {
+		m_Overdraw->destroyRenderPass();
+	}
+	if (m_Oit) {
+		m_Oit->destroyRenderPass();
+	}
+}
 
 void VulkanApp::createDescriptorSetLayout()
 {
-	VkDescriptorSetLayoutBinding uboLayoutBinding = {};
-	uboLayoutBinding.binding = 0;
-	uboLayoutBinding.descriptorCount = 1;
-	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	uboLayoutBinding.pImmutableSamplers = nullptr;
-	uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	//Every pipeline reads the camera and the instances in the vertex stage, and samples one texture
+	VkDescriptorSetLayoutBinding frameLayoutBinding = {};
+	frameLayoutBinding.binding = InstanceBuffers::FRAME_BINDING;
+	frameLayoutBinding.descriptorCount = 1;
+	frameLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	frameLayoutBinding.pImmutableSamplers = nullptr;
+	frameLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
 	VkDescriptorSetLayoutBinding samplerLayoutBinding = {};
 	samplerLayoutBinding.binding = 1;
@@ -1372,147 +2284,295 @@ void VulkanApp::createDescriptorSetLayout()
 	samplerLayoutBinding.pImmutableSamplers = nullptr;
 	samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-	VkDescriptorSetLayoutBinding guboLayoutBinding = {};
-	guboLayoutBinding.binding = 2;
-	guboLayoutBinding.descriptorCount = 1;
-	guboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	guboLayoutBinding.pImmutableSamplers = nullptr;
-	guboLayoutBinding.stageFlags = VK_SHADER_STAGE_GEOMETRY_BIT;
-	
+	VkDescriptorSetLayoutBinding instanceLayoutBinding = {};
+	instanceLayoutBinding.binding = InstanceBuffers::INSTANCE_BINDING;
+	instanceLayoutBinding.descriptorCount = 1;
+	instanceLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	instanceLayoutBinding.pImmutableSamplers = nullptr;
+	instanceLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	VkDescriptorSetLayoutBinding visibleLayoutBinding = instanceLayoutBinding;
+	visibleLayoutBinding.binding = InstanceBuffers::VISIBLE_BINDING;
+
+	//The compute fins' quads, only written in the fin sets
+	VkDescriptorSetLayoutBinding quadLayoutBinding = instanceLayoutBinding;
+	quadLayoutBinding.binding = FinGenerator::QUAD_BINDING;
 
-	std::array<VkDescriptorSetLayoutBinding, 3> bindings = { uboLayoutBinding, samplerLayoutBinding, guboLayoutBinding };// guboLayoutBinding
+	std::array<VkDescriptorSetLayoutBinding, 5> bindings = { frameLayoutBinding, samplerLayoutBinding, instanceLayoutBinding, visibleLayoutBinding, quadLayoutBinding };
 
 	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
 	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.bindingCount = static_cast<uint32_t>(m_Settings.geometryFins ? bindings.size() - 1 : bindings.size());
 	layoutInfo.pBindings = bindings.data();
 
 	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create descriptor set layout!");
 	}
+}
 
-	/*VkDescriptorSetLayoutBinding guboLayoutBinding = {};
-	guboLayoutBinding.binding = 2;
-	guboLayoutBinding.descriptorCount = 1;
-	guboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	guboLayoutBinding.pImmutableSamplers = nullptr;
-	guboLayoutBinding.stageFlags = VK_SHADER_STAGE_GEOMETRY_BIT;*/
+uint32_t VulkanApp::loadObject(const char* modelPath, const char* texturePath)
+{
+	//Objects with the same model and texture are instances of the one already loaded
+	for (size_t i = 0; i < m_Objects.size(); i++) {
+		if (m_Objects[i]->Name() == modelPath && m_Objects[i]->TexturePath() == texturePath) return static_cast<uint32_t>(i);
+	}
 
-	std::array<VkDescriptorSetLayoutBinding, 3> bindingsGeom = { uboLayoutBinding, guboLayoutBinding, samplerLayoutBinding };
-	layoutInfo.pBindings = bindingsGeom.data();
-	layoutInfo.bindingCount = static_cast<uint32_t>(bindingsGeom.size());
+	m_Objects.push_back(new VulkanObject(m_Engine, m_Geometry, physicalDevice, device, graphicsQueue, commandPool, modelPath, texturePath));
+	return static_cast<uint32_t>(m_Objects.size() - 1);
+}
 
-	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayoutGeom) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create descriptor set layout!");
-	}
+glm::mat4 VulkanApp::modelMatrix(unsigned int instanceIndex) const
+{
+	return m_Transforms.World(m_Instances[instanceIndex].transform);
 }
 
-void VulkanApp::createUniformBuffers()
+Bounds VulkanApp::sceneBounds(unsigned int instanceIndex) const
 {
-	//Get size of buffer
-	VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+	//A sphere around the origin the instance spins about, reaching the far side of its own bounds
+	const FurInstance& instance = m_Instances[instanceIndex];
+	Bounds local = m_Objects[instance.object]->GetBounds().expanded(instance.extrusion);
+	Bounds bounds;
+	bounds.centre = glm::vec3(modelMatrix(instanceIndex)[3]);
+	bounds.radius = glm::length(local.centre) + local.radius;
+	bounds.extents = glm::vec3(bounds.radius);
+	return bounds;
+}
 
-	unsigned int size = 0;
-	for (unsigned int i = 0; i < m_Objects.size(); i++)
-	{
-		size += m_Objects[i]->Passes() * swapChainImages.size();
+glm::mat4 VulkanApp::viewMatrix() const
+{
+	//Camera pulled back along Z far enough to see the whole grid
+	return glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -m_CameraDistance));
+}
+
+glm::mat4 VulkanApp::projectionMatrix() const
+{
+	//Perspective with Y flipped for Vulkan's clip space
+	glm::mat4 proj = glm::perspective(glm::radians(67.0f), (float)swapChainExtent.width / (float)swapChainExtent.height, 0.01f, 100.0f);
+	proj[1][1] *= -1;
+	return proj;
+}
+
+void VulkanApp::cullObjects()
+{
+	PROFILE_SCOPE("cullObjects");
+
+	//The compute pass does the culling and lists the visible instances itself
+	if (m_GpuCuller) {
+		//The slot's fence has signalled, so the counts left by the last frame drawn with it are final
+		uint32_t slot = static_cast<uint32_t>(currentFrame);
+		if (m_FrameCount >= static_cast<size_t>(MAX_FRAMES_IN_FLIGHT)) {
+			uint32_t visible = m_GpuCuller->VisibleCount(slot);
+			uint32_t occluded = m_GpuCuller->OccludedCount(slot);
+			m_RenderStats.culled(static_cast<uint32_t>(m_Instances.size()) - visible - occluded);
+			m_RenderStats.occluded(occluded);
+		}
+		m_VisibleInstances.clear();
+		return;
 	}
 
-	//Allocate memory
-	uniformBuffers.resize(size);
-	uniformBuffersMemory.resize(size);
+	if (!m_Settings.frustumCulling) {
+		m_VisibleInstances.resize(m_Instances.size());
+		for (uint32_t i = 0; i < m_VisibleInstances.size(); i++) {
+			m_VisibleInstances[i] = i;
+		}
+		return;
+	}
 
-	//Create a uniform buffer for each of the swap chain images
-	for (size_t i = 0; i < size; i++) {
-		m_Engine->createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i], uniformBuffersMemory[i]);
+	if (m_Settings.sceneBvh) {
+		//The tree comes back in its own order, sorted so the draws match the flat culler
+		m_VisibleInstances.clear();
+		m_SceneIndex.queryFrustum(Frustum::fromMatrix(projectionMatrix() * viewMatrix()), m_VisibleInstances);
+		std::sort(m_VisibleInstances.begin(), m_VisibleInstances.end());
+		m_RenderStats.culled(static_cast<uint32_t>(m_Instances.size() - m_VisibleInstances.size()));
+		return;
 	}
 
-	//Get size of buffer
-	bufferSize = sizeof(GeomUniformBufferObject);
+	//Only the world bounds of the instances that moved are rebuilt, all of them the first time
+	auto setBounds = [&](uint32_t i) {
+		const FurInstance& instance = m_Instances[i];
+		m_Culler.setBounds(i, m_Objects[instance.object]->GetBounds().expanded(instance.extrusion).transformed(modelMatrix(i)));
+	};
+	if (m_Culler.Size() != m_Instances.size()) {
+		m_Culler.resize(m_Instances.size());
+		for (uint32_t i = 0; i < m_Instances.size(); i++) {
+			setBounds(i);
+		}
+	}
+	else {
+		for (uint32_t i : m_MovedInstances) {
+			setBounds(i);
+		}
+	}
 
-	//Allocate memory
-	geomUniformBuffers.resize(size);
-	geomUniformBuffersMemory.resize(size);
+	m_Culler.cull(Frustum::fromMatrix(projectionMatrix() * viewMatrix()), m_VisibleInstances);
+	m_RenderStats.culled(static_cast<uint32_t>(m_Instances.size() - m_VisibleInstances.size()));
+}
+
+void VulkanApp::updateInstances(uint32_t slot)
+{
+	PROFILE_SCOPE("updateInstances");
+
+	GpuFrame& frame = m_InstanceBuffers->Frame(slot);
+	frame.view = viewMatrix();
+	frame.proj = projectionMatrix();
+	frame.frustum = Frustum::fromMatrix(frame.proj * frame.view).planes;
+	if (!m_Settings.frustumCulling) {
+		//Planes every point is in front of
+		frame.frustum.fill(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+	}
+	frame.viewportDim = glm::vec2(swapChainExtent.width, swapChainExtent.height);
+	frame.instanceCount = static_cast<uint32_t>(m_Instances.size());
+	frame.objectCount = static_cast<uint32_t>(m_Objects.size());
+	frame.passStride = static_cast<uint32_t>(m_FurConstants.shellCount);
+	frame.cameraPosition = glm::vec3(glm::inverse(frame.view)[3]);
+
+	//The early pass tests against the pyramid the last frame left, from the camera it was drawn with
+	if (m_DepthPyramid) {
+		frame.occlusionViewProj = m_DepthPyramid->ViewProj();
+		frame.pyramidDim = glm::vec2(m_DepthPyramid->Extent().width, m_DepthPyramid->Extent().height);
+		frame.pyramidLevels = m_DepthPyramid->Levels();
+		frame.occlusionTest = m_DepthPyramid->HasDepth() ? 1 : 0;
+	}
+
+	//Only the instances that changed since the slot was last drawn are written, the rest still hold what they did then
+	GpuInstance* instances = m_InstanceBuffers->Instances(slot);
+	const std::vector<uint32_t>& changed = m_InstanceBuffers->Changed(slot);
+	for (uint32_t i : changed) {
+		const FurInstance& instance = m_Instances[i];
+		Bounds bounds = m_Objects[instance.object]->GetBounds().expanded(instance.extrusion);
+		instances[i].model = modelMatrix(i);
+		glm::mat3 normalMatrix = TransformStore::NormalMatrix(instances[i].model);
+		for (int column = 0; column < 3; column++) {
+			instances[i].normalMatrix[column] = glm::vec4(normalMatrix[column], 0.0f);
+		}
+		instances[i].sphere = glm::vec4(bounds.centre, bounds.radius);
+		instances[i].extents = glm::vec4(bounds.extents, 0.0f);
+		instances[i].object = instance.object;
+		instances[i].passes = instance.passes;
+		instances[i].extrusion = instance.extrusion;
+	}
+	m_RenderStats.upload(sizeof(GpuFrame) + sizeof(GpuInstance) * changed.size());
+	m_InstanceBuffers->clearChanged(slot);
+
+	//The culling pass lists the ones it keeps
+	if (m_GpuCuller) return;
 
-	//Create a uniform buffer for each of the swap chain images
-	for (size_t i = 0; i < size; i++) {
-		m_Engine->createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, geomUniformBuffers[i], geomUniformBuffersMemory[i]);
+	//Visible instances are listed together by object so each object's are drawn from one range
+	for (ObjectDraw& draw : m_ObjectDraws) {
+		draw.count = 0;
+	}
+	for (uint32_t i : m_VisibleInstances) {
+		m_ObjectDraws[m_Instances[i].object].count++;
+	}
+	uint32_t firstVisible = 0;
+	for (ObjectDraw& draw : m_ObjectDraws) {
+		draw.firstVisible = firstVisible;
+		firstVisible += draw.count;
+		draw.count = 0;
+	}
+
+	uint32_t* visible = m_InstanceBuffers->Visible(slot);
+	for (uint32_t i : m_VisibleInstances) {
+		ObjectDraw& draw = m_ObjectDraws[m_Instances[i].object];
+		visible[draw.firstVisible + draw.count++] = i;
+	}
+
+	//The fin pass finds each object's visible instances the way it would in the culling pass's base mesh draws
+	if (m_FinGenerator) {
+		VkDrawIndexedIndirectCommand* objectDraws = m_FinGenerator->ObjectDraws(slot);
+		for (size_t j = 0; j < m_ObjectDraws.size(); j++) {
+			objectDraws[j] = {};
+			objectDraws[j].instanceCount = m_ObjectDraws[j].count;
+			objectDraws[j].firstInstance = m_ObjectDraws[j].firstVisible;
+		}
 	}
+	m_RenderStats.upload(sizeof(uint32_t) * m_VisibleInstances.size());
 }
 
-void VulkanApp::updateUniformBuffer(uint32_t currentImage, unsigned int objectIndex, unsigned int pass)
+uint32_t VulkanApp::shellsPerInstance() const
 {
-	size_t index = m_Objects[objectIndex]->Passes() * currentImage + objectIndex + pass;
+	//Every pass but the base mesh, instances with fewer passes drop the outer ones in the vertex shader
+	return static_cast<uint32_t>(std::max(m_FurConstants.shellCount, 1)) - 1;
+}
 
-	//Time at start of frame
-	static auto startTime = std::chrono::high_resolution_clock::now();
+void VulkanApp::updateTransforms()
+{
+	PROFILE_SCOPE("updateTransforms");
 
-	//Current time
-	auto currentTime = std::chrono::high_resolution_clock::now();
-	//Delta Time
-	float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+	//Spinning instances turn 45 degrees a second about Y
+	glm::quat spin = glm::angleAxis(static_cast<float>(m_SceneTime) * glm::radians(45.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	for (uint32_t transform : m_SpinningTransforms) {
+		m_Transforms.setRotation(transform, spin);
+	}
+	m_Transforms.update();
 
-	//Set up the uniform model matrix (rotation and translation and scale)
-	UniformBufferObject ubo = {};
-	//glm::mat4 model = glm::translate(glm::mat4(1.0f), m_Objects[objectIndex]->GetPos()) * glm::rotate(ubo.model, time * glm::radians(45.0f), glm::vec3(0.0f, 1.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(10.0f, 10.0f, 10.0f));
-	ubo.model = glm::mat4(1);
-	ubo.model = glm::translate(glm::mat4(1.0f), m_Objects[objectIndex]->GetPos()) * glm::rotate(ubo.model, time * glm::radians(45.0f), glm::vec3(0.0f, 1.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, 1.0f, 1.0f));
-	
-	
-	//View matrix using look at
-	ubo.view = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -0.2f));// glm::lookAt(glm::vec3(0.0f, 0.1f, -3.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	//Projection / Perspective matrix
-	glm::mat4 proj = glm::perspective(glm::radians(67.0f), (float)swapChainExtent.width / (float)swapChainExtent.height, 0.01f, 100.0f);
-	proj[1][1] *= -1;
-	ubo.proj = proj;
+	m_MovedInstances.clear();
+	for (uint32_t transform : m_Transforms.Changed()) {
+		uint32_t i = m_TransformInstances[transform];
+		if (i == TransformStore::INVALID) continue;
+		m_MovedInstances.push_back(i);
+		m_InstanceBuffers->markChanged(i);
+		m_SceneIndex.move(m_InstanceProxies[i], sceneBounds(i));
+	}
+}
 
-	ubo.layer = pass+1;
+void VulkanApp::updateSceneTime()
+{
+	//Benchmarks step a fixed amount each frame so every run draws the same frames, otherwise follow the clock
+	if (m_Benchmark) {
+		m_SceneTime = m_FrameCount * Benchmark::TIME_STEP;
+	}
+	else {
+		static auto startTime = std::chrono::high_resolution_clock::now();
+		m_SceneTime = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+	}
+}
 
-	//Map memory to a CPU side pointer, copy over data then unmap from cpu side
-	
-	void* data;
-	vkMapMemory(device, uniformBuffersMemory[index], 0, sizeof(ubo), 0, &data);
-	memcpy(data, &ubo, sizeof(ubo));
-	vkUnmapMemory(device, uniformBuffersMemory[index]);
+void VulkanApp::collectGpuTime(uint32_t slot)
+{
+	//Read back the slot's last frame once its fence has signalled
+	if (!m_GpuProfiler->collect(slot)) return;
+	const GpuFrameTimes* times = m_GpuProfiler->Latest();
 
-	GeomUniformBufferObject gubo = {};
-	//gubo.model = ubo.model * glm::scale(glm::mat4(1), glm::vec3(10.5f, 10.5f, 10.5f));
-	gubo.model = glm::mat4(1);
-	gubo.model = ubo.model;// glm::translate(glm::mat4(1.0f), m_Objects[objectIndex]->GetPos()) * glm::rotate(ubo.model, time * glm::radians(45.0f), glm::vec3(0.0f, 1.0f, 0.0f));// *glm::scale(glm::mat4(1.0f), glm::vec3(10.0f, 10.0f, 10.0f));
-	//gubo.model = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, 1.0f, 1.0f));
-	gubo.view = ubo.view;// glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -4));
+	if (m_Benchmark) {
+		m_Benchmark->setGpuTime(times->frame, *times);
+	}
 
-	gubo.proj = ubo.proj;// glm::perspective(glm::radians(67.0f), swapChainExtent.width / (float)swapChainExtent.height, 0.01f, 100.0f);
-	//gubo.proj[1][1] *= -1;
-	gubo.viewportDim = glm::vec2(swapChainExtent.width, swapChainExtent.height);
+	//Rolling log of the average phase times
+	if (m_Settings.gpuLogInterval > 0 && times->frame % m_Settings.gpuLogInterval == 0) {
+		m_GpuProfiler->printAverage(m_Settings.gpuLogInterval);
+	}
+}
 
-	void* gdata;
-	vkMapMemory(device, geomUniformBuffersMemory[index], 0, sizeof(gubo), 0, &gdata);
-	memcpy(gdata, &gubo, sizeof(gubo));
-	vkUnmapMemory(device, geomUniformBuffersMemory[index]);
+size_t VulkanApp::descriptorSetIndex(uint32_t frame, DrawPhase phase, uint32_t object) const
+{
+	//Each frame in flight has a set for the fins, one for the shells, then one for each object's base mesh
+	size_t frameSize = 2 + m_Objects.size();
+	size_t index = frame * frameSize;
+	if (phase == DrawPhase::Shells) index += 1;
+	else if (phase == DrawPhase::Base) index += 2 + object;
+	return index;
 }
 
 void VulkanApp::createDescriptorPool()
 {
-	unsigned int size = 0;
-	for (unsigned int i = 0; i < m_Objects.size(); i++)
-	{
-		size += m_Objects[i]->Passes() * swapChainImages.size();
-	}
+	//The sets only differ by texture, there are a few per frame in flight however many instances are drawn
+	uint32_t size = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT * (2 + m_Objects.size()));
 
-	//We need to account for the geometry shader pipelines and allocate space for additional descriptors
-	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+	std::array<VkDescriptorPoolSize, 3> poolSizes = {};
 	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[0].descriptorCount = static_cast<uint32_t>(size*4);
+	poolSizes[0].descriptorCount = size;
 	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[1].descriptorCount = static_cast<uint32_t>(size*4);
-
+	poolSizes[1].descriptorCount = size;
+	//Every set takes a descriptor for each binding in the layout, so the quad binding counts even where it isn't written
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[2].descriptorCount = size * 3;
 
 	VkDescriptorPoolCreateInfo poolInfo = {};
 	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 	poolInfo.pPoolSizes = poolSizes.data();
-	poolInfo.maxSets = static_cast<uint32_t>(size)*4;
+	poolInfo.maxSets = size;
 
 	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create descriptor pool!");
@@ -1521,132 +2581,84 @@ void VulkanApp::createDescriptorPool()
 
 void VulkanApp::createDescriptorSets()
 {
-	unsigned int size = 0;
-	for (unsigned int i = 0; i < m_Objects.size(); i++)
-	{
-		size += m_Objects[i]->Passes() * swapChainImages.size();
-	}
+	PROFILE_SCOPE("createDescriptorSets");
+	uint32_t size = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT * (2 + m_Objects.size()));
 
 	//Allocate memory
 	std::vector<VkDescriptorSetLayout> layouts(size, descriptorSetLayout);
 	VkDescriptorSetAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocInfo.descriptorPool = descriptorPool; //Pass in the pool
-	allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size()); //Same as pool descriptor count
+	allocInfo.descriptorSetCount = size;
 	allocInfo.pSetLayouts = layouts.data(); //Pass in layout data
 
-	//Allocate memory
 	descriptorSets.resize(size);
-	
-	//Allocate desciptor sets 
 	if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
 		throw std::runtime_error("failed to allocate descriptor sets!");
 	}
 
+	for (uint32_t frame = 0; frame < static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT); frame++) {
+		VkDescriptorBufferInfo frameInfo = { m_InstanceBuffers->FrameBuffer(frame), 0, sizeof(GpuFrame) };
+		VkDescriptorBufferInfo instanceInfo = { m_InstanceBuffers->InstanceBuffer(frame), 0, VK_WHOLE_SIZE };
+		VkDescriptorBufferInfo visibleInfo = { m_InstanceBuffers->VisibleBuffer(frame), 0, VK_WHOLE_SIZE };
 
-	//Allocate memory
-	std::vector<VkDescriptorSetLayout> layoutsGeom(size, descriptorSetLayoutGeom);
-	VkDescriptorSetAllocateInfo allocInfoGeom = {};
-	allocInfoGeom.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocInfoGeom.descriptorPool = descriptorPool; //Pass in the pool
-	allocInfoGeom.descriptorSetCount = static_cast<uint32_t>(layoutsGeom.size()); //Same as pool descriptor count
-	allocInfoGeom.pSetLayouts = layoutsGeom.data(); //Pass in layout data
-
-	descriptorSetsGeom.resize(size);
-
-	//Allocate desciptor sets 
-	if (vkAllocateDescriptorSets(device, &allocInfoGeom, descriptorSetsGeom.data()) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate descriptor sets!");
-	}
+		for (uint32_t set = 0; set < 2 + m_Objects.size(); set++) {
+			VkDescriptorSet descriptorSet = descriptorSets[frame * (2 + m_Objects.size()) + set];
 
-	//For each swap chain image set up and pass in the descriptor set and buffer for each image
-	for (size_t i = 0; i < swapChainImages.size(); i++) {
-		for (unsigned int j = 0; j < m_Objects.size(); j++)
-		{
-			for (unsigned int p = 0; p < m_Objects[j]->Passes(); p++)
-			{
-				unsigned int index = m_Objects[j]->Passes() * i + j + p;
-				
-				VkDescriptorBufferInfo bufferInfo = {};
-				bufferInfo.buffer = uniformBuffers[index]; //Actual buffer to use
-				bufferInfo.offset = 0; //Start at the start
-				bufferInfo.range = sizeof(UniformBufferObject); //Size of each buffer
-
-				VkDescriptorImageInfo imageInfo = {};
-				imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-				if (p == 0)
-				{
-					std::cout << index << std::endl;
-					imageInfo.imageView = m_Objects[j]->GetTextureImageView();
-					imageInfo.sampler = m_Objects[j]->GetTextureSampler();
-				}
-				else
-				{
-					imageInfo.imageView = furTextureImageView;
-					imageInfo.sampler = furTextureSampler;
-				}
+			//Fins use the fin texture, shells the fur noise and each object's base mesh its own texture
+			VkDescriptorImageInfo imageInfo = {};
+			imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			if (set == 0) {
+				imageInfo.imageView = finTextureImageView;
+				imageInfo.sampler = finTextureSampler;
+			}
+			else if (set == 1) {
+				imageInfo.imageView = furTextureImageView;
+				imageInfo.sampler = furTextureSampler;
+			}
+			else {
+				imageInfo.imageView = m_Objects[set - 2]->GetTextureImageView();
+				imageInfo.sampler = m_Objects[set - 2]->GetTextureSampler();
+			}
 
-				//Pass uniform buffer at binding 0
-				std::array<VkWriteDescriptorSet, 5> descriptorWrites = {};
-				descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-				descriptorWrites[0].dstSet = descriptorSets[index]; //desciptor to use
-				descriptorWrites[0].dstBinding = 0;
-				descriptorWrites[0].dstArrayElement = 0;
-				descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-				descriptorWrites[0].descriptorCount = 1;
-				descriptorWrites[0].pBufferInfo = &bufferInfo;
-				
-				//Pass uniform sampler at binding 1
-				descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-				descriptorWrites[1].dstSet = descriptorSets[index];
-				descriptorWrites[1].dstBinding = 1;
-				descriptorWrites[1].dstArrayElement = 0;
-				descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-				descriptorWrites[1].descriptorCount = 1;
-				descriptorWrites[1].pImageInfo = &imageInfo;
-
-
-				//Now we also need to pass the infomation for the geometry shader pipeline  for all 3 stages (Vert -> Geo -> Frag)
-				VkDescriptorBufferInfo bufferInfoGeom = {};
-				bufferInfoGeom.buffer = geomUniformBuffers[index]; //Actual buffer to use
-				bufferInfoGeom.offset = 0; //Start at the start
-				bufferInfoGeom.range = sizeof(GeomUniformBufferObject); //Size of each buffer
-
-				//Pass uniform buffer at binding 0
-				descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-				descriptorWrites[2].dstSet = descriptorSetsGeom[index]; //desciptor to use
-				descriptorWrites[2].dstBinding = 0;
-				descriptorWrites[2].dstArrayElement = 0;
-				descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-				descriptorWrites[2].descriptorCount = 1;
-				descriptorWrites[2].pBufferInfo = &bufferInfo;
-
-				//Pass geometry uniform buffer at binding 2
-				descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-				descriptorWrites[3].dstSet = descriptorSetsGeom[index];
-				descriptorWrites[3].dstBinding = 2;
-				descriptorWrites[3].dstArrayElement = 0;
-				descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-				descriptorWrites[3].descriptorCount = 1;
-				descriptorWrites[3].pBufferInfo = &bufferInfoGeom;
-
-				VkDescriptorImageInfo imageInfoGeom = {};
-				imageInfoGeom.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-				imageInfoGeom.imageView = finTextureImageView;
-				imageInfoGeom.sampler = finTextureSampler;
-				
-				//Pass uniform texture sampler at binding 1 (fins texture)
-				descriptorWrites[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-				descriptorWrites[4].dstSet = descriptorSetsGeom[index];
-				descriptorWrites[4].dstBinding = 1;
-				descriptorWrites[4].dstArrayElement = 0;
-				descriptorWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-				descriptorWrites[4].descriptorCount = 1;
-				descriptorWrites[4].pImageInfo = &imageInfoGeom;
-
-				//Set the descriptor set for this image
-				vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+			std::array<VkWriteDescriptorSet, 4> descriptorWrites = {};
+			descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrites[0].dstSet = descriptorSet;
+			descriptorWrites[0].dstBinding = InstanceBuffers::FRAME_BINDING;
+			descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			descriptorWrites[0].descriptorCount = 1;
+			descriptorWrites[0].pBufferInfo = &frameInfo;
+
+			descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrites[1].dstSet = descriptorSet;
+			descriptorWrites[1].dstBinding = 1;
+			descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			descriptorWrites[1].descriptorCount = 1;
+			descriptorWrites[1].pImageInfo = &imageInfo;
+
+			descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrites[2].dstSet = descriptorSet;
+			descriptorWrites[2].dstBinding = InstanceBuffers::INSTANCE_BINDING;
+			descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			descriptorWrites[2].descriptorCount = 1;
+			descriptorWrites[2].pBufferInfo = &instanceInfo;
+
+			descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrites[3].dstSet = descriptorSet;
+			descriptorWrites[3].dstBinding = InstanceBuffers::VISIBLE_BINDING;
+			descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			descriptorWrites[3].descriptorCount = 1;
+			descriptorWrites[3].pBufferInfo = &visibleInfo;
+
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+			//The fins read the quads the compute pass built
+			if (set == 0 && m_FinGenerator) {
+				VkDescriptorBufferInfo quadInfo = { m_FinGenerator->QuadBuffer(frame), 0, VK_WHOLE_SIZE };
+				VkWriteDescriptorSet quadWrite = descriptorWrites[3];
+				quadWrite.dstBinding = FinGenerator::QUAD_BINDING;
+				quadWrite.pBufferInfo = &quadInfo;
+				vkUpdateDescriptorSets(device, 1, &quadWrite, 0, nullptr);
 			}
 		}
 	}
@@ -1656,10 +2668,20 @@ void VulkanApp::createDepthResources()
 {
 	VkFormat depthFormat = findDepthFormat();
 
-	m_Engine->createImage(swapChainExtent.width, swapChainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
+	//The depth pyramid is reduced from the depth buffer, so it needs to be sampled too
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	if (m_DepthPyramid) {
+		usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+	}
+
+	m_Engine->createImage(swapChainExtent.width, swapChainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory, MemoryCategory::Depth, "depth buffer");
 	depthImageView = m_Engine->createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
 
 	m_Engine->transitionImageLayout(graphicsQueue, commandPool, depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+
+	if (m_DepthPyramid) {
+		m_DepthPyramid->createTarget(swapChainExtent, depthImageView);
+	}
 }
 
 VkFormat VulkanApp::findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features)
@@ -1681,10 +2703,15 @@ VkFormat VulkanApp::findSupportedFormat(const std::vector<VkFormat>& candidates,
 
 VkFormat VulkanApp::findDepthFormat()
 {
+	//Occlusion culling samples the depth buffer to build the pyramid
+	VkFormatFeatureFlags features = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	if (m_DepthPyramid) {
+		features |= VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+	}
 	return findSupportedFormat(
 		{ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
 		VK_IMAGE_TILING_OPTIMAL,
-		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
+		features
 	);
 }
 
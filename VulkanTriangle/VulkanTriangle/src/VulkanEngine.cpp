@@ -1,4 +1,6 @@
 #include "VulkanEngine.h"
+
+#include "CpuProfiler.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
@@ -20,8 +22,34 @@ uint32_t VulkanEngine::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags
 	throw std::runtime_error("failed to find suitable memory type!");
 }
 
+void VulkanEngine::allocateMemory(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, VkDeviceMemory& memory, MemoryCategory category, const std::string& owner)
+{
+	//Set up the allocation info using the memory requirements
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = requirements.size;
+	allocInfo.memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, properties);
+
+	//Allocate memory on the GPU and error check
+	if (vkAllocateMemory(m_Device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate " + std::string(toString(category)) + " memory for " + owner + "!");
+	}
+
+	if (m_Memory) {
+		m_Memory->track(memory, allocInfo.allocationSize, allocInfo.memoryTypeIndex, category, owner);
+	}
+}
+
+void VulkanEngine::freeMemory(VkDeviceMemory memory)
+{
+	if (m_Memory) {
+		m_Memory->release(memory);
+	}
+	vkFreeMemory(m_Device, memory, nullptr);
+}
+
 void VulkanEngine::createBuffer(VkDeviceSize size, 
-	VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer & buffer, VkDeviceMemory & bufferMemory)
+	VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer & buffer, VkDeviceMemory & bufferMemory, MemoryCategory category, const std::string& owner)
 {
 
 	//Set up generic buffer data
@@ -40,16 +68,8 @@ void VulkanEngine::createBuffer(VkDeviceSize size,
 	VkMemoryRequirements memRequirements;
 	vkGetBufferMemoryRequirements(m_Device, buffer, &memRequirements);
 
-	//Set up the allocation info using the meory requirements we just set up
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-	//Allocate memory on the GPU and error check
-	if (vkAllocateMemory(m_Device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate buffer memory!");
-	}
+	//Allocate memory on the GPU using the meory requirements we just set up
+	allocateMemory(memRequirements, properties, bufferMemory, category, owner);
 
 	//Bind the buffer memory
 	vkBindBufferMemory(m_Device, buffer, bufferMemory, 0);
@@ -101,63 +121,7 @@ void VulkanEngine::endSingleTimeCommands(VkQueue& graphicsQueue, VkCommandPool&
 	vkFreeCommandBuffers(m_Device, comPool, 1, &commandBuffer);
 }
 
-void VulkanEngine::createVertexBuffer(VkQueue& graphicsQueue, VkCommandPool& comPool, VulkanObject* object)
-{
-	//Calculate buffer size
-	VkDeviceSize bufferSize = sizeof(Vertex) * object->GetVertices().size();
-
-
-	//Use our create buffer function to get a generic staging buffer buffer
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-	//Map the memory to a CPU side pointer and copy over the vertex data
-	void* data;
-	vkMapMemory(m_Device, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, object->GetVertices().data(), (size_t)bufferSize);
-	vkUnmapMemory(m_Device, stagingBufferMemory); //Unmap from cpu side
-
-												  //Create a vertex buffer
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, object->GetVertexBuffer(), object->GetVertexMemory());
-
-	//Copy the staging buffer data to the vertex buffer
-	copyBuffer(graphicsQueue, comPool, stagingBuffer, object->GetVertexBuffer(), bufferSize);
-
-	//Destroy the staging buffer and free memory
-	vkDestroyBuffer(m_Device, stagingBuffer, nullptr);
-	vkFreeMemory(m_Device, stagingBufferMemory, nullptr);
-}
-
-void VulkanEngine::createIndexBuffer(VkQueue& graphicsQueue, VkCommandPool& comPool, VulkanObject* object)
-{
-	//Calculate buffer size
-	VkDeviceSize bufferSize = sizeof(object->GetIndices()[0]) * object->GetIndices().size();
-
-	//Set up staging buffer
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-	//Map the data to  CPU side pointer and copy over the data, then unmap
-	void* data;
-	vkMapMemory(m_Device, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, object->GetIndices().data(), (size_t)bufferSize);
-	vkUnmapMemory(m_Device, stagingBufferMemory);
-
-	//Create the index buffer
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, object->GetIndexBuffer(), object->GetIndexMemory());
-
-	//Copy the data from the staging buffer to the new index buffer
-	copyBuffer(graphicsQueue, comPool, stagingBuffer, object->GetIndexBuffer(), bufferSize);
-
-
-	//Clean up the staging buffer
-	vkDestroyBuffer(m_Device, stagingBuffer, nullptr);
-	vkFreeMemory(m_Device, stagingBufferMemory, nullptr);
-}
-
-void VulkanEngine::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage & image, VkDeviceMemory & imageMemory)
+void VulkanEngine::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage & image, VkDeviceMemory & imageMemory, MemoryCategory category, const std::string& owner)
 {
 	VkImageCreateInfo imageInfo = {};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -181,22 +145,21 @@ void VulkanEngine::createImage(uint32_t width, uint32_t height, VkFormat format,
 	VkMemoryRequirements memRequirements;
 	vkGetImageMemoryRequirements(m_Device, image, &memRequirements);
 
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-	if (vkAllocateMemory(m_Device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate image memory!");
-	}
+	allocateMemory(memRequirements, properties, imageMemory, category, owner);
 
 	vkBindImageMemory(m_Device, image, imageMemory, 0);
 }
 
 void VulkanEngine::createTextureImage(VkQueue& graphicsQueue, VkCommandPool& comPool, VkImage& textureImage, VkDeviceMemory& textureImageMemory, const char* texturePath)
 {
+	PROFILE_SCOPE("createTextureImage");
+
 	int texWidth, texHeight, texChannels;
-	stbi_uc* pixels = stbi_load(texturePath, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+	stbi_uc* pixels;
+	{
+		PROFILE_SCOPE("decode texture");
+		pixels = stbi_load(texturePath, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+	}
 	VkDeviceSize imageSize = texWidth * texHeight * 4;
 
 	if (!pixels) {
@@ -205,7 +168,7 @@ void VulkanEngine::createTextureImage(VkQueue& graphicsQueue, VkCommandPool& com
 
 	VkBuffer stagingBuffer;
 	VkDeviceMemory stagingBufferMemory;
-	createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+	createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory, MemoryCategory::Staging, texturePath);
 
 	void* data;
 	vkMapMemory(m_Device, stagingBufferMemory, 0, imageSize, 0, &data);
@@ -214,18 +177,20 @@ void VulkanEngine::createTextureImage(VkQueue& graphicsQueue, VkCommandPool& com
 
 	stbi_image_free(pixels);
 
-	createImage(texWidth, texHeight, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
+	createImage(texWidth, texHeight, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory, MemoryCategory::Texture, texturePath);
 
 	transitionImageLayout(graphicsQueue, comPool, textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 	copyBufferToImage(graphicsQueue, comPool, stagingBuffer, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
 	transitionImageLayout(graphicsQueue, comPool, textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
 	vkDestroyBuffer(m_Device, stagingBuffer, nullptr);
-	vkFreeMemory(m_Device, stagingBufferMemory, nullptr);
+	freeMemory(stagingBufferMemory);
 }
 
 void VulkanEngine::createNoiseTextureImage(VkQueue & graphicsQueue, VkCommandPool & comPool, VkImage & textureImage, VkDeviceMemory & textureImageMemory, float distribution)
 {
+	PROFILE_SCOPE("createNoiseTextureImage");
+
 	int texWidth = 256, texHeight = 256;
 	//Random Noise
 	std::uniform_real_distribution<float> randomFloats(0.0, 1.0); // random floats between 0.0 - 1.0
@@ -259,7 +224,7 @@ void VulkanEngine::createNoiseTextureImage(VkQueue & graphicsQueue, VkCommandPoo
 
 	VkBuffer stagingBuffer;
 	VkDeviceMemory stagingBufferMemory;
-	createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+	createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory, MemoryCategory::Staging, "fur noise");
 
 	void* data;
 	vkMapMemory(m_Device, stagingBufferMemory, 0, imageSize, 0, &data);
@@ -267,14 +232,14 @@ void VulkanEngine::createNoiseTextureImage(VkQueue & graphicsQueue, VkCommandPoo
 	vkUnmapMemory(m_Device, stagingBufferMemory);
 
 
-	createImage(texWidth, texHeight, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
+	createImage(texWidth, texHeight, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory, MemoryCategory::Texture, "fur noise");
 
 	transitionImageLayout(graphicsQueue, comPool, textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 	copyBufferToImage(graphicsQueue, comPool, stagingBuffer, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
 	transitionImageLayout(graphicsQueue, comPool, textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
 	vkDestroyBuffer(m_Device, stagingBuffer, nullptr);
-	vkFreeMemory(m_Device, stagingBufferMemory, nullptr);
+	freeMemory(stagingBufferMemory);
 }
 
 void VulkanEngine::transitionImageLayout(VkQueue& graphicsQueue, VkCommandPool& comPool, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout)
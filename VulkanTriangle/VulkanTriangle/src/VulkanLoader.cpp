@@ -0,0 +1,592 @@
+#include "VulkanLoader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#define VULKAN_DEFINE_FUNCTION(name) PFN_##name name = nullptr;
+PFN_vkGetInstanceProcAddr vkGetInstanceProcAddr = nullptr;
+VULKAN_GLOBAL_FUNCTIONS(VULKAN_DEFINE_FUNCTION)
+VULKAN_INSTANCE_FUNCTIONS(VULKAN_DEFINE_FUNCTION)
+VULKAN_INSTANCE_EXTENSION_FUNCTIONS(VULKAN_DEFINE_FUNCTION)
+VULKAN_DEVICE_FUNCTIONS(VULKAN_DEFINE_FUNCTION)
+
+static void* s_Library = nullptr;
+static bool s_Mocked = false;
+
+void VulkanLoader::loadLibrary()
+{
+#ifdef _WIN32
+	HMODULE library = LoadLibraryA("vulkan-1.dll");
+	if (library) {
+		vkGetInstanceProcAddr = reinterpret_cast<PFN_vkGetInstanceProcAddr>(GetProcAddress(library, "vkGetInstanceProcAddr"));
+	}
+	s_Library = library;
+#else
+	s_Library = dlopen("libvulkan.so.1", RTLD_NOW | RTLD_LOCAL);
+	if (!s_Library) {
+		s_Library = dlopen("libvulkan.so", RTLD_NOW | RTLD_LOCAL);
+	}
+	if (s_Library) {
+		vkGetInstanceProcAddr = reinterpret_cast<PFN_vkGetInstanceProcAddr>(dlsym(s_Library, "vkGetInstanceProcAddr"));
+	}
+#endif
+	if (!vkGetInstanceProcAddr) {
+		throw std::runtime_error("failed to load the Vulkan library!");
+	}
+	s_Mocked = false;
+
+#define VULKAN_LOAD_GLOBAL(name) name = reinterpret_cast<PFN_##name>(vkGetInstanceProcAddr(VK_NULL_HANDLE, #name));
+	VULKAN_GLOBAL_FUNCTIONS(VULKAN_LOAD_GLOBAL)
+}
+
+void VulkanLoader::loadInstance(VkInstance instance)
+{
+	//The mock already has everything
+	if (s_Mocked) return;
+
+	//Extension functions (surface, debug utils) are null if the extension isn't enabled, which is fine as long as they aren't called
+#define VULKAN_LOAD_INSTANCE(name) name = reinterpret_cast<PFN_##name>(vkGetInstanceProcAddr(instance, #name));
+	VULKAN_INSTANCE_FUNCTIONS(VULKAN_LOAD_INSTANCE)
+	VULKAN_INSTANCE_EXTENSION_FUNCTIONS(VULKAN_LOAD_INSTANCE)
+}
+
+void VulkanLoader::loadDevice(VkDevice device)
+{
+	if (s_Mocked) return;
+
+	//Pointers from the instance go through a trampoline that looks up the device's dispatch table on every call,
+	//these are the driver's own entry points for this device
+#define VULKAN_LOAD_DEVICE(name) name = reinterpret_cast<PFN_##name>(vkGetDeviceProcAddr(device, #name));
+	VULKAN_DEVICE_FUNCTIONS(VULKAN_LOAD_DEVICE)
+}
+
+void VulkanLoader::unload()
+{
+	if (!s_Library) return;
+#ifdef _WIN32
+	FreeLibrary(static_cast<HMODULE>(s_Library));
+#else
+	dlclose(s_Library);
+#endif
+	s_Library = nullptr;
+}
+
+bool VulkanLoader::Mocked()
+{
+	return s_Mocked;
+}
+
+//Mock backend
+
+/*! Index of each function in the call counts */
+enum class MockFunction : size_t {
+#define VULKAN_MOCK_INDEX(name) name,
+	vkGetInstanceProcAddr,
+	VULKAN_GLOBAL_FUNCTIONS(VULKAN_MOCK_INDEX)
+	VULKAN_INSTANCE_FUNCTIONS(VULKAN_MOCK_INDEX)
+	VULKAN_INSTANCE_EXTENSION_FUNCTIONS(VULKAN_MOCK_INDEX)
+	VULKAN_DEVICE_FUNCTIONS(VULKAN_MOCK_INDEX)
+	Count
+};
+
+#define VULKAN_MOCK_NAME(name) #name,
+static const char* s_MockNames[] = {
+	"vkGetInstanceProcAddr",
+	VULKAN_GLOBAL_FUNCTIONS(VULKAN_MOCK_NAME)
+	VULKAN_INSTANCE_FUNCTIONS(VULKAN_MOCK_NAME)
+	VULKAN_INSTANCE_EXTENSION_FUNCTIONS(VULKAN_MOCK_NAME)
+	VULKAN_DEVICE_FUNCTIONS(VULKAN_MOCK_NAME)
+};
+
+/*! Mock Counter struct
+	Calls made to one function and the bytes passed to it, pipeline workers call through the mock too so they are atomic
+*/
+struct MockCounter {
+	std::atomic<uint64_t> calls{ 0 };
+	std::atomic<uint64_t> bytes{ 0 };
+};
+
+static MockCounter s_MockCounts[static_cast<size_t>(MockFunction::Count)];
+
+static void mockBytes(MockFunction function, uint64_t bytes)
+{
+	s_MockCounts[static_cast<size_t>(function)].bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+/*! Mock struct
+	Wraps a function so every call is counted, the bytes counted are the arguments themselves.
+	stub is for functions the app doesn't need anything back from and returns VK_SUCCESS (or nothing),
+	wrap counts then forwards to a mock implementation
+*/
+template <typename PFN> struct Mock;
+
+template <typename R, typename... Args>
+struct Mock<R (VKAPI_PTR*)(Args...)> {
+	template <MockFunction Function>
+	static void count() {
+		MockCounter& counter = s_MockCounts[static_cast<size_t>(Function)];
+		counter.calls.fetch_add(1, std::memory_order_relaxed);
+		counter.bytes.fetch_add((sizeof(Args) + ... + 0), std::memory_order_relaxed);
+	}
+
+	template <MockFunction Function>
+	static R VKAPI_CALL stub(Args...) {
+		count<Function>();
+		if constexpr (!std::is_void_v<R>) {
+			return R{};
+		}
+	}
+
+	template <MockFunction Function, R (VKAPI_PTR* Impl)(Args...)>
+	static R VKAPI_CALL wrap(Args... args) {
+		count<Function>();
+		return Impl(args...);
+	}
+};
+
+//Handles are just unique numbers, apart from memory which is real host memory so it can be mapped
+static std::atomic<uint64_t> s_NextHandle{ 0x1000 };
+
+template <typename Handle>
+static Handle toHandle(uint64_t value)
+{
+	if constexpr (std::is_pointer_v<Handle>) {
+		return reinterpret_cast<Handle>(static_cast<uintptr_t>(value));
+	}
+	else {
+		return static_cast<Handle>(value);
+	}
+}
+
+template <typename Handle>
+static uint64_t fromHandle(Handle handle)
+{
+	if constexpr (std::is_pointer_v<Handle>) {
+		return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(handle));
+	}
+	else {
+		return static_cast<uint64_t>(handle);
+	}
+}
+
+template <typename Handle>
+static Handle mockHandle()
+{
+	return toHandle<Handle>(s_NextHandle.fetch_add(16, std::memory_order_relaxed));
+}
+
+//Sizes of live buffers and images, for the memory requirements
+static std::mutex s_SizeMutex;
+static std::unordered_map<uint64_t, VkDeviceSize> s_Sizes;
+
+static const VkPhysicalDevice s_PhysicalDevice = toHandle<VkPhysicalDevice>(0x10);
+static const VkQueue s_Queue = toHandle<VkQueue>(0x20);
+
+static PFN_vkVoidFunction mockProcAddr(const char* pName)
+{
+	//Only what is in the function lists exists, extension functions outside them come back null as if unsupported
+	if (std::strcmp(pName, "vkGetInstanceProcAddr") == 0) return reinterpret_cast<PFN_vkVoidFunction>(vkGetInstanceProcAddr);
+#define VULKAN_MOCK_LOOKUP(name) if (std::strcmp(pName, #name) == 0) return reinterpret_cast<PFN_vkVoidFunction>(name);
+	VULKAN_GLOBAL_FUNCTIONS(VULKAN_MOCK_LOOKUP)
+	VULKAN_INSTANCE_FUNCTIONS(VULKAN_MOCK_LOOKUP)
+	VULKAN_INSTANCE_EXTENSION_FUNCTIONS(VULKAN_MOCK_LOOKUP)
+	VULKAN_DEVICE_FUNCTIONS(VULKAN_MOCK_LOOKUP)
+	return nullptr;
+}
+
+static VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL mockGetInstanceProcAddr(VkInstance, const char* pName)
+{
+	return mockProcAddr(pName);
+}
+
+static VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL mockGetDeviceProcAddr(VkDevice, const char* pName)
+{
+	return mockProcAddr(pName);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL mockCreateInstance(const VkInstanceCreateInfo*, const VkAllocationCallbacks*, VkInstance* pInstance)
+{
+	*pInstance = mockHandle<VkInstance>();
+	return VK_SUCCESS;
+}
+
+//No layers or extensions, so the app runs without validation and with only core features
+static VKAPI_ATTR VkResult VKAPI_CALL mockEnumerateInstanceExtensionProperties(const char*, uint32_t* pPropertyCount, VkExtensionProperties*)
+{
+	*pPropertyCount = 0;
+	return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL mockEnumerateInstanceLayerProperties(uint32_t* pPropertyCount, VkLayerProperties*)
+{
+	*pPropertyCount = 0;
+	return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL mockEnumerateDeviceExtensionProperties(VkPhysicalDevice, const char*, uint32_t* pPropertyCount, VkExtensionProperties*)
+{
+	*pPropertyCount = 0;
+	return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL mockEnumeratePhysicalDevices(VkInstance, uint32_t* pPhysicalDeviceCount, VkPhysicalDevice* pPhysicalDevices)
+{
+	if (pPhysicalDevices && *pPhysicalDeviceCount > 0) {
+		pPhysicalDevices[0] = s_PhysicalDevice;
+	}
+	*pPhysicalDeviceCount = 1;
+	return VK_SUCCESS;
+}
+
+static VKAPI_ATTR void VKAPI_CALL mockGetPhysicalDeviceProperties(VkPhysicalDevice, VkPhysicalDeviceProperties* pProperties)
+{
+	*pProperties = {};
+	pProperties->apiVersion = VK_API_VERSION_1_1;
+	pProperties->deviceType = VK_PHYSICAL_DEVICE_TYPE_CPU;
+	std::strncpy(pProperties->deviceName, "Mock Vulkan Device", VK_MAX_PHYSICAL_DEVICE_NAME_SIZE - 1);
+
+	VkPhysicalDeviceLimits& limits = pProperties->limits;
+	limits.maxImageDimension2D = 16384;
+	limits.maxBoundDescriptorSets = 8;
+	limits.maxPushConstantsSize = 256;
+	limits.maxSamplerAnisotropy = 16.0f;
+	limits.maxDrawIndirectCount = UINT32_MAX;
+	limits.minUniformBufferOffsetAlignment = 256;
+	limits.nonCoherentAtomSize = 64;
+	limits.timestampComputeAndGraphics = VK_TRUE;
+	limits.timestampPeriod = 1.0f;
+	limits.lineWidthRange[0] = 1.0f;
+	limits.lineWidthRange[1] = 8.0f;
+	limits.framebufferColorSampleCounts = VK_SAMPLE_COUNT_1_BIT;
+	limits.framebufferDepthSampleCounts = VK_SAMPLE_COUNT_1_BIT;
+}
+
+static VKAPI_ATTR void VKAPI_CALL mockGetPhysicalDeviceFeatures(VkPhysicalDevice, VkPhysicalDeviceFeatures* pFeatures)
+{
+	//Every feature is a VkBool32, turn them all on
+	VkBool32* features = reinterpret_cast<VkBool32*>(pFeatures);
+	std::fill(features, features + sizeof(VkPhysicalDeviceFeatures) / sizeof(VkBool32), VK_TRUE);
+}
+
+static VKAPI_ATTR void VKAPI_CALL mockGetPhysicalDeviceFormatProperties(VkPhysicalDevice, VkFormat, VkFormatProperties* pFormatProperties)
+{
+	pFormatProperties->linearTilingFeatures = ~0u;
+	pFormatProperties->optimalTilingFeatures = ~0u;
+	pFormatProperties->bufferFeatures = ~0u;
+}
+
+static VKAPI_ATTR void VKAPI_CALL mockGetPhysicalDeviceMemoryProperties(VkPhysicalDevice, VkPhysicalDeviceMemoryProperties* pMemoryProperties)
+{
+	//One heap that every memory type lives in, so any request is satisfied by type 0
+	*pMemoryProperties = {};
+	pMemoryProperties->memoryTypeCount = 1;
+	pMemoryProperties->memoryTypes[0].propertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+	pMemoryProperties->memoryTypes[0].heapIndex = 0;
+	pMemoryProperties->memoryHeapCount = 1;
+	pMemoryProperties->memoryHeaps[0].size = 8ull * 1024 * 1024 * 1024;
+	pMemoryProperties->memoryHeaps[0].flags = VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+}
+
+static VKAPI_ATTR void VKAPI_CALL mockGetPhysicalDeviceMemoryProperties2(VkPhysicalDevice physicalDevice, VkPhysicalDeviceMemoryProperties2* pMemoryProperties)
+{
+	mockGetPhysicalDeviceMemoryProperties(physicalDevice, &pMemoryProperties->memoryProperties);
+
+	//The whole heap is the budget and nothing else is using it
+	for (VkBaseOutStructure* next = static_cast<VkBaseOutStructure*>(pMemoryProperties->pNext); next; next = next->pNext) {
+		if (next->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT) {
+			VkPhysicalDeviceMemoryBudgetPropertiesEXT* budget = reinterpret_cast<VkPhysicalDeviceMemoryBudgetPropertiesEXT*>(next);
+			for (uint32_t i = 0; i < VK_MAX_MEMORY_HEAPS; i++) {
+				budget->heapBudget[i] = pMemoryProperties->memoryProperties.memoryHeaps[i].size;
+				budget->heapUsage[i] = 0;
+			}
+		}
+	}
+}
+
+static VKAPI_ATTR void VKAPI_CALL mockGetPhysicalDeviceQueueFamilyProperties(VkPhysicalDevice, uint32_t* pQueueFamilyPropertyCount, VkQueueFamilyProperties* pQueueFamilyProperties)
+{
+	if (pQueueFamilyProperties && *pQueueFamilyPropertyCount > 0) {
+		pQueueFamilyProperties[0] = {};
+		pQueueFamilyProperties[0].queueFlags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT;
+		pQueueFamilyProperties[0].queueCount = 1;
+		pQueueFamilyProperties[0].timestampValidBits = 64; //Timestamps read back as zero, but the profiler still does its work
+		pQueueFamilyProperties[0].minImageTransferGranularity = { 1, 1, 1 };
+	}
+	*pQueueFamilyPropertyCount = 1;
+}
+
+static VKAPI_ATTR void VKAPI_CALL mockGetDeviceQueue(VkDevice, uint32_t, uint32_t, VkQueue* pQueue)
+{
+	*pQueue = s_Queue;
+}
+
+/*! Creation functions that only need a new handle */
+template <typename Parent, typename Info, typename Handle>
+static VKAPI_ATTR VkResult VKAPI_CALL mockCreate(Parent, const Info*, const VkAllocationCallbacks*, Handle* pHandle)
+{
+	*pHandle = mockHandle<Handle>();
+	return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL mockAllocateMemory(VkDevice, const VkMemoryAllocateInfo* pAllocateInfo, const VkAllocationCallbacks*, VkDeviceMemory* pMemory)
+{
+	void* data = std::calloc(1, static_cast<size_t>(std::max<VkDeviceSize>(pAllocateInfo->allocationSize, 1)));
+	if (!data) {
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+	*pMemory = toHandle<VkDeviceMemory>(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(data)));
+	return VK_SUCCESS;
+}
+
+static VKAPI_ATTR void VKAPI_CALL mockFreeMemory(VkDevice, VkDeviceMemory memory, const VkAllocationCallbacks*)
+{
+	std::free(reinterpret_cast<void*>(static_cast<uintptr_t>(fromHandle(memory))));
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL mockMapMemory(VkDevice, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize, VkMemoryMapFlags, void** ppData)
+{
+	*ppData = reinterpret_cast<char*>(static_cast<uintptr_t>(fromHandle(memory))) + offset;
+	return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL mockCreateBuffer(VkDevice, const VkBufferCreateInfo* pCreateInfo, const VkAllocationCallbacks*, VkBuffer* pBuffer)
+{
+	*pBuffer = mockHandle<VkBuffer>();
+	std::lock_guard<std::mutex> lock(s_SizeMutex);
+	s_Sizes[fromHandle(*pBuffer)] = pCreateInfo->size;
+	return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL mockCreateImage(VkDevice, const VkImageCreateInfo* pCreateInfo, const VkAllocationCallbacks*, VkImage* pImage)
+{
+	//Large enough for the widest format, doubled for the mip chain
+	VkDeviceSize size = static_cast<VkDeviceSize>(pCreateInfo->extent.width) * pCreateInfo->extent.height * pCreateInfo->extent.depth * pCreateInfo->arrayLayers * 16;
+	if (pCreateInfo->mipLevels > 1) size *= 2;
+
+	*pImage = mockHandle<VkImage>();
+	std::lock_guard<std::mutex> lock(s_SizeMutex);
+	s_Sizes[fromHandle(*pImage)] = size;
+	return VK_SUCCESS;
+}
+
+template <typename Handle>
+static VKAPI_ATTR void VKAPI_CALL mockDestroySized(VkDevice, Handle handle, const VkAllocationCallbacks*)
+{
+	std::lock_guard<std::mutex> lock(s_SizeMutex);
+	s_Sizes.erase(fromHandle(handle));
+}
+
+static VkMemoryRequirements mockRequirements(uint64_t handle)
+{
+	VkMemoryRequirements requirements = {};
+	std::lock_guard<std::mutex> lock(s_SizeMutex);
+	auto found = s_Sizes.find(handle);
+	requirements.size = found != s_Sizes.end() ? found->second : 0;
+	requirements.alignment = 256;
+	requirements.memoryTypeBits = 1;
+	return requirements;
+}
+
+static VKAPI_ATTR void VKAPI_CALL mockGetBufferMemoryRequirements(VkDevice, VkBuffer buffer, VkMemoryRequirements* pMemoryRequirements)
+{
+	*pMemoryRequirements = mockRequirements(fromHandle(buffer));
+}
+
+static VKAPI_ATTR void VKAPI_CALL mockGetImageMemoryRequirements(VkDevice, VkImage image, VkMemoryRequirements* pMemoryRequirements)
+{
+	*pMemoryRequirements = mockRequirements(fromHandle(image));
+}
+
+template <typename Info>
+static VKAPI_ATTR VkResult VKAPI_CALL mockCreatePipelines(VkDevice, VkPipelineCache, uint32_t createInfoCount, const Info*,
+	const VkAllocationCallbacks*, VkPipeline* pPipelines)
+{
+	for (uint32_t i = 0; i < createInfoCount; i++) {
+		pPipelines[i] = mockHandle<VkPipeline>();
+	}
+	return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL mockAllocateDescriptorSets(VkDevice, const VkDescriptorSetAllocateInfo* pAllocateInfo, VkDescriptorSet* pDescriptorSets)
+{
+	for (uint32_t i = 0; i < pAllocateInfo->descriptorSetCount; i++) {
+		pDescriptorSets[i] = mockHandle<VkDescriptorSet>();
+	}
+	return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL mockAllocateCommandBuffers(VkDevice, const VkCommandBufferAllocateInfo* pAllocateInfo, VkCommandBuffer* pCommandBuffers)
+{
+	for (uint32_t i = 0; i < pAllocateInfo->commandBufferCount; i++) {
+		pCommandBuffers[i] = mockHandle<VkCommandBuffer>();
+	}
+	return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL mockGetQueryPoolResults(VkDevice, VkQueryPool, uint32_t, uint32_t, size_t dataSize, void* pData, VkDeviceSize, VkQueryResultFlags)
+{
+	std::memset(pData, 0, dataSize);
+	return VK_SUCCESS;
+}
+
+//The calls where most of the bytes are behind pointers also count what they point to
+
+static VKAPI_ATTR void VKAPI_CALL mockUpdateDescriptorSets(VkDevice, uint32_t descriptorWriteCount, const VkWriteDescriptorSet* pDescriptorWrites,
+	uint32_t descriptorCopyCount, const VkCopyDescriptorSet*)
+{
+	uint64_t bytes = descriptorWriteCount * sizeof(VkWriteDescriptorSet) + descriptorCopyCount * sizeof(VkCopyDescriptorSet);
+	for (uint32_t i = 0; i < descriptorWriteCount; i++) {
+		const VkWriteDescriptorSet& write = pDescriptorWrites[i];
+		if (write.pBufferInfo) bytes += write.descriptorCount * sizeof(VkDescriptorBufferInfo);
+		if (write.pImageInfo) bytes += write.descriptorCount * sizeof(VkDescriptorImageInfo);
+		if (write.pTexelBufferView) bytes += write.descriptorCount * sizeof(VkBufferView);
+	}
+	mockBytes(MockFunction::vkUpdateDescriptorSets, bytes);
+}
+
+static VKAPI_ATTR void VKAPI_CALL mockCmdBindDescriptorSets(VkCommandBuffer, VkPipelineBindPoint, VkPipelineLayout, uint32_t, uint32_t descriptorSetCount,
+	const VkDescriptorSet*, uint32_t dynamicOffsetCount, const uint32_t*)
+{
+	mockBytes(MockFunction::vkCmdBindDescriptorSets, descriptorSetCount * sizeof(VkDescriptorSet) + dynamicOffsetCount * sizeof(uint32_t));
+}
+
+static VKAPI_ATTR void VKAPI_CALL mockCmdBindVertexBuffers(VkCommandBuffer, uint32_t, uint32_t bindingCount, const VkBuffer*, const VkDeviceSize*)
+{
+	mockBytes(MockFunction::vkCmdBindVertexBuffers, bindingCount * (sizeof(VkBuffer) + sizeof(VkDeviceSize)));
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL mockQueueSubmit(VkQueue, uint32_t submitCount, const VkSubmitInfo* pSubmits, VkFence)
+{
+	uint64_t bytes = submitCount * sizeof(VkSubmitInfo);
+	for (uint32_t i = 0; i < submitCount; i++) {
+		bytes += pSubmits[i].commandBufferCount * sizeof(VkCommandBuffer);
+		bytes += pSubmits[i].waitSemaphoreCount * (sizeof(VkSemaphore) + sizeof(VkPipelineStageFlags));
+		bytes += pSubmits[i].signalSemaphoreCount * sizeof(VkSemaphore);
+	}
+	mockBytes(MockFunction::vkQueueSubmit, bytes);
+	return VK_SUCCESS;
+}
+
+void VulkanLoader::loadMock()
+{
+	s_Mocked = true;
+
+	//Everything is a counting stub first, then the functions the app needs something back from are wrapped around a mock
+#define VULKAN_MOCK_STUB(name) name = Mock<PFN_##name>::stub<MockFunction::name>;
+	VULKAN_GLOBAL_FUNCTIONS(VULKAN_MOCK_STUB)
+	VULKAN_INSTANCE_FUNCTIONS(VULKAN_MOCK_STUB)
+	VULKAN_INSTANCE_EXTENSION_FUNCTIONS(VULKAN_MOCK_STUB)
+	VULKAN_DEVICE_FUNCTIONS(VULKAN_MOCK_STUB)
+
+#define VULKAN_MOCK(name, impl) name = Mock<PFN_##name>::wrap<MockFunction::name, impl>;
+	VULKAN_MOCK(vkGetInstanceProcAddr, mockGetInstanceProcAddr);
+	VULKAN_MOCK(vkGetDeviceProcAddr, mockGetDeviceProcAddr);
+	VULKAN_MOCK(vkCreateInstance, mockCreateInstance);
+	VULKAN_MOCK(vkEnumerateInstanceExtensionProperties, mockEnumerateInstanceExtensionProperties);
+	VULKAN_MOCK(vkEnumerateInstanceLayerProperties, mockEnumerateInstanceLayerProperties);
+	VULKAN_MOCK(vkEnumerateDeviceExtensionProperties, mockEnumerateDeviceExtensionProperties);
+	VULKAN_MOCK(vkEnumeratePhysicalDevices, mockEnumeratePhysicalDevices);
+	VULKAN_MOCK(vkGetPhysicalDeviceProperties, mockGetPhysicalDeviceProperties);
+	VULKAN_MOCK(vkGetPhysicalDeviceFeatures, mockGetPhysicalDeviceFeatures);
+	VULKAN_MOCK(vkGetPhysicalDeviceFormatProperties, mockGetPhysicalDeviceFormatProperties);
+	VULKAN_MOCK(vkGetPhysicalDeviceMemoryProperties, mockGetPhysicalDeviceMemoryProperties);
+	VULKAN_MOCK(vkGetPhysicalDeviceQueueFamilyProperties, mockGetPhysicalDeviceQueueFamilyProperties);
+	VULKAN_MOCK(vkGetPhysicalDeviceMemoryProperties2KHR, mockGetPhysicalDeviceMemoryProperties2);
+	VULKAN_MOCK(vkCreateDebugUtilsMessengerEXT, (mockCreate<VkInstance, VkDebugUtilsMessengerCreateInfoEXT, VkDebugUtilsMessengerEXT>));
+	VULKAN_MOCK(vkCreateDevice, (mockCreate<VkPhysicalDevice, VkDeviceCreateInfo, VkDevice>));
+	VULKAN_MOCK(vkGetDeviceQueue, mockGetDeviceQueue);
+
+	VULKAN_MOCK(vkAllocateMemory, mockAllocateMemory);
+	VULKAN_MOCK(vkFreeMemory, mockFreeMemory);
+	VULKAN_MOCK(vkMapMemory, mockMapMemory);
+	VULKAN_MOCK(vkGetBufferMemoryRequirements, mockGetBufferMemoryRequirements);
+	VULKAN_MOCK(vkGetImageMemoryRequirements, mockGetImageMemoryRequirements);
+	VULKAN_MOCK(vkCreateBuffer, mockCreateBuffer);
+	VULKAN_MOCK(vkDestroyBuffer, mockDestroySized<VkBuffer>);
+	VULKAN_MOCK(vkCreateImage, mockCreateImage);
+	VULKAN_MOCK(vkDestroyImage, mockDestroySized<VkImage>);
+
+	VULKAN_MOCK(vkCreateImageView, (mockCreate<VkDevice, VkImageViewCreateInfo, VkImageView>));
+	VULKAN_MOCK(vkCreateSampler, (mockCreate<VkDevice, VkSamplerCreateInfo, VkSampler>));
+	VULKAN_MOCK(vkCreateFence, (mockCreate<VkDevice, VkFenceCreateInfo, VkFence>));
+	VULKAN_MOCK(vkCreateSemaphore, (mockCreate<VkDevice, VkSemaphoreCreateInfo, VkSemaphore>));
+	VULKAN_MOCK(vkCreateQueryPool, (mockCreate<VkDevice, VkQueryPoolCreateInfo, VkQueryPool>));
+	VULKAN_MOCK(vkCreateRenderPass, (mockCreate<VkDevice, VkRenderPassCreateInfo, VkRenderPass>));
+	VULKAN_MOCK(vkCreateFramebuffer, (mockCreate<VkDevice, VkFramebufferCreateInfo, VkFramebuffer>));
+	VULKAN_MOCK(vkCreateShaderModule, (mockCreate<VkDevice, VkShaderModuleCreateInfo, VkShaderModule>));
+	VULKAN_MOCK(vkCreatePipelineCache, (mockCreate<VkDevice, VkPipelineCacheCreateInfo, VkPipelineCache>));
+	VULKAN_MOCK(vkCreatePipelineLayout, (mockCreate<VkDevice, VkPipelineLayoutCreateInfo, VkPipelineLayout>));
+	VULKAN_MOCK(vkCreateDescriptorSetLayout, (mockCreate<VkDevice, VkDescriptorSetLayoutCreateInfo, VkDescriptorSetLayout>));
+	VULKAN_MOCK(vkCreateDescriptorPool, (mockCreate<VkDevice, VkDescriptorPoolCreateInfo, VkDescriptorPool>));
+	VULKAN_MOCK(vkCreateCommandPool, (mockCreate<VkDevice, VkCommandPoolCreateInfo, VkCommandPool>));
+	VULKAN_MOCK(vkCreateSwapchainKHR, (mockCreate<VkDevice, VkSwapchainCreateInfoKHR, VkSwapchainKHR>));
+	VULKAN_MOCK(vkCreateGraphicsPipelines, mockCreatePipelines<VkGraphicsPipelineCreateInfo>);
+	VULKAN_MOCK(vkCreateComputePipelines, mockCreatePipelines<VkComputePipelineCreateInfo>);
+	VULKAN_MOCK(vkAllocateDescriptorSets, mockAllocateDescriptorSets);
+	VULKAN_MOCK(vkAllocateCommandBuffers, mockAllocateCommandBuffers);
+	VULKAN_MOCK(vkGetQueryPoolResults, mockGetQueryPoolResults);
+
+	VULKAN_MOCK(vkUpdateDescriptorSets, mockUpdateDescriptorSets);
+	VULKAN_MOCK(vkCmdBindDescriptorSets, mockCmdBindDescriptorSets);
+	VULKAN_MOCK(vkCmdBindVertexBuffers, mockCmdBindVertexBuffers);
+	VULKAN_MOCK(vkQueueSubmit, mockQueueSubmit);
+}
+
+void VulkanLoader::resetMockStats()
+{
+	for (MockCounter& counter : s_MockCounts) {
+		counter.calls.store(0, std::memory_order_relaxed);
+		counter.bytes.store(0, std::memory_order_relaxed);
+	}
+}
+
+void VulkanLoader::printMockStats(size_t frames, size_t objects)
+{
+	double perFrame = 1.0 / std::max<size_t>(frames, 1);
+	double perObject = perFrame / std::max<size_t>(objects, 1);
+
+	//Most called first
+	std::vector<size_t> order;
+	uint64_t totalCalls = 0;
+	uint64_t totalBytes = 0;
+	for (size_t i = 0; i < static_cast<size_t>(MockFunction::Count); i++) {
+		uint64_t calls = s_MockCounts[i].calls.load(std::memory_order_relaxed);
+		if (calls == 0) continue;
+		order.push_back(i);
+		totalCalls += calls;
+		totalBytes += s_MockCounts[i].bytes.load(std::memory_order_relaxed);
+	}
+	std::sort(order.begin(), order.end(), [](size_t a, size_t b) { return s_MockCounts[a].calls.load() > s_MockCounts[b].calls.load(); });
+
+	std::cout << "mock vulkan: " << totalCalls << " calls over " << frames << " frames with " << objects << " objects" << std::endl;
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << "\t" << std::left << std::setw(44) << "function" << std::right << std::setw(12) << "calls/frame"
+		<< std::setw(16) << "calls/obj/frame" << std::setw(14) << "bytes/frame" << std::endl;
+	for (size_t i : order) {
+		double calls = static_cast<double>(s_MockCounts[i].calls.load(std::memory_order_relaxed));
+		double bytes = static_cast<double>(s_MockCounts[i].bytes.load(std::memory_order_relaxed));
+		std::cout << "\t" << std::left << std::setw(44) << s_MockNames[i] << std::right << std::setw(12) << calls * perFrame
+			<< std::setw(16) << calls * perObject << std::setw(14) << bytes * perFrame << std::endl;
+	}
+	std::cout << "\t" << std::left << std::setw(44) << "total" << std::right << std::setw(12) << totalCalls * perFrame
+		<< std::setw(16) << totalCalls * perObject << std::setw(14) << totalBytes * perFrame << std::endl;
+	std::cout << std::defaultfloat << std::setprecision(6);
+}
@@ -1,20 +1,26 @@
 #include "VulkanObject.h"
 
+#include "CpuProfiler.h"
 #include "VulkanEngine.h"
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h> 
 
-VulkanObject::VulkanObject(VulkanEngine* engine, VkPhysicalDevice& phyDevice, VkDevice& device, VkQueue graphicsQueue, VkCommandPool commandPool, const char* modelPath, const char* texturePath) : m_PhyDevice(phyDevice), m_Device(device)
+#include <algorithm>
+#include <cmath>
+
+VulkanObject::VulkanObject(VulkanEngine* engine, GeometryArena* geometry, VkPhysicalDevice& phyDevice, VkDevice& device, VkQueue graphicsQueue, VkCommandPool commandPool, const char* modelPath, const char* texturePath) : m_PhyDevice(phyDevice), m_Device(device)
 {
 	m_Engine = engine;
+	m_Geometry = geometry;
+	m_Name = modelPath;
+	m_TexturePath = texturePath;
 
 	m_GraphicsPipline = graphicsQueue;
 	m_CommandPool = commandPool;
 
 	loadModel(modelPath);
 
-	m_Engine->createVertexBuffer(graphicsQueue, commandPool, this);
-	m_Engine->createIndexBuffer(graphicsQueue, commandPool, this);
+	m_Mesh = m_Geometry->add(graphicsQueue, commandPool, vertices, indices, m_Name);
 
 	m_Engine->createTextureImage(graphicsQueue, commandPool, textureImage, textureImageMemory, texturePath);
 	m_Engine->createTextureImageView(this);
@@ -23,23 +29,19 @@ VulkanObject::VulkanObject(VulkanEngine* engine, VkPhysicalDevice& phyDevice, Vk
 VulkanObject::~VulkanObject()
 {
 
-	//Clean up index buffer
-	vkDestroyBuffer(m_Device, m_IndexBuffer, nullptr);
-	vkFreeMemory(m_Device, m_IndexBufferMemory, nullptr);
-
-	//clean up vertex buffer
-	vkDestroyBuffer(m_Device, m_VertexBuffer, nullptr);
-	vkFreeMemory(m_Device, m_VertexBufferMemory, nullptr);
+	//Give the mesh's range back to the arena
+	m_Geometry->remove(m_Mesh);
 
 	//Cleanup Texture
 	vkDestroyImage(m_Device, textureImage, nullptr);
 	vkDestroyImageView(m_Device, textureImageView, nullptr);
-	vkFreeMemory(m_Device, textureImageMemory, nullptr);
+	m_Engine->freeMemory(textureImageMemory);
 
 }
 
 void VulkanObject::loadModel(const char * path)
 {
+	PROFILE_SCOPE("loadModel");
 	tinyobj::attrib_t attrib;
 	std::vector<tinyobj::shape_t> shapes;
 	std::vector<tinyobj::material_t> materials;
@@ -49,7 +51,14 @@ void VulkanObject::loadModel(const char * path)
 		throw std::runtime_error(warn + err);
 	}
 
+	//Replaces any mesh loaded before
+	vertices.clear();
+	indices.clear();
+	m_Edges.clear();
+
 	std::unordered_map<Vertex, uint32_t> uniqueVertices = {};
+	//The file's position for each vertex, vertices split by a UV or normal seam still share an edge
+	std::vector<uint32_t> positions;
 
 	for (const auto& shape : shapes) {
 		for (const auto& index : shape.mesh.indices) {
@@ -75,11 +84,52 @@ void VulkanObject::loadModel(const char * path)
 			if (uniqueVertices.count(vertex) == 0) {
 				uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
 				vertices.push_back(vertex);
+				positions.push_back(static_cast<uint32_t>(index.vertex_index));
 			}
 
 			indices.push_back(uniqueVertices[vertex]);
 		}
 	}
+
+	//Box around the vertices, and the sphere around its centre that reaches the furthest vertex
+	glm::vec3 minimum(0.0f), maximum(0.0f);
+	if (!vertices.empty()) {
+		minimum = maximum = vertices[0].pos;
+		for (const Vertex& vertex : vertices) {
+			minimum = glm::min(minimum, vertex.pos);
+			maximum = glm::max(maximum, vertex.pos);
+		}
+	}
+	m_Bounds.centre = (minimum + maximum) * 0.5f;
+	m_Bounds.extents = (maximum - minimum) * 0.5f;
+	float radiusSquared = 0.0f;
+	for (const Vertex& vertex : vertices) {
+		glm::vec3 offset = vertex.pos - m_Bounds.centre;
+		radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+	}
+	m_Bounds.radius = std::sqrt(radiusSquared);
+
+	//Pair each triangle's edges up by their positions, the first triangle to reach an edge adds it and the second fills in its side.
+	//Edges with more than two triangles keep the first two
+	std::unordered_map<uint64_t, uint32_t> edgeLookup;
+	edgeLookup.reserve(indices.size());
+	for (size_t triangle = 0; triangle + 2 < indices.size(); triangle += 3) {
+		for (int corner = 0; corner < 3; corner++) {
+			uint32_t v0 = indices[triangle + corner];
+			uint32_t v1 = indices[triangle + (corner + 1) % 3];
+			uint32_t opposite = indices[triangle + (corner + 2) % 3];
+
+			uint64_t low = std::min(positions[v0], positions[v1]);
+			uint64_t high = std::max(positions[v0], positions[v1]);
+			auto found = edgeLookup.emplace((high << 32) | low, static_cast<uint32_t>(m_Edges.size()));
+			if (found.second) {
+				m_Edges.push_back({ v0, v1, opposite, MeshEdge::NO_NEIGHBOUR });
+			}
+			else if (m_Edges[found.first->second].opposite1 == MeshEdge::NO_NEIGHBOUR) {
+				m_Edges[found.first->second].opposite1 = opposite;
+			}
+		}
+	}
 }
 
 